@@ -0,0 +1,322 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_FLAT_HASH_MAP_HEADER__
+#define __PION_FLAT_HASH_MAP_HEADER__
+
+#include <string>
+#include <utility>
+#include <boost/cstdint.hpp>
+#include <pion/config.hpp>
+#include <pion/hash_map.hpp>
+
+
+namespace pion {    // begin namespace pion
+
+
+///
+/// flat_ihash_multimap: case-insensitive dictionary of strings with the same
+/// interface as ihash_multimap, optimized for the small dictionaries used by
+/// HTTP messages (headers, cookies and query parameters).  Entries are stored
+/// in a contiguous array (inline for up to INLINE_CAPACITY entries), and are
+/// found using an open-addressing index of the first entry for each key.
+///
+/// Entries are kept in insertion order, except that values for the same key
+/// are kept together.  Unlike ihash_multimap, inserting or erasing entries
+/// invalidates iterators and references to other entries.
+///
+class flat_ihash_multimap
+{
+public:
+
+    typedef std::string                             key_type;
+    typedef std::string                             mapped_type;
+    typedef std::pair<std::string, std::string>     value_type;
+    typedef value_type *                            iterator;
+    typedef const value_type *                      const_iterator;
+    typedef std::size_t                             size_type;
+
+    /// number of entries stored without allocating memory
+    enum { INLINE_CAPACITY = 16 };
+
+
+    /// frees any memory allocated for entries
+    ~flat_ihash_multimap() { free_storage(); }
+
+    /// default constructor
+    flat_ihash_multimap(void)
+        : m_entries(m_inline_entries), m_hashes(m_inline_hashes), m_index(m_inline_index),
+        m_size(0), m_capacity(INLINE_CAPACITY)
+    {
+        clear_index();
+    }
+
+    /// copy constructor
+    flat_ihash_multimap(const flat_ihash_multimap& dict)
+        : m_entries(m_inline_entries), m_hashes(m_inline_hashes), m_index(m_inline_index),
+        m_size(0), m_capacity(INLINE_CAPACITY)
+    {
+        assign(dict);
+    }
+
+    /// assignment operator
+    flat_ihash_multimap& operator=(const flat_ihash_multimap& dict) {
+        if (this != &dict)
+            assign(dict);
+        return *this;
+    }
+
+    /// returns the number of entries
+    inline size_type size(void) const { return m_size; }
+
+    /// returns true if there are no entries
+    inline bool empty(void) const { return m_size == 0; }
+
+    inline iterator begin(void) { return m_entries; }
+    inline const_iterator begin(void) const { return m_entries; }
+    inline iterator end(void) { return m_entries + m_size; }
+    inline const_iterator end(void) const { return m_entries + m_size; }
+
+    /// removes all entries (memory is kept for reuse)
+    inline void clear(void) {
+        for (size_type n = 0; n < m_size; ++n) {
+            m_entries[n].first.erase();
+            m_entries[n].second.erase();
+        }
+        m_size = 0;
+        clear_index();
+    }
+
+    /**
+     * adds an entry; values for a key that is already defined are added
+     * after the existing values
+     *
+     * @param value the key and value to add
+     *
+     * @return iterator the new entry
+     */
+    inline iterator insert(const value_type& value) {
+        const std::size_t hash = ihash()(value.first);
+        if (m_size == m_capacity)
+            grow();
+        size_type pos = find_index(value.first, hash);
+        if (pos == NPOS) {
+            // new key: append the entry and index it
+            pos = m_size;
+            add_to_index(pos, hash);
+        } else {
+            // existing key: move the following entries to make room after its values
+            while (pos < m_size && m_hashes[pos] == hash && iequal_to()(m_entries[pos].first, value.first))
+                ++pos;
+            for (size_type n = m_size; n > pos; --n) {
+                m_entries[n].first.swap(m_entries[n - 1].first);
+                m_entries[n].second.swap(m_entries[n - 1].second);
+                m_hashes[n] = m_hashes[n - 1];
+            }
+        }
+        m_entries[pos].first = value.first;
+        m_entries[pos].second = value.second;
+        m_hashes[pos] = hash;
+        if (pos != m_size++)
+            rebuild_index();
+        return m_entries + pos;
+    }
+
+    /// adds all entries in the range [first, last)
+    template <typename InputIterator>
+    inline void insert(InputIterator first, InputIterator last) {
+        for (; first != last; ++first)
+            insert(value_type(first->first, first->second));
+    }
+
+    /// returns the first entry for a key, or end() if there are none
+    inline iterator find(const key_type& key) {
+        const size_type pos = find_index(key, ihash()(key));
+        return (pos == NPOS ? end() : m_entries + pos);
+    }
+
+    /// returns the first entry for a key, or end() if there are none
+    inline const_iterator find(const key_type& key) const {
+        const size_type pos = find_index(key, ihash()(key));
+        return (pos == NPOS ? end() : m_entries + pos);
+    }
+
+    /// returns the number of entries for a key
+    inline size_type count(const key_type& key) const {
+        const std::pair<const_iterator, const_iterator> range(equal_range(key));
+        return static_cast<size_type>(range.second - range.first);
+    }
+
+    /// returns the range of entries for a key
+    inline std::pair<iterator, iterator> equal_range(const key_type& key) {
+        const std::pair<const_iterator, const_iterator> range(
+            static_cast<const flat_ihash_multimap&>(*this).equal_range(key));
+        return std::make_pair(const_cast<iterator>(range.first), const_cast<iterator>(range.second));
+    }
+
+    /// returns the range of entries for a key
+    inline std::pair<const_iterator, const_iterator> equal_range(const key_type& key) const {
+        const std::size_t hash = ihash()(key);
+        size_type pos = find_index(key, hash);
+        if (pos == NPOS)
+            return std::make_pair(end(), end());
+        const size_type first = pos;
+        while (pos < m_size && m_hashes[pos] == hash && iequal_to()(m_entries[pos].first, key))
+            ++pos;
+        return std::make_pair(m_entries + first, m_entries + pos);
+    }
+
+    /**
+     * removes the entries in the range [first, last)
+     *
+     * @return iterator the entry that followed the last one removed
+     */
+    inline iterator erase(iterator first, iterator last) {
+        const size_type pos = static_cast<size_type>(first - m_entries);
+        const size_type len = static_cast<size_type>(last - first);
+        if (len > 0) {
+            for (size_type n = pos; n + len < m_size; ++n) {
+                m_entries[n].first.swap(m_entries[n + len].first);
+                m_entries[n].second.swap(m_entries[n + len].second);
+                m_hashes[n] = m_hashes[n + len];
+            }
+            for (size_type n = m_size - len; n < m_size; ++n) {
+                m_entries[n].first.erase();
+                m_entries[n].second.erase();
+            }
+            m_size -= len;
+            rebuild_index();
+        }
+        return m_entries + pos;
+    }
+
+    /// removes an entry, and returns the entry that followed it
+    inline iterator erase(iterator i) { return erase(i, i + 1); }
+
+    /// removes all entries for a key, and returns the number removed
+    inline size_type erase(const key_type& key) {
+        const std::pair<iterator, iterator> range(equal_range(key));
+        erase(range.first, range.second);
+        return static_cast<size_type>(range.second - range.first);
+    }
+
+
+private:
+
+    /// value used for "not found" and for empty index slots
+    static const size_type NPOS = static_cast<size_type>(-1);
+
+    /// returns the position of the first entry for a key, or NPOS
+    inline size_type find_index(const key_type& key, std::size_t hash) const {
+        const size_type mask = m_capacity * 2 - 1;
+        for (size_type slot = hash & mask; m_index[slot] != NPOS; slot = (slot + 1) & mask) {
+            const size_type pos = m_index[slot];
+            if (m_hashes[pos] == hash && iequal_to()(m_entries[pos].first, key))
+                return pos;
+        }
+        return NPOS;
+    }
+
+    /// adds the first entry for a key to the index
+    inline void add_to_index(size_type pos, std::size_t hash) {
+        const size_type mask = m_capacity * 2 - 1;
+        size_type slot = hash & mask;
+        while (m_index[slot] != NPOS)
+            slot = (slot + 1) & mask;
+        m_index[slot] = pos;
+    }
+
+    /// marks all index slots as empty
+    inline void clear_index(void) {
+        for (size_type slot = 0; slot < m_capacity * 2; ++slot)
+            m_index[slot] = NPOS;
+    }
+
+    /// rebuilds the index after entries have moved
+    inline void rebuild_index(void) {
+        clear_index();
+        for (size_type pos = 0; pos < m_size; ++pos) {
+            // only the first entry for each key is indexed
+            if (pos == 0 || m_hashes[pos] != m_hashes[pos - 1]
+                || ! iequal_to()(m_entries[pos].first, m_entries[pos - 1].first))
+                add_to_index(pos, m_hashes[pos]);
+        }
+    }
+
+    /// doubles the capacity (moves entries out of the inline storage)
+    inline void grow(void) {
+        const size_type capacity = m_capacity * 2;
+        value_type *entries = new value_type[capacity];
+        std::size_t *hashes = new std::size_t[capacity];
+        size_type *index = new size_type[capacity * 2];
+        for (size_type n = 0; n < m_size; ++n) {
+            entries[n].first.swap(m_entries[n].first);
+            entries[n].second.swap(m_entries[n].second);
+            hashes[n] = m_hashes[n];
+        }
+        free_storage();
+        m_entries = entries;
+        m_hashes = hashes;
+        m_index = index;
+        m_capacity = capacity;
+        rebuild_index();
+    }
+
+    /// frees the memory allocated for entries, if any
+    inline void free_storage(void) {
+        if (m_entries != m_inline_entries) {
+            delete [] m_entries;
+            delete [] m_hashes;
+            delete [] m_index;
+        }
+    }
+
+    /// replaces all entries with copies of the entries of another dictionary
+    inline void assign(const flat_ihash_multimap& dict) {
+        clear();
+        while (m_capacity < dict.m_size)
+            grow();
+        for (size_type n = 0; n < dict.m_size; ++n) {
+            m_entries[n] = dict.m_entries[n];
+            m_hashes[n] = dict.m_hashes[n];
+        }
+        m_size = dict.m_size;
+        rebuild_index();
+    }
+
+
+    /// entries, in insertion order (values for the same key are together)
+    value_type *                    m_entries;
+
+    /// hash of the key of each entry
+    std::size_t *                   m_hashes;
+
+    /// open-addressing index of the first entry for each key (NPOS = empty)
+    size_type *                     m_index;
+
+    /// number of entries
+    size_type                       m_size;
+
+    /// number of entries that fit in the current storage
+    size_type                       m_capacity;
+
+    /// inline storage for entries
+    value_type                      m_inline_entries[INLINE_CAPACITY];
+
+    /// inline storage for the hash of each entry
+    std::size_t                     m_inline_hashes[INLINE_CAPACITY];
+
+    /// inline storage for the index (twice the capacity, so it is at most half full)
+    size_type                       m_inline_index[INLINE_CAPACITY * 2];
+};
+
+
+}   // end namespace pion
+
+#endif
@@ -12,6 +12,8 @@
 
 #include <string>
 #include <locale>
+#include <cstring>
+#include <boost/cstdint.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/functional/hash.hpp>
 #include <pion/config.hpp>
@@ -57,37 +59,81 @@ namespace pion {    // begin namespace pion
     #endif
 #endif
 
-    /// case insensitive string equality predicate
-    /// copied from boost.unordered hash_equality documentation
-    /// http://www.boost.org/doc/libs/1_50_0/doc/html/unordered/hash_equality.html
+    /// folds the ASCII upper case letters in a word of 8 characters to lower
+    /// case, without branches (other characters are not changed)
+    inline boost::uint64_t ascii_fold_word(boost::uint64_t word)
+    {
+        const boost::uint64_t ONES = 0x0101010101010101ULL;
+        const boost::uint64_t HIGH_BITS = ONES * 0x80;
+        const boost::uint64_t low_bits = word & ~HIGH_BITS;
+        // the high bit of each byte is set if the byte is >= 'A', or > 'Z'
+        const boost::uint64_t ge_upper_a = low_bits + ONES * (0x80 - 'A');
+        const boost::uint64_t gt_upper_z = low_bits + ONES * (0x80 - 'Z' - 1);
+        const boost::uint64_t is_upper = (ge_upper_a ^ gt_upper_z) & ~word & HIGH_BITS;
+        // 0x80 >> 2 == 0x20, the bit that makes a letter lower case
+        return word | (is_upper >> 2);
+    }
+
+    /// reads up to 8 characters into a word (missing characters are zero)
+    inline boost::uint64_t ascii_load_word(const char *ptr, std::size_t len)
+    {
+        boost::uint64_t word = 0;
+        memcpy(&word, ptr, (len < 8 ? len : 8));
+        return word;
+    }
+
+    /// returns true if two strings of len characters are equal, ignoring the
+    /// case of ASCII letters (compares 8 characters at a time)
+    inline bool ascii_iequals(const char *x, const char *y, std::size_t len)
+    {
+        for (; len >= 8; x += 8, y += 8, len -= 8) {
+            if (ascii_fold_word(ascii_load_word(x, 8)) != ascii_fold_word(ascii_load_word(y, 8)))
+                return false;
+        }
+        return (len == 0 || ascii_fold_word(ascii_load_word(x, len))
+            == ascii_fold_word(ascii_load_word(y, len)));
+    }
+
+    /// returns a hash value for a string that ignores the case of ASCII
+    /// letters (hashes 8 characters at a time)
+    inline std::size_t ascii_ihash(const char *ptr, std::size_t len)
+    {
+        const boost::uint64_t MULTIPLIER = 0x9E3779B97F4A7C15ULL;
+        boost::uint64_t hash = len * MULTIPLIER;
+        for (; len >= 8; ptr += 8, len -= 8) {
+            hash = (hash ^ ascii_fold_word(ascii_load_word(ptr, 8))) * MULTIPLIER;
+            hash ^= (hash >> 32);
+        }
+        if (len > 0) {
+            hash = (hash ^ ascii_fold_word(ascii_load_word(ptr, len))) * MULTIPLIER;
+            hash ^= (hash >> 32);
+        }
+        // final mix, so that the low bits depend on all of the characters
+        hash ^= (hash >> 29);
+        hash *= MULTIPLIER;
+        hash ^= (hash >> 32);
+        return static_cast<std::size_t>(hash);
+    }
+
+    /// case insensitive string equality predicate (HTTP header names, cookie
+    /// names and query parameters are compared using ASCII case folding)
     struct iequal_to
         : std::binary_function<std::string, std::string, bool>
     {
         bool operator()(std::string const& x,
                         std::string const& y) const
         {
-            return boost::algorithm::iequals(x, y, std::locale());
+            return (x.size() == y.size() && ascii_iequals(x.data(), y.data(), x.size()));
         }
     };
     
-    /// case insensitive hash generic function
-    /// copied from boost.unordered hash_equality documentation
-    /// http://www.boost.org/doc/libs/1_50_0/doc/html/unordered/hash_equality.html
+    /// case insensitive hash generic function (consistent with iequal_to)
     struct ihash
         : std::unary_function<std::string, std::size_t>
     {
         std::size_t operator()(std::string const& x) const
         {
-            std::size_t seed = 0;
-            std::locale locale;
-            
-            for(std::string::const_iterator it = x.begin();
-                it != x.end(); ++it)
-            {
-                boost::hash_combine(seed, std::toupper(*it, locale));
-            }
-            
-            return seed;
+            return ascii_ihash(x.data(), x.size());
         }
     };
     
@@ -0,0 +1,50 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_HTTP_CONNECTION_OBJECTS_HEADER__
+#define __PION_HTTP_CONNECTION_OBJECTS_HEADER__
+
+#include <boost/shared_ptr.hpp>
+#include <pion/config.hpp>
+#include <pion/tcp/connection.hpp>
+
+
+namespace pion {    // begin namespace pion
+namespace http {    // begin namespace http
+
+
+// forward declarations of the objects that may be recycled
+class request_reader;
+class response_writer;
+
+
+///
+/// connection_objects: HTTP objects that a connection keeps and reuses for
+/// each of its requests, while no one else refers to them (the objects are
+/// only kept if http::server::set_recycle_objects() is enabled)
+///
+struct connection_objects
+{
+    /// reads and parses the requests received over the connection
+    boost::shared_ptr<request_reader>   m_reader;
+
+    /// sends responses over the connection (see response_writer::create())
+    boost::shared_ptr<response_writer>  m_writer;
+
+    /// returns the objects kept with a connection, or NULL if it has none
+    static inline connection_objects *get(const tcp::connection& tcp_conn) {
+        return static_cast<connection_objects*>(tcp_conn.get_user_data().get());
+    }
+};
+
+
+}   // end namespace http
+}   // end namespace pion
+
+#endif
@@ -0,0 +1,250 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_HTTP_CONTENT_BLOCKS_HEADER__
+#define __PION_HTTP_CONTENT_BLOCKS_HEADER__
+
+#include <vector>
+#include <cstring>
+#include <iterator>
+#include <algorithm>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/once.hpp>
+#include <pion/config.hpp>
+
+
+namespace pion {    // begin namespace pion
+namespace http {    // begin namespace http
+
+
+///
+/// content_block_pool: recycles the fixed-size blocks of memory used to store
+/// segmented payload content (shared by all threads)
+///
+class PION_API content_block_pool :
+    private boost::noncopyable
+{
+public:
+
+    /// size of each block of memory, in bytes
+    enum { BLOCK_SIZE = 16384 };
+
+    /// maximum number of unused blocks that are kept for reuse
+    enum { MAX_FREE_BLOCKS = 256 };
+
+    /// frees all unused blocks
+    ~content_block_pool();
+
+    /// returns the pool shared by all content_blocks objects
+    static inline content_block_pool& get_instance(void) {
+        boost::call_once(content_block_pool::create_instance, m_instance_flag);
+        return *m_instance_ptr;
+    }
+
+    /// returns a block of BLOCK_SIZE bytes (allocates a new one if none are free)
+    char *acquire(void);
+
+    /// returns a block to the pool (frees it if the pool is full)
+    void release(char *block);
+
+    /// returns the number of unused blocks kept in the pool
+    std::size_t get_free_blocks(void) const;
+
+
+private:
+
+    /// private constructor restricts creation of objects (use get_instance())
+    content_block_pool(void) {}
+
+    /// creates the shared instance of the pool
+    static void create_instance(void);
+
+
+    /// used to protect the list of unused blocks
+    mutable boost::mutex                m_mutex;
+
+    /// unused blocks available for reuse
+    std::vector<char*>                  m_free_blocks;
+
+    /// points to the shared instance of the pool
+    static content_block_pool *         m_instance_ptr;
+
+    /// used to make sure the shared instance is created only once
+    static boost::once_flag             m_instance_flag;
+};
+
+
+///
+/// content_blocks: payload content stored in a sequence of fixed-size blocks
+/// taken from content_block_pool, so large bodies do not need a contiguous
+/// allocation; each block can be accessed as a boost::asio::const_buffer
+///
+class content_blocks
+{
+public:
+
+    /// data type for a sequence of buffers that refer to the blocks
+    typedef std::vector<boost::asio::const_buffer>  buffers_t;
+
+    ///
+    /// const_iterator: iterates over the blocks as boost::asio::const_buffer objects
+    ///
+    class const_iterator
+    {
+    public:
+        typedef std::forward_iterator_tag       iterator_category;
+        typedef boost::asio::const_buffer       value_type;
+        typedef std::ptrdiff_t                  difference_type;
+        typedef const boost::asio::const_buffer *   pointer;
+        typedef boost::asio::const_buffer       reference;
+
+        /// constructs an iterator for block n of the given content
+        const_iterator(const content_blocks *blocks_ptr, std::size_t n)
+            : m_blocks_ptr(blocks_ptr), m_block_num(n) {}
+
+        /// returns a buffer that refers to the current block
+        inline boost::asio::const_buffer operator*(void) const {
+            return boost::asio::const_buffer(m_blocks_ptr->m_blocks[m_block_num],
+                m_blocks_ptr->get_block_size(m_block_num));
+        }
+
+        /// moves to the next block
+        inline const_iterator& operator++(void) { ++m_block_num; return *this; }
+
+        /// moves to the next block
+        inline const_iterator operator++(int) { const_iterator tmp(*this); ++m_block_num; return tmp; }
+
+        /// returns true if both iterators refer to the same block
+        inline bool operator==(const const_iterator& i) const {
+            return (m_blocks_ptr == i.m_blocks_ptr && m_block_num == i.m_block_num);
+        }
+
+        /// returns true if the iterators refer to different blocks
+        inline bool operator!=(const const_iterator& i) const { return ! (*this == i); }
+
+    private:
+
+        /// the content being iterated
+        const content_blocks *      m_blocks_ptr;
+
+        /// number of the current block
+        std::size_t                 m_block_num;
+    };
+
+
+    /// releases all blocks
+    ~content_blocks() { clear(); }
+
+    /// default constructor
+    content_blocks(void) : m_size(0) {}
+
+    /// copy constructor
+    content_blocks(const content_blocks& blocks) : m_size(0) {
+        append(blocks);
+    }
+
+    /// assignment operator
+    content_blocks& operator=(const content_blocks& blocks) {
+        if (this != &blocks) {
+            clear();
+            append(blocks);
+        }
+        return *this;
+    }
+
+    /// returns the total number of bytes stored
+    inline std::size_t size(void) const { return m_size; }
+
+    /// returns true if no bytes are stored
+    inline bool empty(void) const { return m_size == 0; }
+
+    /// returns the number of blocks used
+    inline std::size_t get_num_blocks(void) const { return m_blocks.size(); }
+
+    /// returns the number of bytes stored in block n
+    inline std::size_t get_block_size(std::size_t n) const {
+        return (n + 1 < m_blocks.size() ? static_cast<std::size_t>(content_block_pool::BLOCK_SIZE)
+            : m_size - n * content_block_pool::BLOCK_SIZE);
+    }
+
+    /// returns an iterator for the first block
+    inline const_iterator begin(void) const { return const_iterator(this, 0); }
+
+    /// returns an iterator for the end of the blocks
+    inline const_iterator end(void) const { return const_iterator(this, m_blocks.size()); }
+
+    /// returns all blocks to the pool
+    inline void clear(void) {
+        if (! m_blocks.empty()) {
+            content_block_pool& pool(content_block_pool::get_instance());
+            for (std::vector<char*>::iterator i = m_blocks.begin(); i != m_blocks.end(); ++i)
+                pool.release(*i);
+            m_blocks.clear();
+        }
+        m_size = 0;
+    }
+
+    /**
+     * appends bytes to the end of the content
+     *
+     * @param ptr points to the bytes to append
+     * @param len number of bytes to append
+     */
+    inline void append(const char *ptr, std::size_t len) {
+        while (len > 0) {
+            // the last block is full (or there are no blocks yet)
+            if (m_size == m_blocks.size() * content_block_pool::BLOCK_SIZE)
+                m_blocks.push_back(content_block_pool::get_instance().acquire());
+            const std::size_t offset = m_size % content_block_pool::BLOCK_SIZE;
+            const std::size_t n = std::min(len, content_block_pool::BLOCK_SIZE - offset);
+            memcpy(m_blocks.back() + offset, ptr, n);
+            m_size += n;
+            ptr += n;
+            len -= n;
+        }
+    }
+
+    /// appends all bytes stored in another content_blocks object
+    inline void append(const content_blocks& blocks) {
+        for (std::size_t n = 0; n < blocks.m_blocks.size(); ++n)
+            append(blocks.m_blocks[n], blocks.get_block_size(n));
+    }
+
+    /// copies all bytes into dest, which must have room for size() bytes
+    inline void copy(char *dest) const {
+        for (std::size_t n = 0; n < m_blocks.size(); ++n) {
+            const std::size_t len = get_block_size(n);
+            memcpy(dest, m_blocks[n], len);
+            dest += len;
+        }
+    }
+
+    /// appends a buffer that refers to each block (the blocks are not copied)
+    inline void get_buffers(buffers_t& buffers) const {
+        for (const_iterator i = begin(); i != end(); ++i)
+            buffers.push_back(*i);
+    }
+
+
+private:
+
+    /// blocks of memory taken from content_block_pool
+    std::vector<char*>              m_blocks;
+
+    /// total number of bytes stored
+    std::size_t                     m_size;
+};
+
+
+}   // end namespace http
+}   // end namespace pion
+
+#endif
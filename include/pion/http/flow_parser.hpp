@@ -0,0 +1,188 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_HTTP_FLOW_PARSER_HEADER__
+#define __PION_HTTP_FLOW_PARSER_HEADER__
+
+#include <deque>
+#include <boost/cstdint.hpp>
+#include <boost/function/function2.hpp>
+#include <boost/noncopyable.hpp>
+#include <pion/config.hpp>
+#include <pion/tcp/reassembler.hpp>
+#include <pion/http/parser.hpp>
+#include <pion/http/request.hpp>
+#include <pion/http/response.hpp>
+
+
+namespace pion {    // begin namespace pion
+namespace http {    // begin namespace http
+
+
+///
+/// flow_parser: parses the HTTP requests and responses of a passively
+/// captured TCP connection (a flow).  The segments sent by the client and by
+/// the server are reassembled separately, and each request is matched with
+/// its response (in order, so that pipelined requests are supported).
+///
+/// Data that was not captured is passed to the parsers as missing data (see
+/// parser::parse_missing_data()) without storing dummy content for it; if a
+/// message cannot be recovered, parsing starts again with the next data that
+/// arrives.
+///
+class PION_API flow_parser :
+    private boost::noncopyable
+{
+public:
+
+    /// function called for each transaction (request and matching response);
+    /// the response is null if the flow ended before one was received, and
+    /// the request is null if it was not captured
+    typedef boost::function2<void, http::request_ptr&, http::response_ptr&>  transaction_handler_t;
+
+
+    /// default destructor
+    virtual ~flow_parser() {}
+
+    /**
+     * creates new flow_parser objects
+     *
+     * @param handler function called for each transaction
+     * @param max_buffered maximum number of bytes held for segments that
+     *                     arrived early, for each direction
+     */
+    explicit flow_parser(transaction_handler_t handler,
+        std::size_t max_buffered = tcp::reassembler::DEFAULT_MAX_BUFFERED);
+
+    /**
+     * processes a segment sent by the client
+     *
+     * @param seq the segment's sequence number
+     * @param ptr points to the segment's payload
+     * @param len length of the segment's payload in bytes
+     */
+    inline void client_segment(boost::uint32_t seq, const char *ptr, std::size_t len) {
+        m_client_stream.push(seq, ptr, len);
+    }
+
+    /**
+     * processes a segment sent by the server
+     *
+     * @param seq the segment's sequence number
+     * @param ptr points to the segment's payload
+     * @param len length of the segment's payload in bytes
+     */
+    inline void server_segment(boost::uint32_t seq, const char *ptr, std::size_t len) {
+        m_server_stream.push(seq, ptr, len);
+    }
+
+    /// processes the SYN segment sent by the client
+    inline void client_syn(boost::uint32_t isn) { m_client_stream.start(isn); }
+
+    /// processes the SYN segment sent by the server
+    inline void server_syn(boost::uint32_t isn) { m_server_stream.start(isn); }
+
+    /**
+     * called when the flow has ended (or timed out): passes on any data that
+     * is still being held, finishes a response that is delimited by the end
+     * of the connection, and reports requests that have no response
+     */
+    void close(void);
+
+    /**
+     * sets the maximum length of payload content stored in messages; content
+     * beyond the limit (and content missing from the capture) is counted but
+     * not stored
+     *
+     * @param n maximum length for HTTP payload content
+     */
+    inline void set_max_content_length(std::size_t n) {
+        m_request_parser.set_max_content_length(n);
+        m_response_parser.set_max_content_length(n);
+    }
+
+    /// returns the stream of data sent by the client
+    inline const tcp::reassembler& get_client_stream(void) const { return m_client_stream; }
+
+    /// returns the stream of data sent by the server
+    inline const tcp::reassembler& get_server_stream(void) const { return m_server_stream; }
+
+    /// returns the number of requests waiting for a response
+    inline std::size_t get_pending_requests(void) const { return m_pending_requests.size(); }
+
+    /// returns the number of times that parsing was started again after an error
+    inline std::size_t get_resync_count(void) const { return m_resync_count; }
+
+    /// returns the number of bytes of payload content that were not captured
+    inline std::size_t get_missing_content_bytes(void) const { return m_missing_content_bytes; }
+
+
+private:
+
+    /// parses data sent by the client
+    void consume_request_data(const char *ptr, std::size_t len);
+
+    /// passes data that is missing from the client's stream to the request parser
+    void consume_request_gap(std::size_t len);
+
+    /// parses data sent by the server
+    void consume_response_data(const char *ptr, std::size_t len);
+
+    /// passes data that is missing from the server's stream to the response parser
+    void consume_response_gap(std::size_t len);
+
+    /// counts payload content that was not captured
+    inline void skip_content(std::size_t len) { m_missing_content_bytes += len; }
+
+    /// called after a request has been parsed
+    void finished_request(void);
+
+    /// called after a response has been parsed
+    void finished_response(void);
+
+    /// creates the response for the next request waiting for one
+    void start_response(void);
+
+
+    /// function called for each transaction
+    transaction_handler_t           m_handler;
+
+    /// reassembles the segments sent by the client
+    tcp::reassembler                m_client_stream;
+
+    /// reassembles the segments sent by the server
+    tcp::reassembler                m_server_stream;
+
+    /// parses the requests sent by the client
+    http::request_parser            m_request_parser;
+
+    /// parses the responses sent by the server
+    http::response_parser           m_response_parser;
+
+    /// the request being parsed (null between requests)
+    http::request_ptr               m_request;
+
+    /// the response being parsed (null between responses)
+    http::response_ptr              m_response;
+
+    /// requests that have been parsed and are waiting for a response
+    std::deque<http::request_ptr>   m_pending_requests;
+
+    /// number of times that parsing was started again after an error
+    std::size_t                     m_resync_count;
+
+    /// number of bytes of payload content that were not captured
+    std::size_t                     m_missing_content_bytes;
+};
+
+
+}   // end namespace http
+}   // end namespace pion
+
+#endif
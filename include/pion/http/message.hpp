@@ -11,16 +11,17 @@
 #define __PION_HTTP_MESSAGE_HEADER__
 
 #include <iosfwd>
+#include <algorithm>
 #include <vector>
 #include <cstring>
 #include <boost/cstdint.hpp>
 #include <boost/asio.hpp>
 #include <boost/scoped_array.hpp>
 #include <boost/lexical_cast.hpp>
-#include <boost/algorithm/string/trim.hpp>
-#include <boost/regex.hpp>
 #include <pion/config.hpp>
 #include <pion/http/types.hpp>
+#include <pion/http/token_view.hpp>
+#include <pion/http/content_blocks.hpp>
 
 
 namespace pion {    // begin namespace pion
@@ -46,8 +47,148 @@ public:
     /// data type for I/O write buffers (these wrap existing data to be sent)
     typedef std::vector<boost::asio::const_buffer>  write_buffers_t;
 
-    /// used to cache chunked data
-    typedef std::vector<char>   chunk_cache_t;
+    ///
+    /// chunk_cache_t: segmented storage used to cache chunked (or until EOF)
+    /// payload content; data is appended with a single copy into segments that
+    /// are never moved, and the first segment may be handed over to the content
+    /// buffer when it holds all of the data
+    ///
+    class chunk_cache_t {
+    public:
+
+        /// minimum number of bytes allocated for a new segment
+        enum { MIN_SEGMENT_SIZE = 4096 };
+
+        /// frees all segments
+        ~chunk_cache_t() { clear(); }
+
+        /// default constructor
+        chunk_cache_t() : m_size(0) {}
+
+        /// copy constructor
+        chunk_cache_t(const chunk_cache_t& cache) : m_size(0) {
+            if (cache.size()) {
+                reserve(cache.size());
+                cache.copy(m_segments.back().ptr);
+                m_segments.back().used = m_size = cache.size();
+            }
+        }
+
+        /// assignment operator
+        chunk_cache_t& operator=(const chunk_cache_t& cache) {
+            if (this != &cache) {
+                chunk_cache_t tmp(cache);
+                m_segments.swap(tmp.m_segments);
+                std::swap(m_size, tmp.m_size);
+            }
+            return *this;
+        }
+
+        /// returns the total number of bytes cached
+        inline std::size_t size(void) const { return m_size; }
+
+        /// returns true if no bytes are cached
+        inline bool empty(void) const { return m_size == 0; }
+
+        /// returns the number of bytes allocated for the segments
+        inline std::size_t capacity(void) const {
+            std::size_t result = 0;
+            for (std::vector<segment_t>::const_iterator i = m_segments.begin(); i != m_segments.end(); ++i)
+                result += i->capacity;
+            return result;
+        }
+
+        /// returns true if all of the bytes are stored in a single segment
+        inline bool is_contiguous(void) const { return m_segments.size() <= 1; }
+
+        /// frees all segments
+        inline void clear(void) {
+            for (std::vector<segment_t>::iterator i = m_segments.begin(); i != m_segments.end(); ++i)
+                delete [] i->ptr;
+            m_segments.clear();
+            m_size = 0;
+        }
+
+        /// makes sure that at least len bytes can be appended without allocating
+        /// memory (used when the size of the next chunk is known in advance)
+        inline void reserve(std::size_t len) {
+            if (m_segments.empty() || m_segments.back().capacity - m_segments.back().used < len) {
+                segment_t s;
+                s.capacity = len;
+                s.used = 0;
+                // allocate one extra byte so that the segment can become a content buffer
+                s.ptr = new char[len + 1];
+                m_segments.push_back(s);
+            }
+        }
+
+        /**
+         * appends bytes to the end of the cache
+         *
+         * @param ptr points to the bytes to append
+         * @param len number of bytes to append
+         */
+        inline void append(const char *ptr, std::size_t len) {
+            if (! m_segments.empty()) {
+                segment_t& s = m_segments.back();
+                const std::size_t n = std::min(len, s.capacity - s.used);
+                memcpy(s.ptr + s.used, ptr, n);
+                s.used += n;
+                m_size += n;
+                ptr += n;
+                len -= n;
+            }
+            if (len > 0) {
+                // segments grow with the size of the cache to keep their number small
+                reserve(std::max(len, std::max(m_size, static_cast<std::size_t>(MIN_SEGMENT_SIZE))));
+                memcpy(m_segments.back().ptr, ptr, len);
+                m_segments.back().used = len;
+                m_size += len;
+            }
+        }
+
+        /// appends a single byte to the end of the cache
+        inline void push_back(char c) { append(&c, 1); }
+
+        /// copies all cached bytes into dest, which must have room for size() bytes
+        inline void copy(char *dest) const {
+            for (std::vector<segment_t>::const_iterator i = m_segments.begin(); i != m_segments.end(); ++i) {
+                memcpy(dest, i->ptr, i->used);
+                dest += i->used;
+            }
+        }
+
+        /**
+         * releases ownership of the only segment; the cache must be contiguous
+         * and not empty
+         *
+         * @return char* new[] allocated array of at least size() + 1 bytes
+         */
+        inline char *release(void) {
+            char *ptr = m_segments.back().ptr;
+            m_segments.clear();
+            m_size = 0;
+            return ptr;
+        }
+
+    private:
+
+        /// a segment of memory used for caching payload content
+        struct segment_t {
+            char *          ptr;
+            std::size_t     used;
+            std::size_t     capacity;
+        };
+
+        /// segments of memory used for caching payload content
+        std::vector<segment_t>      m_segments;
+
+        /// total number of bytes cached
+        std::size_t                 m_size;
+    };
+
+    /// data type for HTTP header (name, value) views, used by the token view parse mode
+    typedef std::vector<std::pair<token_view, token_view> >    header_views_t;
 
     /// data type for library errors returned during receive() operations
     struct receive_error_t
@@ -83,6 +224,7 @@ public:
         : m_is_valid(false), m_is_chunked(false), m_chunks_supported(false),
         m_do_not_send_content_length(false),
         m_version_major(1), m_version_minor(1), m_content_length(0), m_content_buf(),
+        m_header_slots_valid(true),
         m_status(STATUS_NONE), m_has_missing_packets(false), m_has_data_after_missing(false)
     {}
 
@@ -98,12 +240,15 @@ public:
         m_version_minor(http_msg.m_version_minor),
         m_content_length(http_msg.m_content_length),
         m_content_buf(http_msg.m_content_buf),
+        m_content_blocks(http_msg.m_content_blocks),
         m_chunk_cache(http_msg.m_chunk_cache),
-        m_headers(http_msg.m_headers),
+        m_header_slots_valid(true),
         m_status(http_msg.m_status),
         m_has_missing_packets(http_msg.m_has_missing_packets),
         m_has_data_after_missing(http_msg.m_has_data_after_missing)
-    {}
+    {
+        copy_headers(http_msg);
+    }
 
     /// assignment operator
     inline message& operator=(const message& http_msg) {
@@ -117,8 +262,11 @@ public:
         m_version_minor = http_msg.m_version_minor;
         m_content_length = http_msg.m_content_length;
         m_content_buf = http_msg.m_content_buf;
+        m_content_blocks = http_msg.m_content_blocks;
         m_chunk_cache = http_msg.m_chunk_cache;
-        m_headers = http_msg.m_headers;
+        m_header_views.clear();
+        m_token_buffer.clear();
+        copy_headers(http_msg);
         m_status = http_msg.m_status;
         m_has_missing_packets = http_msg.m_has_missing_packets;
         m_has_data_after_missing = http_msg.m_has_data_after_missing;
@@ -137,8 +285,12 @@ public:
         m_version_major = m_version_minor = 1;
         m_content_length = 0;
         m_content_buf.clear();
+        m_content_blocks.clear();
         m_chunk_cache.clear();
         m_headers.clear();
+        m_header_views.clear();
+        m_token_buffer.clear();
+        clear_header_slots();
         m_cookie_params.clear();
         m_status = STATUS_NONE;
         m_has_missing_packets = false;
@@ -187,29 +339,152 @@ public:
     inline std::size_t get_content_buffer_size() const { return m_content_buf.size(); }
     
     /// returns a pointer to the payload content, or empty string if there is none
-    inline char *get_content(void) { return m_content_buf.get(); }
+    /// (segmented content is copied into a single buffer first)
+    inline char *get_content(void) {
+        if (! m_content_blocks.empty())
+            flatten_content();
+        return m_content_buf.get();
+    }
 
     /// returns a const pointer to the payload content, or empty string if there is none
-    inline const char *get_content(void) const { return m_content_buf.get(); }
+    /// (segmented content is not copied: use get_content_blocks() or the non-const
+    /// get_content(), so that the message is not changed by const access)
+    inline const char *get_content(void) const {
+        return m_content_buf.get();
+    }
+
+    /// returns true if the payload content is stored in content blocks
+    inline bool has_content_blocks(void) const { return ! m_content_blocks.empty(); }
+
+    /// returns the payload content stored in blocks (empty unless the message
+    /// was parsed with segmented content enabled, or the blocks were filled directly)
+    inline content_blocks& get_content_blocks(void) { return m_content_blocks; }
+
+    /// returns the payload content stored in blocks
+    inline const content_blocks& get_content_blocks(void) const { return m_content_blocks; }
+
+    /**
+     * appends buffers that refer to the payload content; content blocks are
+     * not copied into a single buffer
+     *
+     * @param write_buffers vector of write buffers to append to
+     */
+    inline void append_content_buffers(write_buffers_t& write_buffers) const {
+        if (! m_content_blocks.empty())
+            m_content_blocks.get_buffers(write_buffers);
+        else if (get_content_length() > 0)
+            write_buffers.push_back(boost::asio::buffer(m_content_buf.get(),
+                std::min(static_cast<std::size_t>(get_content_length()), m_content_buf.size())));
+    }
 
     /// returns a reference to the chunk cache
     inline chunk_cache_t& get_chunk_cache(void) { return m_chunk_cache; }
 
     /// returns a value for the header if any are defined; otherwise, an empty string
-    inline const std::string& get_header(const std::string& key) const {
+    inline const std::string& get_header(const std::string& key) {
+        sync_header_views();
         return get_value(m_headers, key);
     }
 
+    /// returns a copy of the value for the header if any are defined; otherwise,
+    /// an empty string (header views are read without changing the message)
+    inline std::string get_header(const std::string& key) const {
+        return get_header_view(key).str();
+    }
+
     /// returns a reference to the HTTP headers
     inline ihash_multimap& get_headers(void) {
+        sync_header_views();
+        // the headers may be changed through the reference
+        m_header_slots_valid = false;
+        return m_headers;
+    }
+
+    /// returns a const reference to the HTTP headers (header views are not
+    /// included until they are copied by detach_token_views() or get_headers())
+    inline const ihash_multimap& get_headers(void) const {
         return m_headers;
     }
 
     /// returns true if at least one value for the header is defined
     inline bool has_header(const std::string& key) const {
+        if (! m_header_views.empty())
+            return (find_header_view(key).data() != NULL);
         return(m_headers.find(key) != m_headers.end());
     }
 
+    /// returns a view of the value for the header if any are defined; otherwise, an
+    /// empty view (header views are not copied into strings by this function)
+    inline token_view get_header_view(const std::string& key) const {
+        if (! m_header_views.empty())
+            return find_header_view(key);
+        ihash_multimap::const_iterator i = m_headers.find(key);
+        return (i == m_headers.end() ? token_view() : token_view(i->second));
+    }
+
+    /// returns a view of the value for a common header if any are defined;
+    /// otherwise, an empty view (constant time; the name is not hashed, unless
+    /// the headers were changed through get_headers())
+    inline token_view get_header_view(const header_id_t id) const {
+        if (m_header_slots_valid)
+            return m_header_slots[id];
+        return get_header_view(get_header_name(id));
+    }
+
+    /// returns true if at least one value for a common header is defined
+    inline bool has_header(const header_id_t id) const {
+        return (get_header_view(id).data() != NULL);
+    }
+
+    /// returns the HTTP header views that have not been copied into strings
+    /// (only used when parsed in token view mode)
+    inline const header_views_t& get_header_views(void) const {
+        return m_header_views;
+    }
+
+    /// returns true if any token views still refer to memory not owned by the message
+    inline bool has_header_views(void) const { return ! m_header_views.empty(); }
+
+    /// adds a view for the HTTP header named key; the view must remain valid
+    /// until it is relocated, or copied into a string
+    inline void add_header_view(const token_view& key, const token_view& value) {
+        add_header_view(find_header_id(key.data(), key.size()), key, value);
+    }
+
+    /**
+     * adds a view for the HTTP header named key, which has already been
+     * identified (i.e. by the parser)
+     *
+     * @param id identifier of the header (HEADER_ID_UNKNOWN if it is not a common header)
+     * @param key view of the header name
+     * @param value view of the header value
+     */
+    inline void add_header_view(const header_id_t id, const token_view& key, const token_view& value) {
+        if (m_header_views.empty() && ! m_headers.empty()) {
+            add_header(id, key.str(), value.str());
+        } else {
+            m_header_views.push_back(std::make_pair(key, value));
+            if (id != HEADER_ID_UNKNOWN && m_header_slots_valid && m_header_slots[id].data() == NULL)
+                m_header_slots[id] = value;
+        }
+    }
+
+    /// returns the storage used for tokens that could not refer to a read buffer
+    inline token_buffer& get_token_buffer(void) { return m_token_buffer; }
+
+    /**
+     * copies token views that refer to memory in [begin_ptr, end_ptr) into
+     * the message's token buffer (called before a read buffer is reused)
+     *
+     * @param begin_ptr points to the first byte of the read buffer
+     * @param end_ptr points to the end of the read buffer (last byte + 1)
+     */
+    virtual void relocate_token_views(const char *begin_ptr, const char *end_ptr);
+
+    /// copies all token views into strings, so that the message no longer
+    /// depends on the memory the views refer to
+    virtual void detach_token_views(void) { sync_header_views(); }
+
     /// returns a value for the cookie if any are defined; otherwise, an empty string
     /// since cookie names are insensitive, key should use lowercase alpha chars
     inline const std::string& get_cookie(const std::string& key) const {
@@ -297,31 +572,37 @@ public:
     inline void set_status(data_status_t newVal) { m_status = newVal; }
 
     /// sets the length of the payload content using the Content-Length header
+    /// (throws boost::bad_lexical_cast if the header is not a valid length)
     inline void update_content_length_using_header(void) {
-        ihash_multimap::const_iterator i = m_headers.find(HEADER_CONTENT_LENGTH);
-        if (i == m_headers.end()) {
-            m_content_length = 0;
-        } else {
-            std::string trimmed_length(i->second);
-            boost::algorithm::trim(trimmed_length);
-            m_content_length = boost::lexical_cast<boost::uint64_t>(trimmed_length);
-        }
+        const token_view length_view(get_header_view(HEADER_ID_CONTENT_LENGTH));
+        m_content_length = (length_view.data() == NULL ? 0 : parse_content_length(length_view));
     }
 
     /// sets the transfer coding using the Transfer-Encoding header
     inline void update_transfer_encoding_using_header(void) {
-        m_is_chunked = false;
-        ihash_multimap::const_iterator i = m_headers.find(HEADER_TRANSFER_ENCODING);
-        if (i != m_headers.end()) {
-            // From RFC 2616, sec 3.6: All transfer-coding values are case-insensitive.
-            m_is_chunked = boost::regex_match(i->second, REGEX_ICASE_CHUNKED);
-            // ignoring other possible values for now
-        }
+        const token_view encoding_view(get_header_view(HEADER_ID_TRANSFER_ENCODING));
+        // ignoring other possible values for now
+        m_is_chunked = (encoding_view.data() != NULL && has_chunked_coding(encoding_view));
     }
 
+    /**
+     * parses the value of a Content-Length header: decimal digits, optionally
+     * surrounded by spaces or tabs
+     *
+     * @param length_view the header value
+     *
+     * @return boost::uint64_t the content length (throws boost::bad_lexical_cast if invalid)
+     */
+    static boost::uint64_t parse_content_length(const token_view& length_view);
+
+    /// returns true if a Transfer-Encoding header value includes the "chunked"
+    /// coding (case-insensitive, see RFC 2616, sec 3.6)
+    static bool has_chunked_coding(const token_view& encoding_view);
+
     ///creates a payload content buffer of size m_content_length and returns
     /// a pointer to the new buffer (memory is managed by message class)
     inline char *create_content_buffer(void) {
+        m_content_blocks.clear();
         m_content_buf.resize(m_content_length);
         return m_content_buf.get();
     }
@@ -337,32 +618,78 @@ public:
     inline void clear_content(void) {
         set_content_length(0);
         create_content_buffer();
+        sync_header_views();
         delete_value(m_headers, HEADER_CONTENT_TYPE);
+        m_header_slots[HEADER_ID_CONTENT_TYPE] = token_view();
     }
 
     /// sets the content type for the message payload
     inline void set_content_type(const std::string& type) {
-        change_value(m_headers, HEADER_CONTENT_TYPE, type);
+        change_header(HEADER_ID_CONTENT_TYPE, HEADER_CONTENT_TYPE, type);
     }
 
     /// adds a value for the HTTP header named key
     inline void add_header(const std::string& key, const std::string& value) {
-        m_headers.insert(std::make_pair(key, value));
+        add_header(find_header_id(key), key, value);
+    }
+
+    /**
+     * adds a value for the HTTP header named key, which has already been
+     * identified (i.e. by the parser)
+     *
+     * @param id identifier of the header (HEADER_ID_UNKNOWN if it is not a common header)
+     * @param key name of the header
+     * @param value value of the header
+     */
+    inline void add_header(const header_id_t id, const std::string& key, const std::string& value) {
+        sync_header_views();
+        ihash_multimap::iterator i = m_headers.insert(ihash_multimap::value_type(key, value));
+        if (! m_header_slots_valid) {
+            update_header_slots();
+        } else if (id != HEADER_ID_UNKNOWN) {
+            if (m_header_slots[id].data() == NULL)
+                m_header_slots[id] = token_view(i->second);
+            else
+                update_header_slots();  // let find() decide which value is first
+        }
     }
 
     /// changes the value for the HTTP header named key
     inline void change_header(const std::string& key, const std::string& value) {
+        change_header(find_header_id(key), key, value);
+    }
+
+    /**
+     * changes the value for the HTTP header named key, which has already
+     * been identified
+     *
+     * @param id identifier of the header (HEADER_ID_UNKNOWN if it is not a common header)
+     * @param key name of the header
+     * @param value new value of the header
+     */
+    inline void change_header(const header_id_t id, const std::string& key, const std::string& value) {
+        sync_header_views();
         change_value(m_headers, key, value);
+        if (! m_header_slots_valid)
+            update_header_slots();
+        else if (id != HEADER_ID_UNKNOWN)   // only one value remains for the header
+            m_header_slots[id] = token_view(m_headers.find(key)->second);
     }
 
     /// removes all values for the HTTP header named key
     inline void delete_header(const std::string& key) {
+        sync_header_views();
         delete_value(m_headers, key);
+        const header_id_t id = find_header_id(key);
+        if (! m_header_slots_valid)
+            update_header_slots();
+        else if (id != HEADER_ID_UNKNOWN)
+            m_header_slots[id] = token_view();
     }
 
     /// returns true if the HTTP connection may be kept alive
     inline bool check_keep_alive(void) const {
-        return (get_header(HEADER_CONNECTION) != "close"
+        return (get_header_view(HEADER_ID_CONNECTION) != "close"
                 && (get_version_major() > 1
                     || (get_version_major() >= 1 && get_version_minor() >= 1)) );
     }
@@ -387,6 +714,34 @@ public:
         append_headers(write_buffers);
     }
 
+    /**
+     * initializes a vector of write buffers with the HTTP message information,
+     * encoding the first line and all of the headers into a single buffer
+     *
+     * @param write_buffers vector of write buffers to initialize
+     * @param header_buf receives the encoded headers; it must not be changed
+     *                   until the write buffers have been sent
+     * @param keep_alive true if the connection should be kept alive
+     * @param using_chunks true if the payload content will be sent in chunks
+     */
+    inline void prepare_buffers_for_send(write_buffers_t& write_buffers,
+                                      std::string& header_buf,
+                                      const bool keep_alive,
+                                      const bool using_chunks)
+    {
+        prepare_headers_for_send(keep_alive, using_chunks);
+        encode_headers(header_buf);
+        write_buffers.push_back(boost::asio::buffer(header_buf));
+    }
+
+    /**
+     * encodes the first line and HTTP headers of the message (including the
+     * blank line that ends them) into a buffer
+     *
+     * @param buf the buffer to encode the headers into (its contents are replaced)
+     */
+    void encode_headers(std::string& buf);
+
 
     /**
      * sends the message over a TCP connection (blocks until finished)
@@ -437,7 +792,8 @@ public:
         bool headers_only = false);
 
     /**
-     * pieces together all the received chunks
+     * pieces together all the received chunks (the chunk cache is emptied);
+     * content that was received into content blocks is left in place
      */
     void concatenate_chunks(void);
 
@@ -501,6 +857,14 @@ protected:
         
         /// clears the content buffer
         inline void clear() { resize(0); }
+
+        /// takes ownership of a new[] allocated array of at least len + 1 bytes
+        inline void adopt(char *buf, std::size_t len) {
+            m_len = len;
+            m_buf.reset(buf);
+            m_buf[len] = '\0';
+            m_ptr = m_buf.get();
+        }
         
     private:
         boost::scoped_array<char>   m_buf;
@@ -518,12 +882,13 @@ protected:
     inline void prepare_headers_for_send(const bool keep_alive,
                                       const bool using_chunks)
     {
-        change_header(HEADER_CONNECTION, (keep_alive ? "Keep-Alive" : "close") );
+        change_header(HEADER_ID_CONNECTION, HEADER_CONNECTION, (keep_alive ? "Keep-Alive" : "close") );
         if (using_chunks) {
             if (get_chunks_supported())
-                change_header(HEADER_TRANSFER_ENCODING, "chunked");
+                change_header(HEADER_ID_TRANSFER_ENCODING, HEADER_TRANSFER_ENCODING, "chunked");
         } else if (! m_do_not_send_content_length) {
-            change_header(HEADER_CONTENT_LENGTH, boost::lexical_cast<std::string>(get_content_length()));
+            change_header(HEADER_ID_CONTENT_LENGTH, HEADER_CONTENT_LENGTH,
+                          boost::lexical_cast<std::string>(get_content_length()));
         }
     }
 
@@ -533,6 +898,7 @@ protected:
      * @param write_buffers the buffers to append HTTP headers into
      */
     inline void append_headers(write_buffers_t& write_buffers) {
+        sync_header_views();
         // add HTTP headers
         for (ihash_multimap::const_iterator i = m_headers.begin(); i != m_headers.end(); ++i) {
             write_buffers.push_back(boost::asio::buffer(i->first));
@@ -579,7 +945,7 @@ protected:
             result_pair = dict.equal_range(key);
         if (result_pair.first == dict.end()) {
             // no values exist -> add a new key
-            dict.insert(std::make_pair(key, value));
+            dict.insert(typename DictionaryType::value_type(key, value));
         } else {
             // set the first value found for the key to the new one
             result_pair.first->second = value;
@@ -620,6 +986,47 @@ protected:
     /// updates the string containing the first line for the HTTP message
     virtual void update_first_line(void) const = 0;
 
+    /// appends the first line for the HTTP message and a CRLF to a buffer
+    virtual void append_first_line(std::string& buf) const {
+        buf += get_first_line();
+        buf += STRING_CRLF;
+    }
+
+    /// copies any HTTP header views into m_headers
+    inline void sync_header_views(void) {
+        if (! m_header_views.empty())
+            copy_header_views();
+    }
+
+    /// copies all HTTP header views into m_headers and clears the views
+    void copy_header_views(void);
+
+    /// copies the headers of another message, without changing it
+    /// (header views are copied into strings)
+    void copy_headers(const message& http_msg);
+
+    /// sets the header slots to the first value of each common header
+    void update_header_slots(void);
+
+    /// clears the header slots (there are no headers)
+    inline void clear_header_slots(void) {
+        for (int id = 0; id < HEADER_ID_COUNT; ++id)
+            m_header_slots[id] = token_view();
+        m_header_slots_valid = true;
+    }
+
+    /// copies the content blocks into the content buffer and releases the blocks
+    void flatten_content(void);
+
+    /// returns the first header view matching key (case-insensitive), or an empty view
+    inline token_view find_header_view(const std::string& key) const {
+        for (header_views_t::const_iterator i = m_header_views.begin(); i != m_header_views.end(); ++i) {
+            if (i->first.iequals(key))
+                return i->second;
+        }
+        return token_view();
+    }
+
 
     /// first line sent in an HTTP message
     /// (i.e. "GET / HTTP/1.1" for request, or "HTTP/1.1 200 OK" for response)
@@ -628,9 +1035,6 @@ protected:
 
 private:
 
-    /// Regex used to check for the "chunked" transfer encoding header
-    static const boost::regex       REGEX_ICASE_CHUNKED;
-
     /// True if the HTTP message is valid
     bool                            m_is_valid;
 
@@ -658,12 +1062,27 @@ private:
     /// the payload content, if any was sent with the message
     content_buffer_t                m_content_buf;
 
+    /// the payload content, if it is stored in blocks (segmented content)
+    content_blocks                  m_content_blocks;
+
     /// buffers for holding chunked data
     chunk_cache_t                   m_chunk_cache;
 
     /// HTTP message headers
     ihash_multimap                  m_headers;
 
+    /// HTTP message headers parsed in token view mode (not yet copied into m_headers)
+    header_views_t                  m_header_views;
+
+    /// the first value of each common header, indexed by header_id_t
+    token_view                      m_header_slots[HEADER_ID_COUNT];
+
+    /// false if the headers were changed through get_headers() (the slots are not used)
+    bool                            m_header_slots_valid;
+
+    /// storage for token views that could not refer to the read buffer
+    token_buffer                    m_token_buffer;
+
     /// HTTP cookie parameters parsed from the headers
     ihash_multimap                  m_cookie_params;
 
@@ -0,0 +1,245 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_HTTP_MULTIPART_PARSER_HEADER__
+#define __PION_HTTP_MULTIPART_PARSER_HEADER__
+
+#include <string>
+#include <fstream>
+#include <boost/function/function1.hpp>
+#include <boost/function/function3.hpp>
+#include <boost/logic/tribool.hpp>
+#include <boost/noncopyable.hpp>
+#include <pion/config.hpp>
+#include <pion/logger.hpp>
+#include <pion/hash_map.hpp>
+
+
+namespace pion {    // begin namespace pion
+namespace http {    // begin namespace http
+
+
+///
+/// multipart_parser: incrementally parses multipart/form-data payload content
+/// as it arrives, emitting part-begin, part-data and part-end events.  It can
+/// be used as a parser payload handler (see http::parser::set_payload_handler()):
+///
+///     http::parser::payload_handler_t h(boost::ref(my_multipart_parser));
+///     my_parser.set_payload_handler(h);
+///
+class PION_API multipart_parser :
+    private boost::noncopyable
+{
+public:
+
+    /// information about the part currently being parsed
+    struct part_info {
+        /// default constructor
+        part_info(void) : size(0) {}
+        /// the part's MIME headers
+        ihash_multimap      headers;
+        /// form field name (from the Content-Disposition header)
+        std::string         name;
+        /// file name, if the part is a file upload (from the Content-Disposition header)
+        std::string         filename;
+        /// path of the file that the part's data was spilled to, if any
+        std::string         file_path;
+        /// number of data bytes parsed for the part
+        std::size_t         size;
+    };
+
+    /// function called when a part begins (after its headers have been parsed)
+    typedef boost::function1<void, const part_info&>   part_begin_handler_t;
+
+    /// function called for each run of part data that is not spilled to disk
+    typedef boost::function3<void, const part_info&, const char *, std::size_t>   part_data_handler_t;
+
+    /// function called when a part ends
+    typedef boost::function1<void, const part_info&>   part_end_handler_t;
+
+    /// maximum size of the MIME headers of a single part
+    static const std::size_t    MAX_PART_HEADERS_SIZE;
+
+    /// default maximum size of form field values collected by set_fields()
+    static const std::size_t    DEFAULT_MAX_FIELD_SIZE;
+
+
+    /// default destructor (removes the spill file of an unfinished part)
+    virtual ~multipart_parser();
+
+    /**
+     * creates a new multipart_parser object
+     *
+     * @param boundary the boundary parameter of the Content-Type header
+     */
+    explicit multipart_parser(const std::string& boundary);
+
+    /**
+     * gets the boundary parameter from a multipart Content-Type header value
+     *
+     * @param content_type value of the Content-Type header
+     * @param boundary will be set to the boundary, if found
+     *
+     * @return bool true if a boundary was found
+     */
+    static bool parse_boundary(const std::string& content_type, std::string& boundary);
+
+    /**
+     * parses more multipart payload content
+     *
+     * @param ptr points to the next bytes of payload content
+     * @param len number of bytes available
+     *
+     * @return boost::tribool result of parsing:
+     *                        false = the content is invalid,
+     *                        true = finished parsing (found the closing boundary),
+     *                        indeterminate = not yet finished
+     */
+    boost::tribool parse(const char *ptr, std::size_t len);
+
+    /// parses more payload content (allows use as a parser payload handler)
+    inline void operator()(const char *ptr, std::size_t len) { parse(ptr, len); }
+
+    /// returns true if the closing boundary has been parsed
+    inline bool is_finished(void) const { return m_parse_state == MP_EPILOGUE; }
+
+    /// returns true if the content was found to be invalid
+    inline bool has_error(void) const { return m_parse_state == MP_ERROR; }
+
+    /// resets the parser to parse a new body with the same boundary
+    void reset(void);
+
+    /// sets the function called when a part begins
+    inline void set_part_begin_handler(part_begin_handler_t h) { m_part_begin = h; }
+
+    /// sets the function called for each run of part data
+    inline void set_part_data_handler(part_data_handler_t h) { m_part_data = h; }
+
+    /// sets the function called when a part ends
+    inline void set_part_end_handler(part_end_handler_t h) { m_part_end = h; }
+
+    /**
+     * collects the values of form fields that have a text type or no type
+     * into dict (i.e. a request's query parameters), the same way as
+     * parser::parse_multipart_form_data()
+     *
+     * @param dict dictionary that values are added to (must outlive the parser)
+     * @param max_field_size values of larger fields are ignored
+     */
+    inline void set_fields(ihash_multimap& dict, std::size_t max_field_size = DEFAULT_MAX_FIELD_SIZE) {
+        m_fields_ptr = &dict;
+        m_max_field_size = max_field_size;
+    }
+
+    /**
+     * writes the data of file upload parts into new files in a directory,
+     * instead of passing it to the part data handler; part_info::file_path
+     * contains the path of the file, which is left for the caller to move or
+     * remove after the part has ended
+     *
+     * @param dir directory to create files in (empty disables spilling)
+     */
+    inline void set_spill_directory(const std::string& dir) { m_spill_directory = dir; }
+
+    /// sets the logger to be used
+    inline void set_logger(logger log_ptr) { m_logger = log_ptr; }
+
+    /// returns the logger currently in use
+    inline logger get_logger(void) { return m_logger; }
+
+
+private:
+
+    /// state used to keep track of where we are in parsing the content
+    enum parse_state_t {
+        MP_PREAMBLE, MP_BOUNDARY_END, MP_BOUNDARY_DASH, MP_BOUNDARY_PADDING,
+        MP_BOUNDARY_LF, MP_HEADERS, MP_DATA, MP_EPILOGUE, MP_ERROR
+    };
+
+    /**
+     * finds the next delimiter in [ptr, end_ptr), or the start of a partial
+     * delimiter at the end of the buffer
+     *
+     * @return const char* start of the (partial) delimiter, or end_ptr if none
+     */
+    const char *find_delimiter(const char *ptr, const char *end_ptr) const;
+
+    /// passes part data to the handlers (or the spill file)
+    void consume_data(const char *ptr, std::size_t len);
+
+    /// parses a MIME header line of the current part
+    void parse_header_line(void);
+
+    /// called after the headers of a part have been parsed
+    bool begin_part(void);
+
+    /// called after the data of a part has been parsed
+    void end_part(void);
+
+    /// switches to the error state
+    boost::tribool set_error(const char *what);
+
+
+    /// primary logging interface used by this class
+    mutable logger                  m_logger;
+
+    /// the delimiter that separates parts: CRLF, two dashes and the boundary
+    const std::string               m_delimiter;
+
+    /// current parsing state
+    parse_state_t                   m_parse_state;
+
+    /// number of delimiter characters matched at the end of the last buffer
+    std::size_t                     m_match_size;
+
+    /// the MIME header line being parsed
+    std::string                     m_header_line;
+
+    /// total size of the MIME headers of the current part
+    std::size_t                     m_headers_size;
+
+    /// true while a part is open (between the begin and end events)
+    bool                            m_in_part;
+
+    /// the part currently being parsed
+    part_info                       m_part;
+
+    /// value of the form field being collected
+    std::string                     m_field_value;
+
+    /// true if the value of the current part is being collected
+    bool                            m_collect_field;
+
+    /// dictionary form field values are collected into, if any
+    ihash_multimap *                m_fields_ptr;
+
+    /// values of larger form fields are not collected
+    std::size_t                     m_max_field_size;
+
+    /// directory that file upload parts are written to (empty if disabled)
+    std::string                     m_spill_directory;
+
+    /// file that the current part is written to
+    std::ofstream                   m_spill_file;
+
+    /// function called when a part begins
+    part_begin_handler_t            m_part_begin;
+
+    /// function called for each run of part data
+    part_data_handler_t             m_part_data;
+
+    /// function called when a part ends
+    part_end_handler_t              m_part_end;
+};
+
+
+}   // end namespace http
+}   // end namespace pion
+
+#endif
@@ -11,14 +11,18 @@
 #define __PION_HTTP_PARSER_HEADER__
 
 #include <string>
+#include <cstring>
 #include <boost/noncopyable.hpp>
+#include <boost/function/function1.hpp>
 #include <boost/function/function2.hpp>
 #include <boost/logic/tribool.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/thread/once.hpp>
+#include <boost/type_traits/is_same.hpp>
 #include <pion/config.hpp>
 #include <pion/logger.hpp>
 #include <pion/http/message.hpp>
+#include <pion/http/url_encoded_parser.hpp>
 
 
 namespace pion {    // begin namespace pion
@@ -30,7 +34,8 @@ class request;
 class response;
 
 ///
-/// parser: parses HTTP messages
+/// parser: parses HTTP messages (requests or responses, as selected at
+/// runtime; see also basic_parser)
 ///
 class PION_API parser :
     private boost::noncopyable
@@ -43,6 +48,9 @@ public:
 
     /// callback type used to consume payload content
     typedef boost::function2<void, const char *, std::size_t>   payload_handler_t;
+
+    /// callback type used to report payload content that is missing
+    typedef boost::function1<void, std::size_t>                 missing_data_handler_t;
     
     /// class-specific error code values
     enum error_value_t {
@@ -124,13 +132,17 @@ public:
      */
     parser(const bool is_request, std::size_t max_content_length = DEFAULT_CONTENT_MAX)
         : m_logger(PION_GET_LOGGER("pion.http.parser")), m_is_request(is_request),
-        m_read_ptr(NULL), m_read_end_ptr(NULL), m_message_parse_state(PARSE_START),
+        m_read_start_ptr(NULL), m_read_ptr(NULL), m_read_end_ptr(NULL),
+        m_message_parse_state(PARSE_START),
         m_headers_parse_state(is_request ? PARSE_METHOD_START : PARSE_HTTP_VERSION_H),
         m_chunked_content_parse_state(PARSE_CHUNK_SIZE_START), m_status_code(0),
+        m_header_id(http::types::HEADER_ID_UNKNOWN),
         m_bytes_content_remaining(0), m_bytes_content_read(0),
         m_bytes_last_read(0), m_bytes_total_read(0),
         m_max_content_length(max_content_length),
-        m_parse_headers_only(false), m_save_raw_headers(false)
+        m_parse_headers_only(false), m_save_raw_headers(false),
+        m_token_views(false), m_segmented_content(false), m_stream_form_data(false),
+        m_token_ptr(NULL)
     {}
 
     /// default destructor
@@ -150,7 +162,8 @@ public:
     boost::tribool parse(http::message& http_msg, boost::system::error_code& ec);
 
     /**
-     * attempts to continue parsing despite having missed data (length is known but content is not)
+     * attempts to continue parsing despite having missed data (length is known but content is not).
+     * Unless a missing data handler is defined, the missing content is replaced with 'X' characters.
      *
      * @param http_msg the HTTP message object to populate from parsing
      * @param len the length in bytes of the missing data
@@ -178,7 +191,7 @@ public:
      * @param len number of bytes available to be read
      */
     inline void set_read_buffer(const char *ptr, size_t len) {
-        m_read_ptr = ptr;
+        m_read_start_ptr = m_read_ptr = ptr;
         m_read_end_ptr = ptr + len;
     }
 
@@ -238,7 +251,10 @@ public:
         m_resource.erase();
         m_query_string.erase();
         m_raw_headers.erase();
+        m_token_head = m_method_view = m_resource_view = m_query_string_view
+            = m_header_name_view = token_view();
         m_bytes_content_read = m_bytes_last_read = m_bytes_total_read = 0;
+        m_form_decoder.detach();
     }
 
     /// returns true if there are no more bytes available in the read buffer
@@ -274,6 +290,15 @@ public:
     /// defines a callback function to be used for consuming payload content
     inline void set_payload_handler(payload_handler_t& h) { m_payload_handler = h; }
 
+    /**
+     * defines a callback function to be used for reporting payload content
+     * that is missing (see parse_missing_data()).  If defined, no dummy
+     * content is passed to the payload handler or appended to chunked (or
+     * segmented) content for the missing data; only a content buffer that
+     * was allocated for a known content length is filled in.
+     */
+    inline void set_missing_data_handler(missing_data_handler_t h) { m_missing_data_handler = h; }
+
     /// sets the maximum length for HTTP payload content
     inline void set_max_content_length(std::size_t n) { m_max_content_length = n; }
 
@@ -283,6 +308,51 @@ public:
     /// sets parameter for saving raw HTTP header content
     inline void set_save_raw_headers(bool b) { m_save_raw_headers = b; }
 
+    /**
+     * controls the token view parse mode (default is disabled).  If enabled,
+     * the request line and HTTP headers are not copied into strings; the
+     * message instead holds views of the read buffer.  Tokens that span
+     * read buffers are copied once into the message's token buffer.
+     *
+     * Views of the last read buffer are only valid until that buffer is
+     * reused (i.e. the connection reads more data), or until it is released.
+     * Call http::message::detach_token_views() to keep a message longer.
+     *
+     * @param b if true, then tokens are parsed as views of the read buffer
+     */
+    inline void set_token_views(bool b = true) { m_token_views = b; }
+
+    /// returns true if the parser is using the token view parse mode
+    inline bool get_token_views(void) const { return m_token_views; }
+
+    /**
+     * controls how payload content is stored (default is disabled).  If
+     * enabled, content is stored in the message's content blocks (fixed-size
+     * pooled blocks) instead of a single buffer, and chunked content is not
+     * concatenated.  Use http::message::get_content_blocks() or
+     * append_content_buffers() to access it without copying.
+     *
+     * @param b if true, then payload content is stored in content blocks
+     */
+    inline void set_segmented_content(bool b = true) { m_segmented_content = b; }
+
+    /// returns true if payload content is stored in content blocks
+    inline bool get_segmented_content(void) const { return m_segmented_content; }
+
+    /**
+     * controls how url-encoded form data is parsed (default is disabled).  If
+     * enabled, the payload content of requests with a Content-Type of
+     * application/x-www-form-urlencoded is decoded into the request's query
+     * parameters as it arrives, and is not stored in the message (its
+     * content length is zero).  Has no effect if a payload handler is used.
+     *
+     * @param b if true, then url-encoded form data is decoded as it arrives
+     */
+    inline void set_stream_form_data(bool b = true) { m_stream_form_data = b; }
+
+    /// returns true if url-encoded form data is decoded as it arrives
+    inline bool get_stream_form_data(void) const { return m_stream_form_data; }
+
     /// sets the logger to be used
     inline void set_logger(logger log_ptr) { m_logger = log_ptr; }
 
@@ -434,6 +504,51 @@ protected:
 
     /// Called after we have finished parsing the HTTP message headers
     virtual void finished_parsing_headers(const boost::system::error_code& ec) {}
+
+    /**
+     * parses an HTTP message of a type that is known at compile time
+     * (http::request or http::response); see parse()
+     *
+     * @param http_msg the HTTP message object to populate from parsing
+     * @param ec error_code contains additional information for parsing errors
+     *
+     * @return boost::tribool result of parsing
+     */
+    template <typename MessageType>
+    boost::tribool parse_message(MessageType& http_msg, boost::system::error_code& ec);
+
+    /**
+     * parses the headers of an HTTP message of a type that is known at
+     * compile time (http::request or http::response); see parse_headers()
+     *
+     * @param http_msg the HTTP message object to populate from parsing
+     * @param ec error_code contains additional information for parsing errors
+     *
+     * @return boost::tribool result of parsing
+     */
+    template <typename MessageType>
+    boost::tribool parse_message_headers(MessageType& http_msg, boost::system::error_code& ec);
+
+    /**
+     * prepares to parse the payload content of an HTTP message of a type
+     * that is known at compile time; see finish_header_parsing()
+     *
+     * @param http_msg the HTTP message object to populate from parsing
+     * @param ec error_code contains additional information for parsing errors
+     *
+     * @return boost::tribool result of parsing
+     */
+    template <typename MessageType>
+    boost::tribool finish_message_headers(MessageType& http_msg, boost::system::error_code& ec);
+
+    /**
+     * finishes parsing an HTTP message of a type that is known at compile
+     * time; see finish()
+     *
+     * @param http_msg the HTTP message object to finish
+     */
+    template <typename MessageType>
+    void finish_message(MessageType& http_msg) const;
     
     /**
      * parses an HTTP message up to the end of the headers using bytes 
@@ -450,16 +565,55 @@ protected:
     boost::tribool parse_headers(http::message& http_msg, boost::system::error_code& ec);
 
     /**
-     * updates an http::message object with data obtained from parsing headers
+     * scans forward over a run of characters that are valid within the name
+     * of an HTTP header (uses SSE2/AVX2 when supported by the processor)
      *
-     * @param http_msg the HTTP message object to populate from parsing
+     * @param ptr points to the first character to scan
+     * @param end_ptr points to the end of the buffer (last byte + 1)
+     *
+     * @return const char* points to the first character that is not valid
+     *                     within a header name, or end_ptr if there is none
+     */
+    static const char *scan_header_name(const char *ptr, const char *end_ptr);
+
+    /**
+     * scans forward over a run of characters that are valid within the value
+     * of an HTTP header (uses SSE2/AVX2 when supported by the processor)
+     *
+     * @param ptr points to the first character to scan
+     * @param end_ptr points to the end of the buffer (last byte + 1)
+     *
+     * @return const char* points to the first CR, LF or other control character
+     *                     (except for tab), or end_ptr if there is none
+     */
+    static const char *scan_header_value(const char *ptr, const char *end_ptr);
+
+    /**
+     * copies token views that refer to the read buffer into the message's
+     * token buffer (called before the read buffer is reused)
+     *
+     * @param http_msg the HTTP message object being parsed
+     */
+    void relocate_token_views(http::message& http_msg);
+
+    /**
+     * updates an http::request object with data obtained from parsing headers
+     *
+     * @param http_request the HTTP request object to populate from parsing
+     */
+    void update_message_with_header_data(http::request& http_request) const;
+
+    /**
+     * updates an http::response object with data obtained from parsing headers
+     *
+     * @param http_response the HTTP response object to populate from parsing
      */
-    void update_message_with_header_data(http::message& http_msg) const;
+    void update_message_with_header_data(http::response& http_response) const;
 
     /**
      * parses a chunked HTTP message-body using bytes available in the read buffer
      *
-     * @param chunk_buffers buffers to be populated from parsing chunked content
+     * @param http_msg the HTTP message object to populate with chunked content
      * @param ec error_code contains additional information for parsing errors
      *
      * @return boost::tribool result of parsing:
@@ -467,7 +621,7 @@ protected:
      *                        true = finished parsing message,
      *                        indeterminate = message is not yet finished
      */
-    boost::tribool parse_chunks(http::message::chunk_cache_t& chunk_buffers,
+    boost::tribool parse_chunks(http::message& http_msg,
         boost::system::error_code& ec);
 
     /**
@@ -488,10 +642,20 @@ protected:
      * consume the bytes available in the read buffer, converting them into
      * the next chunk for the HTTP message
      *
-     * @param chunk_buffers buffers to be populated from parsing chunked content
+     * @param http_msg the HTTP message object to populate with content
      * @return std::size_t number of content bytes consumed, if any
      */
-    std::size_t consume_content_as_next_chunk(http::message::chunk_cache_t& chunk_buffers);
+    std::size_t consume_content_as_next_chunk(http::message& http_msg);
+
+    /**
+     * consumes payload content that is missing, either by reporting it to the
+     * missing data handler or by using dummy content in its place
+     *
+     * @param http_msg the HTTP message object to populate with content
+     * @param len the length in bytes of the missing data
+     * @param has_length true if the content length is known (not chunked or until EOF)
+     */
+    void consume_missing_content(http::message& http_msg, std::size_t len, bool has_length);
 
     /**
      * compute and sets a HTTP Message data integrity status
@@ -560,6 +724,9 @@ protected:
     /// true if the message is an HTTP request; false if it is an HTTP response
     const bool                          m_is_request;
 
+    /// points to the first character in the read_buffer
+    const char *                        m_read_start_ptr;
+
     /// points to the next character to be consumed in the read_buffer
     const char *                        m_read_ptr;
 
@@ -569,6 +736,88 @@ protected:
 
 private:
 
+    /// returns true if the parser is in the middle of a token (method, URI, header name or value)
+    inline bool is_parsing_token(void) const {
+        return (m_message_parse_state == PARSE_HEADERS
+            && (m_headers_parse_state == PARSE_METHOD
+                || m_headers_parse_state == PARSE_URI_STEM
+                || m_headers_parse_state == PARSE_URI_QUERY
+                || m_headers_parse_state == PARSE_HEADER_NAME
+                || m_headers_parse_state == PARSE_HEADER_VALUE));
+    }
+
+    /// starts a new token at ptr
+    inline void start_token(const char *ptr) {
+        m_token_ptr = ptr;
+        m_token_head = token_view();
+    }
+
+    /// returns the number of characters parsed so far for the current token
+    inline std::size_t get_token_size(const std::string& str) const {
+        return (m_token_views ? m_token_head.size() + (m_read_ptr - m_token_ptr) : str.size());
+    }
+
+    /// sets view to the current token, ending at m_read_ptr (token view mode only)
+    inline void finish_token(http::message& http_msg, token_view& view) {
+        if (m_token_views) {
+            view = (m_token_head.empty() ? token_view(m_token_ptr, m_read_ptr - m_token_ptr)
+                : http_msg.get_token_buffer().extend(m_token_head, m_token_ptr, m_read_ptr - m_token_ptr));
+        }
+    }
+
+    /// appends chunked (or until EOF) payload content to the message, up to
+    /// the maximum content length
+    inline void append_chunk(http::message& http_msg, const char *ptr, std::size_t len) {
+        if (m_form_decoder.is_attached()) {
+            if (m_form_decoder.get_bytes_parsed() < m_max_content_length)
+                m_form_decoder.parse(ptr, std::min(len, m_max_content_length - m_form_decoder.get_bytes_parsed()));
+        } else if (m_segmented_content) {
+            content_blocks& blocks = http_msg.get_content_blocks();
+            if (blocks.size() < m_max_content_length)
+                blocks.append(ptr, std::min(len, m_max_content_length - blocks.size()));
+        } else {
+            http::message::chunk_cache_t& chunks = http_msg.get_chunk_cache();
+            if (chunks.size() < m_max_content_length)
+                chunks.append(ptr, std::min(len, m_max_content_length - chunks.size()));
+        }
+    }
+
+    /// stores payload content with a known length in the message (at offset
+    /// m_bytes_content_read), or decodes it if it is url-encoded form data
+    inline void append_content(http::message& http_msg, const char *ptr, std::size_t len) {
+        if (m_form_decoder.is_attached()) {
+            m_form_decoder.parse(ptr, len);
+        } else if (m_segmented_content) {
+            http_msg.get_content_blocks().append(ptr, len);
+        } else {
+            memcpy(http_msg.get_content() + m_bytes_content_read, ptr, len);
+        }
+    }
+
+    /// starts decoding url-encoded form data if it is streamed (see set_stream_form_data())
+    void start_form_decoding(http::request& http_request);
+
+    /// responses do not have form data
+    inline void start_form_decoding(http::response& http_response) {}
+
+    /// parses query pairs from the form data in a request's payload content
+    void finish_form_data(http::request& http_request) const;
+
+    /// responses do not have form data
+    inline void finish_form_data(http::response& http_response) const {}
+
+    /// adds the HTTP header that has just been parsed to the message
+    inline void add_header(http::message& http_msg) {
+        if (m_token_views) {
+            token_view header_value_view;
+            finish_token(http_msg, header_value_view);
+            http_msg.add_header_view(m_header_id, m_header_name_view, header_value_view);
+        } else {
+            http_msg.add_header(m_header_id, m_header_name, m_header_value);
+        }
+    }
+
+
     /// state used to keep track of where we are in parsing the HTTP message
     enum message_parse_state_t {
         PARSE_START, PARSE_HEADERS, PARSE_CONTENT,
@@ -614,6 +863,9 @@ private:
     /// if defined, this function is used to consume payload content
     payload_handler_t                   m_payload_handler;
 
+    /// if defined, this function is used to report missing payload content
+    missing_data_handler_t              m_missing_data_handler;
+
     /// Used for parsing the HTTP response status code
     boost::uint16_t                     m_status_code;
 
@@ -638,6 +890,9 @@ private:
     /// Used for parsing the value of HTTP headers
     std::string                         m_header_value;
 
+    /// identifier of the HTTP header being parsed, if it is a common header
+    http::types::header_id_t            m_header_id;
+
     /// Used for parsing the chunk size
     std::string                         m_chunk_size_str;
 
@@ -668,6 +923,36 @@ private:
     /// if true, the raw contents of HTTP headers are stored into m_raw_headers
     bool                                m_save_raw_headers;
 
+    /// if true, tokens are parsed as views of the read buffer (see set_token_views())
+    bool                                m_token_views;
+
+    /// if true, payload content is stored in content blocks (see set_segmented_content())
+    bool                                m_segmented_content;
+
+    /// if true, url-encoded form data is decoded as it arrives (see set_stream_form_data())
+    bool                                m_stream_form_data;
+
+    /// decodes streamed url-encoded form data into the request's query parameters
+    mutable url_encoded_parser          m_form_decoder;
+
+    /// points to the start of the token being parsed within the read buffer
+    const char *                        m_token_ptr;
+
+    /// part of the token being parsed that was copied from previous read buffers
+    token_view                          m_token_head;
+
+    /// view of the request method (token view mode only)
+    token_view                          m_method_view;
+
+    /// view of the resource requested (token view mode only)
+    token_view                          m_resource_view;
+
+    /// view of the query string portion of a URI (token view mode only)
+    token_view                          m_query_string_view;
+
+    /// view of the name of the HTTP header being parsed (token view mode only)
+    token_view                          m_header_name_view;
+
     /// points to a single and unique instance of the parser error_category_t
     static error_category_t *           m_error_category_ptr;
         
@@ -718,6 +1003,61 @@ inline bool parser::is_cookie_attribute(const std::string& name, bool set_cookie
         ) );
 }
 
+
+///
+/// basic_parser: parses HTTP messages of a type that is known at compile
+/// time (http::request or http::response).  Unlike parser, it does not
+/// check the type of message being parsed while parsing.
+///
+template <typename MessageType>
+class basic_parser :
+    public http::parser
+{
+public:
+
+    /**
+     * creates new basic_parser objects
+     *
+     * @param max_content_length maximum length for HTTP payload content
+     */
+    explicit basic_parser(std::size_t max_content_length = DEFAULT_CONTENT_MAX)
+        : http::parser(boost::is_same<MessageType, http::request>::value, max_content_length)
+    {}
+
+    /// default destructor
+    virtual ~basic_parser() {}
+
+    /**
+     * parses an HTTP message including all payload content it might contain
+     *
+     * @param http_msg the HTTP message object to populate from parsing
+     * @param ec error_code contains additional information for parsing errors
+     *
+     * @return boost::tribool result of parsing:
+     *                        false = message has an error,
+     *                        true = finished parsing HTTP message,
+     *                        indeterminate = not yet finished parsing HTTP message
+     */
+    inline boost::tribool parse(MessageType& http_msg, boost::system::error_code& ec) {
+        return parse_message(http_msg, ec);
+    }
+
+    /**
+     * finishes parsing an HTTP message
+     *
+     * @param http_msg the HTTP message object to finish
+     */
+    inline void finish(MessageType& http_msg) const { finish_message(http_msg); }
+};
+
+
+/// parser for HTTP requests
+typedef basic_parser<http::request>     request_parser;
+
+/// parser for HTTP responses
+typedef basic_parser<http::response>    response_parser;
+
+
 }   // end namespace http
 }   // end namespace pion
 
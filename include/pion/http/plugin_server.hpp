@@ -138,6 +138,8 @@ protected:
     virtual void before_starting(void) {
         // call the start() method for each web service associated with this server
         m_services.run(boost::bind(&http::plugin_service::start, _1));
+        // only services that stream request content get payload handlers
+        m_services.run(boost::bind(&plugin_server::update_payload_handler, this, _1));
     }
     
     /// called after the TCP server has stopped listening for new connections
@@ -149,6 +151,12 @@ protected:
     
 private:
     
+    /// adds a payload handler for a web service if it has one, or removes it
+    /// (see http::plugin_service::has_payload_handler()); connections that
+    /// are already open only use payload handlers if the server had some
+    /// when they were accepted
+    void update_payload_handler(http::plugin_service *service_ptr);
+    
     /// data type for a collection of web services
     typedef plugin_manager<http::plugin_service>   service_manager_t;
     
@@ -16,6 +16,7 @@
 #include <pion/error.hpp>
 #include <pion/algorithm.hpp>
 #include <pion/http/request.hpp>
+#include <pion/http/parser.hpp>
 #include <pion/tcp/connection.hpp>
 
 
@@ -44,6 +45,25 @@ public:
      * @param tcp_conn the TCP connection that has the new request
      */
     virtual void operator()(http::request_ptr& http_request_ptr, tcp::connection_ptr& tcp_conn) = 0;
+
+    /**
+     * returns a handler for the payload content of a new HTTP request, which
+     * is called with each part of the content as it arrives (the content is
+     * then not stored in the request); called after the request's headers
+     * have been parsed, and returns an empty handler by default
+     *
+     * @param http_request_ptr the new HTTP request (without its content)
+     * @param tcp_conn the TCP connection that has the new request
+     */
+    virtual http::parser::payload_handler_t get_payload_handler(http::request_ptr& http_request_ptr,
+                                                                tcp::connection_ptr& tcp_conn)
+    {
+        return http::parser::payload_handler_t();
+    }
+
+    /// returns true if get_payload_handler() may return handlers; the server
+    /// only calls it for services that return true when it starts (false by default)
+    virtual bool has_payload_handler(void) const { return false; }
     
     /**
      * sets a configuration option
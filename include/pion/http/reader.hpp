@@ -56,6 +56,9 @@ protected:
         : http::parser(is_request), m_tcp_conn(tcp_conn),
         m_read_timeout(DEFAULT_READ_TIMEOUT)
         {}  
+
+    /// sets the TCP connection that has a new HTTP message to parse
+    inline void set_connection(tcp::connection_ptr& tcp_conn) { m_tcp_conn = tcp_conn; }
     
     /**
      * Consumes bytes that have been read using an HTTP parser
@@ -78,6 +81,17 @@ protected:
     /// Returns a reference to the HTTP message being parsed
     virtual http::message& get_message(void) = 0;
 
+    /**
+     * Parses the bytes available in the read buffer into the HTTP message
+     * (derived classes use the parsing functions specialized for their
+     * type of message)
+     *
+     * @param ec error_code contains additional information for parsing errors
+     *
+     * @return boost::tribool result of parsing
+     */
+    virtual boost::tribool parse_read_buffer(boost::system::error_code& ec) = 0;
+
 
 private:
 
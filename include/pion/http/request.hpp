@@ -34,10 +34,26 @@ public:
      * @param resource the HTTP resource to request
      */
     request(const std::string& resource)
-        : m_method(REQUEST_METHOD_GET), m_resource(resource) {}
+        : m_method(REQUEST_METHOD_GET), m_resource(resource),
+        m_has_request_line_views(false) {}
     
     /// constructs a new request object (default constructor)
-    request(void) : m_method(REQUEST_METHOD_GET) {}
+    request(void) : m_method(REQUEST_METHOD_GET), m_has_request_line_views(false) {}
+
+    /// copy constructor
+    request(const request& http_request)
+        : http::message(http_request), m_has_request_line_views(false)
+    {
+        copy_request_data(http_request);
+    }
+
+    /// assignment operator
+    inline request& operator=(const request& http_request) {
+        http::message::operator=(http_request);
+        m_has_request_line_views = false;
+        copy_request_data(http_request);
+        return *this;
+    }
     
     /// virtual destructor
     virtual ~request() {}
@@ -51,22 +67,99 @@ public:
         m_query_string.erase();
         m_query_params.clear();
         m_user_record.reset();
+        m_has_request_line_views = false;
     }
 
     /// the content length of the message can never be implied for requests
     virtual bool is_content_length_implied(void) const { return false; }
 
     /// returns the request method (i.e. GET, POST, PUT)
-    inline const std::string& get_method(void) const { return m_method; }
+    inline const std::string& get_method(void) {
+        sync_request_line_views();
+        return m_method;
+    }
+
+    /// returns a copy of the request method (does not change the request)
+    inline std::string get_method(void) const { return get_method_view().str(); }
     
     /// returns the resource uri-stem to be delivered (possibly the result of a redirect)
-    inline const std::string& get_resource(void) const { return m_resource; }
+    inline const std::string& get_resource(void) {
+        sync_request_line_views();
+        return m_resource;
+    }
+
+    /// returns a copy of the resource uri-stem to be delivered (does not change the request)
+    inline std::string get_resource(void) const { return get_resource_view().str(); }
 
     /// returns the resource uri-stem originally requested
-    inline const std::string& get_original_resource(void) const { return m_original_resource; }
+    inline const std::string& get_original_resource(void) {
+        sync_request_line_views();
+        return m_original_resource;
+    }
+
+    /// returns a copy of the resource uri-stem originally requested (does not change the request)
+    inline std::string get_original_resource(void) const {
+        // until a redirect changes it, the resource is the one originally requested
+        return (m_has_request_line_views ? m_resource_view.str() : m_original_resource);
+    }
 
     /// returns the uri-query or query string requested
-    inline const std::string& get_query_string(void) const { return m_query_string; }
+    inline const std::string& get_query_string(void) {
+        sync_request_line_views();
+        return m_query_string;
+    }
+
+    /// returns a copy of the uri-query or query string requested (does not change the request)
+    inline std::string get_query_string(void) const { return get_query_string_view().str(); }
+
+    /// returns a view of the request method (does not copy token views into strings)
+    inline token_view get_method_view(void) const {
+        return (m_has_request_line_views ? m_method_view : token_view(m_method));
+    }
+
+    /// returns a view of the resource uri-stem (does not copy token views into strings)
+    inline token_view get_resource_view(void) const {
+        return (m_has_request_line_views ? m_resource_view : token_view(m_resource));
+    }
+
+    /// returns a view of the query string (does not copy token views into strings)
+    inline token_view get_query_string_view(void) const {
+        return (m_has_request_line_views ? m_query_string_view : token_view(m_query_string));
+    }
+
+    /**
+     * sets the request method, resource and query string using views; the
+     * views must remain valid until they are relocated or copied into strings
+     *
+     * @param method view of the HTTP request method
+     * @param resource view of the resource or uri-stem requested
+     * @param query_string view of the uri-query or query string requested
+     */
+    inline void set_request_line_views(const token_view& method, const token_view& resource,
+                                       const token_view& query_string)
+    {
+        m_method_view = method;
+        m_resource_view = resource;
+        m_query_string_view = query_string;
+        m_has_request_line_views = true;
+        clear_first_line();
+    }
+
+    /// copies token views that refer to memory in [begin_ptr, end_ptr) into the token buffer
+    virtual void relocate_token_views(const char *begin_ptr, const char *end_ptr) {
+        if (m_has_request_line_views) {
+            get_token_buffer().relocate(m_method_view, begin_ptr, end_ptr);
+            get_token_buffer().relocate(m_resource_view, begin_ptr, end_ptr);
+            get_token_buffer().relocate(m_query_string_view, begin_ptr, end_ptr);
+        }
+        http::message::relocate_token_views(begin_ptr, end_ptr);
+    }
+
+    /// copies all token views into strings
+    virtual void detach_token_views(void) {
+        sync_request_line_views();
+        http::message::detach_token_views();
+    }
     
     /// returns a value for the query key if any are defined; otherwise, an empty string
     inline const std::string& get_query(const std::string& key) const {
@@ -85,21 +178,27 @@ public:
         
     /// sets the HTTP request method (i.e. GET, POST, PUT)
     inline void set_method(const std::string& str) { 
+        sync_request_line_views();
         m_method = str;
         clear_first_line();
     }
     
     /// sets the resource or uri-stem originally requested
     inline void set_resource(const std::string& str) {
+        sync_request_line_views();
         m_resource = m_original_resource = str;
         clear_first_line();
     }
 
     /// changes the resource or uri-stem to be delivered (called as the result of a redirect)
-    inline void change_resource(const std::string& str) { m_resource = str; }
+    inline void change_resource(const std::string& str) {
+        sync_request_line_views();
+        m_resource = str;
+    }
 
     /// sets the uri-query or query string requested
     inline void set_query_string(const std::string& str) {
+        sync_request_line_views();
         m_query_string = str;
         clear_first_line();
     }
@@ -154,15 +253,19 @@ protected:
 
     /// updates the string containing the first line for the HTTP message
     virtual void update_first_line(void) const {
+        // read the views, so that the request line is not changed
+        const token_view method(get_method_view());
+        const token_view resource(get_resource_view());
+        const token_view query_string(get_query_string_view());
         // start out with the request method
-        m_first_line = m_method;
+        m_first_line.assign(method.data(), method.size());
         m_first_line += ' ';
         // append the resource requested
-        m_first_line += m_resource;
-        if (! m_query_string.empty()) {
+        m_first_line.append(resource.data(), resource.size());
+        if (! query_string.empty()) {
             // append query string if not empty
             m_first_line += '?';
-            m_first_line += m_query_string;
+            m_first_line.append(query_string.data(), query_string.size());
         }
         m_first_line += ' ';
         // append HTTP version
@@ -172,6 +275,28 @@ protected:
     
 private:
 
+    /// copies the request line views into strings
+    inline void sync_request_line_views(void) {
+        if (m_has_request_line_views) {
+            m_method = m_method_view.str();
+            m_resource = m_original_resource = m_resource_view.str();
+            m_query_string = m_query_string_view.str();
+            m_has_request_line_views = false;
+        }
+    }
+
+    /// copies the request data from another request (used by copy constructor and assignment)
+    inline void copy_request_data(const request& http_request) {
+        // the views of the other request are copied without changing it
+        m_method = http_request.get_method();
+        m_resource = http_request.get_resource();
+        m_original_resource = http_request.get_original_resource();
+        m_query_string = http_request.get_query_string();
+        m_query_params = http_request.m_query_params;
+        m_user_record = http_request.m_user_record;
+    }
+
+
     /// request method (GET, POST, PUT, etc.)
     std::string                     m_method;
 
@@ -183,6 +308,18 @@ private:
 
     /// query string portion of the URI
     std::string                     m_query_string;
+
+    /// view of the request method (token view parse mode)
+    token_view                      m_method_view;
+
+    /// view of the resource or uri-stem requested (token view parse mode)
+    token_view                      m_resource_view;
+
+    /// view of the query string portion of the URI (token view parse mode)
+    token_view                      m_query_string_view;
+
+    /// true if the request line is held by views that are not yet copied into strings
+    bool                            m_has_request_line_views;
     
     /// HTTP query parameters parsed from the request line and post content
     ihash_multimap                  m_query_params;
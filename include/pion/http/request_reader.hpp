@@ -58,6 +58,23 @@ public:
     
     /// sets a function to be called after HTTP headers have been parsed
     inline void set_headers_parsed_callback(finished_handler_t& h) { m_parsed_headers = h; }
+
+    /**
+     * prepares the reader to read the next request received over a
+     * connection.  The request is cleared and reused (keeping the memory
+     * allocated for it) unless something else still refers to it.
+     *
+     * @param tcp_conn TCP connection containing a new message to parse
+     */
+    inline void recycle(tcp::connection_ptr& tcp_conn) {
+        reset();
+        set_connection(tcp_conn);
+        if (m_http_msg.unique())
+            m_http_msg->clear();
+        else
+            m_http_msg.reset(new http::request);
+        m_http_msg->set_remote_ip(tcp_conn->get_remote_ip());
+    }
     
     
 protected:
@@ -92,13 +109,22 @@ protected:
     
     /// Called after we have finished reading/parsing the HTTP message
     virtual void finished_reading(const boost::system::error_code& ec) {
+        // the reader no longer needs the connection, which may keep the
+        // reader for its next request (see connection_objects)
+        tcp::connection_ptr tcp_conn;
+        tcp_conn.swap(get_connection());
         // call the finished handler with the finished HTTP message
-        if (m_finished) m_finished(m_http_msg, get_connection(), ec);
+        if (m_finished) m_finished(m_http_msg, tcp_conn, ec);
     }
     
     /// Returns a reference to the HTTP message being parsed
     virtual http::message& get_message(void) { return *m_http_msg; }
 
+    /// Parses the read buffer using the parsing functions specialized for requests
+    virtual boost::tribool parse_read_buffer(boost::system::error_code& ec) {
+        return parse_message(*m_http_msg, ec);
+    }
+
     /// The new HTTP message container being created
     http::request_ptr              m_http_msg;
 
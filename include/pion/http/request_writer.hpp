@@ -100,7 +100,9 @@ protected:
         set_logger(PION_GET_LOGGER("pion.http.request_writer"));
         // check if we should initialize the payload content using
         // the request's content buffer
-        if (m_http_request->get_content_length() > 0
+        if (m_http_request->has_content_blocks()) {
+            write_no_copy(m_http_request->get_content_blocks());
+        } else if (m_http_request->get_content_length() > 0
             && m_http_request->get_content() != NULL
             && m_http_request->get_content()[0] != '\0')
         {
@@ -119,15 +121,14 @@ protected:
         if (get_content_length() > 0)
             m_http_request->set_content_length(get_content_length());
         m_http_request->prepare_buffers_for_send(write_buffers,
+                                              get_header_buffer(),
                                               get_connection()->get_keep_alive(),
                                               sending_chunked_message());
     }
 
     /// returns a function bound to http::writer::handle_write()
     virtual write_handler_t bind_to_write_handler(void) {
-        return boost::bind(&request_writer::handle_write, shared_from_this(),
-                           boost::asio::placeholders::error,
-                           boost::asio::placeholders::bytes_transferred);
+        return write_handler_caller(shared_from_this());
     }
 
     /**
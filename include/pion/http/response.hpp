@@ -93,7 +93,8 @@ public:
      * @param http_request the request that this is responding to
      */
     inline void update_request_info(const http::request& http_request) {
-        m_request_method = http_request.get_method();
+        const token_view method(http_request.get_method_view());
+        m_request_method.assign(method.data(), method.size());
         if (http_request.get_version_major() == 1 && http_request.get_version_minor() >= 1)
             set_chunks_supported(true);
     }
@@ -195,6 +196,13 @@ protected:
     
     /// updates the string containing the first line for the HTTP message
     virtual void update_first_line(void) const {
+        // use the pre-encoded status line if there is one (without its CRLF)
+        const std::string *status_line = find_status_line(get_version_major(),
+            get_version_minor(), m_status_code, m_status_message);
+        if (status_line) {
+            m_first_line.assign(*status_line, 0, status_line->size() - STRING_CRLF.size());
+            return;
+        }
         // start out with the HTTP version
         m_first_line = get_version_string();
         m_first_line += ' ';
@@ -204,6 +212,18 @@ protected:
         // append the response status message
         m_first_line += m_status_message;
     }
+
+    /// appends the first line for the HTTP message and a CRLF to a buffer
+    virtual void append_first_line(std::string& buf) const {
+        const std::string *status_line = find_status_line(get_version_major(),
+            get_version_minor(), m_status_code, m_status_message);
+        if (status_line) {
+            buf += *status_line;
+        } else {
+            buf += get_first_line();
+            buf += STRING_CRLF;
+        }
+    }
     
     
 private:
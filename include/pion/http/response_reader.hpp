@@ -103,6 +103,11 @@ protected:
     /// Returns a reference to the HTTP message being parsed
     virtual http::message& get_message(void) { return *m_http_msg; }
 
+    /// Parses the read buffer using the parsing functions specialized for responses
+    virtual boost::tribool parse_read_buffer(boost::system::error_code& ec) {
+        return parse_message(*m_http_msg, ec);
+    }
+
     
     /// The new HTTP message container being created
     http::response_ptr             m_http_msg;
@@ -17,6 +17,7 @@
 #include <boost/enable_shared_from_this.hpp>
 #include <pion/config.hpp>
 #include <pion/http/writer.hpp>
+#include <pion/http/connection_objects.hpp>
 #include <pion/http/request.hpp>
 #include <pion/http/response.hpp>
 
@@ -68,7 +69,17 @@ public:
                                                                const http::request& http_request,
                                                                finished_handler_t handler = finished_handler_t())
     {
-        return boost::shared_ptr<response_writer>(new response_writer(tcp_conn, http_request, handler));
+        // reuse the writer kept by the connection, if nothing else refers to it
+        connection_objects *objects_ptr = connection_objects::get(*tcp_conn);
+        if (objects_ptr == NULL)
+            return boost::shared_ptr<response_writer>(new response_writer(tcp_conn, http_request, handler));
+        if (objects_ptr->m_writer && objects_ptr->m_writer.unique()) {
+            objects_ptr->m_writer->recycle(tcp_conn, http_request, handler);
+        } else {
+            objects_ptr->m_writer.reset(new response_writer(tcp_conn, http_request, handler));
+            objects_ptr->m_writer->m_kept_by_connection = true;
+        }
+        return objects_ptr->m_writer;
     }
     
     /// returns a non-const reference to the response that will be sent
@@ -86,14 +97,17 @@ protected:
      */
     response_writer(tcp::connection_ptr& tcp_conn, http::response_ptr& http_response_ptr,
                        finished_handler_t handler)
-        : http::writer(tcp_conn, handler), m_http_response(http_response_ptr)
+        : http::writer(tcp_conn, handler), m_http_response(http_response_ptr),
+        m_kept_by_connection(false)
     {
         set_logger(PION_GET_LOGGER("pion.http.response_writer"));
         // tell the http::writer base class whether or not the client supports chunks
         supports_chunked_messages(m_http_response->get_chunks_supported());
         // check if we should initialize the payload content using
         // the response's content buffer
-        if (m_http_response->get_content_length() > 0
+        if (m_http_response->has_content_blocks()) {
+            write_no_copy(m_http_response->get_content_blocks());
+        } else if (m_http_response->get_content_length() > 0
             && m_http_response->get_content() != NULL
             && m_http_response->get_content()[0] != '\0')
         {
@@ -110,32 +124,58 @@ protected:
      */
     response_writer(tcp::connection_ptr& tcp_conn, const http::request& http_request,
                        finished_handler_t handler)
-        : http::writer(tcp_conn, handler), m_http_response(new http::response(http_request))
+        : http::writer(tcp_conn, handler), m_http_response(new http::response(http_request)),
+        m_kept_by_connection(false)
     {
         set_logger(PION_GET_LOGGER("pion.http.response_writer"));
         // tell the http::writer base class whether or not the client supports chunks
         supports_chunked_messages(m_http_response->get_chunks_supported());
     }
     
+    /**
+     * prepares a writer kept by a connection to send the response to
+     * another request; the response is cleared and reused unless something
+     * else still refers to it
+     * 
+     * @param tcp_conn TCP connection used to send the response
+     * @param http_request the request we are responding to
+     * @param handler function called after the request has been sent
+     */
+    inline void recycle(tcp::connection_ptr& tcp_conn, const http::request& http_request,
+                        finished_handler_t& handler)
+    {
+        http::writer::recycle(tcp_conn, handler);
+        if (m_http_response.unique()) {
+            m_http_response->clear();
+            m_http_response->update_request_info(http_request);
+        } else {
+            m_http_response.reset(new http::response(http_request));
+        }
+        supports_chunked_messages(m_http_response->get_chunks_supported());
+    }
+    
     
     /**
      * initializes a vector of write buffers with the HTTP message information
+     * (a Date header is added if the response does not have one)
      *
      * @param write_buffers vector of write buffers to initialize
      */
     virtual void prepare_buffers_for_send(http::message::write_buffers_t& write_buffers) {
         if (get_content_length() > 0)
             m_http_response->set_content_length(get_content_length());
+        if (! m_http_response->has_header(http::types::HEADER_ID_DATE))
+            m_http_response->add_header(http::types::HEADER_ID_DATE, http::types::HEADER_DATE,
+                                        http::types::get_current_date_string());
         m_http_response->prepare_buffers_for_send(write_buffers,
+                                               get_header_buffer(),
                                                get_connection()->get_keep_alive(),
                                                sending_chunked_message());
     }   
 
     /// returns a function bound to http::writer::handle_write()
     virtual write_handler_t bind_to_write_handler(void) {
-        return boost::bind(&response_writer::handle_write, shared_from_this(),
-                           boost::asio::placeholders::error,
-                           boost::asio::placeholders::bytes_transferred);
+        return write_handler_caller(shared_from_this());
     }
 
     /**
@@ -158,6 +198,10 @@ protected:
             }
         }
         finished_writing(write_error);
+        // the response is complete: a writer kept by the connection must not
+        // refer back to it
+        if (m_kept_by_connection)
+            release();
     }
 
     
@@ -168,6 +212,9 @@ private:
     
     /// the initial HTTP response header line
     std::string             m_response_line;
+
+    /// true if the writer is kept by its connection (see connection_objects)
+    bool                    m_kept_by_connection;
 };
 
 
@@ -30,6 +30,9 @@ namespace pion {    // begin namespace pion
 namespace http {    // begin namespace http
 
 
+class request_reader;
+
+
 ///
 /// server: a server that handles HTTP connections
 ///
@@ -46,6 +49,12 @@ public:
     typedef boost::function3<void, http::request_ptr&, tcp::connection_ptr&,
         const std::string&> error_handler_t;
 
+    /// type of function that returns a handler for the payload content of a
+    /// request, which is called after its headers have been parsed (if the
+    /// handler returned is empty, the content is stored in the request)
+    typedef boost::function2<http::parser::payload_handler_t, http::request_ptr&,
+        tcp::connection_ptr&>   payload_handler_factory_t;
+
 
     /// default destructor
     virtual ~server() { if (is_listening()) stop(); }
@@ -60,7 +69,11 @@ public:
         m_bad_request_handler(server::handle_bad_request),
         m_not_found_handler(server::handle_not_found_request),
         m_server_error_handler(server::handle_server_error),
-        m_max_content_length(http::parser::DEFAULT_CONTENT_MAX)
+        m_max_content_length(http::parser::DEFAULT_CONTENT_MAX),
+        m_token_views(false),
+        m_segmented_content(false),
+        m_stream_form_data(false),
+        m_recycle_objects(false)
     { 
         set_logger(PION_GET_LOGGER("pion.http.server"));
     }
@@ -75,7 +88,11 @@ public:
         m_bad_request_handler(server::handle_bad_request),
         m_not_found_handler(server::handle_not_found_request),
         m_server_error_handler(server::handle_server_error),
-        m_max_content_length(http::parser::DEFAULT_CONTENT_MAX)
+        m_max_content_length(http::parser::DEFAULT_CONTENT_MAX),
+        m_token_views(false),
+        m_segmented_content(false),
+        m_stream_form_data(false),
+        m_recycle_objects(false)
     { 
         set_logger(PION_GET_LOGGER("pion.http.server"));
     }
@@ -91,7 +108,11 @@ public:
         m_bad_request_handler(server::handle_bad_request),
         m_not_found_handler(server::handle_not_found_request),
         m_server_error_handler(server::handle_server_error),
-        m_max_content_length(http::parser::DEFAULT_CONTENT_MAX)
+        m_max_content_length(http::parser::DEFAULT_CONTENT_MAX),
+        m_token_views(false),
+        m_segmented_content(false),
+        m_stream_form_data(false),
+        m_recycle_objects(false)
     { 
         set_logger(PION_GET_LOGGER("pion.http.server"));
     }
@@ -107,7 +128,11 @@ public:
         m_bad_request_handler(server::handle_bad_request),
         m_not_found_handler(server::handle_not_found_request),
         m_server_error_handler(server::handle_server_error),
-        m_max_content_length(http::parser::DEFAULT_CONTENT_MAX)
+        m_max_content_length(http::parser::DEFAULT_CONTENT_MAX),
+        m_token_views(false),
+        m_segmented_content(false),
+        m_stream_form_data(false),
+        m_recycle_objects(false)
     { 
         set_logger(PION_GET_LOGGER("pion.http.server"));
     }
@@ -127,6 +152,22 @@ public:
      */
     void remove_resource(const std::string& resource);
 
+    /**
+     * adds a function that may stream the payload content of requests for
+     * a resource as it arrives, instead of storing it in the requests
+     *
+     * @param resource the resource name or uri-stem to bind to the function
+     * @param factory function that returns payload handlers for the resource
+     */
+    void add_payload_handler(const std::string& resource, payload_handler_factory_t factory);
+
+    /**
+     * removes the payload handler function for a resource
+     *
+     * @param resource the resource name or uri-stem to remove
+     */
+    void remove_payload_handler(const std::string& resource);
+
     /**
      * adds a new resource redirection to the HTTP server
      *
@@ -149,6 +190,7 @@ public:
         if (is_listening()) stop();
         boost::mutex::scoped_lock resource_lock(m_resource_mutex);
         m_resources.clear();
+        m_payload_handlers.clear();
     }
 
     /**
@@ -223,6 +265,26 @@ public:
     /// sets the maximum length for HTTP request payload content
     inline void set_max_content_length(std::size_t n) { m_max_content_length = n; }
 
+    /// parses requests in token view mode (see http::parser::set_token_views());
+    /// request handlers must call detach_token_views() on requests they keep
+    /// after the response has been sent.  Non-const accessors copy the views
+    /// into strings, so a request that is shared between threads must either
+    /// be detached first, or only be read through a const reference
+    inline void set_token_views(bool b = true) { m_token_views = b; }
+
+    /// stores request payload content in pooled blocks instead of a single
+    /// buffer (see http::parser::set_segmented_content())
+    inline void set_segmented_content(bool b = true) { m_segmented_content = b; }
+
+    /// decodes url-encoded request form data into query parameters as it
+    /// arrives (see http::parser::set_stream_form_data())
+    inline void set_stream_form_data(bool b = true) { m_stream_form_data = b; }
+
+    /// keeps a request reader and a response writer (with their request and
+    /// response) with each connection, and reuses them for each request
+    /// received while the connection is kept alive (see connection_objects)
+    inline void set_recycle_objects(bool b = true) { m_recycle_objects = b; }
+
 protected:
 
     /**
@@ -251,6 +313,29 @@ protected:
     virtual bool find_request_handler(const std::string& resource,
                                       request_handler_t& request_handler) const;
 
+    /**
+     * handles the headers of a new HTTP request, which may have a payload
+     * handler that streams its content (see add_payload_handler())
+     *
+     * @param http_request_ptr the HTTP request whose headers were parsed
+     * @param tcp_conn TCP connection containing the new request
+     * @param ec error_code contains additional information for parsing errors
+     * @param reader the reader that is parsing the request
+     */
+    void handle_request_headers(http::request_ptr& http_request_ptr,
+                                tcp::connection_ptr& tcp_conn,
+                                const boost::system::error_code& ec,
+                                request_reader *reader);
+
+    /**
+     * searches for the payload handler function to use for a given resource
+     *
+     * @param resource the name of the resource to search for
+     * @param factory function that returns payload handlers for this resource
+     */
+    bool find_payload_handler(const std::string& resource,
+                              payload_handler_factory_t& factory) const;
+
 
 private:
 
@@ -263,6 +348,9 @@ private:
     /// data type for a map of requested resources to other resources
     typedef std::map<std::string, std::string>          redirect_map_t;
 
+    /// data type for a map of resources to payload handler functions
+    typedef std::map<std::string, payload_handler_factory_t>    payload_handler_map_t;
+
 
     /// collection of resources that are recognized by this HTTP server
     resource_map_t              m_resources;
@@ -270,6 +358,9 @@ private:
     /// collection of redirections from a requested resource to another resource
     redirect_map_t              m_redirects;
 
+    /// collection of resources whose request content may be streamed
+    payload_handler_map_t       m_payload_handlers;
+
     /// points to a function that handles bad HTTP requests
     request_handler_t           m_bad_request_handler;
 
@@ -287,6 +378,18 @@ private:
 
     /// maximum length for HTTP request payload content
     std::size_t                 m_max_content_length;
+
+    /// if true, requests are parsed in token view mode
+    bool                        m_token_views;
+
+    /// if true, request payload content is stored in content blocks
+    bool                        m_segmented_content;
+
+    /// if true, url-encoded request form data is decoded as it arrives
+    bool                        m_stream_form_data;
+
+    /// if true, connections keep their readers and writers for reuse
+    bool                        m_recycle_objects;
 };
 
 
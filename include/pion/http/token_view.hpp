@@ -0,0 +1,224 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_HTTP_TOKEN_VIEW_HEADER__
+#define __PION_HTTP_TOKEN_VIEW_HEADER__
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include <boost/noncopyable.hpp>
+#include <pion/config.hpp>
+
+
+namespace pion {    // begin namespace pion
+namespace http {    // begin namespace http
+
+
+///
+/// token_view: refers to a sequence of characters owned by something else
+/// (i.e. a read buffer); the characters are not null-terminated
+///
+class token_view
+{
+public:
+
+    /// constructs an empty token view
+    token_view(void) : m_ptr(NULL), m_len(0) {}
+
+    /// constructs a view of len characters starting at ptr
+    token_view(const char *ptr, std::size_t len) : m_ptr(ptr), m_len(len) {}
+
+    /// constructs a view of a string's characters (valid until the string changes)
+    explicit token_view(const std::string& str) : m_ptr(str.data()), m_len(str.size()) {}
+
+    /// returns a pointer to the first character
+    inline const char *data(void) const { return m_ptr; }
+
+    /// returns the number of characters
+    inline std::size_t size(void) const { return m_len; }
+
+    /// returns true if the view is empty
+    inline bool empty(void) const { return m_len == 0; }
+
+    /// returns a copy of the characters as a string
+    inline std::string str(void) const {
+        return (m_len == 0 ? std::string() : std::string(m_ptr, m_len));
+    }
+
+    /// returns true if the view is equal to a string (case-sensitive)
+    inline bool equals(const std::string& str) const {
+        return (str.size() == m_len && (m_len == 0 || memcmp(str.data(), m_ptr, m_len) == 0));
+    }
+
+    /// returns true if the view is equal to a string (ASCII case-insensitive)
+    inline bool iequals(const std::string& str) const {
+        if (str.size() != m_len)
+            return false;
+        for (std::size_t n = 0; n < m_len; ++n) {
+            if (to_lower(m_ptr[n]) != to_lower(str[n]))
+                return false;
+        }
+        return true;
+    }
+
+    /// returns true if the view begins with a string (case-sensitive)
+    inline bool starts_with(const std::string& str) const {
+        return (str.size() <= m_len && (str.empty() || memcmp(str.data(), m_ptr, str.size()) == 0));
+    }
+
+    /// returns true if the view is equal to a string (case-sensitive)
+    inline bool operator==(const std::string& str) const { return equals(str); }
+
+    /// returns true if the view is not equal to a string (case-sensitive)
+    inline bool operator!=(const std::string& str) const { return ! equals(str); }
+
+
+private:
+
+    /// converts an ASCII character to lower case
+    static inline char to_lower(const char c) {
+        return ((c >= 'A' && c <= 'Z') ? static_cast<char>(c + ('a' - 'A')) : c);
+    }
+
+
+    /// points to the first character
+    const char *                    m_ptr;
+
+    /// number of characters
+    std::size_t                     m_len;
+};
+
+
+///
+/// token_buffer: storage for tokens that must outlive the buffer they were
+/// parsed from; memory is allocated in blocks that are never moved, so
+/// views of tokens stay valid until the token_buffer is cleared
+///
+class token_buffer :
+    private boost::noncopyable
+{
+public:
+
+    /// default size of the blocks allocated for storing tokens
+    enum { BLOCK_SIZE = 4096 };
+
+    /// constructs an empty token buffer
+    token_buffer(void) : m_used(0) {}
+
+    /// frees all blocks of memory
+    ~token_buffer() { release(0); }
+
+    /// frees all tokens (keeps the first block for reuse)
+    inline void clear(void) {
+        release(1);
+        m_used = 0;
+    }
+
+    /// returns true if no tokens are stored
+    inline bool empty(void) const { return m_blocks.empty() || (m_blocks.size() == 1 && m_used == 0); }
+
+    /**
+     * copies characters into the buffer
+     *
+     * @param ptr points to the characters to copy
+     * @param len number of characters to copy
+     *
+     * @return token_view view of the copied characters
+     */
+    inline token_view copy(const char *ptr, std::size_t len) {
+        return extend(token_view(), ptr, len);
+    }
+
+    /**
+     * appends characters to a token previously stored in the buffer, keeping
+     * the token contiguous (it is moved if it cannot grow in place)
+     *
+     * @param token the token to extend (must be stored in this buffer, or empty)
+     * @param ptr points to the characters to append
+     * @param len number of characters to append
+     *
+     * @return token_view view of the extended token
+     */
+    inline token_view extend(const token_view& token, const char *ptr, std::size_t len) {
+        char *dest;
+        if (! token.empty() && ! m_blocks.empty()
+            && token.data() + token.size() == m_blocks.back().ptr + m_used
+            && m_used + len <= m_blocks.back().size)
+        {
+            // the token is the last one in the current block and it fits
+            dest = m_blocks.back().ptr + m_used - token.size();
+            m_used += len;
+        } else {
+            dest = reserve(token.size() + len);
+            if (! token.empty())
+                memcpy(dest, token.data(), token.size());
+        }
+        if (len > 0)
+            memcpy(dest + token.size(), ptr, len);
+        return token_view(dest, token.size() + len);
+    }
+
+    /**
+     * copies a token into the buffer if it refers to memory in [begin_ptr, end_ptr]
+     *
+     * @param token the token to relocate (updated to refer to the copy)
+     * @param begin_ptr points to the first byte of the memory being released
+     * @param end_ptr points to the end of the memory being released (last byte + 1)
+     */
+    inline void relocate(token_view& token, const char *begin_ptr, const char *end_ptr) {
+        if (token.data() != NULL && token.data() >= begin_ptr && token.data() <= end_ptr)
+            token = copy(token.data(), token.size());
+    }
+
+
+private:
+
+    /// a block of memory used for storing tokens
+    struct block_t {
+        char *          ptr;
+        std::size_t     size;
+    };
+
+    /// returns a pointer to len unused characters, allocating a new block if necessary
+    inline char *reserve(std::size_t len) {
+        if (m_blocks.empty() || m_used + len > m_blocks.back().size) {
+            block_t b;
+            b.size = std::max(len, static_cast<std::size_t>(BLOCK_SIZE));
+            b.ptr = new char[b.size];
+            m_blocks.push_back(b);
+            m_used = 0;
+        }
+        char *ptr = m_blocks.back().ptr + m_used;
+        m_used += len;
+        return ptr;
+    }
+
+    /// frees all but the first n blocks
+    inline void release(std::size_t n) {
+        while (m_blocks.size() > n) {
+            delete [] m_blocks.back().ptr;
+            m_blocks.pop_back();
+        }
+    }
+
+
+    /// blocks of memory used for storing tokens
+    std::vector<block_t>            m_blocks;
+
+    /// number of characters used in the last block
+    std::size_t                     m_used;
+};
+
+
+}   // end namespace http
+}   // end namespace pion
+
+#endif
@@ -52,6 +52,19 @@ struct PION_API types
     static const std::string    HEADER_USER_AGENT;
     static const std::string    HEADER_X_FORWARDED_FOR;
     static const std::string    HEADER_CLIENT_IP;
+    static const std::string    HEADER_DATE;
+
+    /// identifiers for the common HTTP header names, used by http::message to
+    /// find their values without hashing (see message::get_header_view())
+    enum header_id_t {
+        HEADER_ID_HOST, HEADER_ID_COOKIE, HEADER_ID_SET_COOKIE, HEADER_ID_CONNECTION,
+        HEADER_ID_CONTENT_TYPE, HEADER_ID_CONTENT_LENGTH, HEADER_ID_CONTENT_LOCATION,
+        HEADER_ID_CONTENT_ENCODING, HEADER_ID_CONTENT_DISPOSITION, HEADER_ID_LAST_MODIFIED,
+        HEADER_ID_IF_MODIFIED_SINCE, HEADER_ID_TRANSFER_ENCODING, HEADER_ID_LOCATION,
+        HEADER_ID_AUTHORIZATION, HEADER_ID_REFERER, HEADER_ID_USER_AGENT,
+        HEADER_ID_X_FORWARDED_FOR, HEADER_ID_CLIENT_IP, HEADER_ID_DATE,
+        HEADER_ID_COUNT, HEADER_ID_UNKNOWN = HEADER_ID_COUNT
+    };
 
     // common HTTP content types
     static const std::string    CONTENT_TYPE_HTML;
@@ -72,6 +85,7 @@ struct PION_API types
     static const std::string    RESPONSE_MESSAGE_CREATED;
     static const std::string    RESPONSE_MESSAGE_ACCEPTED;
     static const std::string    RESPONSE_MESSAGE_NO_CONTENT;
+    static const std::string    RESPONSE_MESSAGE_PARTIAL_CONTENT;
     static const std::string    RESPONSE_MESSAGE_FOUND;
     static const std::string    RESPONSE_MESSAGE_UNAUTHORIZED;
     static const std::string    RESPONSE_MESSAGE_FORBIDDEN;
@@ -79,6 +93,8 @@ struct PION_API types
     static const std::string    RESPONSE_MESSAGE_METHOD_NOT_ALLOWED;
     static const std::string    RESPONSE_MESSAGE_NOT_MODIFIED;
     static const std::string    RESPONSE_MESSAGE_BAD_REQUEST;
+    static const std::string    RESPONSE_MESSAGE_REQUEST_ENTITY_TOO_LARGE;
+    static const std::string    RESPONSE_MESSAGE_RANGE_NOT_SATISFIABLE;
     static const std::string    RESPONSE_MESSAGE_SERVER_ERROR;
     static const std::string    RESPONSE_MESSAGE_NOT_IMPLEMENTED;
     static const std::string    RESPONSE_MESSAGE_CONTINUE;
@@ -88,6 +104,7 @@ struct PION_API types
     static const unsigned int   RESPONSE_CODE_CREATED;
     static const unsigned int   RESPONSE_CODE_ACCEPTED;
     static const unsigned int   RESPONSE_CODE_NO_CONTENT;
+    static const unsigned int   RESPONSE_CODE_PARTIAL_CONTENT;
     static const unsigned int   RESPONSE_CODE_FOUND;
     static const unsigned int   RESPONSE_CODE_UNAUTHORIZED;
     static const unsigned int   RESPONSE_CODE_FORBIDDEN;
@@ -95,14 +112,69 @@ struct PION_API types
     static const unsigned int   RESPONSE_CODE_METHOD_NOT_ALLOWED;
     static const unsigned int   RESPONSE_CODE_NOT_MODIFIED;
     static const unsigned int   RESPONSE_CODE_BAD_REQUEST;
+    static const unsigned int   RESPONSE_CODE_REQUEST_ENTITY_TOO_LARGE;
+    static const unsigned int   RESPONSE_CODE_RANGE_NOT_SATISFIABLE;
     static const unsigned int   RESPONSE_CODE_SERVER_ERROR;
     static const unsigned int   RESPONSE_CODE_NOT_IMPLEMENTED;
     static const unsigned int   RESPONSE_CODE_CONTINUE;
     
 
+    /**
+     * finds the identifier for a common HTTP header name
+     *
+     * @param name points to the header name (case-insensitive)
+     * @param len length of the header name, in bytes
+     *
+     * @return header_id_t the identifier, or HEADER_ID_UNKNOWN if it is not a common header
+     */
+    static header_id_t find_header_id(const char *name, std::size_t len);
+
+    /// finds the identifier for a common HTTP header name (case-insensitive)
+    static inline header_id_t find_header_id(const std::string& name) {
+        return find_header_id(name.data(), name.size());
+    }
+
+    /// returns the name of a common HTTP header
+    static const std::string& get_header_name(const header_id_t id);
+
+    /**
+     * finds the pre-encoded status line for a common response
+     *
+     * @param version_major HTTP major version number
+     * @param version_minor HTTP minor version number
+     * @param status_code the response status code
+     * @param status_message the response status message
+     *
+     * @return points to the status line, including the trailing CRLF
+     *         (i.e. "HTTP/1.1 200 OK\r\n"), or NULL if there is none
+     */
+    static const std::string *find_status_line(const unsigned int version_major,
+                                               const unsigned int version_minor,
+                                               const unsigned int status_code,
+                                               const std::string& status_message);
+
     /// converts time_t format into an HTTP-date string
     static std::string get_date_string(const time_t t);
 
+    /**
+     * returns the current time as an HTTP-date string; the string is
+     * formatted at most once per second by each thread
+     *
+     * @return const std::string& valid until the calling thread calls this again
+     */
+    static const std::string& get_current_date_string(void);
+
+    /**
+     * converts an HTTP-date string into time_t format; RFC 1123, RFC 850 and
+     * asctime() formats are accepted.  The last string parsed by each thread
+     * is remembered, so that repeated conditional requests are not re-parsed.
+     *
+     * @param date_string the HTTP-date string to parse
+     *
+     * @return time_t the time, or (time_t)-1 if the string is not a valid date
+     */
+    static time_t parse_date_string(const std::string& date_string);
+
     /// builds an HTTP query string from a collection of query parameters
     static std::string make_query_string(const ihash_multimap& query_params);
     
@@ -0,0 +1,171 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_HTTP_URL_ENCODED_PARSER_HEADER__
+#define __PION_HTTP_URL_ENCODED_PARSER_HEADER__
+
+#include <string>
+#include <boost/noncopyable.hpp>
+#include <pion/config.hpp>
+#include <pion/hash_map.hpp>
+
+
+namespace pion {    // begin namespace pion
+namespace http {    // begin namespace http
+
+
+///
+/// url_encoded_parser: incrementally decodes application/x-www-form-urlencoded
+/// content into a dictionary (i.e. a request's query parameters) as it
+/// arrives.  Names and values are split and percent-decoded in a single pass,
+/// so the raw content does not need to be stored.  It can be used as a parser
+/// payload handler (see http::parser::set_payload_handler()):
+///
+///     http::parser::payload_handler_t h(boost::ref(my_url_encoded_parser));
+///     my_parser.set_payload_handler(h);
+///
+class PION_API url_encoded_parser :
+    private boost::noncopyable
+{
+public:
+
+    /// maximum length of an encoded name (same as http::parser)
+    static const std::size_t    MAX_NAME_SIZE;
+
+    /// maximum length of an encoded value (same as http::parser)
+    static const std::size_t    MAX_VALUE_SIZE;
+
+
+    /// constructs a parser that is not attached to a dictionary
+    url_encoded_parser(void)
+        : m_dict_ptr(NULL)
+    {
+        reset();
+    }
+
+    /**
+     * constructs a parser that decodes content into a dictionary
+     *
+     * @param dict dictionary that pairs are added to (must outlive the parser)
+     */
+    explicit url_encoded_parser(ihash_multimap& dict)
+        : m_dict_ptr(&dict)
+    {
+        reset();
+    }
+
+    /**
+     * decodes more content; pairs are added to the dictionary as soon as
+     * they are complete (the last pair is added by finish())
+     *
+     * @param ptr points to the next bytes of content
+     * @param len number of bytes available
+     *
+     * @return bool false if the content is invalid
+     */
+    bool parse(const char *ptr, std::size_t len);
+
+    /**
+     * finishes decoding the content, adding the last pair to the dictionary
+     *
+     * @return bool false if the content is invalid
+     */
+    bool finish(void);
+
+    /// decodes more content (allows use as a parser payload handler)
+    inline void operator()(const char *ptr, std::size_t len) { parse(ptr, len); }
+
+    /// resets the parser to decode new content into the same dictionary
+    void reset(void);
+
+    /// resets the parser to decode new content into a dictionary
+    inline void attach(ihash_multimap& dict) {
+        m_dict_ptr = &dict;
+        reset();
+    }
+
+    /// detaches the parser from its dictionary
+    inline void detach(void) { m_dict_ptr = NULL; }
+
+    /// returns true if the parser is attached to a dictionary
+    inline bool is_attached(void) const { return m_dict_ptr != NULL; }
+
+    /// returns true if the content was found to be invalid
+    inline bool has_error(void) const { return m_parse_state == URL_PARSE_ERROR; }
+
+    /// returns the number of bytes of content parsed since the last reset
+    inline std::size_t get_bytes_parsed(void) const { return m_bytes_parsed; }
+
+
+private:
+
+    /// state used to keep track of where we are in decoding the content
+    enum parse_state_t {
+        URL_PARSE_NAME, URL_PARSE_VALUE, URL_PARSE_ERROR
+    };
+
+    /// decodes a character of a name or value into str
+    inline void decode_char(std::string& str, char c) {
+        if (m_escape_size > 0) {
+            // hexadecimal digits of an escape sequence
+            m_escape_buf[m_escape_size - 1] = c;
+            if (++m_escape_size == 3)
+                decode_escape(str);
+        } else if (c == '%') {
+            m_escape_size = 1;
+        } else if (c == '+') {
+            str.push_back(' ');
+        } else {
+            str.push_back(c);
+        }
+    }
+
+    /// appends the decoded character of a complete escape sequence to str
+    void decode_escape(std::string& str);
+
+    /// appends an incomplete escape sequence to str without decoding it
+    void flush_escape(std::string& str);
+
+    /// adds the current pair to the dictionary (if the name is not empty)
+    void add_pair(void);
+
+
+    /// dictionary that decoded pairs are added to
+    ihash_multimap *                m_dict_ptr;
+
+    /// current parsing state
+    parse_state_t                   m_parse_state;
+
+    /// decoded name of the current pair
+    std::string                     m_name;
+
+    /// decoded value of the current pair
+    std::string                     m_value;
+
+    /// encoded length of the current name
+    std::size_t                     m_name_size;
+
+    /// encoded length of the current value
+    std::size_t                     m_value_size;
+
+    /// characters of the escape sequence being decoded (after the '%')
+    char                            m_escape_buf[3];
+
+    /// number of characters of the escape sequence seen (0 if none)
+    std::size_t                     m_escape_size;
+
+    /// number of bytes of content parsed since the last reset
+    std::size_t                     m_bytes_parsed;
+};
+
+
+}   // end namespace http
+}   // end namespace pion
+
+#endif
@@ -12,6 +12,10 @@
 
 #include <vector>
 #include <string>
+#include <cstdio>
+#include <cstring>
+#include <ostream>
+#include <streambuf>
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
 #include <boost/function/function0.hpp>
@@ -22,6 +26,7 @@
 #include <pion/logger.hpp>
 #include <pion/tcp/connection.hpp>
 #include <pion/http/message.hpp>
+#include <pion/http/content_blocks.hpp>
 
 
 namespace pion {    // begin namespace pion
@@ -51,8 +56,9 @@ protected:
      */
     writer(tcp::connection_ptr& tcp_conn, finished_handler_t handler)
         : m_logger(PION_GET_LOGGER("pion.http.writer")),
-        m_tcp_conn(tcp_conn), m_content_length(0), m_stream_is_empty(true), 
-        m_client_supports_chunks(true), m_sending_chunks(false),
+        m_tcp_conn(tcp_conn), m_arena_block(0), m_arena_used(0),
+        m_content_streambuf(*this), m_content_stream(&m_content_streambuf),
+        m_content_length(0), m_client_supports_chunks(true), m_sending_chunks(false),
         m_sent_headers(false), m_finished(handler)
     {}
     
@@ -75,39 +81,126 @@ protected:
                                       
     /// returns a function bound to writer::handle_write()
     virtual write_handler_t bind_to_write_handler(void) = 0;
+
+    ///
+    /// write_handler_caller: calls handle_write() for a writer that it keeps
+    /// alive; it is small enough to be stored in a write_handler_t without
+    /// allocating memory (unlike a bound member function and shared pointer)
+    ///
+    class write_handler_caller {
+    public:
+        explicit write_handler_caller(const boost::shared_ptr<writer>& writer_ptr)
+            : m_writer_ptr(writer_ptr) {}
+        inline void operator()(const boost::system::error_code& write_error,
+                               std::size_t bytes_written) const
+        {
+            m_writer_ptr->handle_write(write_error, bytes_written);
+        }
+    private:
+        boost::shared_ptr<writer>   m_writer_ptr;
+    };
+
+    /// returns the buffer that the message's HTTP headers are encoded into
+    inline std::string& get_header_buffer(void) { return m_header_buf; }
     
     /// called after we have finished sending the HTTP message
     inline void finished_writing(const boost::system::error_code& ec) {
         if (m_finished) m_finished(ec);
     }
+
+    /**
+     * prepares the writer to send another message; the arena's blocks and
+     * the memory allocated for buffers are kept for reuse
+     *
+     * @param tcp_conn TCP connection used to send the message
+     * @param handler function called after the message has been sent
+     */
+    inline void recycle(tcp::connection_ptr& tcp_conn, finished_handler_t& handler) {
+        clear();
+        m_content_stream.flags(std::ios_base::skipws | std::ios_base::dec);
+        m_content_stream.precision(6);
+        m_content_stream.fill(' ');
+        m_tcp_conn = tcp_conn;
+        m_finished.swap(handler);
+        m_client_supports_chunks = true;
+        m_sending_chunks = m_sent_headers = false;
+    }
+
+    /// releases the connection and the finished handler (called after the
+    /// message has been sent by a writer that the connection keeps)
+    inline void release(void) {
+        m_tcp_conn.reset();
+        m_finished.clear();
+    }
     
     
 public:
 
-    /// default destructor
-    virtual ~writer() {}
+    /// returns the arena's blocks to content_block_pool
+    virtual ~writer() {
+        content_block_pool& pool(content_block_pool::get_instance());
+        for (std::vector<char*>::iterator i = m_arena_blocks.begin(); i != m_arena_blocks.end(); ++i)
+            pool.release(*i);
+    }
 
-    /// clears out all of the memory buffers used to cache payload content data
+    /// clears out the payload content (the arena's blocks are kept for reuse)
     inline void clear(void) {
         m_content_buffers.clear();
-        m_binary_cache.clear();
-        m_text_cache.clear();
-        m_content_stream.str("");
-        m_stream_is_empty = true;
+        m_arena_block = 0;
+        m_arena_used = 0;
+        m_content_stream.clear();
         m_content_length = 0;
     }
 
     /**
-     * write text (non-binary) payload content
+     * write text (non-binary) payload content; values are formatted by a
+     * std::ostream that appends directly to the content arena
      *
      * @param data the data to append to the payload content
      */
     template <typename T>
     inline void write(const T& data) {
         m_content_stream << data;
-        if (m_stream_is_empty) m_stream_is_empty = false;
     }
 
+    /// write text payload content (copied into the content arena)
+    inline void write(const std::string& data) {
+        if (m_content_stream.width() == 0)
+            append_content(data.data(), data.size());
+        else
+            m_content_stream << data;
+    }
+
+    /// write text payload content (copied into the content arena)
+    inline void write(const char *data) {
+        if (m_content_stream.width() == 0)
+            append_content(data, strlen(data));
+        else
+            m_content_stream << data;
+    }
+
+    /// write a character of text payload content
+    inline void write(const char c) {
+        if (m_content_stream.width() == 0)
+            append_content(&c, 1);
+        else
+            m_content_stream << c;
+    }
+
+    /// write a number as text payload content (formatted without iostreams
+    /// unless the stream's format flags have been changed)
+    inline void write(const bool b) { write_integer(b ? 1 : 0, false, b); }
+    inline void write(const short n) { write_integer(n < 0 ? 0ULL - n : n, n < 0, n); }
+    inline void write(const unsigned short n) { write_integer(n, false, n); }
+    inline void write(const int n) { write_integer(n < 0 ? 0ULL - n : n, n < 0, n); }
+    inline void write(const unsigned int n) { write_integer(n, false, n); }
+    inline void write(const long n) { write_integer(n < 0 ? 0ULL - n : n, n < 0, n); }
+    inline void write(const unsigned long n) { write_integer(n, false, n); }
+    inline void write(const boost::long_long_type n) { write_integer(n < 0 ? 0ULL - n : n, n < 0, n); }
+    inline void write(const boost::ulong_long_type n) { write_integer(n, false, n); }
+    inline void write(const float n) { write_float(n); }
+    inline void write(const double n) { write_float(n); }
+
     /**
      * write binary payload content
      *
@@ -115,11 +208,7 @@ public:
      * @param length the length, in bytes, of the binary data
      */
     inline void write(const void *data, size_t length) {
-        if (length != 0) {
-            flushContentStream();
-            m_content_buffers.push_back(m_binary_cache.add(data, length));
-            m_content_length += length;
-        }
+        append_content(static_cast<const char*>(data), length);
     }
     
     /**
@@ -131,7 +220,6 @@ public:
      */
     inline void write_no_copy(const std::string& data) {
         if (! data.empty()) {
-            flushContentStream();
             m_content_buffers.push_back(boost::asio::buffer(data));
             m_content_length += data.size();
         }
@@ -146,12 +234,24 @@ public:
      */
     inline void write_no_copy(void *data, size_t length) {
         if (length > 0) {
-            flushContentStream();
             m_content_buffers.push_back(boost::asio::buffer(data, length));
             m_content_length += length;
         }
     }
 
+    /**
+     * write payload content stored in blocks; the blocks are not copied, and
+     * therefore must persist until the message has finished sending
+     *
+     * @param blocks the payload content to append
+     */
+    inline void write_no_copy(const http::content_blocks& blocks) {
+        if (! blocks.empty()) {
+            blocks.get_buffers(m_content_buffers);
+            m_content_length += blocks.size();
+        }
+    }
+
     
     /**
      * Sends all data buffered as a single HTTP message (without chunking).
@@ -264,13 +364,11 @@ private:
         // make sure that we did not lose the TCP connection
         if (! m_tcp_conn->is_open())
             finished_writing(boost::asio::error::connection_reset);
-        // make sure that the content-length is up-to-date
-        flushContentStream();
-        // prepare the write buffers to be sent
-        http::message::write_buffers_t write_buffers;
-        prepare_write_buffers(write_buffers, send_final_chunk);
+        // prepare the write buffers to be sent (their memory is kept for reuse)
+        m_write_buffers.clear();
+        prepare_write_buffers(m_write_buffers, send_final_chunk);
         // send data in the write buffers
-        m_tcp_conn->async_write(write_buffers, send_handler);
+        m_tcp_conn->async_write(write_buffers_ref(m_write_buffers), send_handler);
     }
     
     /**
@@ -282,39 +380,154 @@ private:
     void prepare_write_buffers(http::message::write_buffers_t &write_buffers,
                                const bool send_final_chunk);
     
-    /// flushes any text data in the content stream after caching it in the text_cache_t
-    inline void flushContentStream(void) {
-        if (! m_stream_is_empty) {
-            std::string string_to_add(m_content_stream.str());
-            if (! string_to_add.empty()) {
-                m_content_stream.str("");
-                m_content_length += string_to_add.size();
-                m_text_cache.push_back(string_to_add);
-                m_content_buffers.push_back(boost::asio::buffer(m_text_cache.back()));
+    /**
+     * copies payload content into the arena; content that directly follows
+     * the last content buffer extends it rather than adding another buffer
+     *
+     * @param ptr points to the data to append
+     * @param len length of the data, in bytes
+     */
+    inline void append_content(const char *ptr, std::size_t len) {
+        m_content_length += len;
+        while (len > 0) {
+            std::size_t n = len;
+            char *dest = allocate(n, false);
+            memcpy(dest, ptr, n);
+            if (! m_content_buffers.empty()
+                && boost::asio::buffer_cast<const char*>(m_content_buffers.back())
+                   + boost::asio::buffer_size(m_content_buffers.back()) == dest)
+            {
+                m_content_buffers.back() = boost::asio::const_buffer(
+                    boost::asio::buffer_cast<const char*>(m_content_buffers.back()),
+                    boost::asio::buffer_size(m_content_buffers.back()) + n);
+            } else {
+                m_content_buffers.push_back(boost::asio::const_buffer(dest, n));
             }
-            m_stream_is_empty = true;
+            ptr += n;
+            len -= n;
         }
     }
-    
-    
-    /// used to cache binary data included within the payload content
-    class binary_cache_t : public std::vector<std::pair<const char *, size_t> > {
+
+    /**
+     * copies a short string into the arena (not as payload content)
+     *
+     * @param ptr points to the string to copy (no longer than a block)
+     * @param len length of the string, in bytes
+     *
+     * @return boost::asio::const_buffer a buffer that refers to the copy
+     */
+    inline boost::asio::const_buffer add_text(const char *ptr, std::size_t len) {
+        char *dest = allocate(len, true);
+        memcpy(dest, ptr, len);
+        return boost::asio::const_buffer(dest, len);
+    }
+
+    /**
+     * reserves space in the arena, taking another block from the pool when
+     * the current one is full
+     *
+     * @param len number of bytes wanted; set to the number reserved, which
+     *            is less if the block is full and contiguous is false
+     * @param contiguous if true, len bytes are reserved in the same block
+     *
+     * @return char* points to the space reserved
+     */
+    inline char *allocate(std::size_t& len, const bool contiguous) {
+        const std::size_t available = content_block_pool::BLOCK_SIZE - m_arena_used;
+        if (available == 0 || (contiguous && available < len)
+            || m_arena_block == m_arena_blocks.size())
+        {
+            if (m_arena_block < m_arena_blocks.size())
+                ++m_arena_block;
+            if (m_arena_block == m_arena_blocks.size())
+                m_arena_blocks.push_back(content_block_pool::get_instance().acquire());
+            m_arena_used = 0;
+        }
+        len = std::min<std::size_t>(len, content_block_pool::BLOCK_SIZE - m_arena_used);
+        char *ptr = m_arena_blocks[m_arena_block] + m_arena_used;
+        m_arena_used += len;
+        return ptr;
+    }
+
+    /// writes an integer, unless the stream's format flags have been changed
+    template <typename T>
+    inline void write_integer(boost::ulong_long_type magnitude, const bool negative, const T n) {
+        if (! has_default_format()) {
+            m_content_stream << n;
+            return;
+        }
+        char buf[24];
+        char *ptr = buf + sizeof(buf);
+        do {
+            *--ptr = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude != 0);
+        if (negative)
+            *--ptr = '-';
+        append_content(ptr, buf + sizeof(buf) - ptr);
+    }
+
+    /// writes a floating point number, unless the stream's format flags have been changed
+    template <typename T>
+    inline void write_float(const T n) {
+        if (! has_default_format()) {
+            m_content_stream << n;
+            return;
+        }
+        // same as the default ostream format ("%g" with the stream's precision)
+        char buf[64];
+        const int precision = static_cast<int>(std::min<std::streamsize>(m_content_stream.precision(), 40));
+        const int len = sprintf(buf, "%.*g", precision, static_cast<double>(n));
+        append_content(buf, len > 0 ? len : 0);
+    }
+
+    /// length of the final (zero-byte) chunk
+    static const std::string                STRING_ZERO_CHUNK;
+
+    /// returns true if the content stream still has the format of a new ostream
+    inline bool has_default_format(void) const {
+        return (m_content_stream.flags() == (std::ios_base::skipws | std::ios_base::dec)
+                && m_content_stream.width() == 0);
+    }
+
+    ///
+    /// write_buffers_ref: buffer sequence that refers to the writer's write
+    /// buffers, so that asio does not copy the vector along with its handler
+    ///
+    class write_buffers_ref {
     public:
-        ~binary_cache_t() {
-            for (iterator i=begin(); i!=end(); ++i) {
-                delete[] i->first;
+        typedef boost::asio::const_buffer                               value_type;
+        typedef http::message::write_buffers_t::const_iterator          const_iterator;
+        explicit write_buffers_ref(const http::message::write_buffers_t& buffers)
+            : m_buffers(&buffers) {}
+        inline const_iterator begin(void) const { return m_buffers->begin(); }
+        inline const_iterator end(void) const { return m_buffers->end(); }
+    private:
+        const http::message::write_buffers_t *  m_buffers;
+    };
+
+    ///
+    /// content_streambuf: stream buffer that appends everything written
+    /// through it to the writer's payload content
+    ///
+    class content_streambuf : public std::streambuf {
+    public:
+        explicit content_streambuf(writer& w) : m_writer(w) {}
+    protected:
+        virtual int_type overflow(int_type c) {
+            if (! traits_type::eq_int_type(c, traits_type::eof())) {
+                const char ch = traits_type::to_char_type(c);
+                m_writer.append_content(&ch, 1);
             }
+            return traits_type::not_eof(c);
         }
-        inline boost::asio::const_buffer add(const void *ptr, const size_t size) {
-            char *data_ptr = new char[size];
-            memcpy(data_ptr, ptr, size);
-            push_back( std::make_pair(data_ptr, size) );
-            return boost::asio::buffer(data_ptr, size);
+        virtual std::streamsize xsputn(const char *ptr, std::streamsize n) {
+            m_writer.append_content(ptr, static_cast<std::size_t>(n));
+            return n;
         }
+    private:
+        writer&     m_writer;
     };
-    
-    /// used to cache text (non-binary) data included within the payload content
-    typedef std::list<std::string>          text_cache_t;
 
     
     /// primary logging interface used by this class
@@ -325,21 +538,31 @@ private:
     
     /// I/O write buffers that wrap the payload content to be written
     http::message::write_buffers_t          m_content_buffers;
-    
-    /// caches binary data included within the payload content
-    binary_cache_t                          m_binary_cache;
 
-    /// caches text (non-binary) data included within the payload content
-    text_cache_t                            m_text_cache;
-    
-    /// incrementally creates strings of text data for the text_cache_t
-    std::ostringstream                      m_content_stream;
+    /// I/O write buffers for the send operation in progress
+    http::message::write_buffers_t          m_write_buffers;
+
+    /// blocks taken from content_block_pool that hold copies of the payload
+    /// content (an append-only arena, reused after clear())
+    std::vector<char*>                      m_arena_blocks;
+
+    /// index of the arena block being filled
+    std::size_t                             m_arena_block;
+
+    /// number of bytes used in the arena block being filled
+    std::size_t                             m_arena_used;
+
+    /// the message's first line and HTTP headers, encoded for sending
+    std::string                             m_header_buf;
+
+    /// stream buffer that appends to the payload content
+    content_streambuf                       m_content_streambuf;
+
+    /// formats values that are written to the payload content
+    std::ostream                            m_content_stream;
     
     /// The length (in bytes) of the response content to be sent (Content-Length)
     size_t                                  m_content_length;
-
-    /// true if the content_stream is empty (avoids unnecessary string copies)
-    bool                                    m_stream_is_empty;
     
     /// true if the HTTP client supports chunked transfer encodings
     bool                                    m_client_supports_chunks;
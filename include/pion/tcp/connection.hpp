@@ -616,6 +616,21 @@ public:
         read_end_ptr = m_read_position.second;
     }
 
+    /**
+     * sets an object that is kept with the connection, so that a protocol
+     * handler may reuse it for each message (http::server uses this to
+     * recycle its readers and writers).  It is released when the server
+     * finishes a connection that is not kept alive.
+     *
+     * @param user_data the object to keep (or an empty pointer to release it)
+     */
+    inline void set_user_data(const boost::shared_ptr<void>& user_data) {
+        m_user_data = user_data;
+    }
+
+    /// returns the object that is kept with the connection, if any
+    inline const boost::shared_ptr<void>& get_user_data(void) const { return m_user_data; }
+
     /// returns an ASIO endpoint for the client connection
     inline boost::asio::ip::tcp::endpoint get_remote_endpoint(void) const {
         boost::asio::ip::tcp::endpoint remote_endpoint;
@@ -712,6 +727,9 @@ private:
 
     /// function called when a server has finished handling the connection
     connection_handler      m_finished_handler;
+
+    /// object kept with the connection by its protocol handler
+    boost::shared_ptr<void> m_user_data;
 };
 
 
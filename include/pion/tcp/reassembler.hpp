@@ -0,0 +1,185 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#ifndef __PION_TCP_REASSEMBLER_HEADER__
+#define __PION_TCP_REASSEMBLER_HEADER__
+
+#include <string>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/function/function1.hpp>
+#include <boost/function/function2.hpp>
+#include <pion/config.hpp>
+
+
+namespace pion {    // begin namespace pion
+namespace tcp {     // begin namespace tcp
+
+
+///
+/// reassembler: reassembles one direction of a passively captured TCP stream.
+/// Segments may arrive out of order, more than once or not at all; data is
+/// passed to the data handler in sequence order, and data that was never
+/// captured is reported to the gap handler as a number of missing bytes.
+/// Segments that arrive early are copied and held (up to a limit) only until
+/// the data in front of them arrives; segments that arrive in order are
+/// passed through without being copied.
+///
+class PION_API reassembler
+{
+public:
+
+    /// function called with data that is next in sequence
+    typedef boost::function2<void, const char *, std::size_t>   data_handler_t;
+
+    /// function called with the number of bytes that are missing from the stream
+    typedef boost::function1<void, std::size_t>                 gap_handler_t;
+
+    /// default maximum number of bytes held for segments that arrived early
+    static const std::size_t        DEFAULT_MAX_BUFFERED;
+
+
+    /**
+     * creates new reassembler objects
+     *
+     * @param max_buffered maximum number of bytes held for segments that
+     *                     arrived early; if exceeded, the data in front of
+     *                     them is assumed to be lost
+     */
+    explicit reassembler(std::size_t max_buffered = DEFAULT_MAX_BUFFERED)
+        : m_max_buffered(max_buffered), m_started(false), m_next_seq(0),
+        m_buffered_bytes(0), m_gap_bytes(0), m_duplicate_bytes(0)
+    {}
+
+    /// sets the function called with data that is next in sequence
+    inline void set_data_handler(data_handler_t h) { m_data_handler = h; }
+
+    /// sets the function called with the number of bytes that are missing
+    inline void set_gap_handler(gap_handler_t h) { m_gap_handler = h; }
+
+    /**
+     * starts the stream using the sequence number of its SYN segment (if it
+     * is not called, the stream starts with the first segment pushed)
+     *
+     * @param isn the initial sequence number (the SYN segment's sequence number)
+     */
+    inline void start(boost::uint32_t isn) {
+        m_next_seq = isn + 1;
+        m_started = true;
+    }
+
+    /**
+     * processes the payload of a TCP segment
+     *
+     * @param seq the segment's sequence number
+     * @param ptr points to the segment's payload
+     * @param len length of the segment's payload in bytes
+     */
+    void push(boost::uint32_t seq, const char *ptr, std::size_t len);
+
+    /**
+     * passes on all data that is being held, reporting the data in front of
+     * it as missing (called when the stream ends)
+     */
+    void flush(void);
+
+    /// discards all data being held and restarts the stream
+    void reset(void);
+
+    /// returns true if the stream's starting sequence number is known
+    inline bool is_started(void) const { return m_started; }
+
+    /// returns the sequence number of the next byte expected
+    inline boost::uint32_t get_next_seq(void) const { return m_next_seq; }
+
+    /// returns the number of bytes held for segments that arrived early
+    inline std::size_t get_buffered_bytes(void) const { return m_buffered_bytes; }
+
+    /// returns the total number of bytes reported missing
+    inline std::size_t get_gap_bytes(void) const { return m_gap_bytes; }
+
+    /// returns the total number of bytes that were received more than once
+    inline std::size_t get_duplicate_bytes(void) const { return m_duplicate_bytes; }
+
+    /// returns the maximum number of bytes held for segments that arrived early
+    inline std::size_t get_max_buffered(void) const { return m_max_buffered; }
+
+    /// sets the maximum number of bytes held for segments that arrived early
+    inline void set_max_buffered(std::size_t n) { m_max_buffered = n; }
+
+
+private:
+
+    /// a segment that arrived before the data in front of it
+    struct segment_t {
+        boost::uint32_t     seq;
+        std::string         data;
+    };
+
+    /// returns the offset of a sequence number from the next byte expected
+    /// (negative if it has already been passed on)
+    inline boost::int32_t get_offset(boost::uint32_t seq) const {
+        return static_cast<boost::int32_t>(seq - m_next_seq);
+    }
+
+    /// passes on data that is next in sequence
+    inline void deliver(const char *ptr, std::size_t len) {
+        m_next_seq += static_cast<boost::uint32_t>(len);
+        if (m_data_handler)
+            m_data_handler(ptr, len);
+    }
+
+    /// reports data that is missing in front of the next byte expected
+    inline void skip(std::size_t len) {
+        m_next_seq += static_cast<boost::uint32_t>(len);
+        m_gap_bytes += len;
+        if (m_gap_handler)
+            m_gap_handler(len);
+    }
+
+    /// holds a copy of a segment that arrived early
+    void hold(boost::uint32_t seq, const char *ptr, std::size_t len);
+
+    /// passes on held segments that are now next in sequence
+    void deliver_held(void);
+
+
+    /// function called with data that is next in sequence
+    data_handler_t                  m_data_handler;
+
+    /// function called with the number of bytes that are missing
+    gap_handler_t                   m_gap_handler;
+
+    /// segments that arrived early, ordered by sequence number
+    std::vector<segment_t>          m_segments;
+
+    /// maximum number of bytes held for segments that arrived early
+    std::size_t                     m_max_buffered;
+
+    /// true if the stream's starting sequence number is known
+    bool                            m_started;
+
+    /// sequence number of the next byte expected
+    boost::uint32_t                 m_next_seq;
+
+    /// number of bytes held for segments that arrived early
+    std::size_t                     m_buffered_bytes;
+
+    /// total number of bytes reported missing
+    std::size_t                     m_gap_bytes;
+
+    /// total number of bytes that were received more than once
+    std::size_t                     m_duplicate_bytes;
+};
+
+
+}   // end namespace tcp
+}   // end namespace pion
+
+#endif
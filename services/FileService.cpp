@@ -7,20 +7,63 @@
 // See http://www.boost.org/LICENSE_1_0.txt
 //
 
+#include <cstdlib>
+#include <sstream>
+#include <algorithm>
 #include <boost/asio.hpp>
 #include <boost/bind.hpp>
 #include <boost/assert.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/detail/atomic_count.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/algorithm/string/case_conv.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/algorithm/string/trim.hpp>
 #include <boost/exception/diagnostic_information.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 #include "FileService.hpp"
 #include <pion/error.hpp>
 #include <pion/plugin.hpp>
 #include <pion/http/response_writer.hpp>
 
+#ifdef PION_WIN32
+    #include <io.h>
+    #include <fcntl.h>
+    #include <process.h>
+    #include <sys/stat.h>
+#else
+    #include <sys/stat.h>
+    #include <sys/file.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <cerrno>
+#endif
+
+#ifdef PION_HAVE_ZLIB
+    #include <zlib.h>
+    #include <cstring>
+    #include <limits>
+#endif
+
+#ifdef PION_HAVE_SENDFILE
+    #include <sys/sendfile.h>
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <cerrno>
+#endif
+
+#ifdef PION_HAVE_INOTIFY
+    #include <sys/inotify.h>
+    #include <poll.h>
+    #include <unistd.h>
+    #include <cerrno>
+#endif
+
 using namespace pion;
 
 namespace pion {        // begin namespace pion
@@ -34,9 +77,43 @@ const unsigned int          FileService::DEFAULT_CACHE_SETTING = 1;
 const unsigned int          FileService::DEFAULT_SCAN_SETTING = 0;
 const unsigned long         FileService::DEFAULT_MAX_CACHE_SIZE = 0;    /* 0=disabled */
 const unsigned long         FileService::DEFAULT_MAX_CHUNK_SIZE = 0;    /* 0=disabled */
+const unsigned long         FileService::DEFAULT_MAX_UPLOAD_SIZE = 104857600;  /* 100 MB */
+const std::size_t           FileService::MAX_QUEUED_UPLOAD_BYTES = 1048576;    /* 1 MB */
 boost::once_flag            FileService::m_mime_types_init_flag = BOOST_ONCE_INIT;
 FileService::MIMETypeMap    *FileService::m_mime_types_ptr = NULL;
 
+/// names of the headers used for entity tags
+static const std::string    HEADER_ETAG("ETag");
+static const std::string    HEADER_IF_NONE_MATCH("If-None-Match");
+
+/// names of the headers used for byte-range requests
+static const std::string    HEADER_RANGE("Range");
+static const std::string    HEADER_IF_RANGE("If-Range");
+static const std::string    HEADER_ACCEPT_RANGES("Accept-Ranges");
+static const std::string    HEADER_CONTENT_RANGE("Content-Range");
+
+/// number of scanned files between progress messages
+static const unsigned long  SCAN_PROGRESS_INTERVAL = 10000;
+
+/// maximum number of ranges in a Range header (more are ignored, to avoid abuse)
+static const std::size_t    MAX_BYTE_RANGES = 64;
+
+/// maximum number of parts sent for a Range header, after overlapping and
+/// adjacent ranges are merged (more are ignored, to avoid abuse)
+static const std::size_t    MAX_BYTE_RANGE_PARTS = 16;
+
+/// used to make the boundaries of multipart/byteranges responses unique
+static boost::detail::atomic_count  g_byteranges_counter(0);
+
+/// used to generate unique names for the temporary files of uploads
+static boost::detail::atomic_count  g_upload_counter(0);
+
+/// names of the content-codings, indexed by DiskFile::ContentCoding
+static const std::string    CONTENT_CODING_NAMES[DiskFile::CODING_COUNT + 1] = { "gzip", "br", "" };
+
+/// file extensions of precompressed sidecar files, indexed by DiskFile::ContentCoding
+static const std::string    SIDECAR_EXTENSIONS[DiskFile::CODING_COUNT] = { ".gz", ".br" };
+
 
 // FileService member functions
 
@@ -46,8 +123,31 @@ FileService::FileService(void)
     m_scan_setting(DEFAULT_SCAN_SETTING),
     m_max_cache_size(DEFAULT_MAX_CACHE_SIZE),
     m_max_chunk_size(DEFAULT_MAX_CHUNK_SIZE),
-    m_writable(false)
-{}
+    m_max_upload_size(DEFAULT_MAX_UPLOAD_SIZE),
+    m_writable(false),
+    m_mmap(false),
+    m_precompressed(false),
+    m_compress(false),
+    m_watch(false),
+    m_watching(false),
+    m_io_threads(0),
+    m_scan_threads(0),
+    m_scanning(false),
+    m_scan_threads_running(0),
+    m_scanned_files(0)
+{
+#ifdef PION_HAVE_INOTIFY
+    m_inotify_fd = -1;
+    m_watch_pipe[0] = m_watch_pipe[1] = -1;
+#endif
+}
+
+FileService::~FileService()
+{
+    stopIOThreads();
+    stopScanning();
+    stopWatching();
+}
 
 void FileService::set_option(const std::string& name, const std::string& value)
 {
@@ -99,6 +199,8 @@ void FileService::set_option(const std::string& name, const std::string& value)
         }
     } else if (name == "max_chunk_size") {
         m_max_chunk_size = boost::lexical_cast<unsigned long>(value);
+    } else if (name == "max_upload_size") {
+        m_max_upload_size = boost::lexical_cast<unsigned long>(value);
     } else if (name == "writable") {
         if (value == "true") {
             m_writable = true;
@@ -107,12 +209,200 @@ void FileService::set_option(const std::string& name, const std::string& value)
         } else {
             BOOST_THROW_EXCEPTION( error::bad_arg() << error::errinfo_arg_name(name) );
         }
+    } else if (name == "watch") {
+        if (value == "true") {
+#ifdef PION_HAVE_INOTIFY
+            m_watch = true;
+#else
+            BOOST_THROW_EXCEPTION( error::bad_arg() << error::errinfo_arg_name(name) );
+#endif
+        } else if (value == "false") {
+            m_watch = false;
+        } else {
+            BOOST_THROW_EXCEPTION( error::bad_arg() << error::errinfo_arg_name(name) );
+        }
+    } else if (name == "io_threads") {
+        m_io_threads = boost::lexical_cast<unsigned int>(value);
+    } else if (name == "scan_threads") {
+        m_scan_threads = boost::lexical_cast<unsigned int>(value);
+    } else if (name == "cache_budget") {
+        m_cache.setMaxBytes(boost::lexical_cast<unsigned long>(value));
+    } else if (name == "mmap") {
+        if (value == "true") {
+            m_mmap = true;
+        } else if (value == "false") {
+            m_mmap = false;
+        } else {
+            BOOST_THROW_EXCEPTION( error::bad_arg() << error::errinfo_arg_name(name) );
+        }
+    } else if (name == "precompressed") {
+        if (value == "true") {
+            m_precompressed = true;
+        } else if (value == "false") {
+            m_precompressed = false;
+        } else {
+            BOOST_THROW_EXCEPTION( error::bad_arg() << error::errinfo_arg_name(name) );
+        }
+    } else if (name == "compress") {
+        if (value == "true") {
+#ifdef PION_HAVE_ZLIB
+            m_compress = true;
+#else
+            BOOST_THROW_EXCEPTION( error::bad_arg() << error::errinfo_arg_name(name) );
+#endif
+        } else if (value == "false") {
+            m_compress = false;
+        } else {
+            BOOST_THROW_EXCEPTION( error::bad_arg() << error::errinfo_arg_name(name) );
+        }
     } else {
         BOOST_THROW_EXCEPTION( error::bad_arg() << error::errinfo_arg_name(name) );
     }
 }
 
 void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connection_ptr& tcp_conn)
+{
+    // the upload is taken now, while the request's payload handler still
+    // keeps it (see get_payload_handler())
+    DiskFileUploadPtr upload(takeUpload(*http_request_ptr));
+    CacheLookup cache_lookup;
+    if (upload && m_io_work) {
+        // the content may still be queued for the disk I/O threads, so the
+        // request is handled once it has all been written
+        upload->afterWrites(boost::bind(&FileService::handleRequest, this,
+                                        http_request_ptr, tcp_conn, upload, cache_lookup));
+    } else if (m_io_work && needsDiskAccess(*http_request_ptr, cache_lookup)) {
+        // access the disk in a disk I/O thread, so that slow disks do not
+        // hold up other requests that are handled by the connection's thread
+        // (the response is still built and sent in the connection's thread)
+        m_io_service.post(boost::bind(&FileService::handleRequest, this,
+                                      http_request_ptr, tcp_conn, upload, cache_lookup));
+    } else {
+        findResponse(http_request_ptr, upload, cache_lookup);
+        if (upload)
+            upload->discard();
+        sendResponse(http_request_ptr, tcp_conn, cache_lookup);
+    }
+}
+
+bool FileService::needsDiskAccess(http::request& http_request, CacheLookup& cache_lookup)
+{
+    if (http_request.get_method() != http::types::REQUEST_METHOD_GET
+        && http_request.get_method() != http::types::REQUEST_METHOD_HEAD)
+        return true;
+
+    // files are checked for updates if cache == 1, unless they are watched
+    const std::string relative_path(get_relative_resource(http_request.get_resource()));
+    if (m_cache_setting == 0 || (m_cache_setting == 1 && (! isWatching() || relative_path.empty())))
+        return true;
+
+    // the entry found is passed on to handleRequest(), which uses it instead
+    // of looking the file up again
+    cache_lookup.m_found = m_cache.find(relative_path, cache_lookup.m_entry, &cache_lookup.m_version);
+    cache_lookup.m_done = true;
+    return ! cache_lookup.m_found
+        || cache_lookup.m_entry.getLastModified() == 0
+        || ! cache_lookup.m_entry.hasFileContent();
+}
+
+http::parser::payload_handler_t FileService::get_payload_handler(http::request_ptr& http_request_ptr,
+                                                                 tcp::connection_ptr& tcp_conn)
+{
+    if (! m_writable || (http_request_ptr->get_method() != http::types::REQUEST_METHOD_PUT
+                         && http_request_ptr->get_method() != http::types::REQUEST_METHOD_POST))
+        return http::parser::payload_handler_t();
+
+    // determine the path of the file the same way that sendResponse() does;
+    // if the request will not be accepted, its content is not streamed
+    const std::string relative_path(get_relative_resource(http_request_ptr->get_resource()));
+    if (relative_path.empty() ? m_file.empty() : m_directory.empty())
+        return http::parser::payload_handler_t();
+    boost::filesystem::path file_path(relative_path.empty() ? m_file : m_directory / relative_path);
+    file_path.normalize();
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+    if (file_path.string().find(m_directory.string()) != 0)
+#else
+    if (file_path.file_string().find(m_directory.directory_string()) != 0)
+#endif
+        return http::parser::payload_handler_t();
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+    if (DiskFileUpload::isTempFileName(file_path.filename().string()))
+#else
+    if (DiskFileUpload::isTempFileName(file_path.leaf()))
+#endif
+        return http::parser::payload_handler_t();
+
+    DiskFileUploadPtr upload(new DiskFileUpload(file_path,
+        http_request_ptr->get_method() == http::types::REQUEST_METHOD_POST, m_max_upload_size));
+    const http::token_view length_view(http_request_ptr->get_header_view(http::types::HEADER_ID_CONTENT_LENGTH));
+    if (m_max_upload_size != 0 && length_view.data() != NULL
+        && http::message::parse_content_length(length_view) > m_max_upload_size)
+    {
+        // nothing is written; the content is read and ignored, so that the
+        // request can still be answered
+        PION_LOG_WARN(m_logger, "Upload is larger than max_upload_size ("
+                      << get_resource() << "): " << relative_path);
+        upload->discardTooLarge();
+    }
+    if (m_io_work) {
+        // the temporary file is created and written in the disk I/O threads;
+        // if it cannot be created, the request is answered with an error
+        upload->open(m_io_service, MAX_QUEUED_UPLOAD_BYTES);
+    } else if (! upload->isTooLarge()) {
+        if (! upload->open()) {
+            PION_LOG_WARN(m_logger, "Unable to create temporary file for upload ("
+                          << get_resource() << "): " << relative_path);
+            return http::parser::payload_handler_t();
+        }
+        PION_LOG_DEBUG(m_logger, "Writing upload to temporary file: " << upload->getTempPath());
+    }
+
+    boost::mutex::scoped_lock upload_lock(m_upload_mutex);
+    // forget uploads of requests that were never handled (e.g. lost connections);
+    // their temporary files were removed when their payload handlers were destroyed
+    UploadMap::iterator i = m_uploads.begin();
+    while (i != m_uploads.end()) {
+        if (i->second.first.expired() || i->second.second.expired())
+            m_uploads.erase(i++);
+        else
+            ++i;
+    }
+    m_uploads[http_request_ptr.get()] = std::make_pair(boost::weak_ptr<http::request>(http_request_ptr),
+                                                       boost::weak_ptr<DiskFileUpload>(upload));
+    // the payload handler is the only owner of the upload until operator()
+    // takes it, so the upload is discarded if the request is never handled
+    return boost::bind(&DiskFileUpload::write, upload, _1, _2);
+}
+
+DiskFileUploadPtr FileService::takeUpload(const http::request& http_request)
+{
+    DiskFileUploadPtr upload;
+    boost::mutex::scoped_lock upload_lock(m_upload_mutex);
+    UploadMap::iterator i = m_uploads.find(&http_request);
+    if (i != m_uploads.end()) {
+        // the address may have been reused by another request
+        if (! i->second.first.expired())
+            upload = i->second.second.lock();
+        m_uploads.erase(i);
+    }
+    return upload;
+}
+
+void FileService::handleRequest(http::request_ptr& http_request_ptr, tcp::connection_ptr& tcp_conn,
+                                DiskFileUploadPtr& upload, CacheLookup& cache_lookup)
+{
+    findResponse(http_request_ptr, upload, cache_lookup);
+    // remove the temporary file now if the upload was not committed, since
+    // the request's parser may keep the upload until it reads another request
+    if (upload)
+        upload->discard();
+    // the response is built and sent in the connection's thread
+    tcp_conn->get_io_service().post(boost::bind(&FileService::sendResponse, this,
+                                                http_request_ptr, tcp_conn, cache_lookup));
+}
+
+void FileService::findResponse(http::request_ptr& http_request_ptr, DiskFileUploadPtr& upload,
+                               CacheLookup& cache_lookup)
 {
     // get the relative resource path for the request
     const std::string relative_path(get_relative_resource(http_request_ptr->get_resource()));
@@ -126,7 +416,7 @@ void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connectio
             // no file is specified, either in the request or in the options
             PION_LOG_WARN(m_logger, "No file option defined ("
                           << get_resource() << ")");
-            sendNotFoundResponse(http_request_ptr, tcp_conn);
+            cache_lookup.m_response_type = RESPONSE_NOT_FOUND;
             return;
         } else {
             file_path = m_file;
@@ -138,7 +428,7 @@ void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connectio
             // no directory is specified for the relative file
             PION_LOG_WARN(m_logger, "No directory option defined ("
                           << get_resource() << "): " << relative_path);
-            sendNotFoundResponse(http_request_ptr, tcp_conn);
+            cache_lookup.m_response_type = RESPONSE_NOT_FOUND;
             return;
         } else {
             file_path = m_directory / relative_path;
@@ -156,25 +446,19 @@ void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connectio
 #endif
         PION_LOG_WARN(m_logger, "Request for file outside of directory ("
                       << get_resource() << "): " << relative_path);
-        static const std::string FORBIDDEN_HTML_START =
-            "<html><head>\n"
-            "<title>403 Forbidden</title>\n"
-            "</head><body>\n"
-            "<h1>Forbidden</h1>\n"
-            "<p>The requested URL ";
-        static const std::string FORBIDDEN_HTML_FINISH =
-            " is not in the configured directory.</p>\n"
-            "</body></html>\n";
-        http::response_writer_ptr writer(http::response_writer::create(tcp_conn, *http_request_ptr,
-                                     boost::bind(&tcp::connection::finish, tcp_conn)));
-        writer->get_response().set_status_code(http::types::RESPONSE_CODE_FORBIDDEN);
-        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_FORBIDDEN);
-        if (http_request_ptr->get_method() != http::types::REQUEST_METHOD_HEAD) {
-            writer->write_no_copy(FORBIDDEN_HTML_START);
-            writer << http_request_ptr->get_resource();
-            writer->write_no_copy(FORBIDDEN_HTML_FINISH);
-        }
-        writer->send();
+        cache_lookup.m_response_type = RESPONSE_OUTSIDE_DIRECTORY;
+        return;
+    }
+
+    // the temporary files of uploads are never served, written or deleted
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+    if (DiskFileUpload::isTempFileName(file_path.filename().string())) {
+#else
+    if (DiskFileUpload::isTempFileName(file_path.leaf())) {
+#endif
+        PION_LOG_WARN(m_logger, "Request for temporary upload file ("
+                      << get_resource() << "): " << relative_path);
+        cache_lookup.m_response_type = RESPONSE_NOT_FOUND;
         return;
     }
 
@@ -182,25 +466,7 @@ void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connectio
     if (boost::filesystem::is_directory(file_path)) {
         PION_LOG_WARN(m_logger, "Request for directory ("
                       << get_resource() << "): " << relative_path);
-        static const std::string FORBIDDEN_HTML_START =
-            "<html><head>\n"
-            "<title>403 Forbidden</title>\n"
-            "</head><body>\n"
-            "<h1>Forbidden</h1>\n"
-            "<p>The requested URL ";
-        static const std::string FORBIDDEN_HTML_FINISH =
-            " is a directory.</p>\n"
-            "</body></html>\n";
-        http::response_writer_ptr writer(http::response_writer::create(tcp_conn, *http_request_ptr,
-                                     boost::bind(&tcp::connection::finish, tcp_conn)));
-        writer->get_response().set_status_code(http::types::RESPONSE_CODE_FORBIDDEN);
-        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_FORBIDDEN);
-        if (http_request_ptr->get_method() != http::types::REQUEST_METHOD_HEAD) {
-            writer->write_no_copy(FORBIDDEN_HTML_START);
-            writer << http_request_ptr->get_resource();
-            writer->write_no_copy(FORBIDDEN_HTML_FINISH);
-        }
-        writer->send();
+        cache_lookup.m_response_type = RESPONSE_IS_DIRECTORY;
         return;
     }
 
@@ -208,35 +474,44 @@ void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connectio
         || http_request_ptr->get_method() == http::types::REQUEST_METHOD_HEAD)
     {
         // the type of response we will send
-        enum ResponseType {
-            RESPONSE_UNDEFINED,     // initial state until we know how to respond
-            RESPONSE_OK,            // normal response that includes the file's content
-            RESPONSE_HEAD_OK,       // response to HEAD request (would send file's content)
-            RESPONSE_NOT_FOUND,     // Not Found (404)
-            RESPONSE_NOT_MODIFIED   // Not Modified (304) response to If-Modified-Since
-        } response_type = RESPONSE_UNDEFINED;
+        ResponseType& response_type = cache_lookup.m_response_type;
 
         // used to hold our response information
-        DiskFile response_file;
+        DiskFile& response_file = cache_lookup.m_response_file;
+
+        // get the If-None-Match request header (empty if there is none)
+        const std::string& if_none_match(http_request_ptr->get_header(HEADER_IF_NONE_MATCH));
 
-        // get the If-Modified-Since request header
-        const std::string if_modified_since(http_request_ptr->get_header(http::types::HEADER_IF_MODIFIED_SINCE));
+        // get the If-Modified-Since request header ((time_t)-1 if there is none);
+        // it is ignored if the request has an If-None-Match header
+        const std::time_t if_modified_since(if_none_match.empty()
+            && http_request_ptr->has_header(http::types::HEADER_ID_IF_MODIFIED_SINCE)
+            ? http::types::parse_date_string(http_request_ptr->get_header(http::types::HEADER_IF_MODIFIED_SINCE))
+            : static_cast<std::time_t>(-1));
 
         // check the cache for a corresponding entry (if enabled)
         // note that m_cache_setting may equal 0 if m_scan_setting == 1
         if (m_cache_setting > 0 || m_scan_setting > 0) {
 
-            // search for a matching cache entry
-            boost::mutex::scoped_lock cache_lock(m_cache_mutex);
-            CacheMap::iterator cache_itr = m_cache_map.find(relative_path);
+            // search for a matching cache entry, unless operator() did; the
+            // entry is copied so that no locks are held while the file is
+            // read or checked for updates
+            if (! cache_lookup.m_done) {
+                cache_lookup.m_found = m_cache.find(relative_path, cache_lookup.m_entry,
+                                                    &cache_lookup.m_version);
+                cache_lookup.m_done = true;
+            }
+            DiskFile& cache_entry = cache_lookup.m_entry;
+            const unsigned long cache_version = cache_lookup.m_version;
 
-            if (cache_itr == m_cache_map.end()) {
+            if (! cache_lookup.m_found) {
                 // no existing cache entries found
 
-                if (m_scan_setting == 1 || m_scan_setting == 3) {
+                if ((m_scan_setting == 1 || m_scan_setting == 3) && ! isScanning()) {
                     // do not allow files to be added;
                     // all requests must correspond with existing cache entries
                     // since no match was found, just return file not found
+                    // (until scanning is finished, the file may just not be found yet)
                     PION_LOG_WARN(m_logger, "Request for unknown file ("
                                   << get_resource() << "): " << relative_path);
                     response_type = RESPONSE_NOT_FOUND;
@@ -255,14 +530,13 @@ void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connectio
                     // cache is disabled
 
                     // copy & re-use file_path and mime_type
-                    response_file.setFilePath(cache_itr->second.getFilePath());
-                    response_file.setMimeType(cache_itr->second.getMimeType());
+                    response_file.setFilePath(cache_entry.getFilePath());
+                    response_file.setMimeType(cache_entry.getMimeType());
 
                     // get the file_size and last_modified timestamp
                     response_file.update();
 
-                    // just compare strings for simplicity (parsing this date format sucks!)
-                    if (response_file.getLastModifiedString() == if_modified_since) {
+                    if (isNotModified(response_file.getLastModified(), if_modified_since)) {
                         // no need to read the file; the modified times match!
                         response_type = RESPONSE_NOT_MODIFIED;
                     } else {
@@ -281,27 +555,34 @@ void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connectio
                     // true if the entry was updated (used for log message)
                     bool cache_was_updated = false;
 
-                    if (cache_itr->second.getLastModified() == 0) {
+                    if (cache_entry.getLastModified() == 0) {
 
-                        // cache file for the first time
+                        // cache file for the first time (or again, if it was evicted)
                         cache_was_updated = true;
-                        cache_itr->second.update();
-                        if (m_max_cache_size==0 || cache_itr->second.getFileSize() <= m_max_cache_size) {
+                        cache_entry.update();
+                        if (isCacheable(cache_entry.getFileSize())) {
                             // read the file (may throw exception)
-                            cache_itr->second.read();
+                            cacheFileContent(cache_entry);
                         } else {
-                            cache_itr->second.resetFileContent();
+                            cache_entry.resetFileContent();
                         }
 
-                    } else if (m_cache_setting == 1) {
+                    } else if (m_cache_setting == 1 && (! isWatching() || relative_path.empty())) {
 
-                        // check if file has been updated (may throw exception)
-                        cache_was_updated = cache_itr->second.checkUpdated();
+                        // check if file has been updated (may throw exception);
+                        // not needed if the watcher keeps the directory's entries current
+                        cache_was_updated = cache_entry.checkUpdated();
+                        if (cache_was_updated && cache_entry.hasFileContent())
+                            cacheEncodedContent(cache_entry);
 
                     } // else cache_setting == 2 (use existing values)
 
+                    // store the updated entry (unless it was changed meanwhile)
+                    if (cache_was_updated)
+                        m_cache.update(relative_path, cache_entry, cache_version);
+
                     // get the response type
-                    if (cache_itr->second.getLastModifiedString() == if_modified_since) {
+                    if (isNotModified(cache_entry.getLastModified(), if_modified_since)) {
                         response_type = RESPONSE_NOT_MODIFIED;
                     } else if (http_request_ptr->get_method() == http::types::REQUEST_METHOD_HEAD) {
                         response_type = RESPONSE_HEAD_OK;
@@ -309,8 +590,7 @@ void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connectio
                         response_type = RESPONSE_OK;
                     }
 
-                    // copy cache contents so that we can release the mutex
-                    response_file = cache_itr->second;
+                    response_file = cache_entry;
 
                     PION_LOG_DEBUG(m_logger, (cache_was_updated ? "Updated" : "Using")
                                    << " cache entry for request ("
@@ -324,7 +604,7 @@ void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connectio
             if (! boost::filesystem::exists(file_path)) {
                 PION_LOG_WARN(m_logger, "File not found ("
                               << get_resource() << "): " << relative_path);
-                sendNotFoundResponse(http_request_ptr, tcp_conn);
+                response_type = RESPONSE_NOT_FOUND;
                 return;
             }
 
@@ -343,8 +623,7 @@ void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connectio
             // get the file_size and last_modified timestamp
             response_file.update();
 
-            // just compare strings for simplicity (parsing this date format sucks!)
-            if (response_file.getLastModifiedString() == if_modified_since) {
+            if (isNotModified(response_file.getLastModified(), if_modified_since)) {
                 // no need to read the file; the modified times match!
                 response_type = RESPONSE_NOT_MODIFIED;
             } else if (http_request_ptr->get_method() == http::types::REQUEST_METHOD_HEAD) {
@@ -352,192 +631,303 @@ void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connectio
             } else {
                 response_type = RESPONSE_OK;
                 if (m_cache_setting != 0) {
-                    if (m_max_cache_size==0 || response_file.getFileSize() <= m_max_cache_size) {
+                    if (isCacheable(response_file.getFileSize())) {
                         // read the file (may throw exception)
-                        response_file.read();
+                        cacheFileContent(response_file);
                     }
                     // add new entry to the cache
                     PION_LOG_DEBUG(m_logger, "Adding cache entry for request ("
                                    << get_resource() << "): " << relative_path);
-                    boost::mutex::scoped_lock cache_lock(m_cache_mutex);
-                    m_cache_map.insert( std::make_pair(relative_path, response_file) );
+                    m_cache.add(relative_path, response_file);
                 }
             }
         }
 
-        if (response_type == RESPONSE_OK) {
-            // use DiskFileSender to send a file
-            DiskFileSenderPtr sender_ptr(DiskFileSender::create(response_file,
-                                                                http_request_ptr, tcp_conn,
-                                                                m_max_chunk_size));
-            sender_ptr->send();
-        } else if (response_type == RESPONSE_NOT_FOUND) {
-            sendNotFoundResponse(http_request_ptr, tcp_conn);
-        } else {
-            // sending headers only -> use our own response object
-
-            // prepare a response and set the Content-Type
-            http::response_writer_ptr writer(http::response_writer::create(tcp_conn, *http_request_ptr,
-                                         boost::bind(&tcp::connection::finish, tcp_conn)));
-            writer->get_response().set_content_type(response_file.getMimeType());
-
-            // set Last-Modified header to enable client-side caching
-            writer->get_response().add_header(http::types::HEADER_LAST_MODIFIED,
-                                            response_file.getLastModifiedString());
-
-            switch(response_type) {
-                case RESPONSE_UNDEFINED:
-                case RESPONSE_NOT_FOUND:
-                case RESPONSE_OK:
-                    // this should never happen
-                    BOOST_ASSERT(false);
-                    break;
-                case RESPONSE_NOT_MODIFIED:
-                    // set "Not Modified" response
-                    writer->get_response().set_status_code(http::types::RESPONSE_CODE_NOT_MODIFIED);
-                    writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_NOT_MODIFIED);
-                    break;
-                case RESPONSE_HEAD_OK:
-                    // set "OK" response (not really necessary since this is the default)
-                    writer->get_response().set_status_code(http::types::RESPONSE_CODE_OK);
-                    writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_OK);
-                    break;
-            }
+        if (response_type == RESPONSE_NOT_FOUND)
+            return;
+
+        // send a compressed variant of the file if the client accepts one
+        selectContentCoding(http_request_ptr, response_file);
 
-            // send the response
-            writer->send();
+        // revalidate using the entity tag of the variant that would be sent
+        if (! if_none_match.empty()
+            && (response_type == RESPONSE_OK || response_type == RESPONSE_HEAD_OK)
+            && matchesETag(if_none_match, response_file.getETag()))
+        {
+            response_type = RESPONSE_NOT_MODIFIED;
+        }
+
+        // check for a Range header; ranges apply to the variant being sent.
+        // If-Range makes the request unconditional if the file has changed
+        if (response_type == RESPONSE_OK && http_request_ptr->has_header(HEADER_RANGE)) {
+            const std::string& if_range(http_request_ptr->get_header(HEADER_IF_RANGE));
+            if ((if_range.empty() || if_range == response_file.getLastModifiedString()
+                 || (! response_file.getETag().empty() && if_range == response_file.getETag()))
+                && parseRangeHeader(http_request_ptr->get_header(HEADER_RANGE),
+                                    response_file.getFileSize(), cache_lookup.m_byte_ranges)
+                && cache_lookup.m_byte_ranges.empty())
+            {
+                response_type = RESPONSE_RANGE_NOT_SATISFIABLE;
+            }
         }
     } else if (http_request_ptr->get_method() == http::types::REQUEST_METHOD_POST
-               || http_request_ptr->get_method() == http::types::REQUEST_METHOD_PUT
-               || http_request_ptr->get_method() == http::types::REQUEST_METHOD_DELETE)
+               || http_request_ptr->get_method() == http::types::REQUEST_METHOD_PUT)
     {
         // If not writable, then send 405 (Method Not Allowed) response for POST, PUT or DELETE requests.
         if (!m_writable) {
-            static const std::string NOT_ALLOWED_HTML_START =
-                "<html><head>\n"
-                "<title>405 Method Not Allowed</title>\n"
-                "</head><body>\n"
-                "<h1>Not Allowed</h1>\n"
-                "<p>The requested method ";
-            static const std::string NOT_ALLOWED_HTML_FINISH =
-                " is not allowed on this server.</p>\n"
-                "</body></html>\n";
-            http::response_writer_ptr writer(http::response_writer::create(tcp_conn, *http_request_ptr,
-                                         boost::bind(&tcp::connection::finish, tcp_conn)));
-            writer->get_response().set_status_code(http::types::RESPONSE_CODE_METHOD_NOT_ALLOWED);
-            writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_METHOD_NOT_ALLOWED);
-            writer->write_no_copy(NOT_ALLOWED_HTML_START);
-            writer << http_request_ptr->get_method();
-            writer->write_no_copy(NOT_ALLOWED_HTML_FINISH);
-            writer->get_response().add_header("Allow", "GET, HEAD");
-            writer->send();
+            cache_lookup.m_response_type = RESPONSE_NOT_ALLOWED;
+            return;
+        }
+        if (upload && upload->isTooLarge()) {
+            cache_lookup.m_response_type = RESPONSE_TOO_LARGE;
+            return;
+        }
+        const bool file_existed = boost::filesystem::exists(file_path);
+        // The file doesn't exist yet, so it will be created below, unless the
+        // directory of the requested file also doesn't exist.
+        if (!file_existed && !boost::filesystem::exists(file_path.branch_path())) {
+            cache_lookup.m_response_type = RESPONSE_DIRECTORY_NOT_FOUND;
+            return;
+        }
+        bool written = true;
+        if (upload) {
+            // the content was written to a temporary file as it arrived
+            written = (upload->getFilePath() == file_path && upload->commit());
         } else {
-            http::response_writer_ptr writer(http::response_writer::create(tcp_conn, *http_request_ptr,
-                                         boost::bind(&tcp::connection::finish, tcp_conn)));
-            if (http_request_ptr->get_method() == http::types::REQUEST_METHOD_POST
-                || http_request_ptr->get_method() == http::types::REQUEST_METHOD_PUT)
-            {
-                if (boost::filesystem::exists(file_path)) {
-                    writer->get_response().set_status_code(http::types::RESPONSE_CODE_NO_CONTENT);
-                    writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_NO_CONTENT);
-                } else {
-                    // The file doesn't exist yet, so it will be created below, unless the
-                    // directory of the requested file also doesn't exist.
-                    if (!boost::filesystem::exists(file_path.branch_path())) {
-                        static const std::string NOT_FOUND_HTML_START =
-                            "<html><head>\n"
-                            "<title>404 Not Found</title>\n"
-                            "</head><body>\n"
-                            "<h1>Not Found</h1>\n"
-                            "<p>The directory of the requested URL ";
-                        static const std::string NOT_FOUND_HTML_FINISH =
-                            " was not found on this server.</p>\n"
-                            "</body></html>\n";
-                        writer->get_response().set_status_code(http::types::RESPONSE_CODE_NOT_FOUND);
-                        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_NOT_FOUND);
-                        writer->write_no_copy(NOT_FOUND_HTML_START);
-                        writer << http_request_ptr->get_resource();
-                        writer->write_no_copy(NOT_FOUND_HTML_FINISH);
-                        writer->send();
-                        return;
-                    }
-                    static const std::string CREATED_HTML_START =
-                        "<html><head>\n"
-                        "<title>201 Created</title>\n"
-                        "</head><body>\n"
-                        "<h1>Created</h1>\n"
-                        "<p>";
-                    static const std::string CREATED_HTML_FINISH =
-                        "</p>\n"
-                        "</body></html>\n";
-                    writer->get_response().set_status_code(http::types::RESPONSE_CODE_CREATED);
-                    writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_CREATED);
-                    writer->get_response().add_header(http::types::HEADER_LOCATION, http_request_ptr->get_resource());
-                    writer->write_no_copy(CREATED_HTML_START);
-                    writer << http_request_ptr->get_resource();
-                    writer->write_no_copy(CREATED_HTML_FINISH);
-                }
-                std::ios_base::openmode mode = http_request_ptr->get_method() == http::types::REQUEST_METHOD_POST?
-                                               std::ios::app : std::ios::out;
-                boost::filesystem::ofstream file_stream(file_path, mode);
-                file_stream.write(http_request_ptr->get_content(), http_request_ptr->get_content_length());
-                file_stream.close();
-                if (!boost::filesystem::exists(file_path)) {
-                    static const std::string PUT_FAILED_HTML_START =
-                        "<html><head>\n"
-                        "<title>500 Server Error</title>\n"
-                        "</head><body>\n"
-                        "<h1>Server Error</h1>\n"
-                        "<p>Error writing to ";
-                    static const std::string PUT_FAILED_HTML_FINISH =
-                        ".</p>\n"
-                        "</body></html>\n";
-                    writer->get_response().set_status_code(http::types::RESPONSE_CODE_SERVER_ERROR);
-                    writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_SERVER_ERROR);
-                    writer->write_no_copy(PUT_FAILED_HTML_START);
-                    writer << http_request_ptr->get_resource();
-                    writer->write_no_copy(PUT_FAILED_HTML_FINISH);
-                }
-                writer->send();
-            } else if (http_request_ptr->get_method() == http::types::REQUEST_METHOD_DELETE) {
-                if (!boost::filesystem::exists(file_path)) {
-                    sendNotFoundResponse(http_request_ptr, tcp_conn);
-                } else {
-                    try {
-                        boost::filesystem::remove(file_path);
-                        writer->get_response().set_status_code(http::types::RESPONSE_CODE_NO_CONTENT);
-                        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_NO_CONTENT);
-                        writer->send();
-                    } catch (std::exception& e) {
-                        static const std::string DELETE_FAILED_HTML_START =
-                            "<html><head>\n"
-                            "<title>500 Server Error</title>\n"
-                            "</head><body>\n"
-                            "<h1>Server Error</h1>\n"
-                            "<p>Could not delete ";
-                        static const std::string DELETE_FAILED_HTML_FINISH =
-                            ".</p>\n"
-                            "</body></html>\n";
-                        writer->get_response().set_status_code(http::types::RESPONSE_CODE_SERVER_ERROR);
-                        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_SERVER_ERROR);
-                        writer->write_no_copy(DELETE_FAILED_HTML_START);
-                        writer << http_request_ptr->get_resource()
-                            << ".</p><p>"
-                            << boost::diagnostic_information(e);
-                        writer->write_no_copy(DELETE_FAILED_HTML_FINISH);
-                        writer->send();
-                    }
-                }
-            } else {
-                // This should never be reached.
-                writer->get_response().set_status_code(http::types::RESPONSE_CODE_SERVER_ERROR);
-                writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_SERVER_ERROR);
-                writer->send();
+            std::ios_base::openmode mode = http_request_ptr->get_method() == http::types::REQUEST_METHOD_POST?
+                                           std::ios::app : std::ios::out;
+            boost::filesystem::ofstream file_stream(file_path, mode);
+            file_stream.write(http_request_ptr->get_content(), http_request_ptr->get_content_length());
+            file_stream.close();
+        }
+        if (!written || !boost::filesystem::exists(file_path))
+            cache_lookup.m_response_type = RESPONSE_WRITE_FAILED;
+        else
+            cache_lookup.m_response_type = (file_existed ? RESPONSE_NO_CONTENT : RESPONSE_CREATED);
+    } else if (http_request_ptr->get_method() == http::types::REQUEST_METHOD_DELETE) {
+        if (!m_writable) {
+            cache_lookup.m_response_type = RESPONSE_NOT_ALLOWED;
+        } else if (!boost::filesystem::exists(file_path)) {
+            cache_lookup.m_response_type = RESPONSE_NOT_FOUND;
+        } else {
+            try {
+                boost::filesystem::remove(file_path);
+                cache_lookup.m_response_type = RESPONSE_NO_CONTENT;
+            } catch (std::exception& e) {
+                cache_lookup.m_response_type = RESPONSE_DELETE_FAILED;
+                cache_lookup.m_error = boost::diagnostic_information(e);
             }
         }
     }
     // Any method not handled above is unimplemented.
     else {
+        cache_lookup.m_response_type = RESPONSE_NOT_IMPLEMENTED;
+    }
+}
+
+void FileService::sendResponse(http::request_ptr& http_request_ptr, tcp::connection_ptr& tcp_conn,
+                               CacheLookup& cache_lookup)
+{
+    const ResponseType response_type = cache_lookup.m_response_type;
+    if (response_type == RESPONSE_OK) {
+        // use DiskFileSender to send a file
+        DiskFileSenderPtr sender_ptr(DiskFileSender::create(cache_lookup.m_response_file,
+                                                            http_request_ptr, tcp_conn,
+                                                            m_max_chunk_size));
+        if (! cache_lookup.m_byte_ranges.empty())
+            sender_ptr->setByteRanges(cache_lookup.m_byte_ranges);
+        if (m_io_work)
+            sender_ptr->setDiskIOService(m_io_service);
+        sender_ptr->send();
+        return;
+    } else if (response_type == RESPONSE_NOT_FOUND) {
+        sendNotFoundResponse(http_request_ptr, tcp_conn);
+        return;
+    }
+
+    http::response_writer_ptr writer(http::response_writer::create(tcp_conn, *http_request_ptr,
+                                 boost::bind(&tcp::connection::finish, tcp_conn)));
+    switch (response_type) {
+    case RESPONSE_UNDEFINED:
+    case RESPONSE_OK:
+    case RESPONSE_NOT_FOUND:
+        // this should never happen
+        BOOST_ASSERT(false);
+        break;
+    case RESPONSE_HEAD_OK:
+    case RESPONSE_NOT_MODIFIED:
+    case RESPONSE_RANGE_NOT_SATISFIABLE: {
+        // sending headers only
+        const DiskFile& response_file = cache_lookup.m_response_file;
+        writer->get_response().set_content_type(response_file.getMimeType());
+
+        // set Last-Modified and ETag headers to enable client-side caching
+        writer->get_response().add_header(http::types::HEADER_LAST_MODIFIED,
+                                        response_file.getLastModifiedString());
+        if (! response_file.getETag().empty())
+            writer->get_response().add_header(HEADER_ETAG, response_file.getETag());
+
+        // let caches know that the content depends on Accept-Encoding
+        if (response_file.hasEncodedContent()) {
+            writer->get_response().add_header("Vary", "Accept-Encoding");
+            if (! response_file.getContentEncoding().empty())
+                writer->get_response().add_header(http::types::HEADER_CONTENT_ENCODING,
+                                                  response_file.getContentEncoding());
+        }
+
+        if (response_type == RESPONSE_NOT_MODIFIED) {
+            // set "Not Modified" response
+            writer->get_response().set_status_code(http::types::RESPONSE_CODE_NOT_MODIFIED);
+            writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_NOT_MODIFIED);
+        } else if (response_type == RESPONSE_HEAD_OK) {
+            // set "OK" response (not really necessary since this is the default)
+            writer->get_response().set_status_code(http::types::RESPONSE_CODE_OK);
+            writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_OK);
+            writer->get_response().add_header(HEADER_ACCEPT_RANGES, "bytes");
+        } else {
+            // set "Requested Range Not Satisfiable" response
+            writer->get_response().set_status_code(http::types::RESPONSE_CODE_RANGE_NOT_SATISFIABLE);
+            writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_RANGE_NOT_SATISFIABLE);
+            writer->get_response().add_header(HEADER_CONTENT_RANGE, "bytes */"
+                + boost::lexical_cast<std::string>(response_file.getFileSize()));
+        }
+        break;
+    }
+    case RESPONSE_OUTSIDE_DIRECTORY:
+    case RESPONSE_IS_DIRECTORY: {
+        static const std::string FORBIDDEN_HTML_START =
+            "<html><head>\n"
+            "<title>403 Forbidden</title>\n"
+            "</head><body>\n"
+            "<h1>Forbidden</h1>\n"
+            "<p>The requested URL ";
+        static const std::string OUTSIDE_DIRECTORY_HTML_FINISH =
+            " is not in the configured directory.</p>\n"
+            "</body></html>\n";
+        static const std::string IS_DIRECTORY_HTML_FINISH =
+            " is a directory.</p>\n"
+            "</body></html>\n";
+        writer->get_response().set_status_code(http::types::RESPONSE_CODE_FORBIDDEN);
+        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_FORBIDDEN);
+        if (http_request_ptr->get_method() != http::types::REQUEST_METHOD_HEAD) {
+            writer->write_no_copy(FORBIDDEN_HTML_START);
+            writer << http_request_ptr->get_resource();
+            writer->write_no_copy(response_type == RESPONSE_OUTSIDE_DIRECTORY
+                                  ? OUTSIDE_DIRECTORY_HTML_FINISH : IS_DIRECTORY_HTML_FINISH);
+        }
+        break;
+    }
+    case RESPONSE_NOT_ALLOWED: {
+        static const std::string NOT_ALLOWED_HTML_START =
+            "<html><head>\n"
+            "<title>405 Method Not Allowed</title>\n"
+            "</head><body>\n"
+            "<h1>Not Allowed</h1>\n"
+            "<p>The requested method ";
+        static const std::string NOT_ALLOWED_HTML_FINISH =
+            " is not allowed on this server.</p>\n"
+            "</body></html>\n";
+        writer->get_response().set_status_code(http::types::RESPONSE_CODE_METHOD_NOT_ALLOWED);
+        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_METHOD_NOT_ALLOWED);
+        writer->write_no_copy(NOT_ALLOWED_HTML_START);
+        writer << http_request_ptr->get_method();
+        writer->write_no_copy(NOT_ALLOWED_HTML_FINISH);
+        writer->get_response().add_header("Allow", "GET, HEAD");
+        break;
+    }
+    case RESPONSE_CREATED: {
+        static const std::string CREATED_HTML_START =
+            "<html><head>\n"
+            "<title>201 Created</title>\n"
+            "</head><body>\n"
+            "<h1>Created</h1>\n"
+            "<p>";
+        static const std::string CREATED_HTML_FINISH =
+            "</p>\n"
+            "</body></html>\n";
+        writer->get_response().set_status_code(http::types::RESPONSE_CODE_CREATED);
+        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_CREATED);
+        writer->get_response().add_header(http::types::HEADER_LOCATION, http_request_ptr->get_resource());
+        writer->write_no_copy(CREATED_HTML_START);
+        writer << http_request_ptr->get_resource();
+        writer->write_no_copy(CREATED_HTML_FINISH);
+        break;
+    }
+    case RESPONSE_NO_CONTENT:
+        writer->get_response().set_status_code(http::types::RESPONSE_CODE_NO_CONTENT);
+        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_NO_CONTENT);
+        break;
+    case RESPONSE_DIRECTORY_NOT_FOUND: {
+        static const std::string NOT_FOUND_HTML_START =
+            "<html><head>\n"
+            "<title>404 Not Found</title>\n"
+            "</head><body>\n"
+            "<h1>Not Found</h1>\n"
+            "<p>The directory of the requested URL ";
+        static const std::string NOT_FOUND_HTML_FINISH =
+            " was not found on this server.</p>\n"
+            "</body></html>\n";
+        writer->get_response().set_status_code(http::types::RESPONSE_CODE_NOT_FOUND);
+        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_NOT_FOUND);
+        writer->write_no_copy(NOT_FOUND_HTML_START);
+        writer << http_request_ptr->get_resource();
+        writer->write_no_copy(NOT_FOUND_HTML_FINISH);
+        break;
+    }
+    case RESPONSE_TOO_LARGE: {
+        static const std::string TOO_LARGE_HTML_START =
+            "<html><head>\n"
+            "<title>413 Request Entity Too Large</title>\n"
+            "</head><body>\n"
+            "<h1>Request Entity Too Large</h1>\n"
+            "<p>The content sent to ";
+        static const std::string TOO_LARGE_HTML_FINISH =
+            " is larger than this server allows.</p>\n"
+            "</body></html>\n";
+        writer->get_response().set_status_code(http::types::RESPONSE_CODE_REQUEST_ENTITY_TOO_LARGE);
+        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_REQUEST_ENTITY_TOO_LARGE);
+        writer->write_no_copy(TOO_LARGE_HTML_START);
+        writer << http_request_ptr->get_resource();
+        writer->write_no_copy(TOO_LARGE_HTML_FINISH);
+        break;
+    }
+    case RESPONSE_WRITE_FAILED: {
+        static const std::string PUT_FAILED_HTML_START =
+            "<html><head>\n"
+            "<title>500 Server Error</title>\n"
+            "</head><body>\n"
+            "<h1>Server Error</h1>\n"
+            "<p>Error writing to ";
+        static const std::string PUT_FAILED_HTML_FINISH =
+            ".</p>\n"
+            "</body></html>\n";
+        writer->get_response().set_status_code(http::types::RESPONSE_CODE_SERVER_ERROR);
+        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_SERVER_ERROR);
+        writer->write_no_copy(PUT_FAILED_HTML_START);
+        writer << http_request_ptr->get_resource();
+        writer->write_no_copy(PUT_FAILED_HTML_FINISH);
+        break;
+    }
+    case RESPONSE_DELETE_FAILED: {
+        static const std::string DELETE_FAILED_HTML_START =
+            "<html><head>\n"
+            "<title>500 Server Error</title>\n"
+            "</head><body>\n"
+            "<h1>Server Error</h1>\n"
+            "<p>Could not delete ";
+        static const std::string DELETE_FAILED_HTML_FINISH =
+            ".</p>\n"
+            "</body></html>\n";
+        writer->get_response().set_status_code(http::types::RESPONSE_CODE_SERVER_ERROR);
+        writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_SERVER_ERROR);
+        writer->write_no_copy(DELETE_FAILED_HTML_START);
+        writer << http_request_ptr->get_resource()
+            << ".</p><p>"
+            << cache_lookup.m_error;
+        writer->write_no_copy(DELETE_FAILED_HTML_FINISH);
+        break;
+    }
+    case RESPONSE_NOT_IMPLEMENTED: {
         static const std::string NOT_IMPLEMENTED_HTML_START =
             "<html><head>\n"
             "<title>501 Not Implemented</title>\n"
@@ -547,15 +937,15 @@ void FileService::operator()(http::request_ptr& http_request_ptr, tcp::connectio
         static const std::string NOT_IMPLEMENTED_HTML_FINISH =
             " is not implemented on this server.</p>\n"
             "</body></html>\n";
-        http::response_writer_ptr writer(http::response_writer::create(tcp_conn, *http_request_ptr,
-                                     boost::bind(&tcp::connection::finish, tcp_conn)));
         writer->get_response().set_status_code(http::types::RESPONSE_CODE_NOT_IMPLEMENTED);
         writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_NOT_IMPLEMENTED);
         writer->write_no_copy(NOT_IMPLEMENTED_HTML_START);
         writer << http_request_ptr->get_method();
         writer->write_no_copy(NOT_IMPLEMENTED_HTML_FINISH);
-        writer->send();
+        break;
     }
+    }
+    writer->send();
 }
 
 void FileService::sendNotFoundResponse(http::request_ptr& http_request_ptr,
@@ -586,36 +976,87 @@ void FileService::start(void)
 {
     PION_LOG_DEBUG(m_logger, "Starting up resource (" << get_resource() << ')');
 
+    // force caching if scan == (2 | 3)
+    if (m_cache_setting == 0 && m_scan_setting > 1)
+        m_cache_setting = 1;
+
+    // start the disk I/O threads
+    if (m_io_threads > 0 && ! m_io_work) {
+        m_io_service.reset();
+        m_io_work.reset(new boost::asio::io_service::work(m_io_service));
+        for (unsigned int n = 0; n < m_io_threads; ++n) {
+            boost::shared_ptr<boost::thread> new_thread(new boost::thread(
+                boost::bind(&FileService::runIOThread, this) ));
+            m_io_thread_pool.push_back(new_thread);
+        }
+    }
+
+    // start watching before scanning, so that no changes are missed
+    if (m_watch && ! m_directory.empty() && (m_cache_setting > 0 || m_scan_setting > 0))
+        startWatching();
+
     // scan directory/file if scan setting != 0
     if (m_scan_setting != 0) {
-        // force caching if scan == (2 | 3)
-        if (m_cache_setting == 0 && m_scan_setting > 1)
-            m_cache_setting = 1;
+        m_scanned_files = 0;
+        m_scan_start_time = boost::posix_time::microsec_clock::universal_time();
+
+        if (m_scan_threads == 0) {
+            // add entry for file if one is defined
+            if (! m_file.empty()) {
+                // use empty relative_path for file option
+                // use placeholder entry (do not pre-populate) if scan == 1
+                scanFile("", m_file);
+            }
 
-        boost::mutex::scoped_lock cache_lock(m_cache_mutex);
+            // scan directory if one is defined
+            if (! m_directory.empty())
+                scanDirectory(m_directory);
 
-        // add entry for file if one is defined
-        if (! m_file.empty()) {
-            // use empty relative_path for file option
-            // use placeholder entry (do not pre-populate) if scan == 1
-            addCacheEntry("", m_file, m_scan_setting == 1);
-        }
+            boost::mutex::scoped_lock scan_lock(m_scan_mutex);
+            finishScan();
 
-        // scan directory if one is defined
-        if (! m_directory.empty())
-            scanDirectory(m_directory);
+        } else {
+            // scan in the background, so that requests can be served meanwhile
+            PION_LOG_INFO(m_logger, "Scanning in the background (" << get_resource()
+                          << ") using " << m_scan_threads << " threads");
+            {
+                boost::mutex::scoped_lock scan_lock(m_scan_mutex);
+                m_scanning = true;
+            }
+            m_scan_service.reset();
+            if (! m_file.empty())
+                m_scan_service.post(boost::bind(&FileService::scanFile, this, std::string(), m_file));
+            if (! m_directory.empty())
+                m_scan_service.post(boost::bind(&FileService::scanDirectory, this, m_directory, true));
+
+            m_scan_threads_running = m_scan_threads;
+            for (unsigned int n = 0; n < m_scan_threads; ++n) {
+                boost::shared_ptr<boost::thread> new_thread(new boost::thread(
+                    boost::bind(&FileService::runScanThread, this) ));
+                m_scan_thread_pool.push_back(new_thread);
+            }
+        }
     }
 }
 
 void FileService::stop(void)
 {
     PION_LOG_DEBUG(m_logger, "Shutting down resource (" << get_resource() << ')');
+    stopScanning();
+    stopWatching();
+    stopIOThreads();
+    {
+        // forget the uploads that were not handled (their temporary files are
+        // removed when the payload handlers that own them are destroyed)
+        boost::mutex::scoped_lock upload_lock(m_upload_mutex);
+        m_uploads.clear();
+    }
     // clear cached files (if started again, it will re-scan)
-    boost::mutex::scoped_lock cache_lock(m_cache_mutex);
-    m_cache_map.clear();
+    m_cache.clear();
 }
 
-void FileService::scanDirectory(const boost::filesystem::path& dir_path)
+void FileService::scanDirectory(const boost::filesystem::path& dir_path,
+                                const bool parallel)
 {
 # if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
     PION_LOG_DEBUG(m_logger, "Scanning directory (" << get_resource() << "): "
@@ -634,11 +1075,22 @@ void FileService::scanDirectory(const boost::filesystem::path& dir_path)
             // item is a sub-directory
 
             // recursively call scanDirectory()
-            scanDirectory(*itr);
+            if (parallel)
+                m_scan_service.post(boost::bind(&FileService::scanDirectory, this, itr->path(), true));
+            else
+                scanDirectory(*itr);
 
         } else {
             // item is a regular file
 
+            // skip the temporary files of uploads
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+            if (DiskFileUpload::isTempFileName(itr->path().filename().string()))
+#else
+            if (DiskFileUpload::isTempFileName(itr->path().leaf()))
+#endif
+                continue;
+
             // figure out relative path to the file
 # if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
             std::string file_path_string( itr->path().string() );
@@ -649,43 +1101,132 @@ void FileService::scanDirectory(const boost::filesystem::path& dir_path)
 #endif
 
             // add item to cache (use placeholder if scan == 1)
-            addCacheEntry(relative_path, *itr, m_scan_setting == 1);
+            if (parallel)
+                m_scan_service.post(boost::bind(&FileService::scanFile, this, relative_path, itr->path()));
+            else
+                scanFile(relative_path, *itr);
         }
     }
 }
 
-std::pair<FileService::CacheMap::iterator, bool>
-FileService::addCacheEntry(const std::string& relative_path,
-                           const boost::filesystem::path& file_path,
-                           const bool placeholder)
+void FileService::runIOThread(void)
 {
-# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
-    DiskFile cache_entry(file_path, NULL, 0, 0, findMIMEType(file_path.filename().string()));
-#else
-    DiskFile cache_entry(file_path, NULL, 0, 0, findMIMEType(file_path.leaf()));
-#endif
-    if (! placeholder) {
-        cache_entry.update();
-        // only read the file if its size is <= max_cache_size
-        if (m_max_cache_size==0 || cache_entry.getFileSize() <= m_max_cache_size) {
-            try { cache_entry.read(); }
-            catch (std::exception&) {
-# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
-                PION_LOG_ERROR(m_logger, "Unable to add file to cache: "
-                               << file_path.string());
-#else
-                PION_LOG_ERROR(m_logger, "Unable to add file to cache: "
-                               << file_path.file_string());
-#endif
-                return std::make_pair(m_cache_map.end(), false);
-            }
+    while (true) {
+        try {
+            m_io_service.run();
+            break;
+        } catch (std::exception& e) {
+            PION_LOG_ERROR(m_logger, "Error in disk I/O thread (" << get_resource() << "): "
+                           << boost::diagnostic_information(e));
         }
     }
+}
 
-    std::pair<CacheMap::iterator, bool> add_entry_result
-        = m_cache_map.insert( std::make_pair(relative_path, cache_entry) );
+void FileService::stopIOThreads(void)
+{
+    if (! m_io_work)
+        return;
 
-    if (add_entry_result.second) {
+    // let the threads finish the requests that were already posted
+    m_io_work.reset();
+    for (std::vector<boost::shared_ptr<boost::thread> >::iterator i = m_io_thread_pool.begin();
+         i != m_io_thread_pool.end(); ++i)
+    {
+        (*i)->join();
+    }
+    m_io_thread_pool.clear();
+}
+
+void FileService::scanFile(const std::string& relative_path,
+                           const boost::filesystem::path& file_path)
+{
+    addCacheEntry(relative_path, file_path, m_scan_setting == 1);
+
+    boost::mutex::scoped_lock scan_lock(m_scan_mutex);
+    if (++m_scanned_files % SCAN_PROGRESS_INTERVAL == 0) {
+        PION_LOG_INFO(m_logger, "Scanned " << m_scanned_files << " files ("
+                      << get_resource() << ')');
+    }
+}
+
+void FileService::runScanThread(void)
+{
+    // keep going after errors, so that one unreadable directory does not stop the scan
+    while (true) {
+        try {
+            m_scan_service.run();
+            break;
+        } catch (std::exception& e) {
+            PION_LOG_ERROR(m_logger, "Error while scanning (" << get_resource() << "): "
+                           << boost::diagnostic_information(e));
+        }
+    }
+
+    boost::mutex::scoped_lock scan_lock(m_scan_mutex);
+    if (--m_scan_threads_running == 0 && m_scanning)
+        finishScan();
+}
+
+void FileService::finishScan(void)
+{
+    const boost::posix_time::time_duration scan_time(
+        boost::posix_time::microsec_clock::universal_time() - m_scan_start_time);
+    PION_LOG_INFO(m_logger, "Finished scanning (" << get_resource() << "): "
+                  << m_scanned_files << " files in " << scan_time.total_milliseconds() << " ms");
+    m_scanning = false;
+}
+
+void FileService::stopScanning(void)
+{
+    if (m_scan_thread_pool.empty())
+        return;
+
+    {
+        boost::mutex::scoped_lock scan_lock(m_scan_mutex);
+        if (m_scanning)
+            PION_LOG_INFO(m_logger, "Stopped scanning (" << get_resource() << ") after "
+                          << m_scanned_files << " files");
+        m_scanning = false;
+    }
+    m_scan_service.stop();
+    for (std::vector<boost::shared_ptr<boost::thread> >::iterator i = m_scan_thread_pool.begin();
+         i != m_scan_thread_pool.end(); ++i)
+    {
+        (*i)->join();
+    }
+    m_scan_thread_pool.clear();
+}
+
+bool FileService::addCacheEntry(const std::string& relative_path,
+                           const boost::filesystem::path& file_path,
+                           const bool placeholder)
+{
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+    DiskFile cache_entry(file_path, NULL, 0, 0, findMIMEType(file_path.filename().string()));
+#else
+    DiskFile cache_entry(file_path, NULL, 0, 0, findMIMEType(file_path.leaf()));
+#endif
+    if (! placeholder) {
+        cache_entry.update();
+        // only read the file if its size is <= max_cache_size and fits the budget
+        if (isCacheable(cache_entry.getFileSize())) {
+            try { cacheFileContent(cache_entry); }
+            catch (std::exception&) {
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+                PION_LOG_ERROR(m_logger, "Unable to add file to cache: "
+                               << file_path.string());
+#else
+                PION_LOG_ERROR(m_logger, "Unable to add file to cache: "
+                               << file_path.file_string());
+#endif
+                return false;
+            }
+        }
+    }
+
+    const bool added = m_cache.add(relative_path, cache_entry);
+
+    if (added) {
 # if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
         PION_LOG_DEBUG(m_logger, "Added file to cache: "
                        << file_path.string());
@@ -703,7 +1244,486 @@ FileService::addCacheEntry(const std::string& relative_path,
 #endif
     }
 
-    return add_entry_result;
+    return added;
+}
+
+void FileService::invalidateCacheEntry(const std::string& relative_path,
+                                       const boost::filesystem::path& file_path)
+{
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+    m_cache.insert(relative_path, DiskFile(file_path, NULL, 0, 0,
+                                           findMIMEType(file_path.filename().string())));
+#else
+    m_cache.insert(relative_path, DiskFile(file_path, NULL, 0, 0,
+                                           findMIMEType(file_path.leaf())));
+#endif
+}
+
+void FileService::startWatching(void)
+{
+#ifdef PION_HAVE_INOTIFY
+    if (m_watch_thread)
+        return;
+
+    m_inotify_fd = ::inotify_init();
+    if (m_inotify_fd < 0) {
+        PION_LOG_ERROR(m_logger, "Unable to watch directory (" << get_resource()
+                       << "): inotify_init() failed");
+        return;
+    }
+    if (::pipe(m_watch_pipe) != 0) {
+        PION_LOG_ERROR(m_logger, "Unable to watch directory (" << get_resource()
+                       << "): pipe() failed");
+        ::close(m_inotify_fd);
+        m_inotify_fd = -1;
+        return;
+    }
+
+    watchDirectory(m_directory, false);
+    setWatching(true);
+    m_watch_thread.reset(new boost::thread(boost::bind(&FileService::watchFiles, this)));
+#endif
+}
+
+void FileService::stopWatching(void)
+{
+#ifdef PION_HAVE_INOTIFY
+    if (! m_watch_thread)
+        return;
+
+    // closing the pipe's write end always wakes up the watcher thread
+    // (poll() reports a hang-up), so it is safe to wait for it to finish
+    ::close(m_watch_pipe[1]);
+    m_watch_thread->join();
+    m_watch_thread.reset();
+    setWatching(false);
+
+    ::close(m_inotify_fd);
+    ::close(m_watch_pipe[0]);
+    m_inotify_fd = m_watch_pipe[0] = m_watch_pipe[1] = -1;
+    m_watch_dirs.clear();
+#endif
+}
+
+#ifdef PION_HAVE_INOTIFY
+
+void FileService::watchDirectory(const boost::filesystem::path& dir_path, const bool add_files)
+{
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+    const std::string dir_path_string( dir_path.string() );
+    const std::string root_path_string( m_directory.string() );
+#else
+    const std::string dir_path_string( dir_path.directory_string() );
+    const std::string root_path_string( m_directory.directory_string() );
+#endif
+    const int wd = ::inotify_add_watch(m_inotify_fd, dir_path_string.c_str(),
+        IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB
+        | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR);
+    if (wd < 0) {
+        PION_LOG_ERROR(m_logger, "Unable to watch directory (" << get_resource()
+                       << "): " << dir_path_string);
+        return;
+    }
+    m_watch_dirs[wd] = (dir_path_string.size() > root_path_string.size()
+                        ? dir_path_string.substr(root_path_string.size() + 1) : std::string());
+
+    boost::filesystem::directory_iterator end_itr;
+    for (boost::filesystem::directory_iterator itr(dir_path); itr != end_itr; ++itr) {
+        if (boost::filesystem::is_directory(*itr)) {
+            watchDirectory(*itr, add_files);
+        } else if (add_files) {
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+            const std::string file_path_string( itr->path().string() );
+#else
+            const std::string file_path_string( itr->path().file_string() );
+#endif
+            invalidateCacheEntry(file_path_string.substr(root_path_string.size() + 1), *itr);
+        }
+    }
+}
+
+void FileService::watchFiles(void)
+{
+    // aligned for struct inotify_event
+    long event_buf[4096 / sizeof(long)];
+    char * const buf = reinterpret_cast<char*>(event_buf);
+
+    while (true) {
+        struct pollfd poll_fds[2];
+        poll_fds[0].fd = m_inotify_fd;
+        poll_fds[0].events = POLLIN;
+        poll_fds[0].revents = 0;
+        poll_fds[1].fd = m_watch_pipe[0];
+        poll_fds[1].events = POLLIN;
+        poll_fds[1].revents = 0;
+        if (::poll(poll_fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            PION_LOG_ERROR(m_logger, "Stopped watching directory (" << get_resource()
+                           << "): poll() failed");
+            break;
+        }
+        if (poll_fds[1].revents != 0)
+            break;  // stopWatching() was called
+
+        const ssize_t bytes_read = ::read(m_inotify_fd, buf, sizeof(event_buf));
+        if (bytes_read <= 0) {
+            if (bytes_read < 0 && errno == EINTR)
+                continue;
+            PION_LOG_ERROR(m_logger, "Stopped watching directory (" << get_resource()
+                           << "): read() failed");
+            break;
+        }
+
+        for (const char *ptr = buf; ptr < buf + bytes_read; ) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event*>(ptr);
+            try {
+                handleWatchEvent(event->wd, event->mask,
+                                 event->len > 0 ? std::string(event->name) : std::string());
+            } catch (std::exception& e) {
+                PION_LOG_ERROR(m_logger, "Unable to update cache for change in directory ("
+                               << get_resource() << "): " << boost::diagnostic_information(e));
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    setWatching(false);
+}
+
+void FileService::handleWatchEvent(const int wd, const unsigned int mask, const std::string& name)
+{
+    if (mask & IN_Q_OVERFLOW) {
+        // events were lost: start over
+        PION_LOG_WARN(m_logger, "Too many changes in directory (" << get_resource()
+                      << "); clearing cache");
+        m_cache.clear();
+
+        // directories created or moved since the events were lost are not
+        // watched yet, and those moved away still are: rebuild the watches
+        std::map<int, std::string> old_watch_dirs;
+        old_watch_dirs.swap(m_watch_dirs);
+        watchDirectory(m_directory, false);
+        for (std::map<int, std::string>::const_iterator i = old_watch_dirs.begin();
+             i != old_watch_dirs.end(); ++i)
+        {
+            if (m_watch_dirs.find(i->first) == m_watch_dirs.end())
+                ::inotify_rm_watch(m_inotify_fd, i->first);
+        }
+
+        if (m_scan_setting != 0) {
+            if (! m_file.empty())
+                addCacheEntry("", m_file, m_scan_setting == 1);
+            scanDirectory(m_directory);
+        }
+        return;
+    }
+
+    std::map<int, std::string>::iterator dir_itr = m_watch_dirs.find(wd);
+    if (dir_itr == m_watch_dirs.end())
+        return;
+    if (mask & IN_IGNORED) {
+        // the directory was removed
+        m_watch_dirs.erase(dir_itr);
+        return;
+    }
+    // the temporary files of uploads are not cached
+    if (name.empty() || DiskFileUpload::isTempFileName(name))
+        return;
+
+    const std::string relative_path(dir_itr->second.empty() ? name : dir_itr->second + '/' + name);
+    const boost::filesystem::path file_path(m_directory / relative_path);
+
+    if (mask & IN_ISDIR) {
+        if (mask & (IN_CREATE | IN_MOVED_TO)) {
+            // watch the new directory, and add any files that it already has
+            PION_LOG_DEBUG(m_logger, "Watching new directory (" << get_resource()
+                           << "): " << relative_path);
+            watchDirectory(file_path, true);
+        } else if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+            m_cache.erasePrefix(relative_path + '/');
+        }
+    } else if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+        PION_LOG_DEBUG(m_logger, "Removing cache entry for deleted file ("
+                       << get_resource() << "): " << relative_path);
+        m_cache.erase(relative_path);
+    } else {
+        // the file was added or changed: it is read again when next requested;
+        // new files are added even if scan == (1 | 3)
+        PION_LOG_DEBUG(m_logger, "Invalidating cache entry for changed file ("
+                       << get_resource() << "): " << relative_path);
+        invalidateCacheEntry(relative_path, file_path);
+    }
+}
+
+#endif
+
+bool FileService::mapsFileContent(void) const
+{
+    // a mapped file that is truncated makes the process crash (SIGBUS) when
+    // the mapping is read, so only files that must not change are mapped
+    return m_mmap && m_cache_setting == 2 && ! m_writable;
+}
+
+void FileService::cacheFileContent(DiskFile& file)
+{
+    if (mapsFileContent())
+        file.map();
+    else
+        file.read();
+    cacheEncodedContent(file);
+}
+
+void FileService::cacheEncodedContent(DiskFile& file)
+{
+    file.clearEncodedContent();
+
+    if (m_precompressed) {
+        // look for sidecar files that are at least as new as the file
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+        const std::string file_path_string(file.getFilePath().string());
+#else
+        const std::string file_path_string(file.getFilePath().file_string());
+#endif
+        for (int n = 0; n < DiskFile::CODING_COUNT; ++n) {
+            const boost::filesystem::path sidecar_path(file_path_string + SIDECAR_EXTENSIONS[n]);
+            if (! boost::filesystem::exists(sidecar_path)
+                || boost::filesystem::is_directory(sidecar_path)
+                || boost::filesystem::last_write_time(sidecar_path) < file.getLastModified())
+                continue;
+            DiskFile sidecar(sidecar_path, NULL, 0, 0, file.getMimeType());
+            sidecar.update();
+            if (mapsFileContent())
+                sidecar.map();
+            else
+                sidecar.read();
+            file.setEncodedContent(static_cast<DiskFile::ContentCoding>(n), sidecar);
+        }
+    }
+
+#ifdef PION_HAVE_ZLIB
+    if (m_compress && ! file.hasEncodedContent(DiskFile::CODING_GZIP)
+        && file.hasFileContent() && file.getFileSize() > 0
+        && file.getFileSize() <= std::numeric_limits<uInt>::max()
+        && isCompressible(file.getMimeType()))
+    {
+        // compress the content once, using the best compression level
+        z_stream zstream;
+        memset(&zstream, 0, sizeof(zstream));
+        if (deflateInit2(&zstream, Z_BEST_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16,
+                         8, Z_DEFAULT_STRATEGY) != Z_OK)
+            return;
+        const uLong bound = deflateBound(&zstream, file.getFileSize());
+        boost::scoped_array<char> buf(new char[bound]);
+        zstream.next_in = reinterpret_cast<Bytef*>(file.getFileContent());
+        zstream.avail_in = static_cast<uInt>(file.getFileSize());
+        zstream.next_out = reinterpret_cast<Bytef*>(buf.get());
+        zstream.avail_out = static_cast<uInt>(bound);
+        const int result = deflate(&zstream, Z_FINISH);
+        const unsigned long compressed_size = zstream.total_out;
+        deflateEnd(&zstream);
+
+        // only keep the compressed content if it is smaller
+        if (result == Z_STREAM_END && compressed_size < file.getFileSize()) {
+            boost::shared_array<char> compressed_content(new char[compressed_size]);
+            memcpy(compressed_content.get(), buf.get(), compressed_size);
+            file.setEncodedContent(DiskFile::CODING_GZIP, compressed_content, compressed_size);
+        }
+    }
+#endif
+}
+
+void FileService::selectContentCoding(const http::request_ptr& http_request_ptr,
+                                      DiskFile& file)
+{
+    if (! file.hasEncodedContent())
+        return;
+    const std::string& accept_encoding(http_request_ptr->get_header("Accept-Encoding"));
+    if (accept_encoding.empty())
+        return;
+
+    // prefer Brotli, which compresses text better than gzip
+    static const DiskFile::ContentCoding PREFERRED_CODINGS[] = { DiskFile::CODING_BR, DiskFile::CODING_GZIP };
+    for (unsigned int n = 0; n < sizeof(PREFERRED_CODINGS) / sizeof(PREFERRED_CODINGS[0]); ++n) {
+        const DiskFile::ContentCoding coding = PREFERRED_CODINGS[n];
+        if (file.hasEncodedContent(coding)
+            && acceptsContentCoding(accept_encoding, DiskFile::getContentCodingName(coding)))
+        {
+            file.selectContentCoding(coding);
+            return;
+        }
+    }
+}
+
+bool FileService::acceptsContentCoding(const std::string& accept_encoding,
+                                       const std::string& coding)
+{
+    // a coding listed explicitly takes precedence over "*"
+    bool found_wildcard = false;
+    bool wildcard_accepted = false;
+    std::string::size_type pos = 0;
+    while (pos < accept_encoding.size()) {
+        std::string::size_type end = accept_encoding.find(',', pos);
+        if (end == std::string::npos)
+            end = accept_encoding.size();
+        const std::string item(accept_encoding, pos, end - pos);
+        pos = end + 1;
+
+        // split the item into the coding name and its parameters
+        const std::string::size_type params_pos = item.find(';');
+        const std::string name(boost::algorithm::trim_copy(item.substr(0, params_pos)));
+        bool accepted = true;
+        if (params_pos != std::string::npos) {
+            const std::string::size_type q_pos = item.find("q=", params_pos);
+            if (q_pos != std::string::npos)
+                accepted = (strtod(item.c_str() + q_pos + 2, NULL) > 0.0);
+        }
+
+        if (boost::algorithm::iequals(name, coding))
+            return accepted;
+        if (name == "*") {
+            found_wildcard = true;
+            wildcard_accepted = accepted;
+        }
+    }
+    return found_wildcard && wildcard_accepted;
+}
+
+bool FileService::matchesETag(const std::string& if_none_match, const std::string& etag)
+{
+    if (etag.empty())
+        return false;
+    if (boost::algorithm::trim_copy(if_none_match) == "*")
+        return true;
+
+    // compare the opaque tags, ignoring any weakness indicators ("W/")
+    std::string::size_type pos = 0;
+    while ((pos = if_none_match.find('"', pos)) != std::string::npos) {
+        const std::string::size_type end = if_none_match.find('"', pos + 1);
+        if (end == std::string::npos)
+            break;
+        if (if_none_match.compare(pos, end - pos + 1, etag) == 0)
+            return true;
+        pos = end + 1;
+    }
+    return false;
+}
+
+/// parses a byte position in a Range header (false if it is not a number)
+static bool parseBytePosition(const std::string& str, unsigned long& pos)
+{
+    if (str.empty())
+        return false;
+    pos = 0;
+    for (std::string::const_iterator i = str.begin(); i != str.end(); ++i) {
+        const unsigned long digit = static_cast<unsigned long>(*i - '0');
+        if (digit > 9 || pos > (static_cast<unsigned long>(-1) - digit) / 10)
+            return false;
+        pos = pos * 10 + digit;
+    }
+    return true;
+}
+
+bool FileService::parseRangeHeader(const std::string& range_header,
+                                   const unsigned long file_size,
+                                   DiskFileSender::ByteRanges& ranges)
+{
+    ranges.clear();
+    static const std::string BYTES_UNIT("bytes=");
+    if (! boost::algorithm::istarts_with(range_header, BYTES_UNIT))
+        return false;
+
+    DiskFileSender::ByteRanges satisfiable_ranges;
+    std::size_t num_specs = 0;
+    std::string::size_type pos = BYTES_UNIT.size();
+    while (pos <= range_header.size()) {
+        std::string::size_type end = range_header.find(',', pos);
+        if (end == std::string::npos)
+            end = range_header.size();
+        const std::string spec(boost::algorithm::trim_copy(range_header.substr(pos, end - pos)));
+        pos = end + 1;
+        if (spec.empty())
+            continue;
+        if (++num_specs > MAX_BYTE_RANGES)
+            return false;
+
+        const std::string::size_type dash_pos = spec.find('-');
+        if (dash_pos == std::string::npos)
+            return false;
+        unsigned long first, last;
+        if (dash_pos == 0) {
+            // suffix range: the last N bytes of the file
+            unsigned long suffix_length;
+            if (! parseBytePosition(spec.substr(1), suffix_length))
+                return false;
+            if (suffix_length == 0 || file_size == 0)
+                continue;
+            first = (suffix_length < file_size ? file_size - suffix_length : 0);
+            last = file_size - 1;
+        } else {
+            if (! parseBytePosition(spec.substr(0, dash_pos), first))
+                return false;
+            if (dash_pos + 1 == spec.size()) {
+                last = file_size - 1;
+            } else if (! parseBytePosition(spec.substr(dash_pos + 1), last) || last < first) {
+                return false;
+            }
+            // ranges that start past the end of the file are not satisfiable
+            if (first >= file_size)
+                continue;
+            if (last >= file_size)
+                last = file_size - 1;
+        }
+        satisfiable_ranges.push_back(std::make_pair(first, last - first + 1));
+    }
+
+    // a header that does not list any ranges is invalid
+    if (num_specs == 0)
+        return false;
+    if (satisfiable_ranges.empty())
+        return true;
+
+    // requesting more bytes than the file has (e.g. "0-,0-,0-") only makes
+    // sense to amplify the response; the header is ignored (CVE-2011-3192)
+    unsigned long total_bytes = 0;
+    for (DiskFileSender::ByteRanges::const_iterator i = satisfiable_ranges.begin();
+         i != satisfiable_ranges.end(); ++i)
+    {
+        total_bytes += i->second;
+        if (total_bytes > file_size)
+            return false;
+    }
+
+    // merge overlapping and adjacent ranges, so that no byte is sent twice
+    std::sort(satisfiable_ranges.begin(), satisfiable_ranges.end());
+    ranges.push_back(satisfiable_ranges.front());
+    for (DiskFileSender::ByteRanges::const_iterator i = satisfiable_ranges.begin() + 1;
+         i != satisfiable_ranges.end(); ++i)
+    {
+        DiskFileSender::ByteRange& last_range = ranges.back();
+        const unsigned long last_end = last_range.first + last_range.second;
+        if (i->first <= last_end) {
+            if (i->first + i->second > last_end)
+                last_range.second = i->first + i->second - last_range.first;
+        } else {
+            ranges.push_back(*i);
+        }
+    }
+
+    // many small parts are mostly multipart overhead; the header is ignored
+    if (ranges.size() > MAX_BYTE_RANGE_PARTS) {
+        ranges.clear();
+        return false;
+    }
+    return true;
+}
+
+bool FileService::isCompressible(const std::string& mime_type)
+{
+    return boost::algorithm::starts_with(mime_type, "text/")
+        || boost::algorithm::contains(mime_type, "javascript")
+        || boost::algorithm::contains(mime_type, "json")
+        || boost::algorithm::contains(mime_type, "xml");
 }
 
 std::string FileService::findMIMEType(const std::string& file_name) {
@@ -744,18 +1764,68 @@ void FileService::createMIMETypes(void) {
 
 // DiskFile member functions
 
+const std::string& DiskFile::getContentCodingName(ContentCoding coding)
+{
+    return CONTENT_CODING_NAMES[coding];
+}
+
 void DiskFile::update(void)
 {
-    // set file_size and last_modified
-    m_file_size = boost::numeric_cast<std::streamsize>(boost::filesystem::file_size( m_file_path ));
-    m_last_modified = boost::filesystem::last_write_time( m_file_path );
+    // set file_size, last_modified and the entity tag
+    getFileStatus(m_file_size, m_last_modified, m_etag);
     m_last_modified_string = http::types::get_date_string( m_last_modified );
 }
 
+#ifndef PION_WIN32
+/// returns the nanoseconds part of a file's modification time
+static inline unsigned long getModifiedNanoseconds(const struct stat& file_stat)
+{
+#if defined(__APPLE__)
+    return static_cast<unsigned long>(file_stat.st_mtimespec.tv_nsec);
+#else
+    return static_cast<unsigned long>(file_stat.st_mtim.tv_nsec);
+#endif
+}
+#endif
+
+void DiskFile::getFileStatus(std::streamsize& file_size, time_t& last_modified,
+                             std::string& etag) const
+{
+    std::ostringstream etag_stream;
+    etag_stream << '"' << std::hex;
+#ifndef PION_WIN32
+    // a single stat() call, so that all values describe the same version of the file
+    struct stat file_stat;
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+    if (::stat(m_file_path.string().c_str(), &file_stat) == 0) {
+#else
+    if (::stat(m_file_path.file_string().c_str(), &file_stat) == 0) {
+#endif
+        file_size = boost::numeric_cast<std::streamsize>(file_stat.st_size);
+        last_modified = file_stat.st_mtime;
+        // the inode distinguishes files that were replaced by others, and the
+        // nanoseconds distinguish writes made within the same second
+        etag_stream << static_cast<unsigned long>(file_stat.st_ino) << '-'
+                    << static_cast<unsigned long>(file_size) << '-'
+                    << static_cast<unsigned long>(last_modified) << '.'
+                    << getModifiedNanoseconds(file_stat) << '"';
+        etag = etag_stream.str();
+        return;
+    }
+#endif
+    // these throw if the file does not exist
+    file_size = boost::numeric_cast<std::streamsize>(boost::filesystem::file_size( m_file_path ));
+    last_modified = boost::filesystem::last_write_time( m_file_path );
+    etag_stream << static_cast<unsigned long>(file_size) << '-'
+                << static_cast<unsigned long>(last_modified) << '"';
+    etag = etag_stream.str();
+}
+
 void DiskFile::read(void)
 {
     // re-allocate storage buffer for the file's content
     m_file_content.reset(new char[m_file_size]);
+    m_content_mapped = false;
 
     // open the file for reading
     boost::filesystem::ifstream file_stream;
@@ -772,25 +1842,80 @@ void DiskFile::read(void)
     }
 }
 
+/// owns the memory mapping referred to by DiskFile::m_file_content
+class MappedContentDeleter {
+public:
+    /// constructs a deleter that keeps a memory mapping alive
+    explicit MappedContentDeleter(const boost::shared_ptr<boost::interprocess::mapped_region>& region)
+        : m_region(region) {}
+
+    /// the mapping is released when the last copy of the deleter is destroyed
+    void operator()(char *) {}
+
+private:
+    /// the memory mapping of the file's content
+    boost::shared_ptr<boost::interprocess::mapped_region>    m_region;
+};
+
+void DiskFile::map(void)
+{
+    namespace bip = boost::interprocess;
+
+    // mapping an empty file fails; use an empty buffer instead
+    if (m_file_size == 0) {
+        m_file_content.reset(new char[0]);
+        m_content_mapped = true;
+        return;
+    }
+
+    try {
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+        const bip::file_mapping file_map(m_file_path.string().c_str(), bip::read_only);
+#else
+        const bip::file_mapping file_map(m_file_path.file_string().c_str(), bip::read_only);
+#endif
+        // the region stays valid after the file_mapping is closed
+        boost::shared_ptr<bip::mapped_region> region(
+            new bip::mapped_region(file_map, bip::read_only, 0, m_file_size));
+        m_file_content.reset(static_cast<char*>(region->get_address()),
+                             MappedContentDeleter(region));
+        m_content_mapped = true;
+    } catch (bip::interprocess_exception&) {
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+        const std::string file_name = m_file_path.string();
+#else
+        const std::string file_name = m_file_path.file_string();
+#endif
+        BOOST_THROW_EXCEPTION( error::read_file() << error::errinfo_file_name(file_name) );
+    }
+}
+
 bool DiskFile::checkUpdated(void)
 {
     // get current values
-    std::streamsize cur_size = boost::numeric_cast<std::streamsize>(boost::filesystem::file_size( m_file_path ));
-    time_t cur_modified = boost::filesystem::last_write_time( m_file_path );
-
-    // check if file has not been updated
-    if (cur_modified == m_last_modified && cur_size == m_file_size)
+    std::streamsize cur_size;
+    time_t cur_modified;
+    std::string cur_etag;
+    getFileStatus(cur_size, cur_modified, cur_etag);
+
+    // check if file has not been updated (the entity tag includes the size
+    // and the modification time)
+    if (cur_modified == m_last_modified && cur_size == m_file_size && cur_etag == m_etag)
         return false;
 
     // file has been updated
 
-    // update file_size and last_modified timestamp
+    // update file_size, last_modified timestamp and entity tag
     m_file_size = cur_size;
     m_last_modified = cur_modified;
     m_last_modified_string = http::types::get_date_string( m_last_modified );
+    m_etag.swap(cur_etag);
 
-    // read new contents
-    read();
+    // read or map new contents
+    if (m_content_mapped)
+        map();
+    else
+        read();
 
     return true;
 }
@@ -803,7 +1928,12 @@ DiskFileSender::DiskFileSender(DiskFile& file, pion::http::request_ptr& http_req
                                unsigned long max_chunk_size)
     : m_logger(PION_GET_LOGGER("pion.FileService.DiskFileSender")), m_disk_file(file),
     m_writer(pion::http::response_writer::create(tcp_conn, *http_request_ptr, boost::bind(&tcp::connection::finish, tcp_conn))),
-    m_max_chunk_size(max_chunk_size), m_file_bytes_to_send(0), m_bytes_sent(0)
+    m_content_buf_size(0), m_piece_index(0), m_piece_offset(0),
+    m_max_chunk_size(max_chunk_size), m_file_bytes_to_send(0), m_bytes_sent(0),
+    m_disk_io_service(NULL), m_content_read(false), m_buffered_offset(0), m_buffered_length(0)
+#ifdef PION_HAVE_SENDFILE
+    , m_file_fd(-1), m_file_offset(0)
+#endif
 {
 # if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
     PION_LOG_DEBUG(m_logger, "Preparing to send file"
@@ -818,89 +1948,173 @@ DiskFileSender::DiskFileSender(DiskFile& file, pion::http::request_ptr& http_req
         // set the Content-Type HTTP header using the file's MIME type
     m_writer->get_response().set_content_type(m_disk_file.getMimeType());
 
-    // set Last-Modified header to enable client-side caching
+    // set Last-Modified and ETag headers to enable client-side caching
     m_writer->get_response().add_header(http::types::HEADER_LAST_MODIFIED,
                                       m_disk_file.getLastModifiedString());
+    if (! m_disk_file.getETag().empty())
+        m_writer->get_response().add_header(HEADER_ETAG, m_disk_file.getETag());
+
+    // let caches know that the content depends on Accept-Encoding
+    if (m_disk_file.hasEncodedContent()) {
+        m_writer->get_response().add_header("Vary", "Accept-Encoding");
+        if (! m_disk_file.getContentEncoding().empty())
+            m_writer->get_response().add_header(http::types::HEADER_CONTENT_ENCODING,
+                                              m_disk_file.getContentEncoding());
+    }
+
+    // let clients know that they may request ranges of the file
+    m_writer->get_response().add_header(HEADER_ACCEPT_RANGES, "bytes");
 
     // use "200 OK" HTTP response
     m_writer->get_response().set_status_code(http::types::RESPONSE_CODE_OK);
     m_writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_OK);
+
+    // send the whole file, unless ranges are requested
+    if (m_disk_file.getFileSize() > 0)
+        m_content_pieces.push_back(ContentPiece(0, m_disk_file.getFileSize()));
+}
+
+DiskFileSender::~DiskFileSender()
+{
+#ifdef PION_HAVE_SENDFILE
+    if (m_file_fd != -1)
+        ::close(m_file_fd);
+#endif
+}
+
+void DiskFileSender::setByteRanges(const ByteRanges& ranges)
+{
+    BOOST_ASSERT(! ranges.empty());
+    m_content_pieces.clear();
+
+    // use "206 Partial Content" HTTP response
+    m_writer->get_response().set_status_code(http::types::RESPONSE_CODE_PARTIAL_CONTENT);
+    m_writer->get_response().set_status_message(http::types::RESPONSE_MESSAGE_PARTIAL_CONTENT);
+
+    const std::string file_size_string(boost::lexical_cast<std::string>(m_disk_file.getFileSize()));
+    if (ranges.size() == 1) {
+        // a single range is sent as the response content
+        m_writer->get_response().add_header(HEADER_CONTENT_RANGE, "bytes "
+            + boost::lexical_cast<std::string>(ranges[0].first) + '-'
+            + boost::lexical_cast<std::string>(ranges[0].first + ranges[0].second - 1)
+            + '/' + file_size_string);
+        m_content_pieces.push_back(ContentPiece(ranges[0].first, ranges[0].second));
+        return;
+    }
+
+    // multiple ranges are sent as the parts of a multipart/byteranges message
+    std::ostringstream boundary_stream;
+    boundary_stream << "pion_byteranges_" << std::hex << m_disk_file.getLastModified()
+                    << '_' << ++g_byteranges_counter;
+    const std::string boundary(boundary_stream.str());
+    m_writer->get_response().set_content_type("multipart/byteranges; boundary=" + boundary);
+
+    for (ByteRanges::const_iterator i = ranges.begin(); i != ranges.end(); ++i) {
+        std::string part_headers(i == ranges.begin() ? "--" : "\r\n--");
+        part_headers += boundary;
+        part_headers += "\r\nContent-Type: ";
+        part_headers += m_disk_file.getMimeType();
+        part_headers += "\r\nContent-Range: bytes ";
+        part_headers += boost::lexical_cast<std::string>(i->first);
+        part_headers += '-';
+        part_headers += boost::lexical_cast<std::string>(i->first + i->second - 1);
+        part_headers += '/';
+        part_headers += file_size_string;
+        part_headers += "\r\n\r\n";
+        m_content_pieces.push_back(ContentPiece(part_headers));
+        m_content_pieces.push_back(ContentPiece(i->first, i->second));
+    }
+    m_content_pieces.push_back(ContentPiece("\r\n--" + boundary + "--\r\n"));
 }
 
 void DiskFileSender::send(void)
 {
     // check if we have nothing to send (send 0 byte response content)
-    if (m_disk_file.getFileSize() <= m_bytes_sent) {
+    if (m_piece_index >= m_content_pieces.size()) {
         m_writer->send();
         return;
     }
 
-    // calculate the number of bytes to send (m_file_bytes_to_send)
-    m_file_bytes_to_send = m_disk_file.getFileSize() - m_bytes_sent;
-    if (m_max_chunk_size > 0 && m_file_bytes_to_send > m_max_chunk_size)
-        m_file_bytes_to_send = m_max_chunk_size;
-
-    // get the content to send (file_content_ptr)
-    char *file_content_ptr;
-
-    if (m_disk_file.hasFileContent()) {
-
-        // the entire file IS cached in memory (m_disk_file.file_content)
-        file_content_ptr = m_disk_file.getFileContent() + m_bytes_sent;
-
-    } else {
-        // the file is not cached in memory
-
-        // check if the file has been opened yet
-        if (! m_file_stream.is_open()) {
-            // open the file for reading
-            m_file_stream.open(m_disk_file.getFilePath(), std::ios::in | std::ios::binary);
-            if (! m_file_stream.is_open()) {
-# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
-                PION_LOG_ERROR(m_logger, "Unable to open file: "
-                               << m_disk_file.getFilePath().string());
-#else
-                PION_LOG_ERROR(m_logger, "Unable to open file: "
-                               << m_disk_file.getFilePath().file_string());
-#endif
-                return;
-            }
-        }
-
-        // check if the content buffer was initialized yet
-        if (! m_content_buf) {
-            // allocate memory for the new content buffer
-            m_content_buf.reset(new char[m_file_bytes_to_send]);
+#ifdef PION_HAVE_SENDFILE
+    // files that are not cached in memory are sent over plain (non-SSL)
+    // connections using sendfile(), which copies the file's content from
+    // the page cache directly into the socket.  This is only used when the
+    // content is a single range of the file (multipart bodies are read)
+    if (m_bytes_sent == 0 && m_content_pieces.size() == 1 && ! m_disk_file.hasFileContent()
+        && ! m_writer->get_connection()->get_ssl_flag())
+    {
+        m_file_fd = ::open(m_disk_file.getFilePath().string().c_str(), O_RDONLY);
+        if (m_file_fd != -1) {
+            // send the HTTP headers first; the whole range follows them
+            m_file_offset = m_content_pieces[0].m_file_offset;
+            m_file_bytes_to_send = m_content_pieces[0].m_length;
+            m_writer->get_response().set_content_length(m_file_bytes_to_send);
+            m_writer->send(boost::bind(&DiskFileSender::dispatch_file_content,
+                                       shared_from_this(),
+                                       boost::asio::placeholders::error,
+                                       boost::asio::placeholders::bytes_transferred));
+            return;
         }
-        file_content_ptr = m_content_buf.get();
-
-        // read a block of data from the file into the content buffer
-        if (! m_file_stream.read(m_content_buf.get(), m_file_bytes_to_send)) {
-            if (m_file_stream.gcount() > 0) {
-# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
-                PION_LOG_ERROR(m_logger, "File size inconsistency: "
-                               << m_disk_file.getFilePath().string());
-#else
-                PION_LOG_ERROR(m_logger, "File size inconsistency: "
-                               << m_disk_file.getFilePath().file_string());
-#endif
-            } else {
-# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
-                PION_LOG_ERROR(m_logger, "Unable to read file: "
-                               << m_disk_file.getFilePath().string());
-#else
-                PION_LOG_ERROR(m_logger, "Unable to read file: "
-                               << m_disk_file.getFilePath().file_string());
+        // fall back to reading the file using a stream
+    }
 #endif
-            }
+
+    // content that is not cached is read in a disk I/O thread (if there are
+    // any), which calls send() again in the connection's thread
+    if (m_disk_io_service && ! m_disk_file.hasFileContent() && ! m_content_read) {
+        for (std::size_t n = m_piece_index; n < m_content_pieces.size(); ++n) {
+            const ContentPiece& piece = m_content_pieces[n];
+            if (piece.isText())
+                continue;
+            const unsigned long offset = (n == m_piece_index ? m_piece_offset : 0);
+            unsigned long bytes = piece.m_length - offset;
+            if (m_max_chunk_size > 0 && bytes > m_max_chunk_size)
+                bytes = m_max_chunk_size;
+            m_disk_io_service->post(boost::bind(&DiskFileSender::readFileContent, shared_from_this(),
+                                                piece.m_file_offset + offset, bytes));
             return;
         }
     }
+    m_content_read = false;
+
+    // add the content for the next write operation: text pieces, and the
+    // file's bytes up to the maximum chunk size.  Content that is not
+    // cached is read into a single buffer, so only one range is added
+    m_file_bytes_to_send = 0;
+    unsigned long file_bytes = 0;
+    while (m_piece_index < m_content_pieces.size()) {
+        const ContentPiece& piece = m_content_pieces[m_piece_index];
+        if (piece.isText()) {
+            m_writer->write_no_copy(piece.m_text);
+            m_file_bytes_to_send += piece.m_text.size();
+            ++m_piece_index;
+            continue;
+        }
+
+        if (file_bytes > 0 && (! m_disk_file.hasFileContent()
+                               || (m_max_chunk_size > 0 && file_bytes >= m_max_chunk_size)))
+            break;
+        unsigned long bytes = piece.m_length - m_piece_offset;
+        if (m_max_chunk_size > 0 && file_bytes + bytes > m_max_chunk_size)
+            bytes = m_max_chunk_size - file_bytes;
+
+        // get the content to send
+        char *file_content_ptr = getFileContent(piece.m_file_offset + m_piece_offset, bytes);
+        if (file_content_ptr == NULL)
+            return;
 
-    // send the content
-    m_writer->write_no_copy(file_content_ptr, m_file_bytes_to_send);
+        // send the content
+        m_writer->write_no_copy(file_content_ptr, bytes);
+        file_bytes += bytes;
+        m_file_bytes_to_send += bytes;
+        m_piece_offset += bytes;
+        if (m_piece_offset < piece.m_length)
+            break;
+        ++m_piece_index;
+        m_piece_offset = 0;
+    }
 
-    if (m_bytes_sent + m_file_bytes_to_send >= m_disk_file.getFileSize()) {
+    if (m_piece_index >= m_content_pieces.size()) {
         // this is the last piece of data to send
         if (m_bytes_sent > 0) {
             // send last chunk in a series
@@ -924,6 +2138,79 @@ void DiskFileSender::send(void)
     }
 }
 
+char *DiskFileSender::getFileContent(unsigned long offset, unsigned long length)
+{
+    if (m_disk_file.hasFileContent()) {
+        // the entire file IS cached in memory (m_disk_file.file_content)
+        return m_disk_file.getFileContent() + offset;
+    }
+
+    // the file is not cached in memory
+
+    // check if the content was already read (by readFileContent())
+    if (m_buffered_length == length && m_buffered_offset == offset && length > 0)
+        return m_content_buf.get();
+    m_buffered_length = 0;
+
+    // check if the file has been opened yet
+    if (! m_file_stream.is_open()) {
+        // open the file for reading
+        m_file_stream.open(m_disk_file.getFilePath(), std::ios::in | std::ios::binary);
+        if (! m_file_stream.is_open()) {
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+            PION_LOG_ERROR(m_logger, "Unable to open file: "
+                           << m_disk_file.getFilePath().string());
+#else
+            PION_LOG_ERROR(m_logger, "Unable to open file: "
+                           << m_disk_file.getFilePath().file_string());
+#endif
+            return NULL;
+        }
+    }
+
+    // check if the content buffer is large enough
+    if (m_content_buf_size < length) {
+        // allocate memory for the new content buffer
+        m_content_buf.reset(new char[length]);
+        m_content_buf_size = length;
+    }
+
+    // read a block of data from the file into the content buffer
+    if (! m_file_stream.seekg(offset) || ! m_file_stream.read(m_content_buf.get(), length)) {
+        if (m_file_stream.gcount() > 0) {
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+            PION_LOG_ERROR(m_logger, "File size inconsistency: "
+                           << m_disk_file.getFilePath().string());
+#else
+            PION_LOG_ERROR(m_logger, "File size inconsistency: "
+                           << m_disk_file.getFilePath().file_string());
+#endif
+        } else {
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+            PION_LOG_ERROR(m_logger, "Unable to read file: "
+                           << m_disk_file.getFilePath().string());
+#else
+            PION_LOG_ERROR(m_logger, "Unable to read file: "
+                           << m_disk_file.getFilePath().file_string());
+#endif
+        }
+        return NULL;
+    }
+
+    m_buffered_offset = offset;
+    m_buffered_length = length;
+    return m_content_buf.get();
+}
+
+void DiskFileSender::readFileContent(unsigned long offset, unsigned long length)
+{
+    // the content is kept in m_content_buf, where send() finds it
+    getFileContent(offset, length);
+    m_content_read = true;
+    m_writer->get_connection()->get_io_service().post(boost::bind(&DiskFileSender::send,
+                                                                  shared_from_this()));
+}
+
 void DiskFileSender::handle_write(const boost::system::error_code& write_error,
                                  std::size_t bytes_written)
 {
@@ -940,10 +2227,10 @@ void DiskFileSender::handle_write(const boost::system::error_code& write_error,
         // includes bytes for HTTP headers and chunking headers
         m_bytes_sent += m_file_bytes_to_send;
 
-        if (m_bytes_sent >= m_disk_file.getFileSize()) {
+        if (m_piece_index >= m_content_pieces.size()) {
             // finished sending
             PION_LOG_DEBUG(m_logger, "Sent "
-                           << (m_file_bytes_to_send < m_disk_file.getFileSize() ? "file chunk" : "complete file")
+                           << (m_file_bytes_to_send < m_bytes_sent ? "file chunk" : "complete file")
                            << " of " << m_file_bytes_to_send << " bytes (finished"
                            << (m_writer->get_connection()->get_keep_alive() ? ", keeping alive)" : ", closing)") );
         } else {
@@ -964,6 +2251,626 @@ void DiskFileSender::handle_write(const boost::system::error_code& write_error,
     }
 }
 
+#ifdef PION_HAVE_SENDFILE
+void DiskFileSender::send_file_content(const boost::system::error_code& write_error,
+                                       std::size_t /* bytes_written */)
+{
+    if (write_error) {
+        handle_write(write_error, 0);
+        return;
+    }
+
+    // sendfile() is limited to 0x7ffff000 bytes per call
+    static const std::size_t MAX_SENDFILE_BYTES = 0x7ffff000;
+
+    tcp::connection::socket_type& sock = m_writer->get_connection()->get_socket();
+    boost::system::error_code ec;
+    if (! sock.native_non_blocking())
+        sock.native_non_blocking(true, ec);
+
+    const unsigned long file_end = m_content_pieces[0].m_file_offset + m_content_pieces[0].m_length;
+    while (! ec && static_cast<unsigned long>(m_file_offset) < file_end) {
+        const std::size_t bytes_left = file_end - m_file_offset;
+        const ssize_t n = ::sendfile(sock.native_handle(), m_file_fd, &m_file_offset,
+                                     bytes_left < MAX_SENDFILE_BYTES ? bytes_left : MAX_SENDFILE_BYTES);
+        if (n > 0)
+            continue;
+        if (n == 0) {
+            // the file was truncated while we were sending it
+            PION_LOG_ERROR(m_logger, "File size inconsistency: "
+                           << m_disk_file.getFilePath().string());
+            ec = boost::asio::error::eof;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // the socket's send buffer is full -> wait until it is writable
+            sock.async_write_some(boost::asio::null_buffers(),
+                                  boost::bind(&DiskFileSender::dispatch_file_content,
+                                              shared_from_this(),
+                                              boost::asio::placeholders::error,
+                                              boost::asio::placeholders::bytes_transferred));
+            return;
+        } else if (errno != EINTR) {
+            ec = boost::system::error_code(errno, boost::system::system_category());
+        }
+    }
+
+    // synchronous operations on the connection should block again
+    boost::system::error_code ignored_ec;
+    sock.native_non_blocking(false, ignored_ec);
+
+    // handle_write() adds m_file_bytes_to_send to m_bytes_sent and finishes
+    m_piece_index = m_content_pieces.size();
+    if (m_disk_io_service) {
+        m_writer->get_connection()->get_io_service().post(boost::bind(&DiskFileSender::handle_write,
+            shared_from_this(), ec, 0));
+    } else {
+        handle_write(ec, 0);
+    }
+}
+
+void DiskFileSender::dispatch_file_content(const boost::system::error_code& write_error,
+                                           std::size_t bytes_written)
+{
+    if (m_disk_io_service && ! write_error) {
+        m_disk_io_service->post(boost::bind(&DiskFileSender::send_file_content,
+                                            shared_from_this(), write_error, bytes_written));
+    } else {
+        send_file_content(write_error, bytes_written);
+    }
+}
+#endif
+
+
+// DiskFileUpload member functions
+
+DiskFileUpload::DiskFileUpload(const boost::filesystem::path& file_path, bool append,
+                               unsigned long max_bytes)
+    : m_file_path(file_path), m_bytes_written(0), m_max_bytes(max_bytes),
+    m_append(append), m_too_large(false), m_failed(false), m_finished(true),
+    m_io_service(NULL), m_max_queued(0), m_queued_bytes(0), m_bytes_received(0),
+    m_open_queued(false), m_writing(false)
+{
+    // the temporary file is hidden, and in the same directory so that it
+    // can be renamed to the requested file.  Its name includes the process
+    // id, since other processes may serve the same directory
+    const long upload_num = ++g_upload_counter;
+#ifdef PION_WIN32
+    const long process_id = ::_getpid();
+#else
+    const long process_id = ::getpid();
+#endif
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+    const std::string file_name(file_path.filename().string());
+#else
+    const std::string file_name(file_path.leaf());
+#endif
+    m_temp_path = file_path.branch_path() / ("." + file_name + ".upload-"
+                                             + boost::lexical_cast<std::string>(process_id) + '-'
+                                             + boost::lexical_cast<std::string>(upload_num));
+}
+
+bool DiskFileUpload::isTempFileName(const std::string& file_name)
+{
+    // matches "." + name + ".upload-" + process id + '-' + number
+    static const std::string TEMP_FILE_INFIX(".upload-");
+    if (file_name.empty() || file_name[0] != '.')
+        return false;
+    const std::string::size_type infix_pos = file_name.rfind(TEMP_FILE_INFIX);
+    if (infix_pos == std::string::npos || infix_pos < 2)
+        return false;
+    const std::string::size_type num_pos = infix_pos + TEMP_FILE_INFIX.size();
+    const std::string::size_type dash_pos = file_name.find('-', num_pos);
+    if (dash_pos == std::string::npos || dash_pos == num_pos || dash_pos + 1 == file_name.size())
+        return false;
+    for (std::string::size_type n = num_pos; n < file_name.size(); ++n) {
+        if (n != dash_pos && (file_name[n] < '0' || file_name[n] > '9'))
+            return false;
+    }
+    return true;
+}
+
+bool DiskFileUpload::open(void)
+{
+    if (boost::filesystem::is_directory(m_file_path)
+        || ! boost::filesystem::exists(m_file_path.branch_path()))
+        return false;
+
+    // the file is created exclusively, so that an existing file with the
+    // same name is never written to (or removed by discard())
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+    const std::string temp_path_string(m_temp_path.string());
+#else
+    const std::string temp_path_string(m_temp_path.file_string());
+#endif
+#ifdef PION_WIN32
+    const int temp_fd = ::_open(temp_path_string.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY,
+                                _S_IREAD | _S_IWRITE);
+#else
+    const int temp_fd = ::open(temp_path_string.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+#endif
+    if (temp_fd == -1)
+        return false;
+#ifdef PION_WIN32
+    ::_close(temp_fd);
+#else
+    ::close(temp_fd);
+#endif
+    m_finished = false;
+
+    m_file_stream.open(m_temp_path, std::ios::out | std::ios::trunc | std::ios::binary);
+    if (! m_file_stream.is_open()) {
+        discard();
+        return false;
+    }
+    return true;
+}
+
+void DiskFileUpload::open(boost::asio::io_service& io_service, std::size_t max_queued)
+{
+    boost::mutex::scoped_lock queue_lock(m_queue_mutex);
+    m_io_service = &io_service;
+    m_max_queued = max_queued;
+    m_open_queued = true;
+    m_writing = true;
+    m_io_service->post(boost::bind(&DiskFileUpload::writeQueued, shared_from_this()));
+}
+
+void DiskFileUpload::write(const char *ptr, std::size_t len)
+{
+    if (m_io_service == NULL) {
+        writeContent(ptr, len);
+        return;
+    }
+
+    boost::mutex::scoped_lock queue_lock(m_queue_mutex);
+    if (m_too_large)
+        return;
+    if (m_max_bytes != 0 && len > m_max_bytes - m_bytes_received) {
+        // the queued content is dropped, and writeQueued() removes the
+        // temporary file
+        m_too_large = true;
+        for (std::deque<std::string>::const_iterator i = m_queue.begin(); i != m_queue.end(); ++i)
+            m_queued_bytes -= i->size();
+        m_queue.clear();
+        m_queue_written.notify_all();
+    } else {
+        // wait for the disk I/O threads if they are too far behind
+        while (m_writing && m_queued_bytes != 0 && m_queued_bytes + len > m_max_queued)
+            m_queue_written.wait(queue_lock);
+        m_queue.push_back(std::string(ptr, len));
+        m_queued_bytes += len;
+        m_bytes_received += len;
+    }
+    if (! m_writing) {
+        m_writing = true;
+        m_io_service->post(boost::bind(&DiskFileUpload::writeQueued, shared_from_this()));
+    }
+}
+
+void DiskFileUpload::afterWrites(const boost::function0<void>& handler)
+{
+    if (m_io_service == NULL) {
+        handler();
+        return;
+    }
+    boost::mutex::scoped_lock queue_lock(m_queue_mutex);
+    if (m_writing)
+        m_written_handler = handler;
+    else
+        m_io_service->post(handler);
+}
+
+void DiskFileUpload::writeQueued(void)
+{
+    boost::mutex::scoped_lock queue_lock(m_queue_mutex);
+    if (m_open_queued) {
+        m_open_queued = false;
+        if (! m_too_large) {
+            queue_lock.unlock();
+            open();
+            queue_lock.lock();
+        }
+    }
+
+    // the content is written without holding the lock, so that write() can
+    // queue more of it meanwhile
+    while (! m_queue.empty()) {
+        std::string content;
+        content.swap(m_queue.front());
+        m_queue.pop_front();
+        queue_lock.unlock();
+        writeContent(content.data(), content.size());
+        queue_lock.lock();
+        m_queued_bytes -= content.size();
+        m_queue_written.notify_all();
+    }
+    if (m_too_large) {
+        queue_lock.unlock();
+        discard();
+        queue_lock.lock();
+    }
+
+    m_writing = false;
+    m_queue_written.notify_all();
+    boost::function0<void> handler;
+    handler.swap(m_written_handler);
+    queue_lock.unlock();
+    if (handler)
+        handler();
+}
+
+void DiskFileUpload::writeContent(const char *ptr, std::size_t len)
+{
+    if (m_failed || m_finished)
+        return;
+    if (m_max_bytes != 0 && len > m_max_bytes - m_bytes_written) {
+        discardTooLarge();
+        return;
+    }
+    m_file_stream.write(ptr, len);
+    if (m_file_stream.fail())
+        m_failed = true;
+    else
+        m_bytes_written += len;
+}
+
+bool DiskFileUpload::commit(void)
+{
+    if (m_finished)
+        return false;
+    m_file_stream.close();
+    if (m_failed || m_file_stream.fail()) {
+        discard();
+        return false;
+    }
+    m_finished = true;
+
+    bool committed = true;
+    try {
+        if (m_append) {
+            // POST: the content is appended to the file (which is created if
+            // it does not exist)
+            committed = appendContent();
+            boost::filesystem::remove(m_temp_path);
+        } else {
+            // PUT: the temporary file replaces the requested file
+            keepFileMode();
+            try {
+                boost::filesystem::rename(m_temp_path, m_file_path);
+            } catch (std::exception&) {
+                // some platforms do not rename files over existing ones
+                boost::filesystem::remove(m_file_path);
+                boost::filesystem::rename(m_temp_path, m_file_path);
+            }
+        }
+    } catch (std::exception&) {
+        committed = false;
+        boost::system::error_code ec;
+        boost::filesystem::remove(m_temp_path, ec);
+    }
+    return committed;
+}
+
+bool DiskFileUpload::appendContent(void)
+{
+#ifdef PION_HAVE_SENDFILE
+    // the kernel copies the content, without reading it into user space
+    const int temp_fd = ::open(m_temp_path.string().c_str(), O_RDONLY);
+    if (temp_fd == -1)
+        return false;
+    // sendfile() does not write to files opened with O_APPEND, so the file
+    // is locked while the content is written at its end
+    const int file_fd = ::open(m_file_path.string().c_str(), O_WRONLY | O_CREAT, 0666);
+    bool appended = (file_fd != -1 && ::flock(file_fd, LOCK_EX) == 0
+                     && ::lseek(file_fd, 0, SEEK_END) != -1);
+    unsigned long bytes_copied = 0;
+    while (appended && bytes_copied < m_bytes_written) {
+        const ssize_t bytes = ::sendfile(file_fd, temp_fd, NULL, m_bytes_written - bytes_copied);
+        if (bytes > 0) {
+            bytes_copied += bytes;
+        } else if (bytes < 0 && errno == EINTR) {
+            continue;
+        } else if (bytes < 0 && bytes_copied == 0 && (errno == EINVAL || errno == ENOSYS)) {
+            // sendfile() cannot copy between files here: copy using a buffer
+            char buf[65536];
+            ssize_t bytes_read;
+            while (appended && (bytes_read = ::read(temp_fd, buf, sizeof(buf))) != 0) {
+                if (bytes_read < 0) {
+                    appended = (errno == EINTR);
+                    continue;
+                }
+                for (ssize_t offset = 0; appended && offset < bytes_read; ) {
+                    const ssize_t bytes_written = ::write(file_fd, buf + offset, bytes_read - offset);
+                    if (bytes_written > 0)
+                        offset += bytes_written;
+                    else
+                        appended = (bytes_written < 0 && errno == EINTR);
+                }
+            }
+            break;
+        } else {
+            appended = false;
+        }
+    }
+    if (file_fd != -1 && ::close(file_fd) != 0)
+        appended = false;
+    ::close(temp_fd);
+    return appended;
+#else
+    boost::filesystem::ofstream file_stream(m_file_path, std::ios::app | std::ios::binary);
+    if (m_bytes_written > 0) {
+        boost::filesystem::ifstream temp_stream(m_temp_path, std::ios::in | std::ios::binary);
+        file_stream << temp_stream.rdbuf();
+    }
+    file_stream.close();
+    return ! file_stream.fail();
+#endif
+}
+
+void DiskFileUpload::keepFileMode(void)
+{
+#ifndef PION_WIN32
+    // the new file gets the permissions of the file that it replaces, and
+    // its owner and group if the server is allowed to set them
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+    const std::string file_path_string(m_file_path.string());
+    const std::string temp_path_string(m_temp_path.string());
+#else
+    const std::string file_path_string(m_file_path.file_string());
+    const std::string temp_path_string(m_temp_path.file_string());
+#endif
+    struct stat file_stat;
+    if (::stat(file_path_string.c_str(), &file_stat) != 0)
+        return;
+    if (::chown(temp_path_string.c_str(), file_stat.st_uid, file_stat.st_gid) != 0) {
+        // keep the server's user and group
+    }
+    ::chmod(temp_path_string.c_str(), file_stat.st_mode & 07777);
+#endif
+}
+
+void DiskFileUpload::discard(void)
+{
+    if (m_finished)
+        return;
+    m_finished = true;
+    m_file_stream.close();
+    boost::system::error_code ec;
+    boost::filesystem::remove(m_temp_path, ec);
+}
+
+void DiskFileUpload::discardTooLarge(void)
+{
+    m_too_large = true;
+    discard();
+}
+
+
+// static members of FileCache
+
+const std::size_t           FileCache::DEFAULT_NUM_SHARDS = 16;
+
+
+// FileCache member functions
+
+FileCache::FileCache(std::size_t num_shards)
+    : m_num_shards(1), m_max_bytes(0), m_bytes(0), m_evict_shard(0)
+{
+    while (m_num_shards < num_shards)
+        m_num_shards <<= 1;
+    m_shards.reset(new Shard[m_num_shards]);
+}
+
+bool FileCache::find(const std::string& key, DiskFile& file, unsigned long *version)
+{
+    Shard& shard = getShard(key);
+    boost::shared_lock<boost::shared_mutex> shard_lock(shard.m_mutex);
+    EntryMap::const_iterator entry_itr = shard.m_entries.find(key);
+    if (entry_itr == shard.m_entries.end())
+        return false;
+    // counting the reference is enough to give the entry a second chance
+    ++entry_itr->second->m_references;
+    file = entry_itr->second->m_file;
+    if (version)
+        *version = entry_itr->second->m_version;
+    return true;
+}
+
+bool FileCache::update(const std::string& key, const DiskFile& file, unsigned long version)
+{
+    {
+        Shard& shard = getShard(key);
+        boost::unique_lock<boost::shared_mutex> shard_lock(shard.m_mutex);
+        EntryMap::iterator entry_itr = shard.m_entries.find(key);
+        if (entry_itr == shard.m_entries.end() || entry_itr->second->m_version != version)
+            return false;
+        ++entry_itr->second->m_version;
+        setEntryFile(shard, *entry_itr->second, file);
+    }
+    evict();
+    return true;
+}
+
+void FileCache::insert(const std::string& key, const DiskFile& file)
+{
+    {
+        Shard& shard = getShard(key);
+        boost::unique_lock<boost::shared_mutex> shard_lock(shard.m_mutex);
+        EntryMap::iterator entry_itr = shard.m_entries.find(key);
+        if (entry_itr == shard.m_entries.end()) {
+            entry_itr = shard.m_entries.insert(std::make_pair(key,
+                boost::shared_ptr<Entry>(new Entry(DiskFile())))).first;
+        }
+        ++entry_itr->second->m_version;
+        setEntryFile(shard, *entry_itr->second, file);
+    }
+    evict();
+}
+
+bool FileCache::add(const std::string& key, const DiskFile& file)
+{
+    {
+        Shard& shard = getShard(key);
+        boost::unique_lock<boost::shared_mutex> shard_lock(shard.m_mutex);
+        std::pair<EntryMap::iterator, bool> add_result = shard.m_entries.insert(
+            std::make_pair(key, boost::shared_ptr<Entry>()));
+        if (! add_result.second)
+            return false;
+        add_result.first->second.reset(new Entry(DiskFile()));
+        setEntryFile(shard, *add_result.first->second, file);
+    }
+    evict();
+    return true;
+}
+
+void FileCache::erase(const std::string& key)
+{
+    Shard& shard = getShard(key);
+    boost::unique_lock<boost::shared_mutex> shard_lock(shard.m_mutex);
+    EntryMap::iterator entry_itr = shard.m_entries.find(key);
+    if (entry_itr != shard.m_entries.end())
+        eraseEntry(shard, entry_itr);
+}
+
+void FileCache::erasePrefix(const std::string& prefix)
+{
+    for (std::size_t n = 0; n < m_num_shards; ++n) {
+        Shard& shard = m_shards[n];
+        boost::unique_lock<boost::shared_mutex> shard_lock(shard.m_mutex);
+        EntryMap::iterator entry_itr = shard.m_entries.begin();
+        while (entry_itr != shard.m_entries.end()) {
+            EntryMap::iterator next_itr = entry_itr;
+            ++next_itr;
+            if (boost::algorithm::starts_with(entry_itr->first, prefix))
+                eraseEntry(shard, entry_itr);
+            entry_itr = next_itr;
+        }
+    }
+}
+
+void FileCache::clear(void)
+{
+    for (std::size_t n = 0; n < m_num_shards; ++n) {
+        Shard& shard = m_shards[n];
+        boost::unique_lock<boost::shared_mutex> shard_lock(shard.m_mutex);
+        unsigned long bytes = 0;
+        for (ClockList::const_iterator i = shard.m_clock.begin(); i != shard.m_clock.end(); ++i)
+            bytes += (*i)->m_bytes;
+        shard.m_clock.clear();
+        shard.m_hand = shard.m_clock.end();
+        shard.m_entries.clear();
+        addCachedBytes(- static_cast<long>(bytes));
+    }
+}
+
+std::size_t FileCache::size(void) const
+{
+    std::size_t num_entries = 0;
+    for (std::size_t n = 0; n < m_num_shards; ++n) {
+        boost::shared_lock<boost::shared_mutex> shard_lock(m_shards[n].m_mutex);
+        num_entries += m_shards[n].m_entries.size();
+    }
+    return num_entries;
+}
+
+unsigned long FileCache::getCachedBytes(void) const
+{
+    boost::mutex::scoped_lock bytes_lock(m_bytes_mutex);
+    return m_bytes;
+}
+
+void FileCache::setEntryFile(Shard& shard, Entry& entry, const DiskFile& file)
+{
+    entry.m_file = file;
+    const unsigned long old_bytes = entry.m_bytes;
+    entry.m_bytes = file.getCachedBytes();
+    if (entry.m_bytes != old_bytes)
+        addCachedBytes(static_cast<long>(entry.m_bytes) - static_cast<long>(old_bytes));
+
+    if (entry.m_bytes > 0 && ! entry.m_in_clock) {
+        // new content goes just behind the hand, so it is considered last
+        entry.m_clock_pos = shard.m_clock.insert(shard.m_hand, &entry);
+        entry.m_clock_mark = entry.m_references;
+        entry.m_in_clock = true;
+    } else if (entry.m_bytes == 0 && entry.m_in_clock) {
+        if (shard.m_hand == entry.m_clock_pos)
+            ++shard.m_hand;
+        shard.m_clock.erase(entry.m_clock_pos);
+        entry.m_in_clock = false;
+    }
+}
+
+void FileCache::eraseEntry(Shard& shard, EntryMap::iterator entry_itr)
+{
+    Entry& entry = *entry_itr->second;
+    if (entry.m_in_clock) {
+        if (shard.m_hand == entry.m_clock_pos)
+            ++shard.m_hand;
+        shard.m_clock.erase(entry.m_clock_pos);
+    }
+    if (entry.m_bytes > 0)
+        addCachedBytes(- static_cast<long>(entry.m_bytes));
+    shard.m_entries.erase(entry_itr);
+}
+
+bool FileCache::evictFromShard(Shard& shard)
+{
+    for (std::size_t n = shard.m_clock.size(); n > 0; --n) {
+        if (shard.m_hand == shard.m_clock.end())
+            shard.m_hand = shard.m_clock.begin();
+        Entry& entry = **shard.m_hand;
+        const long references = entry.m_references;
+        if (references != entry.m_clock_mark) {
+            // used since the hand last passed: give it a second chance
+            entry.m_clock_mark = references;
+            ++shard.m_hand;
+        } else {
+            // replace the entry with a placeholder that keeps its path and MIME type;
+            // it is read again the next time that it is requested
+            setEntryFile(shard, entry, DiskFile(entry.m_file.getFilePath(), NULL, 0, 0,
+                                                entry.m_file.getMimeType()));
+            return true;
+        }
+    }
+    return false;
+}
+
+void FileCache::evict(void)
+{
+    if (m_max_bytes == 0)
+        return;
+    // each shard gives up at most one entry per turn, so that content is
+    // evicted from the whole cache rather than from the shard that grew;
+    // a round without evictions gives every entry its second chance, so
+    // a second one means that the entries are referenced faster than the
+    // hands move (and the cache is left to the next eviction)
+    unsigned int rounds_without_eviction = 0;
+    bool evicted_in_round = false;
+    std::size_t shards_left_in_round = m_num_shards;
+    while (true) {
+        std::size_t shard_index;
+        {
+            boost::mutex::scoped_lock bytes_lock(m_bytes_mutex);
+            if (m_bytes <= m_max_bytes)
+                break;
+            shard_index = m_evict_shard;
+            m_evict_shard = (m_evict_shard + 1) & (m_num_shards - 1);
+        }
+        {
+            Shard& shard = m_shards[shard_index];
+            boost::unique_lock<boost::shared_mutex> shard_lock(shard.m_mutex);
+            if (evictFromShard(shard))
+                evicted_in_round = true;
+        }
+        if (--shards_left_in_round == 0) {
+            rounds_without_eviction = (evicted_in_round ? 0 : rounds_without_eviction + 1);
+            if (rounds_without_eviction == 2)
+                break;
+            evicted_in_round = false;
+            shards_left_in_round = m_num_shards;
+        }
+    }
+}
+
 
 }   // end namespace plugins
 }   // end namespace pion
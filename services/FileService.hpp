@@ -11,11 +11,23 @@
 #define __PION_FILESERVICE_HEADER__
 
 #include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
 #include <boost/functional/hash.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/filesystem/fstream.hpp>
+#include <boost/asio.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/thread/once.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/function/function0.hpp>
 #include <boost/shared_array.hpp>
+#include <boost/scoped_array.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/detail/atomic_count.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread/thread.hpp>
 #include <pion/config.hpp>
 #include <pion/logger.hpp>
 #include <pion/hash_map.hpp>
@@ -25,6 +37,10 @@
 #include <pion/http/server.hpp>
 #include <string>
 #include <map>
+#include <vector>
+#include <list>
+#include <deque>
+#include <utility>
 
 
 namespace pion {        // begin namespace pion
@@ -36,33 +52,61 @@ namespace plugins {     // begin namespace plugins
 /// 
 class DiskFile {
 public:
+    /// content-codings that compressed variants of a file's content may use
+    enum ContentCoding {
+        CODING_GZIP,    ///< "gzip" (RFC 1952)
+        CODING_BR,      ///< "br" (Brotli, only from precompressed files)
+        CODING_COUNT    ///< number of supported content-codings
+    };
+
     /// default constructor
     DiskFile(void)
-        : m_file_size(0), m_last_modified(0) {}
+        : m_file_size(0), m_last_modified(0), m_content_mapped(false),
+        m_content_coding(CODING_COUNT)
+    {
+        clearEncodedContent();
+    }
 
     /// used to construct new disk file objects
     DiskFile(const boost::filesystem::path& path,
              char *content, unsigned long size,
              std::time_t modified, const std::string& mime)
         : m_file_path(path), m_file_content(content), m_file_size(size),
-        m_last_modified(modified), m_mime_type(mime)
-    {}
+        m_last_modified(modified), m_mime_type(mime), m_content_mapped(false),
+        m_content_coding(CODING_COUNT)
+    {
+        clearEncodedContent();
+    }
 
     /// copy constructor
     DiskFile(const DiskFile& f)
         : m_file_path(f.m_file_path), m_file_content(f.m_file_content),
         m_file_size(f.m_file_size), m_last_modified(f.m_last_modified),
-        m_last_modified_string(f.m_last_modified_string), m_mime_type(f.m_mime_type)
-    {}
+        m_last_modified_string(f.m_last_modified_string), m_etag(f.m_etag),
+        m_mime_type(f.m_mime_type), m_content_mapped(f.m_content_mapped), m_content_coding(f.m_content_coding)
+    {
+        for (int n = 0; n < CODING_COUNT; ++n) {
+            m_encoded_content[n] = f.m_encoded_content[n];
+            m_encoded_size[n] = f.m_encoded_size[n];
+        }
+    }
 
-    /// updates the file_size and last_modified timestamp to disk
+    /// updates the file_size, last_modified timestamp and entity tag to disk
     void update(void);
 
     /// reads content from disk into file_content buffer (may throw)
     void read(void);
 
     /**
-     * checks if the file has been updated and updates vars if it has (may throw)
+     * maps the file's content into memory using a read-only shared mapping
+     * (may throw).  The mapping is released when the last copy of this
+     * object that refers to it is destroyed or updated.
+     */
+    void map(void);
+
+    /**
+     * checks if the file has been updated and updates vars if it has (may throw).
+     * The content is re-read or re-mapped, depending on how it was cached.
      *
      * @return true if the file was updated
      */
@@ -77,6 +121,83 @@ public:
     /// returns true if there is cached file content
     inline bool hasFileContent(void) const { return m_file_content; }
 
+    /// returns true if the cached file content is mapped from the file
+    inline bool isContentMapped(void) const { return m_content_mapped; }
+
+    /// returns true if the file has a compressed variant using the given content-coding
+    inline bool hasEncodedContent(ContentCoding coding) const { return m_encoded_content[coding]; }
+
+    /// returns the number of bytes of content held in memory (including compressed variants)
+    inline unsigned long getCachedBytes(void) const {
+        unsigned long bytes = (m_file_content ? m_file_size : 0);
+        for (int n = 0; n < CODING_COUNT; ++n)
+            bytes += m_encoded_size[n];
+        return bytes;
+    }
+
+    /// returns true if the file has any compressed variants
+    inline bool hasEncodedContent(void) const {
+        for (int n = 0; n < CODING_COUNT; ++n)
+            if (m_encoded_content[n]) return true;
+        return false;
+    }
+
+    /**
+     * sets the compressed variant of the file's content for a content-coding
+     *
+     * @param coding the content-coding used to compress the content
+     * @param content the compressed content
+     * @param size number of bytes of compressed content
+     */
+    inline void setEncodedContent(ContentCoding coding,
+                                  const boost::shared_array<char>& content,
+                                  unsigned long size)
+    {
+        m_encoded_content[coding] = content;
+        m_encoded_size[coding] = size;
+    }
+
+    /**
+     * uses the content of another file as a compressed variant of this file
+     *
+     * @param coding the content-coding used to compress the content
+     * @param encoded_file file containing the compressed content (must be cached)
+     */
+    inline void setEncodedContent(ContentCoding coding, const DiskFile& encoded_file) {
+        setEncodedContent(coding, encoded_file.m_file_content, encoded_file.m_file_size);
+    }
+
+    /// removes all compressed variants of the file's content
+    inline void clearEncodedContent(void) {
+        for (int n = 0; n < CODING_COUNT; ++n) {
+            m_encoded_content[n].reset();
+            m_encoded_size[n] = 0;
+        }
+    }
+
+    /**
+     * replaces the file content with one of its compressed variants; the
+     * content and size returned afterwards are those of the compressed bytes
+     *
+     * @param coding the content-coding to use (must have encoded content)
+     */
+    inline void selectContentCoding(ContentCoding coding) {
+        m_file_content = m_encoded_content[coding];
+        m_file_size = m_encoded_size[coding];
+        m_content_coding = coding;
+        // each variant needs an entity tag of its own
+        if (! m_etag.empty())
+            m_etag.insert(m_etag.size() - 1, "-" + getContentCodingName(coding));
+    }
+
+    /// returns the name of the content-coding selected for the content (empty if identity)
+    inline const std::string& getContentEncoding(void) const {
+        return getContentCodingName(m_content_coding);
+    }
+
+    /// returns the name used in HTTP headers for a content-coding
+    static const std::string& getContentCodingName(ContentCoding coding);
+
     /// returns size of the file's content
     inline unsigned long getFileSize(void) const { return m_file_size; }
 
@@ -86,6 +207,9 @@ public:
     /// returns timestamp that the cached file was last modified (string format)
     inline const std::string& getLastModifiedString(void) const { return m_last_modified_string; }
 
+    /// returns the (quoted) strong entity tag of the content (empty if unknown)
+    inline const std::string& getETag(void) const { return m_etag; }
+
     /// returns mime type for the cached file
     inline const std::string& getMimeType(void) const { return m_mime_type; }
 
@@ -102,11 +226,26 @@ public:
     inline void resetFileContent(unsigned long n = 0) {
         if (n == 0) m_file_content.reset();
         else m_file_content.reset(new char[n]);
+        m_content_mapped = false;
+        clearEncodedContent();
     }
 
 
 protected:
 
+    /**
+     * gets the file's current size, modification time and entity tag, using
+     * a single stat() call where it is available (throws if the file does
+     * not exist)
+     *
+     * @param file_size will hold the size of the file
+     * @param last_modified will hold the time that the file was last modified
+     * @param etag will hold the strong entity tag of the file
+     */
+    void getFileStatus(std::streamsize& file_size, time_t& last_modified,
+                       std::string& etag) const;
+
+
     /// path to the cached file
     boost::filesystem::path     m_file_path;
 
@@ -122,8 +261,23 @@ protected:
     /// timestamp that the cached file was last modified (string format)
     std::string                 m_last_modified_string;
 
+    /// strong entity tag, made from the file's inode, size and modification time
+    std::string                 m_etag;
+
     /// mime type for the cached file
     std::string                 m_mime_type;
+
+    /// true if m_file_content refers to a memory mapping of the file
+    bool                        m_content_mapped;
+
+    /// content-coding selected for m_file_content (CODING_COUNT if identity)
+    ContentCoding               m_content_coding;
+
+    /// compressed variants of the file's content, indexed by content-coding
+    boost::shared_array<char>   m_encoded_content[CODING_COUNT];
+
+    /// sizes of the compressed variants of the file's content
+    unsigned long               m_encoded_size[CODING_COUNT];
 };
 
 
@@ -135,6 +289,13 @@ class DiskFileSender :
     private boost::noncopyable
 {
 public:
+
+    /// a range of the file's bytes: position of the first byte, and number of bytes
+    typedef std::pair<unsigned long, unsigned long>     ByteRange;
+
+    /// data type for a list of byte ranges
+    typedef std::vector<ByteRange>                      ByteRanges;
+
     /**
      * creates new DiskFileSender objects
      *
@@ -153,14 +314,34 @@ public:
                                                                     tcp_conn, max_chunk_size));
     }
 
-    /// default virtual destructor 
-    virtual ~DiskFileSender() {}
+    /// closes the file, if it was opened for sendfile()
+    virtual ~DiskFileSender();
 
     /// Begins sending the file to the client.  Following a call to this
     /// function, it is not thread safe to use your reference to the
     /// DiskFileSender object.
     void send(void);
 
+    /**
+     * sends only some ranges of the file's bytes, using a "206 Partial
+     * Content" response.  Multiple ranges are sent as a multipart/byteranges
+     * message.  Must be called before send().
+     *
+     * @param ranges the ranges to send (each must be within the file)
+     */
+    void setByteRanges(const ByteRanges& ranges);
+
+    /**
+     * reads content that is not cached (and calls sendfile()) in the threads
+     * that run the given io_service, instead of the connection's thread.
+     * Must be called before send().
+     *
+     * @param io_service used to run blocking disk I/O
+     */
+    inline void setDiskIOService(boost::asio::io_service& io_service) {
+        m_disk_io_service = &io_service;
+    }
+
     /// sets the logger to be used
     inline void set_logger(logger log_ptr) { m_logger = log_ptr; }
 
@@ -192,6 +373,47 @@ protected:
     void handle_write(const boost::system::error_code& write_error,
                      std::size_t bytes_written);
 
+    /**
+     * returns a pointer to some of the file's content, reading it from the
+     * file if it is not cached in memory (logs and returns NULL if it fails)
+     *
+     * @param offset position of the first byte
+     * @param length number of bytes
+     */
+    char *getFileContent(unsigned long offset, unsigned long length);
+
+    /**
+     * reads some of the file's content in a disk I/O thread, and then calls
+     * send() again in the connection's thread
+     *
+     * @param offset position of the first byte
+     * @param length number of bytes
+     */
+    void readFileContent(unsigned long offset, unsigned long length);
+
+#ifdef PION_HAVE_SENDFILE
+    /**
+     * calls send_file_content() in a disk I/O thread, if there are any
+     *
+     * @param write_error error status from the last write operation
+     * @param bytes_written number of bytes sent by the last write operation
+     */
+    void dispatch_file_content(const boost::system::error_code& write_error,
+                               std::size_t bytes_written);
+
+    /**
+     * sends the file's content using sendfile(), which copies it from the
+     * file to the socket without passing through user space.  Called after
+     * the HTTP headers have been sent, and whenever the socket is ready to
+     * send more data.
+     *
+     * @param write_error error status from the last write operation
+     * @param bytes_written number of bytes sent by the last write operation
+     */
+    void send_file_content(const boost::system::error_code& write_error,
+                           std::size_t bytes_written);
+#endif
+
 
     /// primary logging interface used by this class
     logger                              m_logger;
@@ -199,6 +421,30 @@ protected:
 
 private:
 
+    /// a piece of the response content: either text, or a range of the file's bytes
+    struct ContentPiece {
+        /// constructs a piece that holds a range of the file's bytes
+        ContentPiece(unsigned long offset, unsigned long length)
+            : m_file_offset(offset), m_length(length) {}
+
+        /// constructs a piece that holds text (such as multipart headers)
+        explicit ContentPiece(const std::string& text)
+            : m_text(text), m_file_offset(0), m_length(0) {}
+
+        /// returns true if the piece holds text
+        inline bool isText(void) const { return m_length == 0; }
+
+        /// text content of the piece
+        std::string     m_text;
+
+        /// position of the piece's first byte within the file
+        unsigned long   m_file_offset;
+
+        /// number of the file's bytes in the piece (0 for text)
+        unsigned long   m_length;
+    };
+
+
     /// the disk file we are sending
     DiskFile                                m_disk_file;
 
@@ -211,6 +457,18 @@ private:
     /// buffer used to send file content
     boost::shared_array<char>               m_content_buf;
 
+    /// size of the buffer used to send file content
+    unsigned long                           m_content_buf_size;
+
+    /// pieces of the response content (the whole file, unless ranges were requested)
+    std::vector<ContentPiece>               m_content_pieces;
+
+    /// index of the next piece of content to send
+    std::size_t                             m_piece_index;
+
+    /// number of bytes of the current piece that have already been sent
+    unsigned long                           m_piece_offset;
+
     /**
      * maximum chunk size (in bytes): files larger than this size will be
      * delivered to clients using HTTP chunked responses.  A value of
@@ -218,17 +476,407 @@ private:
      */
     unsigned long                           m_max_chunk_size;
 
-    /// the number of file bytes send in the last operation
+    /// the number of content bytes sent in the last operation
     unsigned long                           m_file_bytes_to_send;
 
-    /// the number of bytes we have sent so far
+    /// the number of content bytes we have sent so far
     unsigned long                           m_bytes_sent;
+
+    /// used to run blocking disk I/O (NULL to use the connection's thread)
+    boost::asio::io_service *               m_disk_io_service;
+
+    /// true if the content for the next write was read by readFileContent()
+    bool                                    m_content_read;
+
+    /// position within the file of the content in m_content_buf
+    unsigned long                           m_buffered_offset;
+
+    /// number of the file's bytes in m_content_buf (0 if none)
+    unsigned long                           m_buffered_length;
+
+#ifdef PION_HAVE_SENDFILE
+    /// file descriptor used by sendfile() (-1 if the file is not open)
+    int                                     m_file_fd;
+
+    /// offset of the next byte that sendfile() will send
+    off_t                                   m_file_offset;
+#endif
 };
 
 /// data type for a DiskFileSender pointer
 typedef boost::shared_ptr<DiskFileSender>       DiskFileSenderPtr;
 
 
+///
+/// DiskFileUpload: class used to write the content of PUT and POST requests
+///                 to a temporary file as it arrives.  The temporary file is
+///                 then renamed to the requested file (PUT), or appended to
+///                 it (POST), once the whole request has been received.
+///                 If it is opened with a disk I/O service, the temporary
+///                 file is created and written in that service's threads.
+///
+class DiskFileUpload :
+    public boost::enable_shared_from_this<DiskFileUpload>,
+    private boost::noncopyable
+{
+public:
+
+    /**
+     * constructs a new DiskFileUpload object (use open() to create the
+     * temporary file)
+     *
+     * @param file_path path to the requested file
+     * @param append if true, the content is appended to the file (POST)
+     * @param max_bytes the maximum size of the content (0 = unlimited)
+     */
+    DiskFileUpload(const boost::filesystem::path& file_path, bool append,
+                   unsigned long max_bytes = 0);
+
+    /// removes the temporary file, unless the upload was committed
+    ~DiskFileUpload() { discard(); }
+
+    /// creates the temporary file (next to the requested file); returns false
+    /// if it cannot be created, or if the request will not be accepted
+    /// (the requested file is a directory, or its directory does not exist)
+    bool open(void);
+
+    /**
+     * creates the temporary file in one of the threads of a disk I/O
+     * service, where the content is then written as well.  write() copies
+     * the content, and waits if more than max_queued bytes of it have not
+     * been written yet.
+     *
+     * @param io_service the disk I/O service
+     * @param max_queued the maximum number of bytes waiting to be written
+     */
+    void open(boost::asio::io_service& io_service, std::size_t max_queued);
+
+    /// writes part of the content to the temporary file (used as the request
+    /// parser's payload handler)
+    void write(const char *ptr, std::size_t len);
+
+    /**
+     * calls a handler once all of the content received has been written to
+     * the temporary file.  If the upload was opened with a disk I/O service,
+     * the handler is called in one of its threads; otherwise it is called
+     * immediately.
+     *
+     * @param handler the function to call
+     */
+    void afterWrites(const boost::function0<void>& handler);
+
+    /// moves the content into the requested file; returns false if the
+    /// content could not be written
+    bool commit(void);
+
+    /// closes and removes the temporary file, unless the upload was committed
+    void discard(void);
+
+    /// discards the upload because its content is larger than the maximum
+    /// size; the rest of the content is ignored
+    void discardTooLarge(void);
+
+    /// returns true if the content is larger than the maximum size
+    inline bool isTooLarge(void) const { return m_too_large; }
+
+    /// returns the path to the requested file
+    inline const boost::filesystem::path& getFilePath(void) const { return m_file_path; }
+
+    /// returns the path to the temporary file
+    inline const boost::filesystem::path& getTempPath(void) const { return m_temp_path; }
+
+    /// returns the number of content bytes written so far
+    inline unsigned long getBytesWritten(void) const { return m_bytes_written; }
+
+    /// returns true if a file name is that of a temporary file (these files
+    /// are in the served directory, but are neither served nor cached)
+    static bool isTempFileName(const std::string& file_name);
+
+
+private:
+
+    /// writes content to the temporary file, if it is smaller than the
+    /// maximum size
+    void writeContent(const char *ptr, std::size_t len);
+
+    /// creates the temporary file and writes the content that is queued,
+    /// then calls the handler passed to afterWrites() (runs in a disk I/O
+    /// thread)
+    void writeQueued(void);
+
+    /// appends the content of the (closed) temporary file to the requested
+    /// file; returns false if it could not be written
+    bool appendContent(void);
+
+    /// gives the temporary file the mode (and if possible, the owner) of the
+    /// requested file, if it exists
+    void keepFileMode(void);
+
+
+    /// path to the requested file
+    boost::filesystem::path             m_file_path;
+
+    /// path to the temporary file that the content is written to
+    boost::filesystem::path             m_temp_path;
+
+    /// the temporary file
+    boost::filesystem::ofstream         m_file_stream;
+
+    /// number of content bytes written so far
+    unsigned long                       m_bytes_written;
+
+    /// the maximum size of the content (0 = unlimited)
+    unsigned long                       m_max_bytes;
+
+    /// if true, the content is appended to the requested file
+    bool                                m_append;
+
+    /// true if the content is larger than m_max_bytes
+    bool                                m_too_large;
+
+    /// true if writing to the temporary file has failed
+    bool                                m_failed;
+
+    /// true until the temporary file is created, and once the upload has
+    /// been committed or discarded
+    bool                                m_finished;
+
+    /// the disk I/O service that the content is written in (NULL if it is
+    /// written by write())
+    boost::asio::io_service *           m_io_service;
+
+    /// the maximum number of bytes waiting to be written
+    std::size_t                         m_max_queued;
+
+    /// content received that has not been written yet
+    std::deque<std::string>             m_queue;
+
+    /// number of bytes in m_queue
+    std::size_t                         m_queued_bytes;
+
+    /// number of content bytes received by write()
+    unsigned long                       m_bytes_received;
+
+    /// true if the temporary file has yet to be created by writeQueued()
+    bool                                m_open_queued;
+
+    /// true while writeQueued() is posted or running
+    bool                                m_writing;
+
+    /// called once writeQueued() has written all of the content
+    boost::function0<void>              m_written_handler;
+
+    /// protects the queue and the state shared with the disk I/O threads
+    boost::mutex                        m_queue_mutex;
+
+    /// signaled when queued content has been written
+    boost::condition                    m_queue_written;
+};
+
+/// data type for a DiskFileUpload pointer
+typedef boost::shared_ptr<DiskFileUpload>       DiskFileUploadPtr;
+
+
+///
+/// FileCache: thread-safe cache of DiskFile objects with a budget for the
+///            bytes of file content it holds.  Entries are divided among
+///            shards that are locked independently; lookups only take a
+///            shared (read) lock.  When the cache exceeds its budget,
+///            content is evicted from the shards in turn, using the CLOCK
+///            algorithm (an approximation of LRU).  Evicted entries keep their path and
+///            MIME type, so that they are still known to the cache.
+///
+class FileCache :
+    private boost::noncopyable
+{
+public:
+
+    /// default number of shards
+    static const std::size_t    DEFAULT_NUM_SHARDS;
+
+    /**
+     * constructs a new FileCache
+     *
+     * @param num_shards number of shards (rounded up to a power of two)
+     */
+    explicit FileCache(std::size_t num_shards = DEFAULT_NUM_SHARDS);
+
+    /// sets the maximum bytes of content to cache (0 = unlimited), for all shards together
+    inline void setMaxBytes(unsigned long max_bytes) { m_max_bytes = max_bytes; }
+
+    /// returns the maximum bytes of content to cache (0 = unlimited)
+    inline unsigned long getMaxBytes(void) const { return m_max_bytes; }
+
+    /// returns true if content of the given size can be cached at all
+    inline bool fits(unsigned long bytes) const {
+        return m_max_bytes == 0 || bytes <= m_max_bytes;
+    }
+
+    /**
+     * finds a cache entry and marks it as recently used
+     *
+     * @param key the key of the entry
+     * @param file if the entry is found, it is copied into this object
+     * @param version if not NULL, set to the entry's version (see update())
+     * @return true if the entry was found
+     */
+    bool find(const std::string& key, DiskFile& file, unsigned long *version = NULL);
+
+    /**
+     * replaces an existing entry, unless it was changed or removed since it
+     * was found (so that a stale copy never overwrites a newer entry)
+     *
+     * @param key the key of the entry
+     * @param file the file to cache
+     * @param version the entry's version, as returned by find()
+     * @return true if the entry was replaced
+     */
+    bool update(const std::string& key, const DiskFile& file, unsigned long version);
+
+    /**
+     * adds a new entry or replaces an existing one, and evicts other content
+     * if the cache exceeds its budget
+     *
+     * @param key the key of the entry
+     * @param file the file to cache
+     */
+    void insert(const std::string& key, const DiskFile& file);
+
+    /**
+     * adds a new entry, unless the cache already has one for the key
+     *
+     * @param key the key of the entry
+     * @param file the file to cache
+     * @return true if the entry was added
+     */
+    bool add(const std::string& key, const DiskFile& file);
+
+    /// removes an entry from the cache
+    void erase(const std::string& key);
+
+    /// removes all entries whose keys start with the given prefix
+    void erasePrefix(const std::string& prefix);
+
+    /// removes all entries from the cache
+    void clear(void);
+
+    /// returns the number of entries in the cache
+    std::size_t size(void) const;
+
+    /// returns the number of bytes of content held by the cache
+    unsigned long getCachedBytes(void) const;
+
+
+private:
+
+    /// an entry in the cache
+    struct Entry : private boost::noncopyable {
+        /// constructs a new entry
+        Entry(const DiskFile& file)
+            : m_file(file), m_version(0), m_bytes(0), m_references(0),
+            m_clock_mark(0), m_in_clock(false) {}
+
+        /// the cached file
+        DiskFile                        m_file;
+
+        /// incremented each time that the entry is replaced
+        unsigned long                   m_version;
+
+        /// bytes of content held by the entry
+        unsigned long                   m_bytes;
+
+        /// number of times the entry was found (incremented under a shared lock)
+        boost::detail::atomic_count     m_references;
+
+        /// value of m_references when the clock hand last passed the entry
+        long                            m_clock_mark;
+
+        /// true if the entry holds content, and is in the shard's clock list
+        bool                            m_in_clock;
+
+        /// position of the entry in the shard's clock list (if m_in_clock)
+        std::list<Entry*>::iterator     m_clock_pos;
+    };
+
+    /// data type for a map of keys to cache entries
+    typedef PION_HASH_MAP<std::string, boost::shared_ptr<Entry>, PION_HASH_STRING >  EntryMap;
+
+    /// data type for a list of entries that hold content, in clock order
+    typedef std::list<Entry*>                                                       ClockList;
+
+    /// a shard of the cache
+    struct Shard : private boost::noncopyable {
+        /// constructs an empty shard
+        Shard(void) : m_hand(m_clock.end()) {}
+
+        /// protects the shard's entries
+        mutable boost::shared_mutex     m_mutex;
+
+        /// entries of the shard
+        EntryMap                        m_entries;
+
+        /// entries that hold content, in clock order
+        ClockList                       m_clock;
+
+        /// the clock hand: next entry to consider for eviction
+        ClockList::iterator             m_hand;
+    };
+
+    /// returns the shard that a key belongs to
+    inline Shard& getShard(const std::string& key) {
+        return m_shards[boost::hash<std::string>()(key) & (m_num_shards - 1)];
+    }
+
+    /**
+     * changes the file held by an entry, updating the shard's clock list
+     * (requires an exclusive lock on the shard)
+     */
+    void setEntryFile(Shard& shard, Entry& entry, const DiskFile& file);
+
+    /**
+     * moves the shard's clock hand until it evicts an entry, or has passed
+     * each entry once (requires an exclusive lock on the shard)
+     *
+     * @return true if an entry was evicted
+     */
+    bool evictFromShard(Shard& shard);
+
+    /**
+     * evicts content from the shards, in turn, until the cache is within its
+     * budget (requires that no shard is locked by the calling thread)
+     */
+    void evict(void);
+
+    /// adds (or with a negative value, subtracts) bytes to the content held by the cache
+    inline void addCachedBytes(long bytes) {
+        boost::mutex::scoped_lock bytes_lock(m_bytes_mutex);
+        m_bytes += bytes;
+    }
+
+    /// removes an entry from its shard (requires an exclusive lock)
+    void eraseEntry(Shard& shard, EntryMap::iterator entry_itr);
+
+
+    /// the shards of the cache
+    boost::scoped_array<Shard>      m_shards;
+
+    /// number of shards (a power of two)
+    std::size_t                     m_num_shards;
+
+    /// maximum bytes of content to cache (0 = unlimited)
+    unsigned long                   m_max_bytes;
+
+    /// protects m_bytes and m_evict_shard
+    mutable boost::mutex            m_bytes_mutex;
+
+    /// bytes of content held by all of the shards
+    unsigned long                   m_bytes;
+
+    /// index of the next shard to evict content from
+    std::size_t                     m_evict_shard;
+};
+
+
 ///
 /// FileService: web service that serves regular files
 /// 
@@ -239,7 +887,7 @@ public:
 
     // default constructor and destructor
     FileService(void);
-    virtual ~FileService() {}
+    virtual ~FileService();
 
     /**
      * configuration options supported by FileService:
@@ -250,6 +898,23 @@ public:
      * scan:
      * max_chunk_size:
      * writable:
+     * max_upload_size: maximum bytes of content written to a file by a PUT
+     *                  or POST request (0 = unlimited); larger requests are
+     *                  answered with 413 (Request Entity Too Large)
+     * mmap: if true, cached files are mapped into memory instead of being read,
+     *       if cache == 2 and the service is not writable (files must then
+     *       not be truncated while the service is running)
+     * precompressed: if true, cached files use sidecars (foo.js.gz, foo.js.br)
+     * compress: if true, text files are compressed with gzip when cached
+     * cache_budget: maximum bytes of file content to cache (0 = unlimited);
+     *               the budget is shared by all cached files, so a file is
+     *               cached if it is not larger than the budget itself
+     * watch: if true, the directory is watched for changes (requires inotify)
+     * scan_threads: if > 0, the directory is scanned by this many threads in
+     *               the background, while requests are served
+     * io_threads: if > 0, requests that need blocking disk I/O are handled
+     *             by this many threads, instead of the connection's thread
+     *             (the content of uploads is written by them as well)
      */
     virtual void set_option(const std::string& name, const std::string& value);
 
@@ -257,6 +922,14 @@ public:
     virtual void operator()(pion::http::request_ptr& http_request_ptr,
                             pion::tcp::connection_ptr& tcp_conn);
 
+    /// returns a handler that writes the content of PUT and POST requests to
+    /// a temporary file as it arrives, if the service is writable
+    virtual pion::http::parser::payload_handler_t get_payload_handler(pion::http::request_ptr& http_request_ptr,
+                                                                      pion::tcp::connection_ptr& tcp_conn);
+
+    /// returns true if the service is writable (only then is request content streamed)
+    virtual bool has_payload_handler(void) const { return m_writable; }
+
     /// called when the web service's server is starting
     virtual void start(void);
 
@@ -272,18 +945,165 @@ public:
 
 protected:
 
-    /// data type for map of file names to cache entries
-    typedef PION_HASH_MAP<std::string, DiskFile, PION_HASH_STRING >     CacheMap;
-
     /// data type for map of file extensions to MIME types
     typedef PION_HASH_MAP<std::string, std::string, PION_HASH_STRING >  MIMETypeMap;
 
+    /// data type for map of requests to the uploads that their content is written to
+    typedef std::map<const pion::http::request*,
+        std::pair<boost::weak_ptr<pion::http::request>, boost::weak_ptr<DiskFileUpload> > >  UploadMap;
+
+    /// the types of response that sendResponse() sends
+    enum ResponseType {
+        RESPONSE_UNDEFINED,             // initial state until we know how to respond
+        RESPONSE_OK,                    // normal response that includes the file's content
+        RESPONSE_HEAD_OK,               // response to HEAD request (would send file's content)
+        RESPONSE_NOT_FOUND,             // Not Found (404)
+        RESPONSE_NOT_MODIFIED,          // Not Modified (304) response to If-Modified-Since
+        RESPONSE_RANGE_NOT_SATISFIABLE, // Requested Range Not Satisfiable (416)
+        RESPONSE_OUTSIDE_DIRECTORY,     // Forbidden (403): the file is not in the directory
+        RESPONSE_IS_DIRECTORY,          // Forbidden (403): the file is a directory
+        RESPONSE_NOT_ALLOWED,           // Method Not Allowed (405): the files are not writable
+        RESPONSE_CREATED,               // Created (201): a new file was written
+        RESPONSE_NO_CONTENT,            // No Content (204): the file was written or deleted
+        RESPONSE_DIRECTORY_NOT_FOUND,   // Not Found (404): the file's directory does not exist
+        RESPONSE_TOO_LARGE,             // Request Entity Too Large (413): max_upload_size was exceeded
+        RESPONSE_WRITE_FAILED,          // Server Error (500): the file could not be written
+        RESPONSE_DELETE_FAILED,         // Server Error (500): the file could not be deleted
+        RESPONSE_NOT_IMPLEMENTED        // Not Implemented (501)
+    };
+
+    /// the result of looking up a requested file in the cache and on disk,
+    /// which is all that sendResponse() needs to respond without disk access
+    struct CacheLookup {
+        /// constructs a lookup that has not been done yet
+        CacheLookup(void) : m_done(false), m_found(false), m_version(0),
+            m_response_type(RESPONSE_UNDEFINED) {}
+
+        /// true if the cache was searched
+        bool            m_done;
+
+        /// true if an entry was found
+        bool            m_found;
+
+        /// the entry's version (see FileCache::update())
+        unsigned long   m_version;
+
+        /// a copy of the entry found
+        DiskFile        m_entry;
+
+        /// the type of response to send (see findResponse())
+        ResponseType    m_response_type;
+
+        /// the file to send, or whose metadata is sent
+        DiskFile        m_response_file;
+
+        /// the ranges of the file requested (empty to send all of it)
+        DiskFileSender::ByteRanges  m_byte_ranges;
+
+        /// describes why the file could not be deleted
+        std::string     m_error;
+    };
+
+    /**
+     * accesses the disk for a request in one of the disk I/O threads, and
+     * posts sendResponse() to the connection's thread (called by operator())
+     *
+     * @param http_request_ptr the request to handle
+     * @param tcp_conn the connection that the request was received on
+     * @param upload the content of the request, if it was written to a
+     *               temporary file (see takeUpload())
+     * @param cache_lookup the cache lookup for the requested file, if
+     *                     operator() has done it already
+     */
+    void handleRequest(pion::http::request_ptr& http_request_ptr,
+                       pion::tcp::connection_ptr& tcp_conn,
+                       DiskFileUploadPtr& upload,
+                       CacheLookup& cache_lookup);
+
+    /**
+     * finds the file requested and decides how to respond; this is where
+     * the disk is accessed (files are read, checked, written and deleted)
+     *
+     * @param http_request_ptr the request to respond to
+     * @param upload the content of the request, if it was written to a
+     *               temporary file (see get_payload_handler())
+     * @param cache_lookup the cache lookup for the requested file (it is
+     *                     done here if it was not done yet); the response
+     *                     is stored in it
+     */
+    void findResponse(pion::http::request_ptr& http_request_ptr,
+                      DiskFileUploadPtr& upload,
+                      CacheLookup& cache_lookup);
+
+    /**
+     * sends the response that findResponse() decided on (in the
+     * connection's thread)
+     *
+     * @param http_request_ptr the request to respond to
+     * @param tcp_conn the connection that the request was received on
+     * @param cache_lookup the result of findResponse()
+     */
+    void sendResponse(pion::http::request_ptr& http_request_ptr,
+                      pion::tcp::connection_ptr& tcp_conn,
+                      CacheLookup& cache_lookup);
+
+    /**
+     * removes and returns the upload that the content of a request was
+     * written to (empty if the content is stored in the request)
+     *
+     * @param http_request the request that the content belongs to
+     */
+    DiskFileUploadPtr takeUpload(const pion::http::request& http_request);
+
+    /**
+     * returns true unless a request can be answered without blocking disk I/O,
+     * using only the content and metadata of a cached file
+     *
+     * @param http_request the request to check
+     * @param cache_lookup set to the cache lookup for the requested file, if
+     *                     the cache was searched
+     */
+    bool needsDiskAccess(pion::http::request& http_request, CacheLookup& cache_lookup);
+
+    /// runs m_io_service until the service is stopped (runs in each disk I/O thread)
+    void runIOThread(void);
+
+    /// stops the disk I/O threads, after they finish the work already posted
+    void stopIOThreads(void);
+
     /**
      * adds all files within a directory to the cache
      *
      * @param dir_path the directory to scan (sub-directories are included)
+     * @param parallel if true, its sub-directories and files are posted to
+     *                 m_scan_service, to be scanned by the scan threads
      */
-    void scanDirectory(const boost::filesystem::path& dir_path);
+    void scanDirectory(const boost::filesystem::path& dir_path,
+                       const bool parallel = false);
+
+    /**
+     * adds a file found while scanning to the cache, and reports progress
+     *
+     * @param relative_path path for the file relative to the root directory
+     * @param file_path actual path to the file on disk
+     */
+    void scanFile(const std::string& relative_path,
+                  const boost::filesystem::path& file_path);
+
+    /// runs m_scan_service until the scan is finished (runs in each scan thread)
+    void runScanThread(void);
+
+    /// logs that scanning is finished (requires m_scan_mutex)
+    void finishScan(void);
+
+    /// returns true while the directory is being scanned in the background
+    inline bool isScanning(void) const {
+        boost::mutex::scoped_lock scan_lock(m_scan_mutex);
+        return m_scanning;
+    }
+
+    /// stops scanning in the background, and waits for the scan threads to finish
+    void stopScanning(void);
 
     /**
      * adds a single file to the cache
@@ -292,14 +1112,136 @@ protected:
      * @param file_path actual path to the file on disk
      * @param placeholder if true, the file's contents are not cached
      *
-     * @return std::pair<CacheMap::iterator, bool> if an entry is added to the
-     *         cache, second will be true and first will point to the new entry
+     * @return true if an entry was added to the cache
      */
-    std::pair<CacheMap::iterator, bool>
-        addCacheEntry(const std::string& relative_path,
+    bool addCacheEntry(const std::string& relative_path,
                       const boost::filesystem::path& file_path,
                       const bool placeholder);
 
+    /**
+     * replaces a file's cache entry with a placeholder, so that it is read
+     * again the next time that it is requested (adds the entry if necessary)
+     *
+     * @param relative_path path for the file relative to the root directory
+     * @param file_path actual path to the file on disk
+     */
+    void invalidateCacheEntry(const std::string& relative_path,
+                              const boost::filesystem::path& file_path);
+
+    /// starts watching the directory for changes, using a background thread
+    void startWatching(void);
+
+    /// stops watching the directory for changes
+    void stopWatching(void);
+
+    /// returns true while the directory is being watched
+    inline bool isWatching(void) const {
+        boost::mutex::scoped_lock watch_lock(m_watch_mutex);
+        return m_watching;
+    }
+
+    /// sets whether the directory is being watched
+    inline void setWatching(const bool watching) {
+        boost::mutex::scoped_lock watch_lock(m_watch_mutex);
+        m_watching = watching;
+    }
+
+#ifdef PION_HAVE_INOTIFY
+    /**
+     * adds inotify watches for a directory and all of its sub-directories
+     *
+     * @param dir_path the directory to watch
+     * @param add_files if true, placeholder entries are added for its files
+     */
+    void watchDirectory(const boost::filesystem::path& dir_path, const bool add_files);
+
+    /// reads inotify events until stopWatching() is called (runs in m_watch_thread)
+    void watchFiles(void);
+
+    /**
+     * updates the cache for an inotify event (runs in m_watch_thread)
+     *
+     * @param wd the watch descriptor of the directory
+     * @param mask the event's mask
+     * @param name name of the file in the directory (empty if none)
+     */
+    void handleWatchEvent(const int wd, const unsigned int mask, const std::string& name);
+#endif
+
+    /// returns true if cached files are mapped into memory (see m_mmap)
+    bool mapsFileContent(void) const;
+
+    /**
+     * caches the content of a file, by mapping it into memory if
+     * mapsFileContent() or by reading it otherwise (may throw)
+     *
+     * @param file the cache entry to populate
+     */
+    void cacheFileContent(DiskFile& file);
+
+    /**
+     * caches compressed variants of a file's content, using precompressed
+     * sidecar files and/or compressing the cached content, depending on the
+     * precompressed and compress options (may throw)
+     *
+     * @param file the cache entry to populate (its content must be cached)
+     */
+    void cacheEncodedContent(DiskFile& file);
+
+    /**
+     * selects the compressed variant of a file's content that will be sent
+     * in response to a request, based on its Accept-Encoding header
+     *
+     * @param http_request_ptr the request being responded to
+     * @param file the file being sent
+     */
+    static void selectContentCoding(const pion::http::request_ptr& http_request_ptr,
+                                    DiskFile& file);
+
+    /**
+     * checks whether an Accept-Encoding header allows a content-coding
+     *
+     * @param accept_encoding value of the Accept-Encoding request header
+     * @param coding name of the content-coding
+     * @return true if the coding is listed (or matched by "*") with a non-zero qvalue
+     */
+    static bool acceptsContentCoding(const std::string& accept_encoding,
+                                     const std::string& coding);
+
+    /**
+     * checks an If-None-Match header against an entity tag, using the weak
+     * comparison function
+     *
+     * @param if_none_match value of the If-None-Match request header
+     * @param etag the (quoted) entity tag of the content
+     * @return true if the header is "*" or lists the entity tag
+     */
+    static bool matchesETag(const std::string& if_none_match, const std::string& etag);
+
+    /**
+     * parses a Range request header
+     *
+     * @param range_header value of the Range header
+     * @param file_size size of the content that the ranges refer to
+     * @param ranges will hold the satisfiable ranges that were requested,
+     *               sorted, with overlapping and adjacent ranges merged
+     *
+     * @return false if the header is invalid and should be ignored; if it is
+     *         valid but none of its ranges are satisfiable, ranges is empty.
+     *         Headers that request more bytes than the file has, or too many
+     *         separate ranges, are also ignored (to avoid amplification)
+     */
+    static bool parseRangeHeader(const std::string& range_header,
+                                 const unsigned long file_size,
+                                 DiskFileSender::ByteRanges& ranges);
+
+    /**
+     * returns true if files using a MIME type are worth compressing
+     *
+     * @param mime_type the MIME type of the file
+     */
+    static bool isCompressible(const std::string& mime_type);
+
     /**
      * searches for a MIME type that matches a file
      *
@@ -308,6 +1250,26 @@ protected:
      */
     static std::string findMIMEType(const std::string& file_name);
 
+    /**
+     * checks a file against an If-Modified-Since request header
+     *
+     * @param last_modified the time that the file was last modified
+     * @param if_modified_since the parsed header, or (time_t)-1 if there is none
+     * @return true if a Not Modified (304) response should be sent
+     */
+    static inline bool isNotModified(const std::time_t last_modified,
+                                     const std::time_t if_modified_since)
+    {
+        return (if_modified_since != static_cast<std::time_t>(-1)
+                && last_modified <= if_modified_since);
+    }
+
+    /// returns true if the content of a file of the given size may be cached
+    inline bool isCacheable(const unsigned long file_size) const {
+        return (m_max_cache_size == 0 || file_size <= m_max_cache_size)
+            && m_cache.fits(file_size);
+    }
+
     void sendNotFoundResponse(pion::http::request_ptr& http_request_ptr,
                               pion::tcp::connection_ptr& tcp_conn);
 
@@ -336,6 +1298,13 @@ private:
     /// default setting for the maximum chunk size option
     static const unsigned long  DEFAULT_MAX_CHUNK_SIZE;
 
+    /// default setting for the maximum upload size option
+    static const unsigned long  DEFAULT_MAX_UPLOAD_SIZE;
+
+    /// maximum number of bytes of an upload waiting to be written by the disk
+    /// I/O threads (the connection's thread waits when there are more)
+    static const std::size_t    MAX_QUEUED_UPLOAD_BYTES;
+
     /// flag used to make sure that createMIMETypes() is called only once
     static boost::once_flag     m_mime_types_init_flag;
 
@@ -350,10 +1319,7 @@ private:
     boost::filesystem::path     m_file;
 
     /// used to cache file contents and metadata in memory
-    CacheMap                    m_cache_map;
-
-    /// mutex used to make the file cache thread-safe
-    boost::mutex                m_cache_mutex;
+    FileCache                   m_cache;
 
     /**
      * cache configuration setting:
@@ -375,6 +1341,7 @@ private:
     /**
      * maximum cache size (in bytes): files larger than this size will never be
      * cached in memory.  A value of zero means that the size is unlimited.
+     * Files larger than the whole cache_budget are not cached either.
      */
     unsigned long               m_max_cache_size;
 
@@ -385,10 +1352,111 @@ private:
      */
     unsigned long               m_max_chunk_size;
 
+    /**
+     * maximum upload size (in bytes): the content of PUT and POST requests
+     * that is larger than this is not written.  A value of zero means that
+     * the size is unlimited.
+     */
+    unsigned long               m_max_upload_size;
+
     /**
      * Whether the file and/or directory served are writable.
      */
     bool                        m_writable;
+
+    /**
+     * if true, the content of cached files is memory-mapped using read-only
+     * shared mappings, so that it lives in the operating system's page cache
+     * (shared between processes) rather than in private heap memory.
+     * Files are only mapped if cache == 2 and the service is not writable,
+     * since reading a mapping of a file that has been truncated crashes the
+     * process; files must not be truncated while they are mapped.
+     */
+    bool                        m_mmap;
+
+    /// if true, precompressed sidecar files (.gz, .br) are cached with each file
+    bool                        m_precompressed;
+
+    /// if true, the content of cached text files is also cached compressed with gzip
+    bool                        m_compress;
+
+    /**
+     * if true, the directory is watched for changes while the service is running
+     * (Linux only).  Changed and deleted files are updated in the cache as soon
+     * as they change, and new files are added to it, even if scan == (1 | 3).
+     */
+    bool                        m_watch;
+
+    /**
+     * true while the directory is being watched; cache entries are then kept
+     * up to date by the watcher, so requests do not check files for updates
+     * (protected by m_watch_mutex, since the watcher thread clears it if it fails)
+     */
+    bool                        m_watching;
+
+    /// protects m_watching
+    mutable boost::mutex        m_watch_mutex;
+
+    /// number of threads used for blocking disk I/O (0 = none)
+    unsigned int                m_io_threads;
+
+    /// used to run blocking disk I/O in the disk I/O threads
+    boost::asio::io_service     m_io_service;
+
+    /// keeps the disk I/O threads running while the service is running
+    boost::scoped_ptr<boost::asio::io_service::work>    m_io_work;
+
+    /// threads used for blocking disk I/O
+    std::vector<boost::shared_ptr<boost::thread> >  m_io_thread_pool;
+
+    /// number of threads used to scan the directory in the background (0 = none)
+    unsigned int                m_scan_threads;
+
+    /**
+     * true while the directory is being scanned in the background; requests
+     * for files that are not cached yet are then served from disk, even if
+     * scan == (1 | 3) (protected by m_scan_mutex)
+     */
+    bool                        m_scanning;
+
+    /// used to distribute scanning work among the scan threads
+    boost::asio::io_service     m_scan_service;
+
+    /// threads used to scan the directory in the background
+    std::vector<boost::shared_ptr<boost::thread> >  m_scan_thread_pool;
+
+    /// protects the scanning progress
+    mutable boost::mutex        m_scan_mutex;
+
+    /// number of scan threads that are still running
+    unsigned int                m_scan_threads_running;
+
+    /// number of files scanned so far
+    unsigned long               m_scanned_files;
+
+    /// time when scanning started
+    boost::posix_time::ptime    m_scan_start_time;
+
+    /// uploads whose content is being received, until they are taken by
+    /// operator() (or their payload handlers are destroyed)
+    UploadMap                   m_uploads;
+
+    /// protects m_uploads
+    boost::mutex                m_upload_mutex;
+
+#ifdef PION_HAVE_INOTIFY
+    /// inotify instance used to watch the directory
+    int                         m_inotify_fd;
+
+    /// pipe used to wake up the watcher thread when it should stop
+    int                         m_watch_pipe[2];
+
+    /// maps inotify watch descriptors to directory paths relative to m_directory
+    std::map<int, std::string>  m_watch_dirs;
+
+    /// thread that reads inotify events
+    boost::scoped_ptr<boost::thread>    m_watch_thread;
+#endif
 };
 
 
@@ -0,0 +1,70 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <pion/http/content_blocks.hpp>
+
+
+namespace pion {    // begin namespace pion
+namespace http {    // begin namespace http
+
+
+// static members of content_block_pool
+
+content_block_pool *    content_block_pool::m_instance_ptr = NULL;
+boost::once_flag        content_block_pool::m_instance_flag = BOOST_ONCE_INIT;
+
+
+// content_block_pool member functions
+
+content_block_pool::~content_block_pool()
+{
+    for (std::vector<char*>::iterator i = m_free_blocks.begin(); i != m_free_blocks.end(); ++i)
+        delete [] *i;
+}
+
+char *content_block_pool::acquire(void)
+{
+    {
+        boost::mutex::scoped_lock pool_lock(m_mutex);
+        if (! m_free_blocks.empty()) {
+            char *block = m_free_blocks.back();
+            m_free_blocks.pop_back();
+            return block;
+        }
+    }
+    return new char[BLOCK_SIZE];
+}
+
+void content_block_pool::release(char *block)
+{
+    {
+        boost::mutex::scoped_lock pool_lock(m_mutex);
+        if (m_free_blocks.size() < MAX_FREE_BLOCKS) {
+            m_free_blocks.push_back(block);
+            return;
+        }
+    }
+    delete [] block;
+}
+
+std::size_t content_block_pool::get_free_blocks(void) const
+{
+    boost::mutex::scoped_lock pool_lock(m_mutex);
+    return m_free_blocks.size();
+}
+
+void content_block_pool::create_instance(void)
+{
+    static content_block_pool UNIQUE_POOL;
+    m_instance_ptr = &UNIQUE_POOL;
+}
+
+
+}   // end namespace http
+}   // end namespace pion
@@ -0,0 +1,168 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <boost/bind.hpp>
+#include <boost/logic/tribool.hpp>
+#include <pion/http/flow_parser.hpp>
+
+
+namespace pion {    // begin namespace pion
+namespace http {    // begin namespace http
+
+
+// flow_parser member functions
+
+flow_parser::flow_parser(transaction_handler_t handler, std::size_t max_buffered)
+    : m_handler(handler), m_client_stream(max_buffered), m_server_stream(max_buffered),
+    m_resync_count(0), m_missing_content_bytes(0)
+{
+    m_client_stream.set_data_handler(boost::bind(&flow_parser::consume_request_data, this, _1, _2));
+    m_client_stream.set_gap_handler(boost::bind(&flow_parser::consume_request_gap, this, _1));
+    m_server_stream.set_data_handler(boost::bind(&flow_parser::consume_response_data, this, _1, _2));
+    m_server_stream.set_gap_handler(boost::bind(&flow_parser::consume_response_gap, this, _1));
+    m_request_parser.set_missing_data_handler(boost::bind(&flow_parser::skip_content, this, _1));
+    m_response_parser.set_missing_data_handler(boost::bind(&flow_parser::skip_content, this, _1));
+}
+
+void flow_parser::close(void)
+{
+    m_client_stream.flush();
+    m_server_stream.flush();
+
+    // a response without a length ends with the connection; any other
+    // response that has not been finished was truncated
+    if (m_response) {
+        if (m_response_parser.check_premature_eof(*m_response)) {
+            m_response_parser.finish(*m_response);
+            m_response->set_status(http::message::STATUS_TRUNCATED);
+        }
+        finished_response();
+    }
+
+    // report requests that did not get a response
+    http::response_ptr no_response;
+    while (! m_pending_requests.empty()) {
+        http::request_ptr request_ptr(m_pending_requests.front());
+        m_pending_requests.pop_front();
+        m_handler(request_ptr, no_response);
+    }
+    m_request.reset();
+    m_response.reset();
+    m_request_parser.reset();
+    m_response_parser.reset();
+}
+
+void flow_parser::consume_request_data(const char *ptr, std::size_t len)
+{
+    m_request_parser.set_read_buffer(ptr, len);
+    while (! m_request_parser.eof()) {
+        if (! m_request)
+            m_request.reset(new http::request);
+        boost::system::error_code ec;
+        const boost::tribool rc = m_request_parser.parse(*m_request, ec);
+        if (rc == true) {
+            // any bytes left over belong to the next (pipelined) request
+            finished_request();
+        } else if (rc == false) {
+            // start again with the next data that arrives
+            m_request.reset();
+            m_request_parser.reset();
+            ++m_resync_count;
+            break;
+        }
+    }
+}
+
+void flow_parser::consume_request_gap(std::size_t len)
+{
+    if (! m_request)
+        return;
+    boost::system::error_code ec;
+    const boost::tribool rc = m_request_parser.parse_missing_data(*m_request, len, ec);
+    if (rc == true) {
+        finished_request();
+    } else if (rc == false) {
+        m_request.reset();
+        m_request_parser.reset();
+        ++m_resync_count;
+    }
+}
+
+void flow_parser::consume_response_data(const char *ptr, std::size_t len)
+{
+    m_response_parser.set_read_buffer(ptr, len);
+    while (! m_response_parser.eof()) {
+        if (! m_response)
+            start_response();
+        boost::system::error_code ec;
+        const boost::tribool rc = m_response_parser.parse(*m_response, ec);
+        if (rc == true) {
+            finished_response();
+        } else if (rc == false) {
+            m_response.reset();
+            m_response_parser.reset();
+            ++m_resync_count;
+            break;
+        }
+    }
+}
+
+void flow_parser::consume_response_gap(std::size_t len)
+{
+    if (! m_response)
+        return;
+    boost::system::error_code ec;
+    const boost::tribool rc = m_response_parser.parse_missing_data(*m_response, len, ec);
+    if (rc == true) {
+        finished_response();
+    } else if (rc == false) {
+        m_response.reset();
+        m_response_parser.reset();
+        ++m_resync_count;
+    }
+}
+
+void flow_parser::finished_request(void)
+{
+    m_pending_requests.push_back(m_request);
+    m_request.reset();
+    m_request_parser.reset();
+}
+
+void flow_parser::finished_response(void)
+{
+    http::response_ptr response_ptr;
+    response_ptr.swap(m_response);
+    m_response_parser.reset();
+
+    // interim (1xx) responses are followed by the final response to the same request
+    const unsigned int status_code = response_ptr->get_status_code();
+    if (status_code >= 100 && status_code < 200 && status_code != 101)
+        return;
+
+    http::request_ptr request_ptr;
+    if (! m_pending_requests.empty()) {
+        request_ptr = m_pending_requests.front();
+        m_pending_requests.pop_front();
+    }
+    m_handler(request_ptr, response_ptr);
+}
+
+void flow_parser::start_response(void)
+{
+    // the response's request determines whether it has content (i.e. HEAD)
+    if (m_pending_requests.empty())
+        m_response.reset(new http::response);
+    else
+        m_response.reset(new http::response(*m_pending_requests.front()));
+}
+
+
+}   // end namespace http
+}   // end namespace pion
@@ -11,7 +11,6 @@
 #include <algorithm>
 #include <boost/asio.hpp>
 #include <boost/assert.hpp>
-#include <boost/regex.hpp>
 #include <boost/logic/tribool.hpp>
 #include <pion/http/message.hpp>
 #include <pion/http/request.hpp>
@@ -23,11 +22,6 @@ namespace pion {    // begin namespace pion
 namespace http {    // begin namespace http
 
 
-// static members of message
-
-const boost::regex  message::REGEX_ICASE_CHUNKED(".*chunked.*", boost::regex::icase);
-
-
 // message member functions
 
 std::size_t message::send(tcp::connection& tcp_conn,
@@ -35,16 +29,42 @@ std::size_t message::send(tcp::connection& tcp_conn,
 {
     // initialize write buffers for send operation using HTTP headers
     write_buffers_t write_buffers;
-    prepare_buffers_for_send(write_buffers, tcp_conn.get_keep_alive(), false);
+    std::string header_buf;
+    prepare_buffers_for_send(write_buffers, header_buf, tcp_conn.get_keep_alive(), false);
 
     // append payload content to write buffers (if there is any)
-    if (!headers_only && get_content_length() > 0 && get_content() != NULL)
-        write_buffers.push_back(boost::asio::buffer(get_content(), get_content_length()));
+    if (!headers_only)
+        append_content_buffers(write_buffers);
 
     // send the message and return the result
     return tcp_conn.write(write_buffers, ec);
 }
 
+void message::encode_headers(std::string& buf)
+{
+    sync_header_views();
+
+    // find the size of the headers first, so that the buffer grows only once
+    std::size_t headers_len = STRING_CRLF.size();
+    for (ihash_multimap::const_iterator i = m_headers.begin(); i != m_headers.end(); ++i) {
+        headers_len += i->first.size() + HEADER_NAME_VALUE_DELIMITER.size()
+            + i->second.size() + STRING_CRLF.size();
+    }
+    buf.clear();
+    // leave room for a typical first line
+    buf.reserve(headers_len + 64);
+
+    append_first_line(buf);
+    for (ihash_multimap::const_iterator i = m_headers.begin(); i != m_headers.end(); ++i) {
+        buf += i->first;
+        buf += HEADER_NAME_VALUE_DELIMITER;
+        buf += i->second;
+        buf += STRING_CRLF;
+    }
+    // add an extra CRLF to end HTTP headers
+    buf += STRING_CRLF;
+}
+
 std::size_t message::receive(tcp::connection& tcp_conn,
                                  boost::system::error_code& ec,
                                  bool headers_only)
@@ -152,11 +172,12 @@ std::size_t message::write(std::ostream& out,
 
     // initialize write buffers for send operation using HTTP headers
     write_buffers_t write_buffers;
-    prepare_buffers_for_send(write_buffers, true, false);
+    std::string header_buf;
+    prepare_buffers_for_send(write_buffers, header_buf, true, false);
 
     // append payload content to write buffers (if there is any)
-    if (!headers_only && get_content_length() > 0 && get_content() != NULL)
-        write_buffers.push_back(boost::asio::buffer(get_content(), get_content_length()));
+    if (!headers_only)
+        append_content_buffers(write_buffers);
 
     // write message to the output stream
     std::size_t bytes_out = 0;
@@ -213,12 +234,125 @@ std::size_t message::read(std::istream& in,
     return (http_parser.get_total_bytes_read());
 }
 
+void message::relocate_token_views(const char *begin_ptr, const char *end_ptr)
+{
+    for (header_views_t::iterator i = m_header_views.begin(); i != m_header_views.end(); ++i) {
+        m_token_buffer.relocate(i->first, begin_ptr, end_ptr);
+        m_token_buffer.relocate(i->second, begin_ptr, end_ptr);
+    }
+    // the header slots may refer to the read buffer
+    if (! m_header_views.empty())
+        update_header_slots();
+}
+
+void message::copy_header_views(void)
+{
+    for (header_views_t::const_iterator i = m_header_views.begin(); i != m_header_views.end(); ++i)
+        m_headers.insert(std::make_pair(i->first.str(), i->second.str()));
+    m_header_views.clear();
+    // the slots referred to the views
+    update_header_slots();
+}
+
+void message::copy_headers(const message& http_msg)
+{
+    if (http_msg.m_header_views.empty()) {
+        m_headers = http_msg.m_headers;
+    } else {
+        m_headers.clear();
+        for (header_views_t::const_iterator i = http_msg.m_header_views.begin(); i != http_msg.m_header_views.end(); ++i)
+            m_headers.insert(std::make_pair(i->first.str(), i->second.str()));
+    }
+    update_header_slots();
+}
+
+void message::update_header_slots(void)
+{
+    for (int id = 0; id < HEADER_ID_COUNT; ++id)
+        m_header_slots[id] = token_view();
+    if (! m_header_views.empty()) {
+        // use the first view for each common header
+        for (header_views_t::const_iterator i = m_header_views.begin(); i != m_header_views.end(); ++i) {
+            const header_id_t id = find_header_id(i->first.data(), i->first.size());
+            if (id != HEADER_ID_UNKNOWN && m_header_slots[id].data() == NULL)
+                m_header_slots[id] = i->second;
+        }
+    } else if (! m_headers.empty()) {
+        for (int id = 0; id < HEADER_ID_COUNT; ++id) {
+            ihash_multimap::const_iterator i = m_headers.find(get_header_name(static_cast<header_id_t>(id)));
+            if (i != m_headers.end())
+                m_header_slots[id] = token_view(i->second);
+        }
+    }
+    m_header_slots_valid = true;
+}
+
+boost::uint64_t message::parse_content_length(const token_view& length_view)
+{
+    const char *ptr = length_view.data();
+    const char * const end_ptr = ptr + length_view.size();
+
+    // skip leading and trailing whitespace
+    while (ptr < end_ptr && (*ptr == ' ' || *ptr == '\t'))
+        ++ptr;
+    const char *last_ptr = end_ptr;
+    while (last_ptr > ptr && (last_ptr[-1] == ' ' || last_ptr[-1] == '\t'))
+        --last_ptr;
+    if (ptr == last_ptr)
+        throw boost::bad_lexical_cast();
+
+    boost::uint64_t content_length = 0;
+    for (; ptr < last_ptr; ++ptr) {
+        const unsigned int digit = static_cast<unsigned char>(*ptr) - '0';
+        // reject anything but digits, and values that do not fit
+        if (digit > 9 || content_length > (boost::uint64_t(-1) - digit) / 10)
+            throw boost::bad_lexical_cast();
+        content_length = content_length * 10 + digit;
+    }
+    return content_length;
+}
+
+bool message::has_chunked_coding(const token_view& encoding_view)
+{
+    static const char CHUNKED[] = "chunked";
+    static const std::size_t CHUNKED_SIZE = sizeof(CHUNKED) - 1;
+    if (encoding_view.size() < CHUNKED_SIZE)
+        return false;
+    const char * const last_ptr = encoding_view.data() + encoding_view.size() - CHUNKED_SIZE;
+    for (const char *ptr = encoding_view.data(); ptr <= last_ptr; ++ptr) {
+        // codings are ASCII: setting bit 5 folds upper case letters to lower case
+        std::size_t n = 0;
+        while (n < CHUNKED_SIZE && (ptr[n] | 0x20) == CHUNKED[n])
+            ++n;
+        if (n == CHUNKED_SIZE)
+            return true;
+    }
+    return false;
+}
+
+void message::flatten_content(void)
+{
+    m_content_buf.resize(m_content_blocks.size());
+    m_content_blocks.copy(m_content_buf.get());
+    m_content_blocks.clear();
+}
+
 void message::concatenate_chunks(void)
 {
+    if (m_chunk_cache.empty() && ! m_content_blocks.empty()) {
+        // the chunks were received into content blocks
+        set_content_length(m_content_blocks.size());
+        return;
+    }
     set_content_length(m_chunk_cache.size());
-    char *post_buffer = create_content_buffer();
-    if (m_chunk_cache.size() > 0)
-        std::copy(m_chunk_cache.begin(), m_chunk_cache.end(), post_buffer);
+    if (m_chunk_cache.size() > 0 && m_chunk_cache.is_contiguous()) {
+        // hand over the only segment; no need to copy the content
+        m_content_buf.adopt(m_chunk_cache.release(), m_content_length);
+    } else {
+        char *post_buffer = create_content_buffer();
+        m_chunk_cache.copy(post_buffer);
+        m_chunk_cache.clear();
+    }
 }
 
 
@@ -0,0 +1,440 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <ctime>
+#include <cstring>
+#include <algorithm>
+#include <boost/filesystem/path.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/mutex.hpp>
+#include <pion/http/multipart_parser.hpp>
+#include <pion/http/types.hpp>
+
+#ifdef PION_WIN32
+    #include <io.h>
+    #include <fcntl.h>
+    #include <sys/stat.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+#endif
+#include <cerrno>
+
+
+namespace pion {    // begin namespace pion
+namespace http {    // begin namespace http
+
+
+// static members of multipart_parser
+
+const std::size_t   multipart_parser::MAX_PART_HEADERS_SIZE = 8192;      // 8 KB
+const std::size_t   multipart_parser::DEFAULT_MAX_FIELD_SIZE = 1024 * 1024;  // 1 MB
+
+
+// helper functions used by multipart_parser
+
+namespace {
+
+/// returns the value of a parameter of a Content-Disposition header value
+/// (i.e. name or filename), or an empty string if it is not defined
+std::string get_disposition_param(const std::string& disposition, const std::string& param_name)
+{
+    std::size_t pos = disposition.find(';');
+    while (pos != std::string::npos) {
+        // skip the semicolon and any whitespace
+        ++pos;
+        while (pos < disposition.size() && (disposition[pos] == ' ' || disposition[pos] == '\t'))
+            ++pos;
+        const std::size_t equals_pos = disposition.find('=', pos);
+        if (equals_pos == std::string::npos)
+            break;
+        const bool matches = boost::algorithm::iequals(
+            boost::algorithm::trim_copy(disposition.substr(pos, equals_pos - pos)), param_name);
+        std::string value;
+        pos = equals_pos + 1;
+        if (pos < disposition.size() && disposition[pos] == '\"') {
+            // quoted value
+            for (++pos; pos < disposition.size() && disposition[pos] != '\"'; ++pos) {
+                if (disposition[pos] == '\\' && pos + 1 < disposition.size())
+                    ++pos;
+                value += disposition[pos];
+            }
+            pos = disposition.find(';', pos);
+        } else {
+            // token value
+            const std::size_t end_pos = disposition.find(';', pos);
+            value = boost::algorithm::trim_copy(disposition.substr(pos, end_pos == std::string::npos
+                ? std::string::npos : end_pos - pos));
+            pos = end_pos;
+        }
+        if (matches)
+            return value;
+    }
+    return std::string();
+}
+
+/// creates a new, empty file in dir and returns its path (empty if it cannot
+/// be created).  The file is created exclusively, so that a file or symbolic
+/// link placed in a shared directory is never written to
+std::string create_spill_file(const std::string& dir)
+{
+    static boost::mutex counter_mutex;
+    static unsigned long counter = 0;
+    static const unsigned int MAX_ATTEMPTS = 100;
+    for (unsigned int attempt = 0; attempt < MAX_ATTEMPTS; ++attempt) {
+        unsigned long n;
+        {
+            boost::mutex::scoped_lock counter_lock(counter_mutex);
+            n = ++counter;
+        }
+        const std::string file_path((boost::filesystem::path(dir) / ("pion-multipart-"
+            + boost::lexical_cast<std::string>(std::time(NULL)) + "-"
+            + boost::lexical_cast<std::string>(n))).string());
+#ifdef PION_WIN32
+        const int fd = ::_open(file_path.c_str(), _O_WRONLY | _O_CREAT | _O_EXCL | _O_BINARY,
+                               _S_IREAD | _S_IWRITE);
+#else
+        const int fd = ::open(file_path.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+#endif
+        if (fd != -1) {
+#ifdef PION_WIN32
+            ::_close(fd);
+#else
+            ::close(fd);
+#endif
+            return file_path;
+        }
+        if (errno != EEXIST)
+            break;
+    }
+    return std::string();
+}
+
+}   // end anonymous namespace
+
+
+// multipart_parser member functions
+
+multipart_parser::multipart_parser(const std::string& boundary)
+    : m_logger(PION_GET_LOGGER("pion.http.multipart_parser")),
+    m_delimiter(std::string("\r\n--") + boundary),
+    m_in_part(false), m_fields_ptr(NULL), m_max_field_size(DEFAULT_MAX_FIELD_SIZE)
+{
+    reset();
+}
+
+multipart_parser::~multipart_parser()
+{
+    if (m_spill_file.is_open()) {
+        m_spill_file.close();
+        boost::system::error_code ec;
+        boost::filesystem::remove(m_part.file_path, ec);
+    }
+}
+
+bool multipart_parser::parse_boundary(const std::string& content_type, std::string& boundary)
+{
+    std::size_t pos = content_type.find("boundary=");
+    if (pos == std::string::npos)
+        return false;
+    pos += 9;
+    if (pos < content_type.size() && content_type[pos] == '\"') {
+        const std::size_t end_pos = content_type.find('\"', ++pos);
+        if (end_pos == std::string::npos)
+            return false;
+        boundary = content_type.substr(pos, end_pos - pos);
+    } else {
+        const std::size_t end_pos = content_type.find_first_of("; \t", pos);
+        boundary = content_type.substr(pos, end_pos == std::string::npos
+            ? std::string::npos : end_pos - pos);
+    }
+    return ! boundary.empty();
+}
+
+void multipart_parser::reset(void)
+{
+    if (m_spill_file.is_open()) {
+        m_spill_file.close();
+        boost::system::error_code ec;
+        boost::filesystem::remove(m_part.file_path, ec);
+    }
+    m_parse_state = MP_PREAMBLE;
+    // the first delimiter is not preceded by CRLF; act as if it was
+    m_match_size = 2;
+    m_header_line.clear();
+    m_headers_size = 0;
+    m_in_part = false;
+    m_field_value.clear();
+    m_collect_field = false;
+}
+
+boost::tribool multipart_parser::parse(const char *ptr, std::size_t len)
+{
+    const char * const end_ptr = ptr + len;
+
+    while (ptr < end_ptr) {
+        switch (m_parse_state) {
+
+        case MP_PREAMBLE:
+        case MP_DATA:
+            if (m_match_size > 0) {
+                // continue matching a delimiter that started in a previous buffer
+                const std::size_t n = std::min(m_delimiter.size() - m_match_size,
+                    static_cast<std::size_t>(end_ptr - ptr));
+                if (memcmp(ptr, m_delimiter.data() + m_match_size, n) == 0) {
+                    ptr += n;
+                    m_match_size += n;
+                    if (m_match_size == m_delimiter.size()) {
+                        m_match_size = 0;
+                        if (m_in_part)
+                            end_part();
+                        m_parse_state = MP_BOUNDARY_END;
+                    }
+                    break;
+                }
+                // not a delimiter after all: the partial match is data (the
+                // delimiter has only one CR, so none can start within it)
+                if (m_in_part)
+                    consume_data(m_delimiter.data(), m_match_size);
+                m_match_size = 0;
+            }
+            {
+                const char * const delimiter_ptr = find_delimiter(ptr, end_ptr);
+                if (m_in_part && delimiter_ptr > ptr)
+                    consume_data(ptr, delimiter_ptr - ptr);
+                if (static_cast<std::size_t>(end_ptr - delimiter_ptr) >= m_delimiter.size()) {
+                    // found a complete delimiter
+                    ptr = delimiter_ptr + m_delimiter.size();
+                    if (m_in_part)
+                        end_part();
+                    m_parse_state = MP_BOUNDARY_END;
+                } else {
+                    // partial delimiter (or none) at the end of the buffer
+                    m_match_size = end_ptr - delimiter_ptr;
+                    ptr = end_ptr;
+                }
+            }
+            break;
+
+        case MP_BOUNDARY_END:
+            // expecting two dashes (close delimiter), or CRLF
+            if (*ptr == '-') {
+                m_parse_state = MP_BOUNDARY_DASH;
+            } else if (*ptr == ' ' || *ptr == '\t') {
+                m_parse_state = MP_BOUNDARY_PADDING;
+            } else if (*ptr == '\r') {
+                m_parse_state = MP_BOUNDARY_LF;
+            } else if (*ptr == '\n') {
+                m_parse_state = MP_HEADERS;
+            } else {
+                return set_error("invalid character after boundary");
+            }
+            ++ptr;
+            break;
+
+        case MP_BOUNDARY_DASH:
+            // expecting the second dash of the close delimiter
+            if (*ptr != '-')
+                return set_error("invalid character after boundary");
+            m_parse_state = MP_EPILOGUE;
+            ++ptr;
+            break;
+
+        case MP_BOUNDARY_PADDING:
+            // ignore whitespace after the boundary
+            if (*ptr == '\r') {
+                m_parse_state = MP_BOUNDARY_LF;
+            } else if (*ptr == '\n') {
+                m_parse_state = MP_HEADERS;
+            } else if (*ptr != ' ' && *ptr != '\t') {
+                return set_error("invalid character after boundary");
+            }
+            ++ptr;
+            break;
+
+        case MP_BOUNDARY_LF:
+            // expecting LF after the boundary
+            if (*ptr != '\n')
+                return set_error("invalid character after boundary");
+            m_parse_state = MP_HEADERS;
+            ++ptr;
+            break;
+
+        case MP_HEADERS:
+            {
+                // parse the part's MIME headers one line at a time
+                const char *lf_ptr = static_cast<const char*>(memchr(ptr, '\n', end_ptr - ptr));
+                const char *line_end_ptr = (lf_ptr == NULL ? end_ptr : lf_ptr);
+                m_headers_size += (line_end_ptr - ptr);
+                if (m_headers_size > MAX_PART_HEADERS_SIZE)
+                    return set_error("part headers are too large");
+                m_header_line.append(ptr, line_end_ptr);
+                if (lf_ptr == NULL) {
+                    ptr = end_ptr;
+                    break;
+                }
+                ptr = lf_ptr + 1;
+                if (! m_header_line.empty() && m_header_line[m_header_line.size() - 1] == '\r')
+                    m_header_line.resize(m_header_line.size() - 1);
+                if (m_header_line.empty()) {
+                    // an empty line ends the headers
+                    if (! begin_part())
+                        return set_error("unable to create file for part data");
+                    m_parse_state = MP_DATA;
+                } else {
+                    parse_header_line();
+                }
+                m_header_line.clear();
+            }
+            break;
+
+        case MP_EPILOGUE:
+            // ignore anything after the close delimiter
+            ptr = end_ptr;
+            break;
+
+        case MP_ERROR:
+            return false;
+        }
+    }
+
+    if (m_parse_state == MP_EPILOGUE)
+        return true;
+    if (m_parse_state == MP_ERROR)
+        return false;
+    return boost::indeterminate;
+}
+
+const char *multipart_parser::find_delimiter(const char *ptr, const char *end_ptr) const
+{
+    const std::size_t delimiter_size = m_delimiter.size();
+    const char * const delimiter = m_delimiter.data();
+
+    while (ptr < end_ptr) {
+        // the delimiter starts with the only CR it contains
+        const char *cr_ptr = static_cast<const char*>(memchr(ptr, '\r', end_ptr - ptr));
+        if (cr_ptr == NULL)
+            break;
+        const std::size_t bytes_avail = end_ptr - cr_ptr;
+        if (bytes_avail >= delimiter_size) {
+            // check the last character first since boundaries usually start with dashes
+            if (cr_ptr[delimiter_size - 1] == delimiter[delimiter_size - 1]
+                && memcmp(cr_ptr + 1, delimiter + 1, delimiter_size - 2) == 0)
+                return cr_ptr;
+        } else if (memcmp(cr_ptr + 1, delimiter + 1, bytes_avail - 1) == 0) {
+            // the delimiter may continue in the next buffer
+            return cr_ptr;
+        }
+        ptr = cr_ptr + 1;
+    }
+
+    return end_ptr;
+}
+
+void multipart_parser::consume_data(const char *ptr, std::size_t len)
+{
+    m_part.size += len;
+    if (m_spill_file.is_open()) {
+        m_spill_file.write(ptr, len);
+    } else if (m_part_data) {
+        m_part_data(m_part, ptr, len);
+    }
+    if (m_collect_field) {
+        if (m_field_value.size() + len <= m_max_field_size) {
+            m_field_value.append(ptr, len);
+        } else {
+            PION_LOG_WARN(m_logger, "Ignoring value of large form field: " << m_part.name);
+            m_collect_field = false;
+            m_field_value.clear();
+        }
+    }
+}
+
+void multipart_parser::parse_header_line(void)
+{
+    const std::size_t colon_pos = m_header_line.find(':');
+    if (colon_pos == std::string::npos) {
+        // ignore lines that are not headers
+        PION_LOG_DEBUG(m_logger, "Ignoring invalid part header: " << m_header_line);
+        return;
+    }
+    m_part.headers.insert(std::make_pair(
+        boost::algorithm::trim_copy(m_header_line.substr(0, colon_pos)),
+        boost::algorithm::trim_copy(m_header_line.substr(colon_pos + 1))));
+}
+
+bool multipart_parser::begin_part(void)
+{
+    ihash_multimap::const_iterator i = m_part.headers.find(types::HEADER_CONTENT_DISPOSITION);
+    if (i != m_part.headers.end()) {
+        m_part.name = get_disposition_param(i->second, "name");
+        m_part.filename = get_disposition_param(i->second, "filename");
+    } else {
+        m_part.name.clear();
+        m_part.filename.clear();
+    }
+    m_part.file_path.clear();
+    m_part.size = 0;
+
+    // only collect values of fields that have a text type or no type
+    i = m_part.headers.find(types::HEADER_CONTENT_TYPE);
+    m_collect_field = (m_fields_ptr != NULL && ! m_part.name.empty()
+        && (i == m_part.headers.end() || boost::algorithm::istarts_with(i->second, "text/")));
+
+    // write file uploads to disk if a spill directory is defined
+    if (! m_spill_directory.empty() && ! m_part.filename.empty()) {
+        m_part.file_path = create_spill_file(m_spill_directory);
+        if (! m_part.file_path.empty())
+            m_spill_file.open(m_part.file_path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (! m_spill_file.is_open()) {
+            PION_LOG_ERROR(m_logger, "Unable to create file for part data in: " << m_spill_directory);
+            if (! m_part.file_path.empty()) {
+                boost::system::error_code ec;
+                boost::filesystem::remove(m_part.file_path, ec);
+            }
+            return false;
+        }
+    }
+
+    m_in_part = true;
+    if (m_part_begin)
+        m_part_begin(m_part);
+    return true;
+}
+
+void multipart_parser::end_part(void)
+{
+    if (m_spill_file.is_open())
+        m_spill_file.close();
+    if (m_collect_field)
+        m_fields_ptr->insert(std::make_pair(m_part.name, m_field_value));
+    m_field_value.clear();
+    m_collect_field = false;
+    m_in_part = false;
+    if (m_part_end)
+        m_part_end(m_part);
+
+    // prepare for the next part
+    m_part.headers.clear();
+    m_header_line.clear();
+    m_headers_size = 0;
+}
+
+boost::tribool multipart_parser::set_error(const char *what)
+{
+    PION_LOG_WARN(m_logger, "Invalid multipart content: " << what);
+    m_parse_state = MP_ERROR;
+    return false;
+}
+
+
+}   // end namespace http
+}   // end namespace pion
@@ -18,6 +18,8 @@
 #include <pion/http/request.hpp>
 #include <pion/http/response.hpp>
 #include <pion/http/message.hpp>
+#include <pion/http/multipart_parser.hpp>
+#include <pion/http/url_encoded_parser.hpp>
 
 
 namespace pion {    // begin namespace pion
@@ -41,10 +43,227 @@ parser::error_category_t * parser::m_error_category_ptr = NULL;
 boost::once_flag            parser::m_instance_flag = BOOST_ONCE_INIT;
 
 
+// helpers used to scan runs of header characters
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define PION_PARSER_USE_SSE2
+    #include <emmintrin.h>
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+    #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+        && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+        #define PION_PARSER_USE_AVX2
+        #include <immintrin.h>
+    #endif
+#endif
+
+/// lookup table for characters that are valid within a header name (RFC 2616 token)
+static const bool HEADER_NAME_CHARS[256] = {
+    // 0x00 - 0x1F: control characters
+    0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
+    // 0x20 - 0x3F: ' ' '"' '(' ')' ',' '/' ':' ';' '<' '=' '>' '?' are separators
+    0,1,0,1,1,1,1,1, 0,0,1,1,0,1,1,0, 1,1,1,1,1,1,1,1, 1,1,0,0,0,0,0,0,
+    // 0x40 - 0x5F: '@' '[' '\\' ']' are separators
+    0,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,0,0,0,1,1,
+    // 0x60 - 0x7F: '{' '}' are separators, DEL is a control character
+    1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,1,1,1,1,1, 1,1,1,0,1,0,1,0
+    // 0x80 - 0xFF: not valid (remaining entries are zero-initialized)
+};
+
+/// returns true if the byte is valid within a header value (anything but CTLs, except tab)
+static inline bool is_header_value_char(const char c)
+{
+    const unsigned char uc = static_cast<unsigned char>(c);
+    return ( (uc >= 0x20 && uc != 0x7F) || uc == '\t' );
+}
+
+static const char *scan_header_name_scalar(const char *ptr, const char *end_ptr)
+{
+    while (ptr < end_ptr && HEADER_NAME_CHARS[static_cast<unsigned char>(*ptr)])
+        ++ptr;
+    return ptr;
+}
+
+static const char *scan_header_value_scalar(const char *ptr, const char *end_ptr)
+{
+    while (ptr < end_ptr && is_header_value_char(*ptr))
+        ++ptr;
+    return ptr;
+}
+
+#ifdef PION_PARSER_USE_SSE2
+
+/// returns the index of the lowest bit that is set in a non-zero mask
+static inline unsigned int first_bit_set(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned int>(index);
+#else
+    return static_cast<unsigned int>(__builtin_ctz(mask));
+#endif
+}
+
+/// returns a mask of the bytes within [lo, hi] (both must be in the range 0x00 - 0x7F)
+static inline __m128i sse2_in_range(const __m128i v, const char lo, const char hi)
+{
+    return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                         _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1)));
+}
+
+static const char *scan_header_name_sse2(const char *ptr, const char *end_ptr)
+{
+    // letters, digits and '-' cover nearly all header names; blocks made up
+    // of those only are accepted as a whole, and anything else is checked
+    // one byte at a time using the lookup table
+    while (end_ptr - ptr >= 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        const __m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        const __m128i ok = _mm_or_si128(
+            _mm_or_si128(sse2_in_range(folded, 'a', 'z'), sse2_in_range(v, '0', '9')),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('-')));
+        const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(ok));
+        if (mask == 0xFFFF) {
+            ptr += 16;
+        } else {
+            ptr += first_bit_set(~mask);
+            if (! HEADER_NAME_CHARS[static_cast<unsigned char>(*ptr)])
+                return ptr;
+            ++ptr;
+        }
+    }
+    return scan_header_name_scalar(ptr, end_ptr);
+}
+
+static const char *scan_header_value_sse2(const char *ptr, const char *end_ptr)
+{
+    const __m128i max_ctl = _mm_set1_epi8(0x1F);
+    const __m128i tab = _mm_set1_epi8('\t');
+    const __m128i del = _mm_set1_epi8(0x7F);
+    while (end_ptr - ptr >= 16) {
+        const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+        // CTLs (unsigned compare: v <= 0x1F) except tab, plus DEL
+        const __m128i ctl = _mm_cmpeq_epi8(_mm_max_epu8(v, max_ctl), max_ctl);
+        const __m128i bad = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(v, tab), ctl),
+                                         _mm_cmpeq_epi8(v, del));
+        const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(bad));
+        if (mask != 0)
+            return ptr + first_bit_set(mask);
+        ptr += 16;
+    }
+    return scan_header_value_scalar(ptr, end_ptr);
+}
+
+#endif  // PION_PARSER_USE_SSE2
+
+#ifdef PION_PARSER_USE_AVX2
+
+__attribute__((target("avx2")))
+static inline __m256i avx2_in_range(const __m256i v, const char lo, const char hi)
+{
+    return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(lo - 1)),
+                            _mm256_cmpgt_epi8(_mm256_set1_epi8(hi + 1), v));
+}
+
+__attribute__((target("avx2")))
+static const char *scan_header_name_avx2(const char *ptr, const char *end_ptr)
+{
+    while (end_ptr - ptr >= 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+        const __m256i folded = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        const __m256i ok = _mm256_or_si256(
+            _mm256_or_si256(avx2_in_range(folded, 'a', 'z'), avx2_in_range(v, '0', '9')),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('-')));
+        const unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(ok));
+        if (mask == 0xFFFFFFFFU) {
+            ptr += 32;
+        } else {
+            ptr += first_bit_set(~mask);
+            if (! HEADER_NAME_CHARS[static_cast<unsigned char>(*ptr)])
+                return ptr;
+            ++ptr;
+        }
+    }
+    return scan_header_name_sse2(ptr, end_ptr);
+}
+
+__attribute__((target("avx2")))
+static const char *scan_header_value_avx2(const char *ptr, const char *end_ptr)
+{
+    const __m256i max_ctl = _mm256_set1_epi8(0x1F);
+    const __m256i tab = _mm256_set1_epi8('\t');
+    const __m256i del = _mm256_set1_epi8(0x7F);
+    while (end_ptr - ptr >= 32) {
+        const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ptr));
+        const __m256i ctl = _mm256_cmpeq_epi8(_mm256_max_epu8(v, max_ctl), max_ctl);
+        const __m256i bad = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(v, tab), ctl),
+                                            _mm256_cmpeq_epi8(v, del));
+        const unsigned int mask = static_cast<unsigned int>(_mm256_movemask_epi8(bad));
+        if (mask != 0)
+            return ptr + first_bit_set(mask);
+        ptr += 32;
+    }
+    return scan_header_value_sse2(ptr, end_ptr);
+}
+
+#endif  // PION_PARSER_USE_AVX2
+
+/// function type used to scan runs of header characters
+typedef const char *(*header_scan_func_t)(const char *, const char *);
+
+/// returns the best available function for scanning header names
+static header_scan_func_t select_header_name_scan(void)
+{
+#if defined(PION_PARSER_USE_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &scan_header_name_avx2;
+#endif
+#if defined(PION_PARSER_USE_SSE2)
+    return &scan_header_name_sse2;
+#else
+    return &scan_header_name_scalar;
+#endif
+}
+
+/// returns the best available function for scanning header values
+static header_scan_func_t select_header_value_scan(void)
+{
+#if defined(PION_PARSER_USE_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &scan_header_value_avx2;
+#endif
+#if defined(PION_PARSER_USE_SSE2)
+    return &scan_header_value_sse2;
+#else
+    return &scan_header_value_scalar;
+#endif
+}
+
+/// functions used to scan header characters, selected at runtime (on startup)
+static const header_scan_func_t SCAN_HEADER_NAME = select_header_name_scan();
+static const header_scan_func_t SCAN_HEADER_VALUE = select_header_value_scan();
+
+
 // parser member functions
 
 boost::tribool parser::parse(http::message& http_msg,
     boost::system::error_code& ec)
+{
+    if (m_is_request) {
+        BOOST_ASSERT(dynamic_cast<http::request*>(&http_msg) != NULL);
+        return parse_message(static_cast<http::request&>(http_msg), ec);
+    }
+    BOOST_ASSERT(dynamic_cast<http::response*>(&http_msg) != NULL);
+    return parse_message(static_cast<http::response&>(http_msg), ec);
+}
+
+template <typename MessageType>
+boost::tribool parser::parse_message(MessageType& http_msg,
+    boost::system::error_code& ec)
 {
     BOOST_ASSERT(! eof() );
 
@@ -64,18 +283,18 @@ boost::tribool parser::parse(http::message& http_msg,
 
             // parsing the HTTP headers
             case PARSE_HEADERS:
-                rc = parse_headers(http_msg, ec);
+                rc = parse_message_headers(http_msg, ec);
                 total_bytes_parsed += m_bytes_last_read;
                 // check if we have finished parsing HTTP headers
                 if (rc == true) {
-                    // finish_header_parsing() updates m_message_parse_state
-                    rc = finish_header_parsing(http_msg, ec);
+                    // finish_message_headers() updates m_message_parse_state
+                    rc = finish_message_headers(http_msg, ec);
                 }
                 break;
 
             // parsing chunked payload content
             case PARSE_CHUNKS:
-                rc = parse_chunks(http_msg.get_chunk_cache(), ec);
+                rc = parse_chunks(http_msg, ec);
                 total_bytes_parsed += m_bytes_last_read;
                 // check if we have finished parsing all chunks
                 if (rc == true && !m_payload_handler) {
@@ -91,7 +310,7 @@ boost::tribool parser::parse(http::message& http_msg,
 
             // parsing payload content with no length (until EOF)
             case PARSE_CONTENT_NO_LENGTH:
-                consume_content_as_next_chunk(http_msg.get_chunk_cache());
+                consume_content_as_next_chunk(http_msg);
                 total_bytes_parsed += m_bytes_last_read;
                 break;
 
@@ -105,9 +324,12 @@ boost::tribool parser::parse(http::message& http_msg,
     // check if we've finished parsing the HTTP message
     if (rc == true) {
         m_message_parse_state = PARSE_END;
-        finish(http_msg);
+        finish_message(http_msg);
     } else if(rc == false) {
         compute_msg_status(http_msg, false);
+    } else if (m_token_views) {
+        // the read buffer will be reused for more data
+        relocate_token_views(http_msg);
     }
 
     // update bytes last read (aggregate individual operations for caller)
@@ -119,7 +341,6 @@ boost::tribool parser::parse(http::message& http_msg,
 boost::tribool parser::parse_missing_data(http::message& http_msg,
     std::size_t len, boost::system::error_code& ec)
 {
-    static const char MISSING_DATA_CHAR = 'X';
     boost::tribool rc = boost::indeterminate;
 
     http_msg.set_missing_packets(true);
@@ -140,19 +361,11 @@ boost::tribool parser::parse_missing_data(http::message& http_msg,
                 && m_bytes_read_in_current_chunk < m_size_of_current_chunk
                 && (m_size_of_current_chunk - m_bytes_read_in_current_chunk) >= len)
             {
-                // use dummy content for missing data
-                if (m_payload_handler) {
-                    for (std::size_t n = 0; n < len; ++n)
-                        m_payload_handler(&MISSING_DATA_CHAR, 1);
-                } else {
-                    for (std::size_t n = 0; n < len && http_msg.get_chunk_cache().size() < m_max_content_length; ++n) 
-                        http_msg.get_chunk_cache().push_back(MISSING_DATA_CHAR);
-                }
+                consume_missing_content(http_msg, len, false);
 
                 m_bytes_read_in_current_chunk += len;
                 m_bytes_last_read = len;
                 m_bytes_total_read += len;
-                m_bytes_content_read += len;
 
                 if (m_bytes_read_in_current_chunk == m_size_of_current_chunk) {
                     m_chunked_content_parse_state = PARSE_EXPECTING_CR_AFTER_CHUNK;
@@ -175,18 +388,7 @@ boost::tribool parser::parse_missing_data(http::message& http_msg,
                 set_error(ec, ERROR_MISSING_TOO_MUCH_CONTENT);
                 rc = false;
             } else {
-
-                // make sure content buffer is not already full
-                if (m_payload_handler) {
-                    for (std::size_t n = 0; n < len; ++n)
-                        m_payload_handler(&MISSING_DATA_CHAR, 1);
-                } else if ( (m_bytes_content_read+len) <= m_max_content_length) {
-                    // use dummy content for missing data
-                    for (std::size_t n = 0; n < len; ++n)
-                        http_msg.get_content()[m_bytes_content_read++] = MISSING_DATA_CHAR;
-                } else {
-                    m_bytes_content_read += len;
-                }
+                consume_missing_content(http_msg, len, true);
 
                 m_bytes_content_remaining -= len;
                 m_bytes_total_read += len;
@@ -199,17 +401,9 @@ boost::tribool parser::parse_missing_data(http::message& http_msg,
 
         // parsing payload content with no length (until EOF)
         case PARSE_CONTENT_NO_LENGTH:
-            // use dummy content for missing data
-            if (m_payload_handler) {
-                for (std::size_t n = 0; n < len; ++n)
-                    m_payload_handler(&MISSING_DATA_CHAR, 1);
-            } else {
-                for (std::size_t n = 0; n < len && http_msg.get_chunk_cache().size() < m_max_content_length; ++n) 
-                    http_msg.get_chunk_cache().push_back(MISSING_DATA_CHAR);
-            }
+            consume_missing_content(http_msg, len, false);
             m_bytes_last_read = len;
             m_bytes_total_read += len;
-            m_bytes_content_read += len;
             break;
 
         // finished parsing the HTTP message
@@ -232,6 +426,21 @@ boost::tribool parser::parse_missing_data(http::message& http_msg,
 boost::tribool parser::parse_headers(http::message& http_msg,
     boost::system::error_code& ec)
 {
+    if (m_is_request) {
+        BOOST_ASSERT(dynamic_cast<http::request*>(&http_msg) != NULL);
+        return parse_message_headers(static_cast<http::request&>(http_msg), ec);
+    }
+    BOOST_ASSERT(dynamic_cast<http::response*>(&http_msg) != NULL);
+    return parse_message_headers(static_cast<http::response&>(http_msg), ec);
+}
+
+template <typename MessageType>
+boost::tribool parser::parse_message_headers(MessageType& http_msg,
+    boost::system::error_code& ec)
+{
+    // known at compile time, so that branches for the other type of message are removed
+    const bool is_request = boost::is_same<MessageType, http::request>::value;
+
     //
     // note that boost::tribool may have one of THREE states:
     //
@@ -241,6 +450,11 @@ boost::tribool parser::parse_headers(http::message& http_msg,
     //
     const char *read_start_ptr = m_read_ptr;
     m_bytes_last_read = 0;
+
+    // any part of a token parsed from the previous read buffer is in m_token_head
+    if (is_parsing_token())
+        m_token_ptr = m_read_ptr;
+
     while (m_read_ptr < m_read_end_ptr) {
 
         if (m_save_raw_headers)
@@ -255,23 +469,27 @@ boost::tribool parser::parse_headers(http::message& http_msg,
                     return false;
                 }
                 m_headers_parse_state = PARSE_METHOD;
+                start_token(m_read_ptr);
                 m_method.erase();
-                m_method.push_back(*m_read_ptr);
+                if (! m_token_views)
+                    m_method.push_back(*m_read_ptr);
             }
             break;
 
         case PARSE_METHOD:
             // we have started parsing the HTTP method string
             if (*m_read_ptr == ' ') {
+                finish_token(http_msg, m_method_view);
+                start_token(m_read_ptr + 1);
                 m_resource.erase();
                 m_headers_parse_state = PARSE_URI_STEM;
             } else if (!is_char(*m_read_ptr) || is_control(*m_read_ptr) || is_special(*m_read_ptr)) {
                 set_error(ec, ERROR_METHOD_CHAR);
                 return false;
-            } else if (m_method.size() >= METHOD_MAX) {
+            } else if (get_token_size(m_method) >= METHOD_MAX) {
                 set_error(ec, ERROR_METHOD_SIZE);
                 return false;
-            } else {
+            } else if (! m_token_views) {
                 m_method.push_back(*m_read_ptr);
             }
             break;
@@ -279,25 +497,30 @@ boost::tribool parser::parse_headers(http::message& http_msg,
         case PARSE_URI_STEM:
             // we have started parsing the URI stem (or resource name)
             if (*m_read_ptr == ' ') {
+                finish_token(http_msg, m_resource_view);
                 m_headers_parse_state = PARSE_HTTP_VERSION_H;
             } else if (*m_read_ptr == '?') {
+                finish_token(http_msg, m_resource_view);
+                start_token(m_read_ptr + 1);
                 m_query_string.erase();
                 m_headers_parse_state = PARSE_URI_QUERY;
             } else if (*m_read_ptr == '\r') {
+                finish_token(http_msg, m_resource_view);
                 http_msg.set_version_major(0);
                 http_msg.set_version_minor(0);
                 m_headers_parse_state = PARSE_EXPECTING_NEWLINE;
             } else if (*m_read_ptr == '\n') {
+                finish_token(http_msg, m_resource_view);
                 http_msg.set_version_major(0);
                 http_msg.set_version_minor(0);
                 m_headers_parse_state = PARSE_EXPECTING_CR;
             } else if (is_control(*m_read_ptr)) {
                 set_error(ec, ERROR_URI_CHAR);
                 return false;
-            } else if (m_resource.size() >= RESOURCE_MAX) {
+            } else if (get_token_size(m_resource) >= RESOURCE_MAX) {
                 set_error(ec, ERROR_URI_SIZE);
                 return false;
-            } else {
+            } else if (! m_token_views) {
                 m_resource.push_back(*m_read_ptr);
             }
             break;
@@ -305,22 +528,25 @@ boost::tribool parser::parse_headers(http::message& http_msg,
         case PARSE_URI_QUERY:
             // we have started parsing the URI query string
             if (*m_read_ptr == ' ') {
+                finish_token(http_msg, m_query_string_view);
                 m_headers_parse_state = PARSE_HTTP_VERSION_H;
             } else if (*m_read_ptr == '\r') {
+                finish_token(http_msg, m_query_string_view);
                 http_msg.set_version_major(0);
                 http_msg.set_version_minor(0);
                 m_headers_parse_state = PARSE_EXPECTING_NEWLINE;
             } else if (*m_read_ptr == '\n') {
+                finish_token(http_msg, m_query_string_view);
                 http_msg.set_version_major(0);
                 http_msg.set_version_minor(0);
                 m_headers_parse_state = PARSE_EXPECTING_CR;
             } else if (is_control(*m_read_ptr)) {
                 set_error(ec, ERROR_QUERY_CHAR);
                 return false;
-            } else if (m_query_string.size() >= QUERY_STRING_MAX) {
+            } else if (get_token_size(m_query_string) >= QUERY_STRING_MAX) {
                 set_error(ec, ERROR_QUERY_SIZE);
                 return false;
-            } else {
+            } else if (! m_token_views) {
                 m_query_string.push_back(*m_read_ptr);
             }
             break;
@@ -329,7 +555,7 @@ boost::tribool parser::parse_headers(http::message& http_msg,
             // parsing "HTTP"
             if (*m_read_ptr == '\r') {
                 // should only happen for requests (no HTTP/VERSION specified)
-                if (! m_is_request) {
+                if (! is_request) {
                     set_error(ec, ERROR_VERSION_EMPTY);
                     return false;
                 }
@@ -338,7 +564,7 @@ boost::tribool parser::parse_headers(http::message& http_msg,
                 m_headers_parse_state = PARSE_EXPECTING_NEWLINE;
             } else if (*m_read_ptr == '\n') {
                 // should only happen for requests (no HTTP/VERSION specified)
-                if (! m_is_request) {
+                if (! is_request) {
                     set_error(ec, ERROR_VERSION_EMPTY);
                     return false;
                 }
@@ -425,19 +651,19 @@ boost::tribool parser::parse_headers(http::message& http_msg,
             // parsing the major version number (not first digit)
             if (*m_read_ptr == ' ') {
                 // ignore trailing spaces after version in request
-                if (! m_is_request) {
+                if (! is_request) {
                     m_headers_parse_state = PARSE_STATUS_CODE_START;
                 }
             } else if (*m_read_ptr == '\r') {
                 // should only happen for requests
-                if (! m_is_request) {
+                if (! is_request) {
                     set_error(ec, ERROR_STATUS_EMPTY);
                     return false;
                 }
                 m_headers_parse_state = PARSE_EXPECTING_NEWLINE;
             } else if (*m_read_ptr == '\n') {
                 // should only happen for requests
-                if (! m_is_request) {
+                if (! is_request) {
                     set_error(ec, ERROR_STATUS_EMPTY);
                     return false;
                 }
@@ -518,8 +744,10 @@ boost::tribool parser::parse_headers(http::message& http_msg,
                 return false;
             } else {
                 // assume it is the first character for the name of a header
+                start_token(m_read_ptr);
                 m_header_name.erase();
-                m_header_name.push_back(*m_read_ptr);
+                if (! m_token_views)
+                    m_header_name.push_back(*m_read_ptr);
                 m_headers_parse_state = PARSE_HEADER_NAME;
             }
             break;
@@ -543,8 +771,10 @@ boost::tribool parser::parse_headers(http::message& http_msg,
                 return false;
             } else {
                 // assume it is the first character for the name of a header
+                start_token(m_read_ptr);
                 m_header_name.erase();
-                m_header_name.push_back(*m_read_ptr);
+                if (! m_token_views)
+                    m_header_name.push_back(*m_read_ptr);
                 m_headers_parse_state = PARSE_HEADER_NAME;
             }
             break;
@@ -560,8 +790,10 @@ boost::tribool parser::parse_headers(http::message& http_msg,
                     set_error(ec, ERROR_HEADER_CHAR);
                     return false;
                 // assume it is the first character for the name of a header
+                start_token(m_read_ptr);
                 m_header_name.erase();
-                m_header_name.push_back(*m_read_ptr);
+                if (! m_token_views)
+                    m_header_name.push_back(*m_read_ptr);
                 m_headers_parse_state = PARSE_HEADER_NAME;
             }
             break;
@@ -579,8 +811,10 @@ boost::tribool parser::parse_headers(http::message& http_msg,
                 return false;
             } else {
                 // first character for the name of a header
+                start_token(m_read_ptr);
                 m_header_name.erase();
-                m_header_name.push_back(*m_read_ptr);
+                if (! m_token_views)
+                    m_header_name.push_back(*m_read_ptr);
                 m_headers_parse_state = PARSE_HEADER_NAME;
             }
             break;
@@ -588,36 +822,55 @@ boost::tribool parser::parse_headers(http::message& http_msg,
         case PARSE_HEADER_NAME:
             // parsing the name of a header
             if (*m_read_ptr == ':') {
+                finish_token(http_msg, m_header_name_view);
+                m_header_id = (m_token_views ? http::types::find_header_id(m_header_name_view.data(), m_header_name_view.size())
+                    : http::types::find_header_id(m_header_name));
                 m_header_value.erase();
                 m_headers_parse_state = PARSE_SPACE_BEFORE_HEADER_VALUE;
             } else if (!is_char(*m_read_ptr) || is_control(*m_read_ptr) || is_special(*m_read_ptr)) {
                 set_error(ec, ERROR_HEADER_CHAR);
                 return false;
-            } else if (m_header_name.size() >= HEADER_NAME_MAX) {
+            } else if (get_token_size(m_header_name) >= HEADER_NAME_MAX) {
                 set_error(ec, ERROR_HEADER_NAME_SIZE);
                 return false;
             } else {
-                // character (not first) for the name of a header
-                m_header_name.push_back(*m_read_ptr);
+                // character (not first) for the name of a header:
+                // consume the rest of the name in one step
+                const char * const run_end_ptr = scan_header_name(m_read_ptr + 1, m_read_end_ptr);
+                const std::size_t run_len = run_end_ptr - m_read_ptr;
+                if (get_token_size(m_header_name) + run_len > HEADER_NAME_MAX) {
+                    set_error(ec, ERROR_HEADER_NAME_SIZE);
+                    return false;
+                }
+                if (! m_token_views)
+                    m_header_name.append(m_read_ptr, run_len);
+                if (m_save_raw_headers)
+                    m_raw_headers.append(m_read_ptr + 1, run_len - 1);
+                m_read_ptr = run_end_ptr - 1;
             }
             break;
 
         case PARSE_SPACE_BEFORE_HEADER_VALUE:
             // parsing space character before a header's value
             if (*m_read_ptr == ' ') {
+                start_token(m_read_ptr + 1);
                 m_headers_parse_state = PARSE_HEADER_VALUE;
             } else if (*m_read_ptr == '\r') {
-                http_msg.add_header(m_header_name, m_header_value);
+                start_token(m_read_ptr);
+                add_header(http_msg);
                 m_headers_parse_state = PARSE_EXPECTING_NEWLINE;
             } else if (*m_read_ptr == '\n') {
-                http_msg.add_header(m_header_name, m_header_value);
+                start_token(m_read_ptr);
+                add_header(http_msg);
                 m_headers_parse_state = PARSE_EXPECTING_CR;
             } else if (!is_char(*m_read_ptr) || is_control(*m_read_ptr) || is_special(*m_read_ptr)) {
                 set_error(ec, ERROR_HEADER_CHAR);
                 return false;
             } else {
                 // assume it is the first character for the value of a header
-                m_header_value.push_back(*m_read_ptr);
+                start_token(m_read_ptr);
+                if (! m_token_views)
+                    m_header_value.push_back(*m_read_ptr);
                 m_headers_parse_state = PARSE_HEADER_VALUE;
             }
             break;
@@ -625,10 +878,10 @@ boost::tribool parser::parse_headers(http::message& http_msg,
         case PARSE_HEADER_VALUE:
             // parsing the value of a header
             if (*m_read_ptr == '\r') {
-                http_msg.add_header(m_header_name, m_header_value);
+                add_header(http_msg);
                 m_headers_parse_state = PARSE_EXPECTING_NEWLINE;
             } else if (*m_read_ptr == '\n') {
-                http_msg.add_header(m_header_name, m_header_value);
+                add_header(http_msg);
                 m_headers_parse_state = PARSE_EXPECTING_CR;
             } else if (*m_read_ptr != '\t' && is_control(*m_read_ptr)) {
                 // RFC 2616, 2.2 basic Rules.
@@ -639,12 +892,23 @@ boost::tribool parser::parse_headers(http::message& http_msg,
                 //       doesn't work properly still
                 set_error(ec, ERROR_HEADER_CHAR);
                 return false;
-            } else if (m_header_value.size() >= HEADER_VALUE_MAX) {
+            } else if (get_token_size(m_header_value) >= HEADER_VALUE_MAX) {
                 set_error(ec, ERROR_HEADER_VALUE_SIZE);
                 return false;
             } else {
-                // character (not first) for the value of a header
-                m_header_value.push_back(*m_read_ptr);
+                // character (not first) for the value of a header:
+                // consume the rest of the value in one step
+                const char * const run_end_ptr = scan_header_value(m_read_ptr + 1, m_read_end_ptr);
+                const std::size_t run_len = run_end_ptr - m_read_ptr;
+                if (get_token_size(m_header_value) + run_len > HEADER_VALUE_MAX) {
+                    set_error(ec, ERROR_HEADER_VALUE_SIZE);
+                    return false;
+                }
+                if (! m_token_views)
+                    m_header_value.append(m_read_ptr, run_len);
+                if (m_save_raw_headers)
+                    m_raw_headers.append(m_read_ptr + 1, run_len - 1);
+                m_read_ptr = run_end_ptr - 1;
             }
             break;
 
@@ -669,69 +933,139 @@ boost::tribool parser::parse_headers(http::message& http_msg,
     return boost::indeterminate;
 }
 
-void parser::update_message_with_header_data(http::message& http_msg) const
+const char *parser::scan_header_name(const char *ptr, const char *end_ptr)
 {
-    if (is_parsing_request()) {
+    // scan functions are not yet selected during static initialization
+    return (SCAN_HEADER_NAME ? SCAN_HEADER_NAME(ptr, end_ptr)
+        : scan_header_name_scalar(ptr, end_ptr));
+}
 
-        // finish an HTTP request message
+const char *parser::scan_header_value(const char *ptr, const char *end_ptr)
+{
+    // scan functions are not yet selected during static initialization
+    return (SCAN_HEADER_VALUE ? SCAN_HEADER_VALUE(ptr, end_ptr)
+        : scan_header_value_scalar(ptr, end_ptr));
+}
+
+void parser::relocate_token_views(http::message& http_msg)
+{
+    token_buffer& tokens = http_msg.get_token_buffer();
+    if (m_message_parse_state == PARSE_HEADERS) {
+        // copy what we have of the token being parsed; the rest of it will
+        // be appended once it has been parsed from the next read buffer
+        if (is_parsing_token())
+            m_token_head = tokens.extend(m_token_head, m_token_ptr, m_read_end_ptr - m_token_ptr);
+        tokens.relocate(m_method_view, m_read_start_ptr, m_read_end_ptr);
+        tokens.relocate(m_resource_view, m_read_start_ptr, m_read_end_ptr);
+        tokens.relocate(m_query_string_view, m_read_start_ptr, m_read_end_ptr);
+        tokens.relocate(m_header_name_view, m_read_start_ptr, m_read_end_ptr);
+    }
+    http_msg.relocate_token_views(m_read_start_ptr, m_read_end_ptr);
+}
+
+void parser::update_message_with_header_data(http::request& http_request) const
+{
+    // finish an HTTP request message
 
-        http::request& http_request(dynamic_cast<http::request&>(http_msg));
+    if (m_token_views) {
+        http_request.set_request_line_views(m_method_view, m_resource_view, m_query_string_view);
+    } else {
         http_request.set_method(m_method);
         http_request.set_resource(m_resource);
         http_request.set_query_string(m_query_string);
+    }
 
-        // parse query pairs from the URI query string
-        if (! m_query_string.empty()) {
-            if (! parse_url_encoded(http_request.get_queries(),
-                                  m_query_string.c_str(),
-                                  m_query_string.size())) 
-                PION_LOG_WARN(m_logger, "Request query string parsing failed (URI)");
-        }
+    // parse query pairs from the URI query string
+    const token_view query_string(m_token_views ? m_query_string_view : token_view(m_query_string));
+    if (! query_string.empty()) {
+        if (! parse_url_encoded(http_request.get_queries(),
+                              query_string.data(),
+                              query_string.size())) 
+            PION_LOG_WARN(m_logger, "Request query string parsing failed (URI)");
+    }
 
-        // parse "Cookie" headers in request
+    // parse "Cookie" headers in request
+    if (http_request.has_header_views()) {
+        const http::message::header_views_t& header_views(http_request.get_header_views());
+        for (http::message::header_views_t::const_iterator i = header_views.begin();
+             i != header_views.end(); ++i)
+        {
+            if (i->first.iequals(http::types::HEADER_COOKIE)
+                && ! parse_cookie_header(http_request.get_cookies(),
+                                         i->second.data(), i->second.size(), false) )
+                PION_LOG_WARN(m_logger, "Cookie header parsing failed");
+        }
+    } else if (http_request.has_header(http::types::HEADER_ID_COOKIE)) {
+        const ihash_multimap& headers(static_cast<const http::request&>(http_request).get_headers());
         std::pair<ihash_multimap::const_iterator, ihash_multimap::const_iterator>
-        cookie_pair = http_request.get_headers().equal_range(http::types::HEADER_COOKIE);
+        cookie_pair = headers.equal_range(http::types::HEADER_COOKIE);
         for (ihash_multimap::const_iterator cookie_iterator = cookie_pair.first;
-             cookie_iterator != http_request.get_headers().end()
+             cookie_iterator != headers.end()
              && cookie_iterator != cookie_pair.second; ++cookie_iterator)
         {
             if (! parse_cookie_header(http_request.get_cookies(),
                                     cookie_iterator->second, false) )
                 PION_LOG_WARN(m_logger, "Cookie header parsing failed");
         }
+    }
+}
 
-    } else {
-
-        // finish an HTTP response message
+void parser::update_message_with_header_data(http::response& http_response) const
+{
+    // finish an HTTP response message
 
-        http::response& http_response(dynamic_cast<http::response&>(http_msg));
-        http_response.set_status_code(m_status_code);
-        http_response.set_status_message(m_status_message);
+    http_response.set_status_code(m_status_code);
+    http_response.set_status_message(m_status_message);
 
-        // parse "Set-Cookie" headers in response
+    // parse "Set-Cookie" headers in response
+    if (http_response.has_header_views()) {
+        const http::message::header_views_t& header_views(http_response.get_header_views());
+        for (http::message::header_views_t::const_iterator i = header_views.begin();
+             i != header_views.end(); ++i)
+        {
+            if (i->first.iequals(http::types::HEADER_SET_COOKIE)
+                && ! parse_cookie_header(http_response.get_cookies(),
+                                         i->second.data(), i->second.size(), true) )
+                PION_LOG_WARN(m_logger, "Set-Cookie header parsing failed");
+        }
+    } else if (http_response.has_header(http::types::HEADER_ID_SET_COOKIE)) {
+        const ihash_multimap& headers(static_cast<const http::response&>(http_response).get_headers());
         std::pair<ihash_multimap::const_iterator, ihash_multimap::const_iterator>
-        cookie_pair = http_response.get_headers().equal_range(http::types::HEADER_SET_COOKIE);
+        cookie_pair = headers.equal_range(http::types::HEADER_SET_COOKIE);
         for (ihash_multimap::const_iterator cookie_iterator = cookie_pair.first;
-             cookie_iterator != http_response.get_headers().end()
+             cookie_iterator != headers.end()
              && cookie_iterator != cookie_pair.second; ++cookie_iterator)
         {
             if (! parse_cookie_header(http_response.get_cookies(),
                                     cookie_iterator->second, true) )
                 PION_LOG_WARN(m_logger, "Set-Cookie header parsing failed");
         }
-
     }
 }
 
 boost::tribool parser::finish_header_parsing(http::message& http_msg,
     boost::system::error_code& ec)
 {
+    if (m_is_request) {
+        BOOST_ASSERT(dynamic_cast<http::request*>(&http_msg) != NULL);
+        return finish_message_headers(static_cast<http::request&>(http_msg), ec);
+    }
+    BOOST_ASSERT(dynamic_cast<http::response*>(&http_msg) != NULL);
+    return finish_message_headers(static_cast<http::response&>(http_msg), ec);
+}
+
+template <typename MessageType>
+boost::tribool parser::finish_message_headers(MessageType& http_msg,
+    boost::system::error_code& ec)
+{
+    const bool is_request = boost::is_same<MessageType, http::request>::value;
     boost::tribool rc = boost::indeterminate;
 
     m_bytes_content_remaining = m_bytes_content_read = 0;
     http_msg.set_content_length(0);
     http_msg.update_transfer_encoding_using_header();
     update_message_with_header_data(http_msg);
+    start_form_decoding(http_msg);
 
     if (http_msg.is_chunked()) {
 
@@ -751,7 +1085,7 @@ boost::tribool parser::finish_header_parsing(http::message& http_msg,
     } else {
         // content length should be specified in the headers
 
-        if (http_msg.has_header(http::types::HEADER_CONTENT_LENGTH)) {
+        if (http_msg.has_header(http::types::HEADER_ID_CONTENT_LENGTH)) {
 
             // message has a content-length header
             try {
@@ -775,7 +1109,15 @@ boost::tribool parser::finish_header_parsing(http::message& http_msg,
                     http_msg.set_content_length(m_max_content_length);
 
                 // allocate a buffer for payload content (may be zero-size)
-                http_msg.create_content_buffer();
+                if (m_form_decoder.is_attached()) {
+                    // form data is decoded as it arrives and is not stored
+                    http_msg.set_content_length(0);
+                    http_msg.create_content_buffer();
+                } else if (m_segmented_content) {
+                    http_msg.get_content_blocks().clear();
+                } else {
+                    http_msg.create_content_buffer();
+                }
                 
                 // return true if parsing headers only
                 if (m_parse_headers_only)
@@ -787,9 +1129,10 @@ boost::tribool parser::finish_header_parsing(http::message& http_msg,
             // otherwise be determined
 
             // only if not a request, read through the close of the connection
-            if (! m_is_request) {
+            if (! is_request) {
                 // clear the chunk buffers before we start
                 http_msg.get_chunk_cache().clear();
+                http_msg.get_content_blocks().clear();
 
                 // continue reading content until there is no more data
                 m_message_parse_state = PARSE_CONTENT_NO_LENGTH;
@@ -876,73 +1219,9 @@ bool parser::parse_uri(const std::string& uri, std::string& proto,
 bool parser::parse_url_encoded(ihash_multimap& dict,
                                  const char *ptr, const size_t len)
 {
-    // used to track whether we are parsing the name or value
-    enum QueryParseState {
-        QUERY_PARSE_NAME, QUERY_PARSE_VALUE
-    } parse_state = QUERY_PARSE_NAME;
-
-    // misc other variables used for parsing
-    const char * const end = ptr + len;
-    std::string query_name;
-    std::string query_value;
-
-    // iterate through each encoded character
-    while (ptr < end) {
-        switch (parse_state) {
-
-        case QUERY_PARSE_NAME:
-            // parsing query name
-            if (*ptr == '=') {
-                // end of name found (OK if empty)
-                parse_state = QUERY_PARSE_VALUE;
-            } else if (*ptr == '&') {
-                // if query name is empty, just skip it (i.e. "&&")
-                if (! query_name.empty()) {
-                    // assume that "=" is missing -- it's OK if the value is empty
-                    dict.insert( std::make_pair(algorithm::url_decode(query_name), algorithm::url_decode(query_value)) );
-                    query_name.erase();
-                }
-            } else if (*ptr == '\r' || *ptr == '\n' || *ptr == '\t') {
-                // ignore linefeeds, carriage return and tabs (normally within POST content)
-            } else if (is_control(*ptr) || query_name.size() >= QUERY_NAME_MAX) {
-                // control character detected, or max sized exceeded
-                return false;
-            } else {
-                // character is part of the name
-                query_name.push_back(*ptr);
-            }
-            break;
-
-        case QUERY_PARSE_VALUE:
-            // parsing query value
-            if (*ptr == '&') {
-                // end of value found (OK if empty)
-                if (! query_name.empty()) {
-                    dict.insert( std::make_pair(algorithm::url_decode(query_name), algorithm::url_decode(query_value)) );
-                    query_name.erase();
-                }
-                query_value.erase();
-                parse_state = QUERY_PARSE_NAME;
-            } else if (*ptr == '\r' || *ptr == '\n' || *ptr == '\t') {
-                // ignore linefeeds, carriage return and tabs (normally within POST content)
-            } else if (is_control(*ptr) || query_value.size() >= QUERY_VALUE_MAX) {
-                // control character detected, or max sized exceeded
-                return false;
-            } else {
-                // character is part of the value
-                query_value.push_back(*ptr);
-            }
-            break;
-        }
-
-        ++ptr;
-    }
-
-    // handle last pair in string
-    if (! query_name.empty())
-        dict.insert( std::make_pair(algorithm::url_decode(query_name), algorithm::url_decode(query_value)) );
-
-    return true;
+    // names and values are split and decoded in a single pass
+    url_encoded_parser query_parser(dict);
+    return (query_parser.parse(ptr, len) && query_parser.finish());
 }
 
 bool parser::parse_multipart_form_data(ihash_multimap& dict,
@@ -950,158 +1229,15 @@ bool parser::parse_multipart_form_data(ihash_multimap& dict,
                                        const char *ptr, const size_t len)
 {
     // parse field boundary
-    std::size_t pos = content_type.find("boundary=");
-    if (pos == std::string::npos)
+    std::string boundary;
+    if (! multipart_parser::parse_boundary(content_type, boundary))
         return false;
-    const std::string boundary = std::string("--") + content_type.substr(pos+9);
-    
-    // used to track what we are parsing
-    enum MultiPartParseState {
-        MP_PARSE_START,
-        MP_PARSE_HEADER_CR, MP_PARSE_HEADER_LF,
-        MP_PARSE_HEADER_NAME, MP_PARSE_HEADER_SPACE, MP_PARSE_HEADER_VALUE,
-        MP_PARSE_HEADER_LAST_LF, MP_PARSE_FIELD_DATA
-    } parse_state = MP_PARSE_START;
-
-    // a few variables used for parsing
-    std::string header_name;
-    std::string header_value;
-    std::string field_name;
-    std::string field_value;
-    bool save_current_field = true;
-    const char * const end_ptr = ptr + len;
-
-    ptr = strstr(ptr, boundary.c_str());
-
-    while (ptr != NULL && ptr < end_ptr) {
-        switch (parse_state) {
-            case MP_PARSE_START:
-                // start parsing a new field
-                header_name.clear();
-                header_value.clear();
-                field_name.clear();
-                field_value.clear();
-                save_current_field = true;
-                ptr += boundary.size() - 1;
-                parse_state = MP_PARSE_HEADER_CR;
-                break;
-            case MP_PARSE_HEADER_CR:
-                // expecting CR while parsing headers
-                if (*ptr == '\r') {
-                    // got it -> look for linefeed
-                    parse_state = MP_PARSE_HEADER_LF;
-                } else if (*ptr == '\n') {
-                    // got a linefeed? try to ignore and start parsing header
-                    parse_state = MP_PARSE_HEADER_NAME;
-                } else if (*ptr == '-' && ptr+1 < end_ptr && ptr[1] == '-') {
-                    // end of multipart content
-                    return true;
-                } else return false;
-                break;
-            case MP_PARSE_HEADER_LF:
-                // expecting LF while parsing headers
-                if (*ptr == '\n') {
-                    // got it -> start parsing header name
-                    parse_state = MP_PARSE_HEADER_NAME;
-                } else return false;
-                break;
-            case MP_PARSE_HEADER_NAME:
-                // parsing the name of a header
-                if (*ptr == '\r' || *ptr == '\n') {
-                    if (header_name.empty()) {
-                        // got CR or LF at beginning; skip to data
-                        parse_state = (*ptr == '\r' ? MP_PARSE_HEADER_LAST_LF : MP_PARSE_FIELD_DATA);
-                    } else {
-                        // premature CR or LF -> just ignore and start parsing next header
-                        parse_state = (*ptr == '\r' ? MP_PARSE_HEADER_LF : MP_PARSE_HEADER_NAME);
-                    }
-                } else if (*ptr == ':') {
-                    // done parsing header name -> consume space next
-                    parse_state = MP_PARSE_HEADER_SPACE;
-                } else {
-                    // one more byte for header name
-                    header_name += *ptr;
-                }
-                break;
-            case MP_PARSE_HEADER_SPACE:
-                // expecting a space before header value
-                if (*ptr == '\r') {
-                    // premature CR -> just ignore and start parsing next header
-                    parse_state = MP_PARSE_HEADER_LF;
-                } else if (*ptr == '\n') {
-                    // premature LF -> just ignore and start parsing next header
-                    parse_state = MP_PARSE_HEADER_NAME;
-                } else if (*ptr != ' ') {
-                    // not a space -> assume it's a value char
-                    header_value += *ptr;
-                    parse_state = MP_PARSE_HEADER_VALUE;
-                }
-                // otherwise just ignore the space(s)
-                break;
-            case MP_PARSE_HEADER_VALUE:
-                // parsing the value of a header
-                if (*ptr == '\r' || *ptr == '\n') {
-                    // reached the end of the value -> check if it's important
-                    if (boost::algorithm::iequals(header_name, types::HEADER_CONTENT_TYPE)) {
-                        // only keep fields that have a text type or no type
-                        save_current_field = boost::algorithm::iequals(header_value.substr(0, 5), "text/");
-                    } else if (boost::algorithm::iequals(header_name, types::HEADER_CONTENT_DISPOSITION)) {
-                        // get current field from content-disposition header
-                        std::size_t name_pos = header_value.find("name=\"");
-                        if (name_pos != std::string::npos) {
-                            for (name_pos += 6; name_pos < header_value.size() && header_value[name_pos] != '\"'; ++name_pos) {
-                                field_name += header_value[name_pos];
-                            }
-                        }
-                    }
-                    // clear values and start parsing next header
-                    header_name.clear();
-                    header_value.clear();
-                    parse_state = (*ptr == '\r' ? MP_PARSE_HEADER_LF : MP_PARSE_HEADER_NAME);
-                } else {
-                    // one more byte for header value
-                    header_value += *ptr;
-                }
-                break;
-            case MP_PARSE_HEADER_LAST_LF:
-                // expecting final linefeed to terminate headers and begin field data
-                if (*ptr == '\n') {
-                    // got it
-                    if (save_current_field && !field_name.empty()) {
-                        // parse the field if we care & know enough about it
-                        parse_state = MP_PARSE_FIELD_DATA;
-                    } else {
-                        // otherwise skip ahead to next field
-                        parse_state = MP_PARSE_START;
-                        ptr = strstr(ptr, boundary.c_str());
-                    }
-                } else return false;
-                break;
-            case MP_PARSE_FIELD_DATA:
-                // parsing the value of a field -> find the end of it
-                const char *field_end_ptr = end_ptr;
-                const char *next_ptr = strstr(ptr, boundary.c_str());
-                if (next_ptr) {
-                    // don't include CRLF before next boundary
-                    const char *temp_ptr = next_ptr - 2;
-                    if (temp_ptr[0] == '\r' && temp_ptr[1] == '\n')
-                        field_end_ptr = temp_ptr;
-                    else field_end_ptr = next_ptr;
-                }
-                field_value.assign(ptr, field_end_ptr - ptr);
-                // add the field to the query dictionary
-                dict.insert( std::make_pair(field_name, field_value) );
-                // skip ahead to next field
-                parse_state = MP_PARSE_START;
-                ptr = next_ptr;
-                break;
-        }
-        // we've already bumped position if MP_PARSE_START
-        if (parse_state != MP_PARSE_START)
-            ++ptr;
-    }
-    
-    return true;
+
+    // the content is already in memory, so there is no need to limit field sizes
+    multipart_parser form_parser(boundary);
+    form_parser.set_fields(dict, len);
+    form_parser.parse(ptr, len);
+    return ! form_parser.has_error();
 }
 
 bool parser::parse_cookie_header(ihash_multimap& dict,
@@ -1218,7 +1354,7 @@ bool parser::parse_cookie_header(ihash_multimap& dict,
     return true;
 }
 
-boost::tribool parser::parse_chunks(http::message::chunk_cache_t& chunks,
+boost::tribool parser::parse_chunks(http::message& http_msg,
     boost::system::error_code& ec)
 {
     //
@@ -1287,6 +1423,17 @@ boost::tribool parser::parse_chunks(http::message::chunk_cache_t& chunks,
                     m_chunked_content_parse_state = PARSE_EXPECTING_FINAL_CR_AFTER_LAST_CHUNK;
                 } else {
                     m_chunked_content_parse_state = PARSE_CHUNK;
+                    // make room for the part of the chunk that has already been read, so
+                    // that it is stored contiguously; the rest is allocated as it arrives
+                    // (a chunk size alone must not make the parser allocate memory)
+                    http::message::chunk_cache_t& chunks = http_msg.get_chunk_cache();
+                    const std::size_t bytes_read_ahead = bytes_available() - 1;
+                    if (! m_payload_handler && ! m_segmented_content && bytes_read_ahead > 0
+                        && chunks.size() < m_max_content_length)
+                    {
+                        chunks.reserve(std::min(std::min(m_size_of_current_chunk, bytes_read_ahead),
+                                                m_max_content_length - chunks.size()));
+                    }
                 }
             } else {
                 set_error(ec, ERROR_CHUNK_CHAR);
@@ -1296,17 +1443,15 @@ boost::tribool parser::parse_chunks(http::message::chunk_cache_t& chunks,
 
         case PARSE_CHUNK:
             if (m_bytes_read_in_current_chunk < m_size_of_current_chunk) {
-                if (m_payload_handler) {
-                    const std::size_t bytes_avail = bytes_available();
-                    const std::size_t bytes_in_chunk = m_size_of_current_chunk - m_bytes_read_in_current_chunk;
-                    const std::size_t len = (bytes_in_chunk > bytes_avail) ? bytes_avail : bytes_in_chunk;
+                const std::size_t bytes_avail = bytes_available();
+                const std::size_t bytes_in_chunk = m_size_of_current_chunk - m_bytes_read_in_current_chunk;
+                const std::size_t len = (bytes_in_chunk > bytes_avail) ? bytes_avail : bytes_in_chunk;
+                if (m_payload_handler)
                     m_payload_handler(m_read_ptr, len);
-                    m_bytes_read_in_current_chunk += len;
-                    if (len > 1) m_read_ptr += (len - 1);
-                } else if (chunks.size() < m_max_content_length) {
-                    chunks.push_back(*m_read_ptr);
-                    m_bytes_read_in_current_chunk++;
-                }
+                else
+                    append_chunk(http_msg, m_read_ptr, len);
+                m_bytes_read_in_current_chunk += len;
+                if (len > 1) m_read_ptr += (len - 1);
             }
             if (m_bytes_read_in_current_chunk == m_size_of_current_chunk) {
                 m_chunked_content_parse_state = PARSE_EXPECTING_CR_AFTER_CHUNK;
@@ -1393,15 +1538,9 @@ boost::tribool parser::consume_content(http::message& http_msg,
     if (m_payload_handler) {
         m_payload_handler(m_read_ptr, content_bytes_to_read);
     } else if (m_bytes_content_read < m_max_content_length) {
-        if (m_bytes_content_read + content_bytes_to_read > m_max_content_length) {
-            // read would exceed maximum size for content buffer
-            // copy only enough bytes to fill up the content buffer
-            memcpy(http_msg.get_content() + m_bytes_content_read, m_read_ptr, 
-                m_max_content_length - m_bytes_content_read);
-        } else {
-            // copy all bytes available
-            memcpy(http_msg.get_content() + m_bytes_content_read, m_read_ptr, content_bytes_to_read);
-        }
+        // copy only enough bytes to fill up the content buffer
+        append_content(http_msg, m_read_ptr,
+            std::min(content_bytes_to_read, m_max_content_length - m_bytes_content_read));
     }
 
     m_read_ptr += content_bytes_to_read;
@@ -1412,7 +1551,54 @@ boost::tribool parser::consume_content(http::message& http_msg,
     return rc;
 }
 
-std::size_t parser::consume_content_as_next_chunk(http::message::chunk_cache_t& chunks)
+void parser::consume_missing_content(http::message& http_msg, std::size_t len,
+    bool has_length)
+{
+    static const char MISSING_DATA_CHAR = 'X';
+    static const std::size_t MISSING_DATA_BLOCK_SIZE = 1024;
+
+    if (m_missing_data_handler)
+        m_missing_data_handler(len);
+
+    if (has_length && ! m_payload_handler && ! m_segmented_content
+        && ! m_form_decoder.is_attached())
+    {
+        // the content buffer has already been allocated; fill in the missing data
+        if (m_bytes_content_read < m_max_content_length) {
+            memset(http_msg.get_content() + m_bytes_content_read, MISSING_DATA_CHAR,
+                std::min(len, m_max_content_length - m_bytes_content_read));
+        }
+        m_bytes_content_read += len;
+        return;
+    }
+
+    if (m_missing_data_handler) {
+        // the missing data was reported instead of storing dummy content for it
+        m_bytes_content_read += len;
+        return;
+    }
+
+    // use dummy content for missing data, a block at a time
+    char dummy_content[MISSING_DATA_BLOCK_SIZE];
+    memset(dummy_content, MISSING_DATA_CHAR, std::min(len, sizeof(dummy_content)));
+
+    const std::size_t content_end = m_bytes_content_read + len;
+    while (m_bytes_content_read < content_end) {
+        const std::size_t n = std::min(content_end - m_bytes_content_read, sizeof(dummy_content));
+        if (m_payload_handler) {
+            m_payload_handler(dummy_content, n);
+        } else if (! has_length) {
+            append_chunk(http_msg, dummy_content, n);
+        } else if (m_bytes_content_read < m_max_content_length) {
+            // make sure content is not already full
+            append_content(http_msg, dummy_content,
+                std::min(n, m_max_content_length - m_bytes_content_read));
+        }
+        m_bytes_content_read += n;
+    }
+}
+
+std::size_t parser::consume_content_as_next_chunk(http::message& http_msg)
 {
     if (bytes_available() == 0) {
         m_bytes_last_read = 0;
@@ -1422,12 +1608,9 @@ std::size_t parser::consume_content_as_next_chunk(http::message::chunk_cache_t&
             if (m_bytes_last_read)
                 m_payload_handler(m_read_ptr, m_bytes_last_read);
         } else {
-            while (m_read_ptr < m_read_end_ptr) {
-                if (chunks.size() < m_max_content_length)
-                    chunks.push_back(*m_read_ptr);
-                ++m_read_ptr;
-            }
+            append_chunk(http_msg, m_read_ptr, m_bytes_last_read);
         }
+        m_read_ptr = m_read_end_ptr;
         m_bytes_total_read += m_bytes_last_read;
         m_bytes_content_read += m_bytes_last_read;
     }
@@ -1435,6 +1618,18 @@ std::size_t parser::consume_content_as_next_chunk(http::message::chunk_cache_t&
 }
 
 void parser::finish(http::message& http_msg) const
+{
+    if (m_is_request) {
+        BOOST_ASSERT(dynamic_cast<http::request*>(&http_msg) != NULL);
+        finish_message(static_cast<http::request&>(http_msg));
+    } else {
+        BOOST_ASSERT(dynamic_cast<http::response*>(&http_msg) != NULL);
+        finish_message(static_cast<http::response&>(http_msg));
+    }
+}
+
+template <typename MessageType>
+void parser::finish_message(MessageType& http_msg) const
 {
     switch (m_message_parse_state) {
     case PARSE_START:
@@ -1453,7 +1648,7 @@ void parser::finish(http::message& http_msg) const
         break;
     case PARSE_CONTENT:
         http_msg.set_is_valid(false);
-        if (get_content_bytes_read() < m_max_content_length)   // NOTE: we can read more than we have allocated/stored
+        if (get_content_bytes_read() < m_max_content_length && ! m_form_decoder.is_attached())   // NOTE: we can read more than we have allocated/stored
             http_msg.set_content_length(get_content_bytes_read());
         break;
     case PARSE_CHUNKS:
@@ -1470,28 +1665,42 @@ void parser::finish(http::message& http_msg) const
 
     compute_msg_status(http_msg, http_msg.is_valid());
 
-    if (is_parsing_request() && !m_payload_handler) {
-        // Parse query pairs from post content if content type is x-www-form-urlencoded.
-        // Type could be followed by parameters (as defined in section 3.6 of RFC 2616)
-        // e.g. Content-Type: application/x-www-form-urlencoded; charset=UTF-8
-        http::request& http_request(dynamic_cast<http::request&>(http_msg));
-        const std::string& content_type_header = http_request.get_header(http::types::HEADER_CONTENT_TYPE);
-        if (content_type_header.compare(0, http::types::CONTENT_TYPE_URLENCODED.length(),
-                                        http::types::CONTENT_TYPE_URLENCODED) == 0)
-        {
-            if (! parse_url_encoded(http_request.get_queries(),
-                                  http_request.get_content(),
-                                  http_request.get_content_length()))
-                PION_LOG_WARN(m_logger, "Request form data parsing failed (POST urlencoded)");
-        } else if (content_type_header.compare(0, http::types::CONTENT_TYPE_MULTIPART_FORM_DATA.length(),
-                                               http::types::CONTENT_TYPE_MULTIPART_FORM_DATA) == 0)
-        {
-            if (! parse_multipart_form_data(http_request.get_queries(),
-                                            content_type_header,
-                                            http_request.get_content(),
-                                            http_request.get_content_length()))
-                PION_LOG_WARN(m_logger, "Request form data parsing failed (POST multipart)");
-        }
+    if (!m_payload_handler)
+        finish_form_data(http_msg);
+}
+
+void parser::finish_form_data(http::request& http_request) const
+{
+    // Parse query pairs from post content if content type is x-www-form-urlencoded.
+    // Type could be followed by parameters (as defined in section 3.6 of RFC 2616)
+    // e.g. Content-Type: application/x-www-form-urlencoded; charset=UTF-8
+    const token_view content_type_header(http_request.get_header_view(http::types::HEADER_ID_CONTENT_TYPE));
+    if (m_form_decoder.is_attached()) {
+        // form data was decoded as it arrived
+        if (! m_form_decoder.finish())
+            PION_LOG_WARN(m_logger, "Request form data parsing failed (POST urlencoded)");
+        m_form_decoder.detach();
+    } else if (content_type_header.starts_with(http::types::CONTENT_TYPE_URLENCODED)) {
+        if (! parse_url_encoded(http_request.get_queries(),
+                              http_request.get_content(),
+                              http_request.get_content_length()))
+            PION_LOG_WARN(m_logger, "Request form data parsing failed (POST urlencoded)");
+    } else if (content_type_header.starts_with(http::types::CONTENT_TYPE_MULTIPART_FORM_DATA)) {
+        if (! parse_multipart_form_data(http_request.get_queries(),
+                                        content_type_header.str(),
+                                        http_request.get_content(),
+                                        http_request.get_content_length()))
+            PION_LOG_WARN(m_logger, "Request form data parsing failed (POST multipart)");
+    }
+}
+
+void parser::start_form_decoding(http::request& http_request)
+{
+    m_form_decoder.detach();
+    if (m_stream_form_data && !m_payload_handler && !m_parse_headers_only
+        && http_request.get_header_view(http::types::HEADER_ID_CONTENT_TYPE).starts_with(http::types::CONTENT_TYPE_URLENCODED))
+    {
+        m_form_decoder.attach(http_request.get_queries());
     }
 }
 
@@ -1553,5 +1762,17 @@ bool parser::parse_forwarded_for(const std::string& header, std::string& public_
     return false;
 }
 
+
+// explicit instantiations of the parsing functions for each type of message
+
+template boost::tribool parser::parse_message<http::request>(http::request&, boost::system::error_code&);
+template boost::tribool parser::parse_message<http::response>(http::response&, boost::system::error_code&);
+template boost::tribool parser::parse_message_headers<http::request>(http::request&, boost::system::error_code&);
+template boost::tribool parser::parse_message_headers<http::response>(http::response&, boost::system::error_code&);
+template boost::tribool parser::finish_message_headers<http::request>(http::request&, boost::system::error_code&);
+template boost::tribool parser::finish_message_headers<http::response>(http::response&, boost::system::error_code&);
+template void parser::finish_message<http::request>(http::request&) const;
+template void parser::finish_message<http::response>(http::response&) const;
+
 }   // end namespace http
 }   // end namespace pion
@@ -44,11 +44,23 @@ void plugin_server::load_service(const std::string& resource, const std::string&
     PION_LOG_INFO(m_logger, "Loaded web service plug-in for resource (" << clean_resource << "): " << service_name);
 }
 
+void plugin_server::update_payload_handler(http::plugin_service *service_ptr)
+{
+    if (service_ptr->has_payload_handler())
+        http::server::add_payload_handler(service_ptr->get_resource(),
+                                          boost::bind(&http::plugin_service::get_payload_handler,
+                                                      service_ptr, _1, _2));
+    else
+        http::server::remove_payload_handler(service_ptr->get_resource());
+}
+
 void plugin_server::set_service_option(const std::string& resource,
                                  const std::string& name, const std::string& value)
 {
     const std::string clean_resource(strip_trailing_slash(resource));
     m_services.run(clean_resource, boost::bind(&http::plugin_service::set_option, _1, name, value));
+    // the option may change whether the service streams request content
+    m_services.run(clean_resource, boost::bind(&plugin_server::update_payload_handler, this, _1));
     PION_LOG_INFO(m_logger, "Set web service option for resource ("
                   << resource << "): " << name << '=' << value);
 }
@@ -9,6 +9,8 @@
 
 #include <boost/asio.hpp>
 #include <boost/logic/tribool.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/ref.hpp>
 #include <pion/http/reader.hpp>
 #include <pion/http/request.hpp>
 
@@ -29,7 +31,10 @@ void reader::receive(void)
     if (m_tcp_conn->get_pipelined()) {
         // there are pipelined messages available in the connection's read buffer
         m_tcp_conn->set_lifecycle(tcp::connection::LIFECYCLE_CLOSE);   // default to close the connection
-        m_tcp_conn->load_read_pos(m_read_ptr, m_read_end_ptr);
+        const char *read_ptr;
+        const char *read_end_ptr;
+        m_tcp_conn->load_read_pos(read_ptr, read_end_ptr);
+        set_read_buffer(read_ptr, read_end_ptr - read_ptr);
         consume_bytes();
     } else {
         // no pipelined messages available in the read buffer -> read bytes from the socket
@@ -74,7 +79,7 @@ void reader::consume_bytes(void)
     // indeterminate: parsed bytes, but the message is not yet finished
     //
     boost::system::error_code ec;
-    boost::tribool result = parse(get_message(), ec);
+    boost::tribool result = parse_read_buffer(ec);
     
     if (gcount() > 0) {
         // parsed > 0 bytes in HTTP headers
@@ -123,7 +128,7 @@ void reader::consume_bytes(void)
 void reader::read_bytes_with_timeout(void)
 {
     if (m_read_timeout > 0) {
-        m_timer_ptr.reset(new tcp::timer(m_tcp_conn));
+        m_timer_ptr = boost::make_shared<tcp::timer>(boost::ref(m_tcp_conn));
         m_timer_ptr->start(m_read_timeout);
     } else if (m_timer_ptr) {
         m_timer_ptr.reset();
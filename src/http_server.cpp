@@ -11,6 +11,7 @@
 #include <pion/http/server.hpp>
 #include <pion/http/request.hpp>
 #include <pion/http/request_reader.hpp>
+#include <pion/http/connection_objects.hpp>
 #include <pion/http/response_writer.hpp>
 
 
@@ -28,12 +29,94 @@ const unsigned int          server::MAX_REDIRECTS = 10;
 void server::handle_connection(tcp::connection_ptr& tcp_conn)
 {
     request_reader_ptr my_reader_ptr;
-    my_reader_ptr = request_reader::create(tcp_conn, boost::bind(&server::handle_request,
-                                           this, _1, _2, _3));
+    connection_objects *objects_ptr = NULL;
+    if (m_recycle_objects) {
+        objects_ptr = connection_objects::get(*tcp_conn);
+        if (objects_ptr == NULL) {
+            boost::shared_ptr<connection_objects> new_objects(new connection_objects);
+            tcp_conn->set_user_data(new_objects);
+            objects_ptr = new_objects.get();
+        } else if (objects_ptr->m_reader && objects_ptr->m_reader.unique()) {
+            // reuse the reader kept by the connection (nothing else refers to it)
+            my_reader_ptr = objects_ptr->m_reader;
+            my_reader_ptr->recycle(tcp_conn);
+        }
+    }
+    if (! my_reader_ptr) {
+        my_reader_ptr = request_reader::create(tcp_conn, boost::bind(&server::handle_request,
+                                               this, _1, _2, _3));
+        if (objects_ptr != NULL)
+            objects_ptr->m_reader = my_reader_ptr;
+        // let the payload handlers stream the content of the requests read
+        // (the callback is kept when the reader is recycled)
+        boost::mutex::scoped_lock resource_lock(m_resource_mutex);
+        if (! m_payload_handlers.empty()) {
+            request_reader::finished_handler_t headers_handler(boost::bind(&server::handle_request_headers,
+                                                               this, _1, _2, _3, my_reader_ptr.get()));
+            my_reader_ptr->set_headers_parsed_callback(headers_handler);
+        }
+    }
     my_reader_ptr->set_max_content_length(m_max_content_length);
+    my_reader_ptr->set_token_views(m_token_views);
+    my_reader_ptr->set_segmented_content(m_segmented_content);
+    my_reader_ptr->set_stream_form_data(m_stream_form_data);
     my_reader_ptr->receive();
 }
 
+void server::handle_request_headers(http::request_ptr& http_request_ptr,
+    tcp::connection_ptr& tcp_conn, const boost::system::error_code& ec,
+    request_reader *reader)
+{
+    // always replaced, since a recycled reader still has the payload handler
+    // that was used for the previous request
+    http::parser::payload_handler_t payload_handler;
+
+    // there is nothing to stream if the request has no content
+    if (ec || (! http_request_ptr->is_chunked() && http_request_ptr->get_content_length() == 0)) {
+        reader->set_payload_handler(payload_handler);
+        return;
+    }
+
+    // apply any redirection now, as handle_request() does, so that the
+    // payload handler sees the resource that will handle the request
+    std::string resource_requested(strip_trailing_slash(http_request_ptr->get_resource()));
+    redirect_map_t::const_iterator it = m_redirects.find(resource_requested);
+    unsigned int num_redirects = 0;
+    while (it != m_redirects.end() && num_redirects <= MAX_REDIRECTS) {
+        ++num_redirects;
+        resource_requested = it->second;
+        it = m_redirects.find(resource_requested);
+    }
+    if (num_redirects > 0 && num_redirects <= MAX_REDIRECTS)
+        http_request_ptr->change_resource(resource_requested);
+
+    // content is not streamed if requests may need to be authenticated
+    // (which happens after the whole request has been received)
+    payload_handler_factory_t factory;
+    if (num_redirects <= MAX_REDIRECTS && ! m_auth_ptr
+        && find_payload_handler(resource_requested, factory))
+    {
+        try {
+            payload_handler = factory(http_request_ptr, tcp_conn);
+        } catch (std::bad_alloc&) {
+            // propagate memory errors (FATAL)
+            throw;
+        } catch (std::exception& e) {
+            // the content is stored in the request instead
+            PION_LOG_ERROR(m_logger, "HTTP payload handler: " << boost::diagnostic_information(e));
+        }
+    }
+
+    reader->set_payload_handler(payload_handler);
+    if (payload_handler) {
+        // the content is not stored, so free the buffer allocated for it
+        PION_LOG_DEBUG(m_logger, "Streaming content of HTTP request for resource: "
+                       << http_request_ptr->get_resource());
+        http_request_ptr->set_content_length(0);
+        http_request_ptr->create_content_buffer();
+    }
+}
+
 void server::handle_request(http::request_ptr& http_request_ptr,
     tcp::connection_ptr& tcp_conn, const boost::system::error_code& ec)
 {
@@ -143,6 +226,32 @@ bool server::find_request_handler(const std::string& resource,
     return false;
 }
 
+bool server::find_payload_handler(const std::string& resource,
+                                  payload_handler_factory_t& factory) const
+{
+    boost::mutex::scoped_lock resource_lock(m_resource_mutex);
+    if (m_payload_handlers.empty())
+        return false;
+
+    // use the payload handler of the resource whose request handler is used
+    // (see find_request_handler())
+    resource_map_t::const_iterator i = m_resources.upper_bound(resource);
+    while (i != m_resources.begin()) {
+        --i;
+        if (i->first.empty() || resource.compare(0, i->first.size(), i->first) == 0) {
+            if (resource.size() == i->first.size() || resource[i->first.size()]=='/') {
+                payload_handler_map_t::const_iterator j = m_payload_handlers.find(i->first);
+                if (j == m_payload_handlers.end())
+                    return false;
+                factory = j->second;
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
 void server::add_resource(const std::string& resource,
                              request_handler_t request_handler)
 {
@@ -157,9 +266,27 @@ void server::remove_resource(const std::string& resource)
     boost::mutex::scoped_lock resource_lock(m_resource_mutex);
     const std::string clean_resource(strip_trailing_slash(resource));
     m_resources.erase(clean_resource);
+    m_payload_handlers.erase(clean_resource);
     PION_LOG_INFO(m_logger, "Removed request handler for HTTP resource: " << clean_resource);
 }
 
+void server::add_payload_handler(const std::string& resource,
+                                 payload_handler_factory_t factory)
+{
+    boost::mutex::scoped_lock resource_lock(m_resource_mutex);
+    const std::string clean_resource(strip_trailing_slash(resource));
+    m_payload_handlers[clean_resource] = factory;
+    PION_LOG_INFO(m_logger, "Added payload handler for HTTP resource: " << clean_resource);
+}
+
+void server::remove_payload_handler(const std::string& resource)
+{
+    boost::mutex::scoped_lock resource_lock(m_resource_mutex);
+    const std::string clean_resource(strip_trailing_slash(resource));
+    if (m_payload_handlers.erase(clean_resource) > 0)
+        PION_LOG_INFO(m_logger, "Removed payload handler for HTTP resource: " << clean_resource);
+}
+
 void server::add_redirect(const std::string& requested_resource,
                              const std::string& new_resource)
 {
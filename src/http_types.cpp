@@ -8,10 +8,11 @@
 //
 
 #include <boost/lexical_cast.hpp>
-#include <boost/thread/mutex.hpp>
+#include <boost/thread/tss.hpp>
 #include <pion/http/types.hpp>
 #include <pion/algorithm.hpp>
 #include <cstdio>
+#include <cstring>
 #include <ctime>
 
 
@@ -44,6 +45,7 @@ const std::string   types::HEADER_REFERER("Referer");
 const std::string   types::HEADER_USER_AGENT("User-Agent");
 const std::string   types::HEADER_X_FORWARDED_FOR("X-Forwarded-For");
 const std::string   types::HEADER_CLIENT_IP("Client-IP");
+const std::string   types::HEADER_DATE("Date");
 
 // common HTTP content types
 const std::string   types::CONTENT_TYPE_HTML("text/html");
@@ -64,6 +66,7 @@ const std::string   types::RESPONSE_MESSAGE_OK("OK");
 const std::string   types::RESPONSE_MESSAGE_CREATED("Created");
 const std::string   types::RESPONSE_MESSAGE_ACCEPTED("Accepted");
 const std::string   types::RESPONSE_MESSAGE_NO_CONTENT("No Content");
+const std::string   types::RESPONSE_MESSAGE_PARTIAL_CONTENT("Partial Content");
 const std::string   types::RESPONSE_MESSAGE_FOUND("Found");
 const std::string   types::RESPONSE_MESSAGE_UNAUTHORIZED("Unauthorized");
 const std::string   types::RESPONSE_MESSAGE_FORBIDDEN("Forbidden");
@@ -71,6 +74,8 @@ const std::string   types::RESPONSE_MESSAGE_NOT_FOUND("Not Found");
 const std::string   types::RESPONSE_MESSAGE_METHOD_NOT_ALLOWED("Method Not Allowed");
 const std::string   types::RESPONSE_MESSAGE_NOT_MODIFIED("Not Modified");
 const std::string   types::RESPONSE_MESSAGE_BAD_REQUEST("Bad Request");
+const std::string   types::RESPONSE_MESSAGE_REQUEST_ENTITY_TOO_LARGE("Request Entity Too Large");
+const std::string   types::RESPONSE_MESSAGE_RANGE_NOT_SATISFIABLE("Requested Range Not Satisfiable");
 const std::string   types::RESPONSE_MESSAGE_SERVER_ERROR("Server Error");
 const std::string   types::RESPONSE_MESSAGE_NOT_IMPLEMENTED("Not Implemented");
 const std::string   types::RESPONSE_MESSAGE_CONTINUE("Continue");
@@ -80,6 +85,7 @@ const unsigned int  types::RESPONSE_CODE_OK = 200;
 const unsigned int  types::RESPONSE_CODE_CREATED = 201;
 const unsigned int  types::RESPONSE_CODE_ACCEPTED = 202;
 const unsigned int  types::RESPONSE_CODE_NO_CONTENT = 204;
+const unsigned int  types::RESPONSE_CODE_PARTIAL_CONTENT = 206;
 const unsigned int  types::RESPONSE_CODE_FOUND = 302;
 const unsigned int  types::RESPONSE_CODE_UNAUTHORIZED = 401;
 const unsigned int  types::RESPONSE_CODE_FORBIDDEN = 403;
@@ -87,27 +93,250 @@ const unsigned int  types::RESPONSE_CODE_NOT_FOUND = 404;
 const unsigned int  types::RESPONSE_CODE_METHOD_NOT_ALLOWED = 405;
 const unsigned int  types::RESPONSE_CODE_NOT_MODIFIED = 304;
 const unsigned int  types::RESPONSE_CODE_BAD_REQUEST = 400;
+const unsigned int  types::RESPONSE_CODE_REQUEST_ENTITY_TOO_LARGE = 413;
+const unsigned int  types::RESPONSE_CODE_RANGE_NOT_SATISFIABLE = 416;
 const unsigned int  types::RESPONSE_CODE_SERVER_ERROR = 500;
 const unsigned int  types::RESPONSE_CODE_NOT_IMPLEMENTED = 501;
 const unsigned int  types::RESPONSE_CODE_CONTINUE = 100;
 
 
+// names of the common HTTP headers, indexed by types::header_id_t
+static const std::string * const HEADER_NAMES[types::HEADER_ID_COUNT] = {
+    &types::HEADER_HOST, &types::HEADER_COOKIE, &types::HEADER_SET_COOKIE,
+    &types::HEADER_CONNECTION, &types::HEADER_CONTENT_TYPE, &types::HEADER_CONTENT_LENGTH,
+    &types::HEADER_CONTENT_LOCATION, &types::HEADER_CONTENT_ENCODING,
+    &types::HEADER_CONTENT_DISPOSITION, &types::HEADER_LAST_MODIFIED,
+    &types::HEADER_IF_MODIFIED_SINCE, &types::HEADER_TRANSFER_ENCODING,
+    &types::HEADER_LOCATION, &types::HEADER_AUTHORIZATION, &types::HEADER_REFERER,
+    &types::HEADER_USER_AGENT, &types::HEADER_X_FORWARDED_FOR, &types::HEADER_CLIENT_IP,
+    &types::HEADER_DATE
+};
+
+
+// pre-encoded status lines for the common responses (HTTP/1.0 and HTTP/1.1)
+struct status_line_t {
+    unsigned int        code;
+    const std::string * message;
+    std::string         line[2];
+};
+static const status_line_t STATUS_LINES[] = {
+    { 200, &types::RESPONSE_MESSAGE_OK,
+        { "HTTP/1.0 200 OK\x0D\x0A", "HTTP/1.1 200 OK\x0D\x0A" } },
+    { 201, &types::RESPONSE_MESSAGE_CREATED,
+        { "HTTP/1.0 201 Created\x0D\x0A", "HTTP/1.1 201 Created\x0D\x0A" } },
+    { 202, &types::RESPONSE_MESSAGE_ACCEPTED,
+        { "HTTP/1.0 202 Accepted\x0D\x0A", "HTTP/1.1 202 Accepted\x0D\x0A" } },
+    { 204, &types::RESPONSE_MESSAGE_NO_CONTENT,
+        { "HTTP/1.0 204 No Content\x0D\x0A", "HTTP/1.1 204 No Content\x0D\x0A" } },
+    { 206, &types::RESPONSE_MESSAGE_PARTIAL_CONTENT,
+        { "HTTP/1.0 206 Partial Content\x0D\x0A", "HTTP/1.1 206 Partial Content\x0D\x0A" } },
+    { 302, &types::RESPONSE_MESSAGE_FOUND,
+        { "HTTP/1.0 302 Found\x0D\x0A", "HTTP/1.1 302 Found\x0D\x0A" } },
+    { 304, &types::RESPONSE_MESSAGE_NOT_MODIFIED,
+        { "HTTP/1.0 304 Not Modified\x0D\x0A", "HTTP/1.1 304 Not Modified\x0D\x0A" } },
+    { 400, &types::RESPONSE_MESSAGE_BAD_REQUEST,
+        { "HTTP/1.0 400 Bad Request\x0D\x0A", "HTTP/1.1 400 Bad Request\x0D\x0A" } },
+    { 401, &types::RESPONSE_MESSAGE_UNAUTHORIZED,
+        { "HTTP/1.0 401 Unauthorized\x0D\x0A", "HTTP/1.1 401 Unauthorized\x0D\x0A" } },
+    { 403, &types::RESPONSE_MESSAGE_FORBIDDEN,
+        { "HTTP/1.0 403 Forbidden\x0D\x0A", "HTTP/1.1 403 Forbidden\x0D\x0A" } },
+    { 404, &types::RESPONSE_MESSAGE_NOT_FOUND,
+        { "HTTP/1.0 404 Not Found\x0D\x0A", "HTTP/1.1 404 Not Found\x0D\x0A" } },
+    { 405, &types::RESPONSE_MESSAGE_METHOD_NOT_ALLOWED,
+        { "HTTP/1.0 405 Method Not Allowed\x0D\x0A", "HTTP/1.1 405 Method Not Allowed\x0D\x0A" } },
+    { 416, &types::RESPONSE_MESSAGE_RANGE_NOT_SATISFIABLE,
+        { "HTTP/1.0 416 Requested Range Not Satisfiable\x0D\x0A",
+          "HTTP/1.1 416 Requested Range Not Satisfiable\x0D\x0A" } },
+    { 500, &types::RESPONSE_MESSAGE_SERVER_ERROR,
+        { "HTTP/1.0 500 Server Error\x0D\x0A", "HTTP/1.1 500 Server Error\x0D\x0A" } },
+    { 501, &types::RESPONSE_MESSAGE_NOT_IMPLEMENTED,
+        { "HTTP/1.0 501 Not Implemented\x0D\x0A", "HTTP/1.1 501 Not Implemented\x0D\x0A" } },
+    { 100, &types::RESPONSE_MESSAGE_CONTINUE,
+        { "HTTP/1.0 100 Continue\x0D\x0A", "HTTP/1.1 100 Continue\x0D\x0A" } }
+};
+
+
+// names used in HTTP-date strings
+static const char * const DAY_NAMES[7] = {
+    "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"
+};
+static const char * const MONTH_NAMES[12] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+/// HTTP-date strings recently formatted and parsed by a thread
+struct date_cache_t {
+    date_cache_t(void) : now(-1), formatted(-1), parsed(-1) {}
+    time_t          now;
+    std::string     now_string;
+    time_t          formatted;
+    std::string     formatted_string;
+    std::string     parsed_string;
+    time_t          parsed;
+};
+
+/// returns the calling thread's date cache
+static date_cache_t& get_date_cache(void)
+{
+    static boost::thread_specific_ptr<date_cache_t> cache_ptr;
+    if (cache_ptr.get() == NULL)
+        cache_ptr.reset(new date_cache_t);
+    return *cache_ptr;
+}
+
+/// returns the number of days from 1970-01-01 to a date (proleptic Gregorian calendar)
+static long days_from_civil(long y, unsigned int m, unsigned int d)
+{
+    y -= (m <= 2);
+    const long era = (y >= 0 ? y : y - 399) / 400;
+    const unsigned long yoe = static_cast<unsigned long>(y - era * 400);
+    const unsigned long doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + static_cast<long>(doe) - 719468;
+}
+
+/// formats a time as an RFC 1123 HTTP-date (gmtime() and strftime() are avoided
+/// because they are not thread-safe, and depend on the locale)
+static void format_date(const time_t t, std::string& date_string)
+{
+    long days = static_cast<long>(t / 86400);
+    long secs = static_cast<long>(t % 86400);
+    if (secs < 0) {
+        secs += 86400;
+        --days;
+    }
+    // convert the number of days into a date
+    const long z = days + 719468;
+    const long era = (z >= 0 ? z : z - 146096) / 146097;
+    const unsigned long doe = static_cast<unsigned long>(z - era * 146097);
+    const unsigned long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const unsigned long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const unsigned long mp = (5 * doy + 2) / 153;
+    const unsigned int d = static_cast<unsigned int>(doy - (153 * mp + 2) / 5 + 1);
+    const unsigned int m = static_cast<unsigned int>(mp < 10 ? mp + 3 : mp - 9);
+    const long y = static_cast<long>(yoe) + era * 400 + (m <= 2);
+    const long weekday = (days % 7 + 11) % 7;
+
+    char time_buf[64];
+    sprintf(time_buf, "%s, %02u %s %04ld %02ld:%02ld:%02ld GMT", DAY_NAMES[weekday], d,
+            MONTH_NAMES[m - 1], y, secs / 3600, (secs / 60) % 60, secs % 60);
+    date_string = time_buf;
+}
+
+/// parses an HTTP-date in RFC 1123, RFC 850 or asctime() format
+static time_t parse_date(const char *date_string)
+{
+    char month_name[4];
+    int d, y, hours, minutes, seconds;
+    if (sscanf(date_string, "%*3s, %2d %3s %4d %2d:%2d:%2d GMT",
+               &d, month_name, &y, &hours, &minutes, &seconds) == 6)
+    {
+        // RFC 1123: "Sun, 06 Nov 1994 08:49:37 GMT"
+    } else if (sscanf(date_string, "%*[A-Za-z], %2d-%3s-%2d %2d:%2d:%2d GMT",
+                      &d, month_name, &y, &hours, &minutes, &seconds) == 6)
+    {
+        // RFC 850: "Sunday, 06-Nov-94 08:49:37 GMT"
+        y += (y < 70 ? 2000 : 1900);
+    } else if (sscanf(date_string, "%*3s %3s %2d %2d:%2d:%2d %4d",
+                      month_name, &d, &hours, &minutes, &seconds, &y) == 6)
+    {
+        // asctime(): "Sun Nov  6 08:49:37 1994"
+    } else {
+        return static_cast<time_t>(-1);
+    }
+
+    unsigned int m = 0;
+    while (m < 12 && strcmp(month_name, MONTH_NAMES[m]) != 0)
+        ++m;
+    if (m == 12 || d < 1 || d > 31 || y < 1970 || hours > 23 || minutes > 59 || seconds > 60
+        || hours < 0 || minutes < 0 || seconds < 0)
+    {
+        return static_cast<time_t>(-1);
+    }
+    return static_cast<time_t>(days_from_civil(y, m + 1, d)) * 86400
+        + hours * 3600 + minutes * 60 + seconds;
+}
+
+
 // static member functions
 
+types::header_id_t types::find_header_id(const char *name, std::size_t len)
+{
+    for (int id = 0; id < HEADER_ID_COUNT; ++id) {
+        const std::string& header_name = *HEADER_NAMES[id];
+        // header names are short, so most are rejected by comparing lengths
+        if (header_name.size() != len)
+            continue;
+        std::size_t n = 0;
+        for (; n < len; ++n) {
+            // header names are ASCII: fold upper case letters to lower case
+            char c = name[n];
+            if (c >= 'A' && c <= 'Z')
+                c += ('a' - 'A');
+            char h = header_name[n];
+            if (h >= 'A' && h <= 'Z')
+                h += ('a' - 'A');
+            if (c != h)
+                break;
+        }
+        if (n == len)
+            return static_cast<header_id_t>(id);
+    }
+    return HEADER_ID_UNKNOWN;
+}
+
+const std::string& types::get_header_name(const header_id_t id)
+{
+    return (id < HEADER_ID_COUNT ? *HEADER_NAMES[id] : STRING_EMPTY);
+}
+
+const std::string *types::find_status_line(const unsigned int version_major,
+                                           const unsigned int version_minor,
+                                           const unsigned int status_code,
+                                           const std::string& status_message)
+{
+    if (version_major != 1 || version_minor > 1)
+        return NULL;
+    for (std::size_t n = 0; n < sizeof(STATUS_LINES) / sizeof(STATUS_LINES[0]); ++n) {
+        if (STATUS_LINES[n].code == status_code) {
+            // the message may have been changed from the usual one
+            return (*STATUS_LINES[n].message == status_message ? &STATUS_LINES[n].line[version_minor] : NULL);
+        }
+    }
+    return NULL;
+}
+
 std::string types::get_date_string(const time_t t)
 {
-    // use mutex since time functions are normally not thread-safe
-    static boost::mutex time_mutex;
-    static const char *TIME_FORMAT = "%a, %d %b %Y %H:%M:%S GMT";
-    static const unsigned int TIME_BUF_SIZE = 100;
-    char time_buf[TIME_BUF_SIZE+1];
-
-    boost::mutex::scoped_lock time_lock(time_mutex);
-    if (strftime(time_buf, TIME_BUF_SIZE, TIME_FORMAT, gmtime(&t)) == 0)
-        time_buf[0] = '\0'; // failed; resulting buffer is indeterminate
-    time_lock.unlock();
-
-    return std::string(time_buf);
+    date_cache_t& cache = get_date_cache();
+    if (t == cache.now)
+        return cache.now_string;
+    if (t != cache.formatted) {
+        format_date(t, cache.formatted_string);
+        cache.formatted = t;
+    }
+    return cache.formatted_string;
+}
+
+const std::string& types::get_current_date_string(void)
+{
+    date_cache_t& cache = get_date_cache();
+    const time_t now = time(NULL);
+    if (now != cache.now) {
+        format_date(now, cache.now_string);
+        cache.now = now;
+    }
+    return cache.now_string;
+}
+
+time_t types::parse_date_string(const std::string& date_string)
+{
+    date_cache_t& cache = get_date_cache();
+    if (date_string != cache.parsed_string) {
+        cache.parsed = parse_date(date_string.c_str());
+        cache.parsed_string = date_string;
+    }
+    return cache.parsed;
 }
 
 std::string types::make_query_string(const ihash_multimap& query_params)
@@ -0,0 +1,145 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <cstdlib>
+#include <pion/http/url_encoded_parser.hpp>
+
+
+namespace pion {    // begin namespace pion
+namespace http {    // begin namespace http
+
+
+// static members of url_encoded_parser
+
+const std::size_t   url_encoded_parser::MAX_NAME_SIZE = 1024;  // 1 KB
+const std::size_t   url_encoded_parser::MAX_VALUE_SIZE = 1024 * 1024;  // 1 MB
+
+
+// url_encoded_parser member functions
+
+void url_encoded_parser::reset(void)
+{
+    m_parse_state = URL_PARSE_NAME;
+    m_name.erase();
+    m_value.erase();
+    m_name_size = m_value_size = 0;
+    m_escape_size = 0;
+    m_bytes_parsed = 0;
+}
+
+bool url_encoded_parser::parse(const char *ptr, std::size_t len)
+{
+    if (m_parse_state == URL_PARSE_ERROR)
+        return false;
+
+    const char * const end = ptr + len;
+    m_bytes_parsed += len;
+
+    // iterate through each encoded character
+    for (; ptr < end; ++ptr) {
+        const char c = *ptr;
+
+        // ignore linefeeds, carriage return and tabs (normally within POST content)
+        if (c == '\r' || c == '\n' || c == '\t')
+            continue;
+
+        switch (m_parse_state) {
+
+        case URL_PARSE_NAME:
+            // parsing name
+            if (c == '=') {
+                // end of name found (OK if empty)
+                flush_escape(m_name);
+                m_parse_state = URL_PARSE_VALUE;
+            } else if (c == '&') {
+                // assume that "=" is missing -- it's OK if the value is empty
+                flush_escape(m_name);
+                add_pair();
+            } else if ((c >= 0 && c <= 31) || c == 127 || m_name_size >= MAX_NAME_SIZE) {
+                // control character detected, or max sized exceeded
+                m_parse_state = URL_PARSE_ERROR;
+                return false;
+            } else {
+                // character is part of the name
+                ++m_name_size;
+                decode_char(m_name, c);
+            }
+            break;
+
+        case URL_PARSE_VALUE:
+            // parsing value
+            if (c == '&') {
+                // end of value found (OK if empty)
+                flush_escape(m_value);
+                add_pair();
+                m_parse_state = URL_PARSE_NAME;
+            } else if ((c >= 0 && c <= 31) || c == 127 || m_value_size >= MAX_VALUE_SIZE) {
+                // control character detected, or max sized exceeded
+                m_parse_state = URL_PARSE_ERROR;
+                return false;
+            } else {
+                // character is part of the value
+                ++m_value_size;
+                decode_char(m_value, c);
+            }
+            break;
+
+        case URL_PARSE_ERROR:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool url_encoded_parser::finish(void)
+{
+    if (m_parse_state == URL_PARSE_ERROR)
+        return false;
+
+    // handle last pair in content
+    flush_escape(m_parse_state == URL_PARSE_NAME ? m_name : m_value);
+    add_pair();
+    m_parse_state = URL_PARSE_NAME;
+
+    return true;
+}
+
+void url_encoded_parser::decode_escape(std::string& str)
+{
+    // decode hexidecimal value (the same way as algorithm::url_decode())
+    m_escape_buf[2] = '\0';
+    str.push_back(static_cast<char>( strtol(m_escape_buf, 0, 16) ));
+    m_escape_size = 0;
+}
+
+void url_encoded_parser::flush_escape(std::string& str)
+{
+    if (m_escape_size > 0) {
+        // recover from error by not decoding the sequence
+        str.push_back('%');
+        if (m_escape_size == 2)
+            str.push_back(m_escape_buf[0] == '+' ? ' ' : m_escape_buf[0]);
+        m_escape_size = 0;
+    }
+}
+
+void url_encoded_parser::add_pair(void)
+{
+    // if the name is empty, just skip the pair (i.e. "&&")
+    if (! m_name.empty() && m_dict_ptr != NULL)
+        m_dict_ptr->insert( std::make_pair(m_name, m_value) );
+    m_name.erase();
+    m_value.erase();
+    m_name_size = m_value_size = 0;
+}
+
+
+}   // end namespace http
+}   // end namespace pion
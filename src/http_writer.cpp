@@ -16,6 +16,11 @@ namespace pion {    // begin namespace pion
 namespace http {    // begin namespace http
 
 
+// static members of writer
+
+const std::string writer::STRING_ZERO_CHUNK("0");
+
+
 // writer member functions
 
 void writer::prepare_write_buffers(http::message::write_buffers_t& write_buffers,
@@ -40,12 +45,10 @@ void writer::prepare_write_buffers(http::message::write_buffers_t& write_buffers
             // prepare the next chunk of data to send
             // write chunk length in hex
             char cast_buf[35];
-            sprintf(cast_buf, "%lx", static_cast<long>(m_content_length));
+            const int cast_len = sprintf(cast_buf, "%lx", static_cast<long>(m_content_length));
             
-            // add chunk length as a string at the back of the text cache
-            m_text_cache.push_back(cast_buf);
-            // append length of chunk to write_buffers
-            write_buffers.push_back(boost::asio::buffer(m_text_cache.back()));
+            // append length of chunk to write_buffers (copied into the content arena)
+            write_buffers.push_back(add_text(cast_buf, cast_len));
             // append an extra CRLF for chunk formatting
             write_buffers.push_back(boost::asio::buffer(http::types::STRING_CRLF));
             
@@ -63,10 +66,8 @@ void writer::prepare_write_buffers(http::message::write_buffers_t& write_buffers
     
     // prepare a zero-byte (final) chunk
     if (send_final_chunk && supports_chunked_messages() && sending_chunked_message()) {
-        // add chunk length as a string at the back of the text cache
-        m_text_cache.push_back("0");
         // append length of chunk to write_buffers
-        write_buffers.push_back(boost::asio::buffer(m_text_cache.back()));
+        write_buffers.push_back(boost::asio::buffer(STRING_ZERO_CHUNK));
         // append an extra CRLF for chunk formatting
         write_buffers.push_back(boost::asio::buffer(http::types::STRING_CRLF));
         write_buffers.push_back(boost::asio::buffer(http::types::STRING_CRLF));
@@ -0,0 +1,121 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <pion/tcp/reassembler.hpp>
+
+
+namespace pion {    // begin namespace pion
+namespace tcp {     // begin namespace tcp
+
+
+// static members of reassembler
+
+const std::size_t   reassembler::DEFAULT_MAX_BUFFERED = 64 * 1024;  // 64 KB
+
+
+// reassembler member functions
+
+void reassembler::push(boost::uint32_t seq, const char *ptr, std::size_t len)
+{
+    if (len == 0)
+        return;
+
+    // if the SYN was not seen, the stream starts with the first segment
+    if (! m_started) {
+        m_next_seq = seq;
+        m_started = true;
+    }
+
+    if (get_offset(seq) > 0) {
+        // data in front of the segment has not arrived yet
+        hold(seq, ptr, len);
+        while (m_buffered_bytes > m_max_buffered) {
+            // holding too much: assume that the data in front of it was lost
+            skip(get_offset(m_segments.front().seq));
+            deliver_held();
+        }
+        return;
+    }
+
+    // skip any data that has already been passed on (retransmissions)
+    const std::size_t old_bytes = m_next_seq - seq;
+    if (old_bytes >= len) {
+        m_duplicate_bytes += len;
+        return;
+    }
+    m_duplicate_bytes += old_bytes;
+    deliver(ptr + old_bytes, len - old_bytes);
+
+    // the segment may have filled a hole in front of held segments
+    if (! m_segments.empty())
+        deliver_held();
+}
+
+void reassembler::flush(void)
+{
+    while (! m_segments.empty()) {
+        skip(get_offset(m_segments.front().seq));
+        deliver_held();
+    }
+    // release the memory used for holding segments
+    std::vector<segment_t>().swap(m_segments);
+}
+
+void reassembler::reset(void)
+{
+    std::vector<segment_t>().swap(m_segments);
+    m_started = false;
+    m_next_seq = 0;
+    m_buffered_bytes = m_gap_bytes = m_duplicate_bytes = 0;
+}
+
+void reassembler::hold(boost::uint32_t seq, const char *ptr, std::size_t len)
+{
+    // segments usually arrive in increasing order, so search from the end
+    const boost::int32_t offset = get_offset(seq);
+    std::vector<segment_t>::iterator i = m_segments.end();
+    while (i != m_segments.begin() && get_offset((i - 1)->seq) > offset)
+        --i;
+
+    // ignore retransmissions of a segment that is already held
+    if (i != m_segments.begin() && (i - 1)->seq == seq && (i - 1)->data.size() >= len) {
+        m_duplicate_bytes += len;
+        return;
+    }
+
+    i = m_segments.insert(i, segment_t());
+    i->seq = seq;
+    i->data.assign(ptr, len);
+    m_buffered_bytes += len;
+}
+
+void reassembler::deliver_held(void)
+{
+    while (! m_segments.empty() && get_offset(m_segments.front().seq) <= 0) {
+        // remove the segment before passing it on
+        const boost::uint32_t seq = m_segments.front().seq;
+        std::string data;
+        data.swap(m_segments.front().data);
+        m_segments.erase(m_segments.begin());
+        m_buffered_bytes -= data.size();
+
+        // held segments may overlap data that has already been passed on
+        const std::size_t old_bytes = m_next_seq - seq;
+        if (old_bytes >= data.size()) {
+            m_duplicate_bytes += data.size();
+        } else {
+            m_duplicate_bytes += old_bytes;
+            deliver(data.data() + old_bytes, data.size() - old_bytes);
+        }
+    }
+}
+
+
+}   // end namespace tcp
+}   // end namespace pion
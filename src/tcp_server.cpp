@@ -255,6 +255,9 @@ void server::finish_connection(tcp::connection_ptr& tcp_conn)
     } else {
         PION_LOG_DEBUG(m_logger, "Closing connection on port " << get_port());
         
+        // release objects kept with the connection (these may refer back to it)
+        tcp_conn->set_user_data(boost::shared_ptr<void>());
+
         // remove the connection from the server's management pool
         ConnectionPool::iterator conn_itr = m_conn_pool.find(tcp_conn);
         if (conn_itr != m_conn_pool.end())
@@ -0,0 +1,51 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+// Replaces the global operator new and operator delete, to count the memory
+// allocations made by a program.  These are kept in their own translation
+// unit, so that the compiler never sees malloc() and free() inlined into
+// new and delete expressions (which -Wmismatched-new-delete warns about).
+
+#include <new>
+#include <cstdlib>
+#include <boost/detail/atomic_count.hpp>
+
+
+/// number of times operator new has been called
+static boost::detail::atomic_count g_allocations(0);
+
+/// returns the number of times operator new has been called
+long get_allocation_count(void)
+{
+    return g_allocations;
+}
+
+void *operator new(std::size_t size) throw(std::bad_alloc)
+{
+    ++g_allocations;
+    void *ptr = std::malloc(size == 0 ? 1 : size);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](std::size_t size) throw(std::bad_alloc)
+{
+    return operator new(size);
+}
+
+void operator delete(void *ptr) throw()
+{
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) throw()
+{
+    std::free(ptr);
+}
@@ -0,0 +1,128 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+// These tests count the memory allocations made by the whole process, using
+// the operator new of allocation_counter.cpp.  They are built as their own
+// test program, so that the other unit tests do not run with it.
+
+#include <string>
+#include <cstdlib>
+#include <pion/config.hpp>
+#include <pion/plugin.hpp>
+#include <pion/scheduler.hpp>
+#include <pion/http/plugin_server.hpp>
+#include <boost/asio.hpp>
+
+#define BOOST_TEST_MODULE pion-allocation-tests
+#include <boost/test/unit_test.hpp>
+
+#include <pion/test/unit_test.hpp>
+
+using namespace pion;
+
+namespace pion {
+    namespace test {
+        BOOST_GLOBAL_FIXTURE(config);
+    }
+}
+
+PION_DECLARE_PLUGIN(HelloService)
+
+#if defined(PION_XCODE)
+    static const std::string PATH_TO_PLUGINS("../bin/Debug");
+#else
+    // same for Unix and Windows
+    static const std::string PATH_TO_PLUGINS("../services/.libs");
+#endif
+
+
+/// returns the number of times operator new has been called (see allocation_counter.cpp)
+long get_allocation_count(void);
+
+/**
+ * returns the number of memory allocations made (by the whole process) for
+ * each keep-alive request sent to HelloService
+ *
+ * @param port the port number of the server
+ * @param num_requests number of requests to measure
+ */
+static double countAllocationsPerRequest(unsigned int port, unsigned long num_requests)
+{
+    static const std::string HELLO_REQUEST("GET /hello HTTP/1.1\r\n"
+                                           "Connection: keep-alive\r\n\r\n");
+    boost::asio::io_service io_service;
+    boost::asio::ip::tcp::socket sock(io_service);
+    sock.connect(boost::asio::ip::tcp::endpoint(
+        boost::asio::ip::address::from_string("127.0.0.1"), port));
+
+    // read the first response to find out the length of each response
+    char buf[4096];
+    std::size_t response_length = 0;
+    std::size_t bytes_read = 0;
+    boost::asio::write(sock, boost::asio::buffer(HELLO_REQUEST));
+    while (response_length == 0 || bytes_read < response_length) {
+        bytes_read += sock.read_some(boost::asio::buffer(buf + bytes_read, sizeof(buf) - bytes_read));
+        const std::string response(buf, bytes_read);
+        const std::string::size_type headers_end = response.find("\r\n\r\n");
+        const std::string::size_type length_pos = response.find("Content-Length: ");
+        if (headers_end != std::string::npos && length_pos != std::string::npos)
+            response_length = headers_end + 4 + strtoul(response.c_str() + length_pos + 16, NULL, 10);
+    }
+
+    // warm up: the first requests create the objects that may be recycled
+    for (unsigned int n = 0; n < 10; ++n) {
+        boost::asio::write(sock, boost::asio::buffer(HELLO_REQUEST));
+        boost::asio::read(sock, boost::asio::buffer(buf, response_length));
+    }
+
+    const long allocations_before = get_allocation_count();
+    for (unsigned long n = 0; n < num_requests; ++n) {
+        boost::asio::write(sock, boost::asio::buffer(HELLO_REQUEST));
+        boost::asio::read(sock, boost::asio::buffer(buf, response_length));
+    }
+    const long allocations = get_allocation_count() - allocations_before;
+    return static_cast<double>(allocations) / num_requests;
+}
+
+
+class HelloServer_F {
+public:
+    HelloServer_F() : m_server(m_scheduler) {
+        plugin::reset_plugin_directories();
+#ifndef PION_STATIC_LINKING
+        plugin::add_plugin_directory(PATH_TO_PLUGINS);
+#endif
+        m_server.load_service("/hello", "HelloService");
+    }
+    ~HelloServer_F() {
+        m_server.stop();
+        m_scheduler.shutdown();
+    }
+
+    single_service_scheduler    m_scheduler;
+    http::plugin_server         m_server;
+};
+
+BOOST_FIXTURE_TEST_SUITE(HelloServer_S, HelloServer_F)
+
+BOOST_AUTO_TEST_CASE(checkRecycledObjectsReduceAllocationsPerRequest) {
+    m_server.start();
+    const double fresh_allocations = countAllocationsPerRequest(m_server.get_port(), 200);
+    m_server.stop();
+
+    m_server.set_recycle_objects();
+    m_server.start();
+    const double recycled_allocations = countAllocationsPerRequest(m_server.get_port(), 200);
+
+    BOOST_TEST_MESSAGE("allocations per request: " << fresh_allocations
+                       << " (new objects), " << recycled_allocations << " (recycled objects)");
+    BOOST_CHECK_LT(recycled_allocations, fresh_allocations);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,135 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <pion/scheduler.hpp>
+#include <pion/http/server.hpp>
+#include <pion/http/response_writer.hpp>
+
+using namespace pion;
+
+
+/// returns the number of times operator new has been called (see allocation_counter.cpp)
+long get_allocation_count(void);
+
+
+/// handles requests the same way that HelloService does
+static void hello_handler(http::request_ptr& http_request_ptr, tcp::connection_ptr& tcp_conn)
+{
+    static const std::string HELLO_HTML = "<html><body>Hello World!</body></html>";
+    http::response_writer_ptr writer(http::response_writer::create(tcp_conn, *http_request_ptr,
+                                                            boost::bind(&tcp::connection::finish, tcp_conn)));
+    writer->write_no_copy(HELLO_HTML);
+    writer->write_no_copy(http::types::STRING_CRLF);
+    writer->write_no_copy(http::types::STRING_CRLF);
+    writer->send();
+}
+
+/// keep-alive request for HelloService
+static const std::string HELLO_REQUEST("GET /hello HTTP/1.1\r\n"
+                                       "Host: localhost\r\n"
+                                       "Connection: keep-alive\r\n"
+                                       "\r\n");
+
+/// sends a request and reads its response (which has a fixed length)
+static void send_request(boost::asio::ip::tcp::socket& sock, char *buf, std::size_t response_length)
+{
+    boost::asio::write(sock, boost::asio::buffer(HELLO_REQUEST));
+    boost::asio::read(sock, boost::asio::buffer(buf, response_length));
+}
+
+/// returns the length of a response, which is read from the socket
+static std::size_t read_response_length(boost::asio::ip::tcp::socket& sock, char *buf, std::size_t buf_size)
+{
+    boost::asio::write(sock, boost::asio::buffer(HELLO_REQUEST));
+    std::size_t bytes_read = 0;
+    while (true) {
+        bytes_read += sock.read_some(boost::asio::buffer(buf + bytes_read, buf_size - bytes_read));
+        const std::string response(buf, bytes_read);
+        const std::string::size_type headers_end = response.find("\r\n\r\n");
+        const std::string::size_type length_pos = response.find("Content-Length: ");
+        if (headers_end != std::string::npos && length_pos != std::string::npos) {
+            const std::size_t length = headers_end + 4 + strtoul(response.c_str() + length_pos + 16, NULL, 10);
+            if (bytes_read >= length)
+                return length;
+        }
+    }
+}
+
+/// returns the number of allocations for each keep-alive request to HelloService
+static double count_allocations(const bool recycle_objects, const bool token_views,
+                                const unsigned long num_requests)
+{
+    single_service_scheduler sched;
+    sched.set_num_threads(1);
+    http::server hello_server(sched, 0);
+    hello_server.set_recycle_objects(recycle_objects);
+    hello_server.set_token_views(token_views);
+    hello_server.add_resource("/hello", &hello_handler);
+    hello_server.start();
+
+    boost::asio::io_service io_service;
+    boost::asio::ip::tcp::socket sock(io_service);
+    sock.connect(boost::asio::ip::tcp::endpoint(
+        boost::asio::ip::address::from_string("127.0.0.1"), hello_server.get_port()));
+    sock.set_option(boost::asio::ip::tcp::no_delay(true));
+
+    // warm up: the first requests create the objects that are recycled
+    char buf[4096];
+    const std::size_t response_length = read_response_length(sock, buf, sizeof(buf));
+    for (unsigned int n = 0; n < 100; ++n)
+        send_request(sock, buf, response_length);
+
+    const long allocations_before = get_allocation_count();
+    for (unsigned long n = 0; n < num_requests; ++n)
+        send_request(sock, buf, response_length);
+    const long allocations = get_allocation_count() - allocations_before;
+
+    sock.close();
+    hello_server.stop();
+    return static_cast<double>(allocations) / num_requests;
+}
+
+
+/// measures memory allocations for steady-state keep-alive requests
+int main(int argc, char *argv[])
+{
+    unsigned long num_requests = 10000;
+    if (argc == 2) {
+        num_requests = strtoul(argv[1], 0, 10);
+        if (num_requests == 0) num_requests = 10000;
+    } else if (argc != 1) {
+        std::cerr << "usage: allocbench [requests]" << std::endl;
+        return 1;
+    }
+
+    // allocations made by the logging system are not interesting
+    logger pion_log(PION_GET_LOGGER("pion"));
+    PION_LOG_SETLEVEL_WARN(pion_log);
+
+    try {
+        std::cout << "allocations per keep-alive request to HelloService ("
+                  << num_requests << " requests):" << std::endl;
+        std::cout << "  new objects for each request:       "
+                  << count_allocations(false, false, num_requests) << std::endl;
+        std::cout << "  recycled connection objects:        "
+                  << count_allocations(true, false, num_requests) << std::endl;
+        std::cout << "  recycled objects and token views:   "
+                  << count_allocations(true, true, num_requests) << std::endl;
+    } catch (std::exception& e) {
+        std::cerr << "allocbench: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -12,6 +12,7 @@
 #include <boost/scoped_array.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
+#include <boost/thread/thread.hpp>
 #include <boost/test/unit_test.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/operations.hpp>
@@ -25,6 +26,10 @@
 #include <pion/http/plugin_service.hpp>
 #include <pion/http/plugin_server.hpp>
 
+#ifndef PION_WIN32
+    #include <sys/stat.h>
+#endif
+
 using namespace pion;
 
 PION_DECLARE_PLUGIN(FileService)
@@ -150,6 +155,38 @@ BOOST_AUTO_TEST_CASE(checkSetServiceOptionWritableToNonBooleanThrows) {
     BOOST_REQUIRE_THROW(m_server.set_service_option("/resource1", "writable", "3"), error::bad_arg);
 }
 
+BOOST_AUTO_TEST_CASE(checkSetServiceOptionMmapToTrueDoesntThrow) {
+    BOOST_CHECK_NO_THROW(m_server.set_service_option("/resource1", "mmap", "true"));
+}
+
+BOOST_AUTO_TEST_CASE(checkSetServiceOptionMmapToNonBooleanThrows) {
+    BOOST_REQUIRE_THROW(m_server.set_service_option("/resource1", "mmap", "3"), error::bad_arg);
+}
+
+BOOST_AUTO_TEST_CASE(checkSetServiceOptionPrecompressedToTrueDoesntThrow) {
+    BOOST_CHECK_NO_THROW(m_server.set_service_option("/resource1", "precompressed", "true"));
+}
+
+BOOST_AUTO_TEST_CASE(checkSetServiceOptionCompressToNonBooleanThrows) {
+    BOOST_REQUIRE_THROW(m_server.set_service_option("/resource1", "compress", "3"), error::bad_arg);
+}
+
+BOOST_AUTO_TEST_CASE(checkSetServiceOptionCacheBudgetDoesntThrow) {
+    BOOST_CHECK_NO_THROW(m_server.set_service_option("/resource1", "cache_budget", "1048576"));
+}
+
+BOOST_AUTO_TEST_CASE(checkSetServiceOptionWatchToNonBooleanThrows) {
+    BOOST_REQUIRE_THROW(m_server.set_service_option("/resource1", "watch", "3"), error::bad_arg);
+}
+
+BOOST_AUTO_TEST_CASE(checkSetServiceOptionScanThreadsDoesntThrow) {
+    BOOST_CHECK_NO_THROW(m_server.set_service_option("/resource1", "scan_threads", "4"));
+}
+
+BOOST_AUTO_TEST_CASE(checkSetServiceOptionIOThreadsDoesntThrow) {
+    BOOST_CHECK_NO_THROW(m_server.set_service_option("/resource1", "io_threads", "4"));
+}
+
 BOOST_AUTO_TEST_CASE(checkSetServiceOptionWithInvalidOptionNameThrows) {
     BOOST_CHECK_THROW(m_server.set_service_option("/resource1", "NotAnOption", "value1"), error::bad_arg);
 }
@@ -170,6 +207,23 @@ public:
     }
     ~RunningFileService_F() {
     }
+
+    /**
+     * restarts the server with an option that is only applied when it starts,
+     * and reconnects to it
+     *
+     * @param name the name of the option
+     * @param value the value of the option
+     */
+    inline void restartWithOption(const std::string& name, const std::string& value) {
+        m_http_stream.close();
+        m_server.stop();
+        m_server.set_service_option("/resource1", name, value);
+        m_server.start();
+        boost::asio::ip::tcp::endpoint http_endpoint(boost::asio::ip::address::from_string("127.0.0.1"), m_server.get_port());
+        m_http_stream.clear();
+        m_http_stream.connect(http_endpoint);
+    }
     
     /**
      * sends a request to the local HTTP server
@@ -268,6 +322,38 @@ public:
         // check the response content
         BOOST_CHECK(boost::regex_match(content_buf.get(), content_regex));
     }
+
+    /**
+     * sends a GET request with a Range header and checks the response head
+     *
+     * @param resource name of the HTTP resource to request
+     * @param range value of the Range header
+     * @param if_range value of the If-Range header (none if empty)
+     * @param expected_response_code expected status code of the response
+     */
+    inline void sendRangeRequestAndCheckResponseHead(const std::string& resource,
+                                                     const std::string& range,
+                                                     const std::string& if_range,
+                                                     unsigned int expected_response_code)
+    {
+        m_http_stream << "GET " << resource << " HTTP/1.1" << http::types::STRING_CRLF
+            << "Range: " << range << http::types::STRING_CRLF;
+        if (! if_range.empty())
+            m_http_stream << "If-Range: " << if_range << http::types::STRING_CRLF;
+        m_http_stream << http::types::STRING_CRLF;
+        m_http_stream.flush();
+        m_content_length = 0;
+        m_response_headers.clear();
+        checkResponseHead(expected_response_code);
+    }
+
+    /// reads the content of the response (m_content_length bytes)
+    inline std::string readResponseContent(void) {
+        std::string content(m_content_length, '\0');
+        if (m_content_length > 0)
+            BOOST_CHECK(m_http_stream.read(&content[0], m_content_length));
+        return content;
+    }
     
     unsigned long m_content_length;
     boost::asio::ip::tcp::iostream m_http_stream;
@@ -281,6 +367,27 @@ BOOST_AUTO_TEST_CASE(checkResponseToGetRequestForDefaultFile) {
     checkWebServerResponseContent(boost::regex("abc\\s*"));
 }
 
+BOOST_AUTO_TEST_CASE(checkResponseToConditionalGetRequestForDefaultFile) {
+    sendRequestAndCheckResponseHead("GET", "/resource1");
+    checkWebServerResponseContent(boost::regex("abc\\s*"));
+    BOOST_CHECK(m_response_headers.find("Date") != m_response_headers.end());
+    const std::string last_modified(m_response_headers["Last-Modified"]);
+    BOOST_REQUIRE(! last_modified.empty());
+
+    // the file has not been modified since it was last sent
+    m_http_stream << "GET /resource1 HTTP/1.1" << http::types::STRING_CRLF
+        << "If-Modified-Since: " << last_modified << http::types::STRING_CRLF << http::types::STRING_CRLF;
+    m_http_stream.flush();
+    checkResponseHead(304);
+
+    // the file has been modified since 1994
+    m_http_stream << "GET /resource1 HTTP/1.1" << http::types::STRING_CRLF
+        << "If-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT" << http::types::STRING_CRLF << http::types::STRING_CRLF;
+    m_http_stream.flush();
+    checkResponseHead(200);
+    checkWebServerResponseContent(boost::regex("abc\\s*"));
+}
+
 BOOST_AUTO_TEST_CASE(checkResponseToHeadRequestForDefaultFile) {
     sendRequestAndCheckResponseHead("HEAD", "/resource1");
     BOOST_CHECK(m_content_length == 0);
@@ -396,12 +503,128 @@ BOOST_AUTO_TEST_CASE(checkResponseToHTTP_1_0_Request) {
     checkWebServerResponseContent(boost::regex("abc\\s*"));
 }
 
+BOOST_AUTO_TEST_CASE(checkResponseToIfNoneMatchRequest) {
+    sendRequestAndCheckResponseHead("GET", "/resource1/file1");
+    checkWebServerResponseContent(boost::regex("abc\\s*"));
+    const std::string etag(m_response_headers["ETag"]);
+    BOOST_REQUIRE(etag.size() > 2);
+    BOOST_CHECK(etag[0] == '"' && etag[etag.size() - 1] == '"');
+    const std::string last_modified(m_response_headers["Last-Modified"]);
+
+    // matching entity tags (weak comparison) and "*"
+    const char *matching_values[] = { "", "\"x\", ", "W/", "*" };
+    for (unsigned int n = 0; n < sizeof(matching_values) / sizeof(matching_values[0]); ++n) {
+        const std::string if_none_match(matching_values[n] == std::string("*")
+                                        ? std::string("*") : matching_values[n] + etag);
+        m_http_stream << "GET /resource1/file1 HTTP/1.1" << http::types::STRING_CRLF
+            << "If-None-Match: " << if_none_match << http::types::STRING_CRLF << http::types::STRING_CRLF;
+        m_http_stream.flush();
+        m_response_headers.clear();
+        checkResponseHead(304);
+        BOOST_CHECK_EQUAL(m_response_headers["ETag"], etag);
+    }
+
+    // If-Modified-Since is ignored if If-None-Match does not match
+    m_http_stream << "GET /resource1/file1 HTTP/1.1" << http::types::STRING_CRLF
+        << "If-None-Match: \"x\"" << http::types::STRING_CRLF
+        << "If-Modified-Since: " << last_modified << http::types::STRING_CRLF << http::types::STRING_CRLF;
+    m_http_stream.flush();
+    m_content_length = 0;
+    checkResponseHead(200);
+    checkWebServerResponseContent(boost::regex("abc\\s*"));
+
+    // the entity tag may also be used with If-Range
+    sendRangeRequestAndCheckResponseHead("/resource1/file1", "bytes=2-", etag, 206);
+    BOOST_CHECK_EQUAL(m_response_headers["ETag"], etag);
+    BOOST_CHECK_EQUAL(readResponseContent(), "c\n");
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToGetRequestForFileRewrittenWithinTheSameSecond) {
+    sendRequestAndCheckResponseHead("GET", "/resource1/file2");
+    checkWebServerResponseContent(boost::regex("xyz\\s*"));
+    const std::string etag(m_response_headers["ETag"]);
+    const std::time_t last_modified = boost::filesystem::last_write_time("sandbox/file2");
+
+    // rewrite the file in place with the same size and the same modification second
+    boost::filesystem::ofstream file2("sandbox/file2", std::ios::out | std::ios::trunc);
+    file2 << "uvw" << std::endl;
+    file2.close();
+    boost::filesystem::last_write_time("sandbox/file2", last_modified);
+
+    m_content_length = 0;
+    m_response_headers.clear();
+    sendRequestAndCheckResponseHead("GET", "/resource1/file2");
+    checkWebServerResponseContent(boost::regex("uvw\\s*"));
+    BOOST_CHECK(m_response_headers["ETag"] != etag);
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToSingleRangeRequest) {
+    sendRangeRequestAndCheckResponseHead("/resource1/file1", "bytes=1-2", "", 206);
+    BOOST_CHECK_EQUAL(m_response_headers["Content-Range"], "bytes 1-2/4");
+    BOOST_CHECK_EQUAL(readResponseContent(), "bc");
+
+    sendRangeRequestAndCheckResponseHead("/resource1/file1", "bytes=-3", "", 206);
+    BOOST_CHECK_EQUAL(m_response_headers["Content-Range"], "bytes 1-3/4");
+    BOOST_CHECK_EQUAL(readResponseContent(), "bc\n");
+
+    sendRangeRequestAndCheckResponseHead("/resource1/file1", "bytes=2-100", "", 206);
+    BOOST_CHECK_EQUAL(m_response_headers["Content-Range"], "bytes 2-3/4");
+    BOOST_CHECK_EQUAL(readResponseContent(), "c\n");
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToMultipleRangeRequest) {
+    sendRangeRequestAndCheckResponseHead("/resource1/file1", "bytes=0-0, 2-", "", 206);
+    const std::string content_type(m_response_headers["Content-Type"]);
+    BOOST_REQUIRE(content_type.find("multipart/byteranges; boundary=") == 0);
+    const std::string boundary(content_type.substr(content_type.find('=') + 1));
+    BOOST_CHECK_EQUAL(readResponseContent(),
+                      "--" + boundary + "\r\n"
+                      "Content-Type: application/octet-stream\r\n"
+                      "Content-Range: bytes 0-0/4\r\n\r\n"
+                      "a\r\n"
+                      "--" + boundary + "\r\n"
+                      "Content-Type: application/octet-stream\r\n"
+                      "Content-Range: bytes 2-3/4\r\n\r\n"
+                      "c\n\r\n"
+                      "--" + boundary + "--\r\n");
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToUnsatisfiableRangeRequest) {
+    sendRangeRequestAndCheckResponseHead("/resource1/file1", "bytes=4-", "", 416);
+    BOOST_CHECK_EQUAL(m_response_headers["Content-Range"], "bytes */4");
+    BOOST_CHECK(m_content_length == 0);
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToInvalidRangeRequest) {
+    sendRangeRequestAndCheckResponseHead("/resource1/file1", "bytes=2-1", "", 200);
+    BOOST_CHECK_EQUAL(m_response_headers["Accept-Ranges"], "bytes");
+    BOOST_CHECK_EQUAL(readResponseContent(), "abc\n");
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToIfRangeRequest) {
+    sendRequestAndCheckResponseHead("GET", "/resource1/file1");
+    checkWebServerResponseContent(boost::regex("abc\\s*"));
+    const std::string last_modified(m_response_headers["Last-Modified"]);
+    BOOST_REQUIRE(! last_modified.empty());
+
+    // the file has not changed -> send the range
+    sendRangeRequestAndCheckResponseHead("/resource1/file1", "bytes=1-", last_modified, 206);
+    BOOST_CHECK_EQUAL(readResponseContent(), "bc\n");
+
+    // the file has changed -> send all of it
+    sendRangeRequestAndCheckResponseHead("/resource1/file1", "bytes=1-",
+                                         "Sun, 06 Nov 1994 08:49:37 GMT", 200);
+    BOOST_CHECK_EQUAL(readResponseContent(), "abc\n");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 class RunningFileServiceWithWritingEnabled_F : public RunningFileService_F {
 public:
     RunningFileServiceWithWritingEnabled_F() {
-        m_server.set_service_option("/resource1", "writable", "true");
+        // the content of requests is only streamed over connections that are
+        // accepted after the service becomes writable
+        restartWithOption("writable", "true");
     }
     ~RunningFileServiceWithWritingEnabled_F() {
     }
@@ -415,6 +638,30 @@ public:
         while (in.get(c)) actual_contents += c;
         BOOST_CHECK_EQUAL(actual_contents, expected_contents);
     }
+
+    /// returns the number of temporary upload files in the sandbox directory
+    unsigned int countUploadFiles(void) {
+        unsigned int num_files = 0;
+        for (boost::filesystem::directory_iterator i("sandbox"); i != boost::filesystem::directory_iterator(); ++i) {
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+            if (i->path().filename().string().find(".upload-") != std::string::npos)
+#else
+            if (i->path().leaf().find(".upload-") != std::string::npos)
+#endif
+                ++num_files;
+        }
+        return num_files;
+    }
+
+    /// returns true if the number of temporary upload files becomes the expected one within two seconds
+    bool waitForUploadFiles(unsigned int expected_num_files) {
+        for (unsigned int n = 0; n < 200; ++n) {
+            if (countUploadFiles() == expected_num_files)
+                return true;
+            boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+        }
+        return false;
+    }
 };
 
 BOOST_FIXTURE_TEST_SUITE(RunningFileServiceWithWritingEnabled_S, RunningFileServiceWithWritingEnabled_F)
@@ -556,6 +803,125 @@ BOOST_AUTO_TEST_CASE(checkResponseToChunkedPostRequest) {
     checkFileContents("sandbox/file1", "abc\nabcdefghijklmno");
 }
 
+BOOST_AUTO_TEST_CASE(checkResponseToPutRequestLargerThanMaxContentLength) {
+    // the content is written to a temporary file as it arrives, so it is
+    // not limited by the maximum content length of requests (1 MB)
+    std::string content;
+    for (unsigned int n = 0; content.size() < 1500000; ++n)
+        content += boost::lexical_cast<std::string>(n) + '\n';
+    sendRequestWithContent("PUT", "/resource1/file3", content);
+    checkResponseHead(201);
+    checkWebServerResponseContent(boost::regex(".*201\\sCreated.*"));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size("sandbox/file3"), content.size());
+    checkFileContents("sandbox/file3", content);
+
+    // the temporary file has been renamed
+    for (boost::filesystem::directory_iterator i("sandbox"); i != boost::filesystem::directory_iterator(); ++i) {
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+        BOOST_CHECK(i->path().filename().string().find(".upload-") == std::string::npos);
+#else
+        BOOST_CHECK(i->path().leaf().find(".upload-") == std::string::npos);
+#endif
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToPostRequestLargerThanMaxContentLength) {
+    const std::string content(1200000, 'x');
+    sendRequestWithContent("POST", "/resource1/file2", content);
+    checkResponseHead(204);
+    BOOST_CHECK(m_content_length == 0);
+    checkFileContents("sandbox/file2", "xyz\n" + content);
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToPutRequestLargerThanMaxUploadSize) {
+    m_server.set_service_option("/resource1", "max_upload_size", "1000");
+    sendRequestWithContent("PUT", "/resource1/file3", std::string(1000, 'x'));
+    checkResponseHead(201);
+    checkFileContents("sandbox/file3", std::string(1000, 'x'));
+    checkWebServerResponseContent(boost::regex(".*201\\sCreated.*"));
+
+    // the content is not written at all if its length is too large
+    sendRequestWithContent("PUT", "/resource1/file3", std::string(1001, 'y'));
+    checkResponseHead(413);
+    checkWebServerResponseContent(boost::regex(".*413\\sRequest\\sEntity\\sToo\\sLarge.*"));
+    checkFileContents("sandbox/file3", std::string(1000, 'x'));
+    BOOST_CHECK_EQUAL(countUploadFiles(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(checkChunkedUploadLargerThanMaxUploadSizeIsRemoved) {
+    m_server.set_service_option("/resource1", "max_upload_size", "1000");
+    m_http_stream << "POST /resource1/file2 HTTP/1.1" << http::types::STRING_CRLF
+        << "Transfer-Encoding: chunked" << http::types::STRING_CRLF << http::types::STRING_CRLF
+        << "320" << http::types::STRING_CRLF << std::string(800, 'x') << http::types::STRING_CRLF;
+    m_http_stream.flush();
+    BOOST_REQUIRE(waitForUploadFiles(1));
+
+    // the temporary file is removed as soon as the limit is exceeded
+    m_http_stream << "320" << http::types::STRING_CRLF << std::string(800, 'x') << http::types::STRING_CRLF;
+    m_http_stream.flush();
+    BOOST_CHECK(waitForUploadFiles(0));
+    m_http_stream << "0" << http::types::STRING_CRLF << http::types::STRING_CRLF;
+    m_http_stream.flush();
+    checkResponseHead(413);
+    checkFileContents("sandbox/file2", "xyz\n");
+}
+
+BOOST_AUTO_TEST_CASE(checkUploadOfRequestThatIsNeverHandledIsRemoved) {
+    // send only part of the content, so that the request is never handled
+    m_http_stream << "PUT /resource1/file3 HTTP/1.1" << http::types::STRING_CRLF
+        << "Content-Length: 100000" << http::types::STRING_CRLF << http::types::STRING_CRLF
+        << std::string(1000, 'x');
+    m_http_stream.flush();
+    BOOST_REQUIRE(waitForUploadFiles(1));
+
+    // the temporary file is removed once the connection is closed
+    m_http_stream.close();
+    BOOST_CHECK(waitForUploadFiles(0));
+    BOOST_CHECK(! boost::filesystem::exists("sandbox/file3"));
+}
+
+BOOST_AUTO_TEST_CASE(checkTemporaryUploadFileIsNotServed) {
+    m_http_stream << "PUT /resource1/file3 HTTP/1.1" << http::types::STRING_CRLF
+        << "Content-Length: 100000" << http::types::STRING_CRLF << http::types::STRING_CRLF
+        << std::string(1000, 'x');
+    m_http_stream.flush();
+    BOOST_REQUIRE(waitForUploadFiles(1));
+    std::string temp_name;
+    for (boost::filesystem::directory_iterator i("sandbox"); i != boost::filesystem::directory_iterator(); ++i) {
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+        if (i->path().filename().string().find(".upload-") != std::string::npos)
+            temp_name = i->path().filename().string();
+#else
+        if (i->path().leaf().find(".upload-") != std::string::npos)
+            temp_name = i->path().leaf();
+#endif
+    }
+
+    // request the temporary file over another connection, while it exists
+    boost::asio::ip::tcp::iostream other_stream;
+    boost::asio::ip::tcp::endpoint http_endpoint(boost::asio::ip::address::from_string("127.0.0.1"), m_server.get_port());
+    other_stream.connect(http_endpoint);
+    other_stream << "GET /resource1/" << temp_name << " HTTP/1.1" << http::types::STRING_CRLF << http::types::STRING_CRLF;
+    other_stream.flush();
+    std::string rsp_line;
+    BOOST_REQUIRE(std::getline(other_stream, rsp_line));
+    BOOST_CHECK(rsp_line.find(" 404 ") != std::string::npos);
+    BOOST_CHECK_EQUAL(countUploadFiles(), 1U);
+}
+
+#ifndef PION_WIN32
+BOOST_AUTO_TEST_CASE(checkResponseToPutRequestKeepsFileMode) {
+    BOOST_REQUIRE(::chmod("sandbox/file2", 0640) == 0);
+    sendRequestWithContent("PUT", "/resource1/file2", "1234\n");
+    checkResponseHead(204);
+    checkFileContents("sandbox/file2", "1234\n");
+
+    struct stat file_stat;
+    BOOST_REQUIRE(::stat("sandbox/file2", &file_stat) == 0);
+    BOOST_CHECK_EQUAL(file_stat.st_mode & 07777, 0640U);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
 
 const char g_file4_contents[] = "012345678901234";
@@ -690,3 +1056,665 @@ BOOST_AUTO_TEST_CASE(checkResponseToHTTP_1_0_Request) {
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+
+class RunningFileServiceWithCachingDisabled_F : public RunningFileService_F {
+public:
+    enum _size_constants { LARGE_FILE_SIZE = 3 * 1024 * 1024 + 17 };
+
+    RunningFileServiceWithCachingDisabled_F() {
+        m_server.set_service_option("/resource1", "cache", "0");
+
+        // make a file that is too large to be sent in a single write
+        m_large_file_contents.reserve(LARGE_FILE_SIZE);
+        for (unsigned int n = 0; n < LARGE_FILE_SIZE; ++n)
+            m_large_file_contents.push_back(static_cast<char>('a' + (n % 26) + (n / 4096) % 7));
+        FILE* fp = fopen("sandbox/large_file", "wb");
+        fwrite(m_large_file_contents.data(), 1, m_large_file_contents.size(), fp);
+        fclose(fp);
+    }
+    ~RunningFileServiceWithCachingDisabled_F() {
+        boost::filesystem::remove("sandbox/large_file");
+    }
+
+    /// sends a GET request for the large file and checks that all of it is received
+    inline void checkLargeFileResponse(void) {
+        m_http_stream << "GET /resource1/large_file HTTP/1.1" << http::types::STRING_CRLF << http::types::STRING_CRLF;
+        m_http_stream.flush();
+
+        m_content_length = 0;
+        checkResponseHead(200);
+        BOOST_REQUIRE_EQUAL(m_content_length, static_cast<unsigned long>(LARGE_FILE_SIZE));
+
+        std::string content(m_content_length, '\0');
+        BOOST_REQUIRE(m_http_stream.read(&content[0], m_content_length));
+        BOOST_CHECK(content == m_large_file_contents);
+    }
+
+    std::string m_large_file_contents;
+};
+
+BOOST_FIXTURE_TEST_SUITE(RunningFileServiceWithCachingDisabled_S, RunningFileServiceWithCachingDisabled_F)
+
+BOOST_AUTO_TEST_CASE(checkResponseToGetRequestForLargeFile) {
+    checkLargeFileResponse();
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToSingleRangeRequestForLargeFile) {
+    sendRangeRequestAndCheckResponseHead("/resource1/large_file", "bytes=1000000-", "", 206);
+    BOOST_CHECK_EQUAL(m_response_headers["Content-Range"], "bytes 1000000-"
+        + boost::lexical_cast<std::string>(LARGE_FILE_SIZE - 1) + '/'
+        + boost::lexical_cast<std::string>(LARGE_FILE_SIZE));
+    BOOST_CHECK(readResponseContent() == m_large_file_contents.substr(1000000));
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToDuplicateAndOverlappingRangeRequests) {
+    // requesting the whole file many times sends it once, without ranges
+    std::string range("bytes=0-");
+    for (unsigned int n = 0; n < 63; ++n)
+        range += ",0-";
+    sendRangeRequestAndCheckResponseHead("/resource1/large_file", range, "", 200);
+    BOOST_CHECK_EQUAL(m_content_length, static_cast<unsigned long>(LARGE_FILE_SIZE));
+    BOOST_CHECK(readResponseContent() == m_large_file_contents);
+
+    // overlapping and adjacent ranges are merged
+    sendRangeRequestAndCheckResponseHead("/resource1/large_file",
+                                         "bytes=150-299,100-199,300-399,120-130", "", 206);
+    BOOST_CHECK_EQUAL(m_response_headers["Content-Range"], "bytes 100-399/"
+        + boost::lexical_cast<std::string>(LARGE_FILE_SIZE));
+    BOOST_CHECK(readResponseContent() == m_large_file_contents.substr(100, 300));
+
+    pion::tcp::connection tcp_conn(get_io_service());
+    boost::system::error_code error_code;
+    error_code = tcp_conn.connect(boost::asio::ip::address::from_string("127.0.0.1"), m_server.get_port());
+    BOOST_REQUIRE(!error_code);
+    http::request http_request("/resource1/large_file");
+    http_request.add_header("Range", "bytes=1000-1009,0-9,5-14");
+    http_request.send(tcp_conn, error_code);
+    BOOST_REQUIRE(!error_code);
+    http::response http_response(http_request);
+    http_response.receive(tcp_conn, error_code);
+    BOOST_REQUIRE(!error_code);
+    BOOST_CHECK_EQUAL(http_response.get_status_code(), 206U);
+    const std::string content(http_response.get_content(), http_response.get_content_length());
+    BOOST_CHECK(content.size() < 1000);
+    BOOST_CHECK(content.find("Content-Range: bytes 0-14/") != std::string::npos);
+    BOOST_CHECK(content.find("Content-Range: bytes 1000-1009/") != std::string::npos);
+    BOOST_CHECK(content.find("Content-Range: bytes 5-14/") == std::string::npos);
+
+    // many separate small ranges are ignored
+    range = "bytes=0-0";
+    for (unsigned int n = 1; n <= 20; ++n)
+        range += ',' + boost::lexical_cast<std::string>(n * 10) + '-' + boost::lexical_cast<std::string>(n * 10);
+    sendRangeRequestAndCheckResponseHead("/resource1/large_file", range, "", 200);
+    BOOST_CHECK_EQUAL(m_content_length, static_cast<unsigned long>(LARGE_FILE_SIZE));
+    BOOST_CHECK(readResponseContent() == m_large_file_contents);
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToMultipleRangeRequestForLargeFile) {
+    // the parts are read from the file one at a time, and sent as chunks
+    pion::tcp::connection tcp_conn(get_io_service());
+    boost::system::error_code error_code;
+    error_code = tcp_conn.connect(boost::asio::ip::address::from_string("127.0.0.1"), m_server.get_port());
+    BOOST_REQUIRE(!error_code);
+
+    http::request http_request("/resource1/large_file");
+    http_request.add_header("Range", "bytes=10-19,-10");
+    http_request.send(tcp_conn, error_code);
+    BOOST_REQUIRE(!error_code);
+
+    http::response http_response(http_request);
+    http_response.receive(tcp_conn, error_code);
+    BOOST_REQUIRE(!error_code);
+    BOOST_CHECK_EQUAL(http_response.get_status_code(), 206U);
+
+    const std::string content(http_response.get_content(), http_response.get_content_length());
+    BOOST_CHECK(content.find("Content-Range: bytes 10-19/") != std::string::npos);
+    BOOST_CHECK(content.find("\r\n\r\n" + m_large_file_contents.substr(10, 10) + "\r\n") != std::string::npos);
+    BOOST_CHECK(content.find("\r\n\r\n" + m_large_file_contents.substr(LARGE_FILE_SIZE - 10) + "\r\n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(checkResponsesToGetRequestsForLargeFileOverKeptAliveConnection) {
+    checkLargeFileResponse();
+    checkLargeFileResponse();
+
+    // make sure the connection is still usable for other responses
+    m_http_stream << "GET /resource1/file1 HTTP/1.1" << http::types::STRING_CRLF << http::types::STRING_CRLF;
+    m_http_stream.flush();
+    m_content_length = 0;
+    checkResponseHead(200);
+    checkWebServerResponseContent(boost::regex("abc\\s+"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+class RunningFileServiceWithIOThreads_F : public RunningFileServiceWithCachingDisabled_F {
+public:
+    RunningFileServiceWithIOThreads_F() {
+        // restart the server, since the disk I/O threads are started with it
+        m_server.set_service_option("/resource1", "writable", "true");
+        restartWithOption("io_threads", "2");
+    }
+    ~RunningFileServiceWithIOThreads_F() {
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(RunningFileServiceWithIOThreads_S, RunningFileServiceWithIOThreads_F)
+
+BOOST_AUTO_TEST_CASE(checkResponsesToGetRequestsForLargeFileOverKeptAliveConnection) {
+    checkLargeFileResponse();
+    checkLargeFileResponse();
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToMultipleRangeRequestForLargeFileInChunks) {
+    // each chunk of the parts is read in a disk I/O thread
+    m_server.set_service_option("/resource1", "max_chunk_size", "100000");
+    pion::tcp::connection tcp_conn(get_io_service());
+    boost::system::error_code error_code;
+    error_code = tcp_conn.connect(boost::asio::ip::address::from_string("127.0.0.1"), m_server.get_port());
+    BOOST_REQUIRE(!error_code);
+
+    http::request http_request("/resource1/large_file");
+    http_request.add_header("Range", "bytes=0-299999,-10");
+    http_request.send(tcp_conn, error_code);
+    BOOST_REQUIRE(!error_code);
+
+    http::response http_response(http_request);
+    http_response.receive(tcp_conn, error_code);
+    BOOST_REQUIRE(!error_code);
+    BOOST_CHECK_EQUAL(http_response.get_status_code(), 206U);
+
+    const std::string content(http_response.get_content(), http_response.get_content_length());
+    BOOST_CHECK(content.find("\r\n\r\n" + m_large_file_contents.substr(0, 300000) + "\r\n") != std::string::npos);
+    BOOST_CHECK(content.find("\r\n\r\n" + m_large_file_contents.substr(LARGE_FILE_SIZE - 10) + "\r\n") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToRangeRequestForLargeFile) {
+    sendRangeRequestAndCheckResponseHead("/resource1/large_file", "bytes=1000000-1000009", "", 206);
+    BOOST_CHECK(readResponseContent() == m_large_file_contents.substr(1000000, 10));
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToCachedFileAndPutRequest) {
+    m_server.set_service_option("/resource1", "cache", "2");
+    sendRequestAndCheckResponseHead("GET", "/resource1/file1");
+    checkWebServerResponseContent(boost::regex("abc\\s*"));
+
+    sendRequestWithContent("PUT", "/resource1/file3", "1234");
+    checkResponseHead(201);
+    checkWebServerResponseContent(boost::regex(".*201\\sCreated.*"));
+    BOOST_CHECK(boost::filesystem::exists("sandbox/file3"));
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size("sandbox/file3"), 4U);
+
+    m_content_length = 0;
+    sendRequestAndCheckResponseHead("GET", "/resource1/file1");
+    checkWebServerResponseContent(boost::regex("abc\\s*"));
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToPutRequestLargerThanUploadQueue) {
+    // the content is written by the disk I/O threads, while more of it is received
+    sendRequestWithContent("PUT", "/resource1/file3", m_large_file_contents);
+    checkResponseHead(201);
+    checkWebServerResponseContent(boost::regex(".*201\\sCreated.*"));
+    BOOST_REQUIRE_EQUAL(boost::filesystem::file_size("sandbox/file3"), m_large_file_contents.size());
+    boost::filesystem::ifstream in("sandbox/file3", std::ios::binary);
+    const std::string file_contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    BOOST_CHECK(file_contents == m_large_file_contents);
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToChunkedPostRequestLargerThanMaxUploadSize) {
+    m_server.set_service_option("/resource1", "max_upload_size", "1000");
+    m_http_stream << "POST /resource1/file2 HTTP/1.1" << http::types::STRING_CRLF
+        << "Transfer-Encoding: chunked" << http::types::STRING_CRLF << http::types::STRING_CRLF
+        << "320" << http::types::STRING_CRLF << std::string(800, 'x') << http::types::STRING_CRLF
+        << "320" << http::types::STRING_CRLF << std::string(800, 'x') << http::types::STRING_CRLF
+        << "0" << http::types::STRING_CRLF << http::types::STRING_CRLF;
+    m_http_stream.flush();
+    checkResponseHead(413);
+    BOOST_CHECK_EQUAL(boost::filesystem::file_size("sandbox/file2"), 4U);
+    // the temporary file is removed before the response is sent
+    for (boost::filesystem::directory_iterator i("sandbox"); i != boost::filesystem::directory_iterator(); ++i) {
+# if defined(BOOST_FILESYSTEM_VERSION) && BOOST_FILESYSTEM_VERSION >= 3
+        BOOST_CHECK(i->path().filename().string().find(".upload-") == std::string::npos);
+#else
+        BOOST_CHECK(i->path().leaf().find(".upload-") == std::string::npos);
+#endif
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+class RunningFileServiceWithMmapEnabled_F : public RunningFileService_F {
+public:
+    RunningFileServiceWithMmapEnabled_F() {
+        // files are only mapped if they are not expected to change
+        m_server.set_service_option("/resource1", "mmap", "true");
+        m_server.set_service_option("/resource1", "cache", "2");
+    }
+    ~RunningFileServiceWithMmapEnabled_F() {
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(RunningFileServiceWithMmapEnabled_S, RunningFileServiceWithMmapEnabled_F)
+
+BOOST_AUTO_TEST_CASE(checkResponseToGetRequestForSpecifiedFile) {
+    sendRequestAndCheckResponseHead("GET", "/resource1/file2");
+    checkWebServerResponseContent(boost::regex("xyz\\s*"));
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToGetRequestForEmptyFile) {
+    sendRequestAndCheckResponseHead("GET", "/resource1/emptyFile");
+    BOOST_CHECK(m_content_length == 0);
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToGetRequestForFileAfterUpdatingIt) {
+    // files that are checked for updates are read instead of mapped
+    m_server.set_service_option("/resource1", "cache", "1");
+    sendRequestAndCheckResponseHead("GET", "/resource1/file2");
+    checkWebServerResponseContent(boost::regex("xyz\\s*"));
+
+    // replace the file, so that the cached content is refreshed
+    boost::filesystem::remove("sandbox/file2");
+    boost::filesystem::ofstream file2("sandbox/file2");
+    file2 << "uvwxyz" << std::endl;
+    file2.close();
+
+    m_content_length = 0;
+    sendRequestAndCheckResponseHead("GET", "/resource1/file2");
+    checkWebServerResponseContent(boost::regex("uvwxyz\\s*"));
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToGetRequestForFileTruncatedWhileSent) {
+    // a writable service does not map files, since they may be truncated
+    m_server.set_service_option("/resource1", "writable", "true");
+    const std::string contents(4 * 1024 * 1024, 'q');
+    boost::filesystem::ofstream large_file("sandbox/large_file", std::ios::out | std::ios::binary);
+    large_file << contents;
+    large_file.close();
+
+    // start receiving the file; it is too large to be sent in a single write
+    m_http_stream << "GET /resource1/large_file HTTP/1.1" << http::types::STRING_CRLF << http::types::STRING_CRLF;
+    m_http_stream.flush();
+    checkResponseHead(200);
+    BOOST_REQUIRE_EQUAL(m_content_length, contents.size());
+    std::string content(m_content_length, '\0');
+    BOOST_REQUIRE(m_http_stream.read(&content[0], 1000));
+
+    // truncate the file in place while the rest of it is being sent
+    large_file.open("sandbox/large_file", std::ios::out | std::ios::trunc | std::ios::binary);
+    large_file.close();
+    BOOST_REQUIRE(m_http_stream.read(&content[1000], m_content_length - 1000));
+    BOOST_CHECK(content == contents);
+
+    // the server is still running
+    m_content_length = 0;
+    sendRequestAndCheckResponseHead("GET", "/resource1/file1");
+    checkWebServerResponseContent(boost::regex("abc\\s*"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+class RunningFileServiceWithCacheBudgetSet_F : public RunningFileService_F {
+public:
+    RunningFileServiceWithCacheBudgetSet_F() {
+        // cache=2 never checks files for updates, so stale content shows what was cached
+        m_server.set_service_option("/resource1", "cache", "2");
+    }
+    ~RunningFileServiceWithCacheBudgetSet_F() {
+    }
+
+    void replaceFile2(void) {
+        boost::filesystem::remove("sandbox/file2");
+        boost::filesystem::ofstream file2("sandbox/file2");
+        file2 << "uvw" << std::endl;
+        file2.close();
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(RunningFileServiceWithCacheBudgetSet_S, RunningFileServiceWithCacheBudgetSet_F)
+
+BOOST_AUTO_TEST_CASE(checkFileContentIsCachedIfItFitsTheBudget) {
+    m_server.set_service_option("/resource1", "cache_budget", "1048576");
+    sendRequestAndCheckResponseHead("GET", "/resource1/file2");
+    checkWebServerResponseContent(boost::regex("xyz\\s*"));
+
+    replaceFile2();
+
+    m_content_length = 0;
+    sendRequestAndCheckResponseHead("GET", "/resource1/file2");
+    checkWebServerResponseContent(boost::regex("xyz\\s*"));
+}
+
+BOOST_AUTO_TEST_CASE(checkFileContentIsNotCachedIfItExceedsTheBudget) {
+    // smaller than file2 (4 bytes)
+    m_server.set_service_option("/resource1", "cache_budget", "3");
+    sendRequestAndCheckResponseHead("GET", "/resource1/file2");
+    checkWebServerResponseContent(boost::regex("xyz\\s*"));
+
+    replaceFile2();
+
+    m_content_length = 0;
+    sendRequestAndCheckResponseHead("GET", "/resource1/file2");
+    checkWebServerResponseContent(boost::regex("uvw\\s*"));
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseToGetRequestsForSeveralFiles) {
+    m_server.set_service_option("/resource1", "cache_budget", "16");
+    sendRequestAndCheckResponseHead("GET", "/resource1/file1");
+    checkWebServerResponseContent(boost::regex("abc\\s*"));
+    m_content_length = 0;
+    sendRequestAndCheckResponseHead("GET", "/resource1/file2");
+    checkWebServerResponseContent(boost::regex("xyz\\s*"));
+    m_content_length = 0;
+    sendRequestAndCheckResponseHead("GET", "/resource1/file1");
+    checkWebServerResponseContent(boost::regex("abc\\s*"));
+}
+
+BOOST_AUTO_TEST_CASE(checkContentIsEvictedToStayWithinTheBudget) {
+    // each file is larger than the budget divided among the cache's shards,
+    // and the budget holds four of them
+    const unsigned int NUM_FILES = 10;
+    const std::size_t FILE_SIZE = 1000;
+    m_server.set_service_option("/resource1", "cache_budget", "4500");
+    for (unsigned int n = 0; n < NUM_FILES; ++n) {
+        boost::filesystem::ofstream file("sandbox/evict" + boost::lexical_cast<std::string>(n));
+        file << std::string(FILE_SIZE, static_cast<char>('a' + n));
+    }
+
+    // cache each file, referencing the first one after each of the others
+    for (unsigned int n = 0; n < NUM_FILES; ++n) {
+        const std::string resource("/resource1/evict" + boost::lexical_cast<std::string>(n));
+        m_content_length = 0;
+        sendRequestAndCheckResponseHead("GET", resource);
+        BOOST_CHECK_EQUAL(readResponseContent(), std::string(FILE_SIZE, static_cast<char>('a' + n)));
+        m_content_length = 0;
+        sendRequestAndCheckResponseHead("GET", "/resource1/evict0");
+        BOOST_CHECK_EQUAL(readResponseContent(), std::string(FILE_SIZE, 'a'));
+    }
+
+    // replace the files: cached content is now stale, evicted content is read again
+    for (unsigned int n = 0; n < NUM_FILES; ++n) {
+        const std::string file_name("sandbox/evict" + boost::lexical_cast<std::string>(n));
+        boost::filesystem::remove(file_name);
+        boost::filesystem::ofstream file(file_name);
+        file << std::string(FILE_SIZE, static_cast<char>('A' + n));
+    }
+
+    // the recently referenced file is still cached
+    m_content_length = 0;
+    sendRequestAndCheckResponseHead("GET", "/resource1/evict0");
+    BOOST_CHECK_EQUAL(readResponseContent(), std::string(FILE_SIZE, 'a'));
+
+    // the cached files fit the budget, and the evicted ones have their current content
+    // (the files cached last are checked first, since checking an evicted file caches it again)
+    unsigned int num_cached = 1;
+    for (unsigned int n = NUM_FILES - 1; n > 0; --n) {
+        m_content_length = 0;
+        sendRequestAndCheckResponseHead("GET", "/resource1/evict" + boost::lexical_cast<std::string>(n));
+        const std::string content(readResponseContent());
+        if (content == std::string(FILE_SIZE, static_cast<char>('a' + n)))
+            ++num_cached;
+        else
+            BOOST_CHECK_EQUAL(content, std::string(FILE_SIZE, static_cast<char>('A' + n)));
+    }
+    BOOST_CHECK_GT(num_cached, 1U);
+    BOOST_CHECK_LE(num_cached * FILE_SIZE, 4500U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+class RunningFileServiceWithScanThreads_F : public RunningFileService_F {
+public:
+    RunningFileServiceWithScanThreads_F() {
+        // add some files in sub-directories, to give the scan threads some work
+        for (unsigned int d = 0; d < NUM_SCANNED_DIRS; ++d) {
+            const std::string dir_name("sandbox/dir1/scan" + boost::lexical_cast<std::string>(d));
+            BOOST_REQUIRE(boost::filesystem::create_directory(dir_name));
+            for (unsigned int f = 0; f < NUM_SCANNED_FILES_PER_DIR; ++f) {
+                boost::filesystem::ofstream file(dir_name + "/file" + boost::lexical_cast<std::string>(f));
+                file << d << '-' << f << std::endl;
+                file.close();
+            }
+        }
+        // used when the tests restart the server with a scan setting
+        m_server.set_service_option("/resource1", "scan_threads", "4");
+    }
+    ~RunningFileServiceWithScanThreads_F() {
+    }
+
+    /// requests each of the files, which may or may not be cached yet
+    inline void checkScannedFiles(void) {
+        for (unsigned int d = 0; d < NUM_SCANNED_DIRS; ++d) {
+            for (unsigned int f = 0; f < NUM_SCANNED_FILES_PER_DIR; ++f) {
+                m_content_length = 0;
+                sendRequestAndCheckResponseHead("GET", "/resource1/dir1/scan" + boost::lexical_cast<std::string>(d)
+                                                + "/file" + boost::lexical_cast<std::string>(f));
+                BOOST_CHECK_EQUAL(readResponseContent(), boost::lexical_cast<std::string>(d) + '-'
+                                  + boost::lexical_cast<std::string>(f) + '\n');
+            }
+        }
+    }
+
+    static const unsigned int NUM_SCANNED_DIRS = 8;
+    static const unsigned int NUM_SCANNED_FILES_PER_DIR = 25;
+};
+
+BOOST_FIXTURE_TEST_SUITE(RunningFileServiceWithScanThreads_S, RunningFileServiceWithScanThreads_F)
+
+BOOST_AUTO_TEST_CASE(checkResponsesToGetRequestsWhileWarmingUpCache) {
+    // scan == 3 does not allow new files, except while scanning
+    restartWithOption("scan", "3");
+    checkScannedFiles();
+    sendRequestAndCheckResponseHead("GET", "/resource1/file1");
+    checkWebServerResponseContent(boost::regex("abc\\s*"));
+}
+
+BOOST_AUTO_TEST_CASE(checkResponsesToGetRequestsWithPlaceholders) {
+    restartWithOption("scan", "1");
+    checkScannedFiles();
+}
+
+BOOST_AUTO_TEST_CASE(checkStoppingWhileScanning) {
+    restartWithOption("scan", "2");
+    // the server is stopped while it is still scanning
+    restartWithOption("scan", "2");
+    checkScannedFiles();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+
+#ifdef PION_HAVE_INOTIFY
+class RunningFileServiceWithWatchEnabled_F : public RunningFileService_F {
+public:
+    RunningFileServiceWithWatchEnabled_F() {
+        // restart the server, since the directory is watched and scanned when starting
+        m_server.set_service_option("/resource1", "scan", "3");
+        restartWithOption("watch", "true");
+    }
+    ~RunningFileServiceWithWatchEnabled_F() {
+    }
+
+    /**
+     * sends a GET request to the local HTTP server
+     *
+     * @param resource name of the HTTP resource to request
+     * @return the content of the response, or an empty string if it is not 200 (OK)
+     */
+    inline std::string getContent(const std::string& resource) {
+        pion::tcp::connection tcp_conn(get_io_service());
+        boost::system::error_code error_code;
+        error_code = tcp_conn.connect(boost::asio::ip::address::from_string("127.0.0.1"), m_server.get_port());
+        BOOST_REQUIRE(!error_code);
+
+        http::request http_request(resource);
+        http_request.send(tcp_conn, error_code);
+        BOOST_REQUIRE(!error_code);
+
+        http::response http_response(http_request);
+        http_response.receive(tcp_conn, error_code);
+        BOOST_REQUIRE(!error_code);
+        if (http_response.get_status_code() != 200)
+            return std::string();
+        return std::string(http_response.get_content(), http_response.get_content_length());
+    }
+
+    /// returns true if the content of a resource becomes what is expected within two seconds
+    inline bool waitForContent(const std::string& resource, const std::string& expected_content) {
+        for (unsigned int n = 0; n < 200; ++n) {
+            if (getContent(resource) == expected_content)
+                return true;
+            boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+        }
+        return false;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(RunningFileServiceWithWatchEnabled_S, RunningFileServiceWithWatchEnabled_F)
+
+BOOST_AUTO_TEST_CASE(checkChangedFileIsReloaded) {
+    BOOST_CHECK_EQUAL(getContent("/resource1/file2"), "xyz\n");
+
+    boost::filesystem::ofstream file2("sandbox/file2");
+    file2 << "uvwxyz" << std::endl;
+    file2.close();
+
+    BOOST_CHECK(waitForContent("/resource1/file2", "uvwxyz\n"));
+}
+
+BOOST_AUTO_TEST_CASE(checkNewFileIsAdded) {
+    // scan == 3 would otherwise ignore new files
+    BOOST_CHECK_EQUAL(getContent("/resource1/file3"), "");
+
+    boost::filesystem::ofstream file3("sandbox/file3");
+    file3 << "def" << std::endl;
+    file3.close();
+
+    BOOST_CHECK(waitForContent("/resource1/file3", "def\n"));
+}
+
+BOOST_AUTO_TEST_CASE(checkNewFileInNewDirectoryIsAdded) {
+    BOOST_REQUIRE(boost::filesystem::create_directory("sandbox/dir2"));
+
+    boost::filesystem::ofstream file3("sandbox/dir2/file3");
+    file3 << "def" << std::endl;
+    file3.close();
+
+    BOOST_CHECK(waitForContent("/resource1/dir2/file3", "def\n"));
+}
+
+BOOST_AUTO_TEST_CASE(checkDeletedFileIsRemoved) {
+    BOOST_CHECK_EQUAL(getContent("/resource1/file2"), "xyz\n");
+
+    boost::filesystem::remove("sandbox/file2");
+
+    BOOST_CHECK(waitForContent("/resource1/file2", ""));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+#endif
+
+
+class RunningFileServiceWithCompressionEnabled_F : public RunningFileService_F {
+public:
+    RunningFileServiceWithCompressionEnabled_F() {
+        m_server.set_service_option("/resource1", "precompressed", "true");
+        m_server.set_service_option("/resource1", "compress", "true");
+
+        // sidecars only need to be as new as the file; their content is not checked
+        boost::filesystem::ofstream file2_gz("sandbox/file2.gz");
+        file2_gz << "gzip-compressed xyz";
+        file2_gz.close();
+        boost::filesystem::ofstream file2_br("sandbox/file2.br");
+        file2_br << "brotli-compressed xyz";
+        file2_br.close();
+
+        // text that is worth compressing
+        boost::filesystem::ofstream page("sandbox/page.html");
+        for (int n = 0; n < 100; ++n)
+            page << "<p>The quick brown fox jumps over the lazy dog.</p>" << std::endl;
+        m_page_size = static_cast<unsigned long>(page.tellp());
+        page.close();
+    }
+    ~RunningFileServiceWithCompressionEnabled_F() {
+    }
+
+    /// sends a GET request with an Accept-Encoding header and checks the response head
+    inline void sendRequestWithAcceptEncoding(const std::string& resource,
+                                              const std::string& accept_encoding)
+    {
+        m_http_stream << "GET " << resource << " HTTP/1.1" << http::types::STRING_CRLF
+            << "Accept-Encoding: " << accept_encoding << http::types::STRING_CRLF << http::types::STRING_CRLF;
+        m_http_stream.flush();
+        m_content_length = 0;
+        m_response_headers.clear();
+        checkResponseHead(200);
+    }
+
+    unsigned long m_page_size;
+};
+
+BOOST_FIXTURE_TEST_SUITE(RunningFileServiceWithCompressionEnabled_S, RunningFileServiceWithCompressionEnabled_F)
+
+BOOST_AUTO_TEST_CASE(checkResponseWithoutAcceptEncodingIsNotCompressed) {
+    sendRequestAndCheckResponseHead("GET", "/resource1/file2");
+    checkWebServerResponseContent(boost::regex("xyz\\s*"));
+    BOOST_CHECK_EQUAL(m_response_headers["Vary"], "Accept-Encoding");
+    BOOST_CHECK(m_response_headers.find("Content-Encoding") == m_response_headers.end());
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseUsesPrecompressedGzipFile) {
+    sendRequestWithAcceptEncoding("/resource1/file2", "gzip, deflate");
+    BOOST_CHECK_EQUAL(m_response_headers["Content-Encoding"], "gzip");
+    BOOST_CHECK_EQUAL(m_response_headers["Vary"], "Accept-Encoding");
+    checkWebServerResponseContent(boost::regex("gzip-compressed xyz"));
+}
+
+BOOST_AUTO_TEST_CASE(checkEachVariantHasItsOwnETag) {
+    sendRequestWithAcceptEncoding("/resource1/file2", "gzip");
+    checkWebServerResponseContent(boost::regex("gzip-compressed xyz"));
+    const std::string gzip_etag(m_response_headers["ETag"]);
+
+    sendRequestWithAcceptEncoding("/resource1/file2", "identity");
+    checkWebServerResponseContent(boost::regex("xyz\\s*"));
+    const std::string identity_etag(m_response_headers["ETag"]);
+    BOOST_CHECK(! gzip_etag.empty());
+    BOOST_CHECK(! identity_etag.empty());
+    BOOST_CHECK(gzip_etag != identity_etag);
+}
+
+BOOST_AUTO_TEST_CASE(checkResponsePrefersPrecompressedBrotliFile) {
+    sendRequestWithAcceptEncoding("/resource1/file2", "gzip, br");
+    BOOST_CHECK_EQUAL(m_response_headers["Content-Encoding"], "br");
+    checkWebServerResponseContent(boost::regex("brotli-compressed xyz"));
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseHonorsZeroQValues) {
+    sendRequestWithAcceptEncoding("/resource1/file2", "br;q=0, *");
+    BOOST_CHECK_EQUAL(m_response_headers["Content-Encoding"], "gzip");
+    checkWebServerResponseContent(boost::regex("gzip-compressed xyz"));
+
+    sendRequestWithAcceptEncoding("/resource1/file2", "gzip;q=0");
+    BOOST_CHECK(m_response_headers.find("Content-Encoding") == m_response_headers.end());
+    checkWebServerResponseContent(boost::regex("xyz\\s*"));
+}
+
+#ifdef PION_HAVE_ZLIB
+BOOST_AUTO_TEST_CASE(checkResponseUsesContentCompressedWhenCached) {
+    sendRequestWithAcceptEncoding("/resource1/page.html", "gzip");
+    BOOST_CHECK_EQUAL(m_response_headers["Content-Encoding"], "gzip");
+    BOOST_REQUIRE(m_content_length > 2);
+    BOOST_CHECK(m_content_length < m_page_size);
+
+    // check for the gzip magic number
+    std::string content(m_content_length, '\0');
+    BOOST_REQUIRE(m_http_stream.read(&content[0], m_content_length));
+    BOOST_CHECK_EQUAL(static_cast<unsigned char>(content[0]), 0x1f);
+    BOOST_CHECK_EQUAL(static_cast<unsigned char>(content[1]), 0x8b);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,112 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <string>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include <pion/config.hpp>
+#include <pion/hash_map.hpp>
+#include <pion/flat_hash_map.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace pion;
+
+
+BOOST_AUTO_TEST_CASE(testIHashIgnoresCase) {
+    const std::string name("Content-Type: X-Forwarded-For_0123456789[]@`{}");
+    std::string upper_name(name);
+    std::string lower_name(name);
+    for (std::size_t n = 0; n < name.size(); ++n) {
+        upper_name[n] = toupper(name[n]);
+        lower_name[n] = tolower(name[n]);
+    }
+    // compare every length, so that partial words are tested
+    for (std::size_t len = 0; len <= name.size(); ++len) {
+        const std::string x(upper_name, 0, len);
+        const std::string y(lower_name, 0, len);
+        BOOST_CHECK(iequal_to()(x, y));
+        BOOST_CHECK_EQUAL(ihash()(x), ihash()(y));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testIEqualToComparesAllCharacters) {
+    const std::string name("Accept-Language-And-More");
+    for (std::size_t n = 0; n < name.size(); ++n) {
+        std::string other(name);
+        other[n] = (other[n] == '-' ? '_' : '-');
+        BOOST_CHECK(! iequal_to()(name, other));
+        BOOST_CHECK(ihash()(name) != ihash()(other));
+    }
+    BOOST_CHECK(! iequal_to()(name, name + "s"));
+
+    // only ASCII letters are folded
+    BOOST_CHECK(! iequal_to()("[", "{"));
+    BOOST_CHECK(! iequal_to()("@", "`"));
+    BOOST_CHECK(! iequal_to()("\xC1", "\xE1"));
+}
+
+BOOST_AUTO_TEST_CASE(testFlatIHashMultimapFindsValues) {
+    flat_ihash_multimap dict;
+    BOOST_CHECK(dict.empty());
+    BOOST_CHECK(dict.find("Host") == dict.end());
+
+    dict.insert(std::make_pair(std::string("Host"), std::string("localhost")));
+    dict.insert(std::make_pair(std::string("Cookie"), std::string("a=1")));
+    dict.insert(std::make_pair(std::string("Accept"), std::string("*/*")));
+    dict.insert(std::make_pair(std::string("COOKIE"), std::string("b=2")));
+    BOOST_CHECK_EQUAL(dict.size(), 4UL);
+
+    BOOST_REQUIRE(dict.find("host") != dict.end());
+    BOOST_CHECK_EQUAL(dict.find("host")->second, "localhost");
+    BOOST_CHECK_EQUAL(dict.count("cookie"), 2UL);
+    BOOST_CHECK_EQUAL(dict.count("missing"), 0UL);
+
+    // values for the same key are kept together, in order
+    std::pair<flat_ihash_multimap::const_iterator, flat_ihash_multimap::const_iterator>
+        range = static_cast<const flat_ihash_multimap&>(dict).equal_range("Cookie");
+    BOOST_REQUIRE_EQUAL(range.second - range.first, 2);
+    BOOST_CHECK_EQUAL(range.first->second, "a=1");
+    BOOST_CHECK_EQUAL((range.first + 1)->second, "b=2");
+    BOOST_CHECK_EQUAL(dict.find("Accept")->second, "*/*");
+
+    BOOST_CHECK_EQUAL(dict.erase("cookie"), 2UL);
+    BOOST_CHECK_EQUAL(dict.size(), 2UL);
+    BOOST_CHECK(dict.find("Cookie") == dict.end());
+    BOOST_CHECK_EQUAL(dict.find("Accept")->second, "*/*");
+    dict.erase(dict.find("Host"));
+    BOOST_CHECK_EQUAL(dict.size(), 1UL);
+    BOOST_CHECK_EQUAL(dict.begin()->first, "Accept");
+
+    dict.clear();
+    BOOST_CHECK(dict.empty());
+    BOOST_CHECK(dict.find("Accept") == dict.end());
+}
+
+BOOST_AUTO_TEST_CASE(testFlatIHashMultimapGrowsBeyondInlineCapacity) {
+    flat_ihash_multimap dict;
+    const std::size_t NUM_ENTRIES = flat_ihash_multimap::INLINE_CAPACITY * 5;
+    for (std::size_t n = 0; n < NUM_ENTRIES; ++n) {
+        const std::string key("Header-" + boost::lexical_cast<std::string>(n % (NUM_ENTRIES / 2)));
+        dict.insert(std::make_pair(key, boost::lexical_cast<std::string>(n)));
+    }
+    BOOST_CHECK_EQUAL(dict.size(), NUM_ENTRIES);
+    for (std::size_t n = 0; n < NUM_ENTRIES / 2; ++n) {
+        const std::string key("HEADER-" + boost::lexical_cast<std::string>(n));
+        BOOST_REQUIRE_EQUAL(dict.count(key), 2UL);
+        BOOST_CHECK_EQUAL(dict.find(key)->second, boost::lexical_cast<std::string>(n));
+    }
+
+    // copies are independent
+    flat_ihash_multimap copy(dict);
+    dict.clear();
+    BOOST_CHECK_EQUAL(copy.size(), NUM_ENTRIES);
+    BOOST_CHECK_EQUAL(copy.find("header-7")->second, "7");
+    dict = copy;
+    BOOST_CHECK_EQUAL(dict.count("header-7"), 2UL);
+}
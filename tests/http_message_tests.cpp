@@ -67,6 +67,155 @@ BOOST_AUTO_TEST_CASE(checkHTTPResponseAssignmentOperator) {
     BOOST_CHECK_EQUAL(rsp1.get_header("Test"), rsp2.get_header("Test"));
 }
 
+BOOST_AUTO_TEST_CASE(checkContentBlocks) {
+    std::string content;
+    for (std::size_t n = 0; n < 3 * http::content_block_pool::BLOCK_SIZE + 100; ++n)
+        content += static_cast<char>('a' + (n % 26));
+
+    http::content_blocks blocks;
+    BOOST_CHECK(blocks.empty());
+    BOOST_CHECK(blocks.begin() == blocks.end());
+    blocks.append(content.c_str(), 10);
+    blocks.append(content.c_str() + 10, content.size() - 10);
+    BOOST_CHECK_EQUAL(blocks.size(), content.size());
+    BOOST_CHECK_EQUAL(blocks.get_num_blocks(), 4UL);
+
+    // the buffers refer to the blocks, in order
+    std::string joined;
+    for (http::content_blocks::const_iterator i = blocks.begin(); i != blocks.end(); ++i)
+        joined.append(boost::asio::buffer_cast<const char*>(*i), boost::asio::buffer_size(*i));
+    BOOST_CHECK_EQUAL(joined, content);
+    BOOST_CHECK_EQUAL(boost::asio::buffer_size(*blocks.begin()),
+                      static_cast<std::size_t>(http::content_block_pool::BLOCK_SIZE));
+
+    http::content_blocks::buffers_t buffers;
+    blocks.get_buffers(buffers);
+    BOOST_CHECK_EQUAL(buffers.size(), 4UL);
+    BOOST_CHECK_EQUAL(boost::asio::buffer_size(buffers), content.size());
+
+    // copies do not share blocks
+    http::content_blocks blocks_copy(blocks);
+    blocks.clear();
+    BOOST_CHECK(blocks.empty());
+    std::vector<char> flat(blocks_copy.size());
+    blocks_copy.copy(&flat[0]);
+    BOOST_CHECK(std::string(flat.begin(), flat.end()) == content);
+
+    // released blocks are reused
+    BOOST_CHECK(http::content_block_pool::get_instance().get_free_blocks() >= 4UL);
+}
+
+BOOST_AUTO_TEST_CASE(checkMessageWithContentBlocks) {
+    const std::string content(http::content_block_pool::BLOCK_SIZE + 1, 'x');
+    http::response rsp;
+    rsp.get_content_blocks().append(content.c_str(), content.size());
+    rsp.set_content_length(content.size());
+    BOOST_CHECK(rsp.has_content_blocks());
+
+    // content buffers refer to the blocks
+    http::message::write_buffers_t write_buffers;
+    rsp.append_content_buffers(write_buffers);
+    BOOST_CHECK_EQUAL(write_buffers.size(), 2UL);
+    BOOST_CHECK_EQUAL(boost::asio::buffer_size(write_buffers), content.size());
+
+    // copies keep the content blocks
+    http::response rsp_copy(rsp);
+    BOOST_CHECK(rsp_copy.has_content_blocks());
+
+    // get_content() copies the blocks into a single buffer
+    BOOST_CHECK_EQUAL(rsp.get_content(), content);
+    BOOST_CHECK(! rsp.has_content_blocks());
+    write_buffers.clear();
+    rsp.append_content_buffers(write_buffers);
+    BOOST_CHECK_EQUAL(write_buffers.size(), 1UL);
+    BOOST_CHECK_EQUAL(boost::asio::buffer_size(write_buffers), content.size());
+
+    // write() sends the content blocks without copying them
+    std::ostringstream out;
+    boost::system::error_code ec;
+    rsp_copy.write(out, ec);
+    BOOST_CHECK(! ec);
+    BOOST_CHECK(rsp_copy.has_content_blocks());
+    BOOST_CHECK_EQUAL(out.str().substr(out.str().size() - content.size()), content);
+}
+
+BOOST_AUTO_TEST_CASE(checkFindHeaderId) {
+    BOOST_CHECK_EQUAL(http::types::find_header_id("content-length"), http::types::HEADER_ID_CONTENT_LENGTH);
+    BOOST_CHECK_EQUAL(http::types::find_header_id("TRANSFER-ENCODING"), http::types::HEADER_ID_TRANSFER_ENCODING);
+    BOOST_CHECK_EQUAL(http::types::find_header_id("Host"), http::types::HEADER_ID_HOST);
+    BOOST_CHECK_EQUAL(http::types::find_header_id("Hosts"), http::types::HEADER_ID_UNKNOWN);
+    BOOST_CHECK_EQUAL(http::types::find_header_id("Content-Lengt_"), http::types::HEADER_ID_UNKNOWN);
+    BOOST_CHECK_EQUAL(http::types::find_header_id(""), http::types::HEADER_ID_UNKNOWN);
+    for (int id = 0; id < http::types::HEADER_ID_COUNT; ++id) {
+        BOOST_CHECK_EQUAL(http::types::find_header_id(http::types::get_header_name(
+            static_cast<http::types::header_id_t>(id))), id);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkWellKnownHeaderSlots) {
+    http::request req;
+    BOOST_CHECK(! req.has_header(http::types::HEADER_ID_HOST));
+    req.add_header("host", "localhost");
+    req.add_header(http::types::HEADER_CONTENT_TYPE, "text/plain");
+    BOOST_CHECK_EQUAL(req.get_header_view(http::types::HEADER_ID_HOST).str(), "localhost");
+    BOOST_CHECK_EQUAL(req.get_header_view(http::types::HEADER_ID_CONTENT_TYPE).str(), "text/plain");
+
+    // the slots follow changes to the headers
+    req.change_header(http::types::HEADER_HOST, "example.com");
+    BOOST_CHECK_EQUAL(req.get_header_view(http::types::HEADER_ID_HOST).str(), "example.com");
+    req.delete_header("HOST");
+    BOOST_CHECK(! req.has_header(http::types::HEADER_ID_HOST));
+    req.get_headers().erase(http::types::HEADER_CONTENT_TYPE);
+    BOOST_CHECK(! req.has_header(http::types::HEADER_ID_CONTENT_TYPE));
+    req.set_content_type("text/html");
+    BOOST_CHECK_EQUAL(req.get_header_view(http::types::HEADER_ID_CONTENT_TYPE).str(), "text/html");
+
+    // copies have their own slots
+    http::request req2(req);
+    req.clear();
+    BOOST_CHECK(! req.has_header(http::types::HEADER_ID_CONTENT_TYPE));
+    BOOST_CHECK_EQUAL(req2.get_header_view(http::types::HEADER_ID_CONTENT_TYPE).str(), "text/html");
+    const http::request req3(req2);
+    BOOST_CHECK_EQUAL(req3.get_header_view(http::types::HEADER_ID_CONTENT_TYPE).str(), "text/html");
+    req2.get_headers().erase(http::types::HEADER_CONTENT_TYPE);
+    req = req2;
+    BOOST_CHECK(! req.has_header(http::types::HEADER_ID_CONTENT_TYPE));
+    BOOST_CHECK_EQUAL(req3.get_header_view(http::types::HEADER_ID_CONTENT_TYPE).str(), "text/html");
+}
+
+BOOST_AUTO_TEST_CASE(checkUpdateContentLengthUsingHeader) {
+    http::request req;
+    req.update_content_length_using_header();
+    BOOST_CHECK_EQUAL(req.get_content_length(), 0UL);
+    req.change_header(http::types::HEADER_CONTENT_LENGTH, " \t12345 ");
+    req.update_content_length_using_header();
+    BOOST_CHECK_EQUAL(req.get_content_length(), 12345UL);
+    req.change_header(http::types::HEADER_CONTENT_LENGTH, "18446744073709551615");
+    req.update_content_length_using_header();
+    BOOST_CHECK_EQUAL(req.get_content_length(), 18446744073709551615ULL);
+
+    const char *invalid_lengths[] = { "", " ", "12a", "-1", "1 2", "18446744073709551616" };
+    for (std::size_t n = 0; n < sizeof(invalid_lengths) / sizeof(invalid_lengths[0]); ++n) {
+        req.change_header(http::types::HEADER_CONTENT_LENGTH, invalid_lengths[n]);
+        BOOST_CHECK_THROW(req.update_content_length_using_header(), boost::bad_lexical_cast);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkUpdateTransferEncodingUsingHeader) {
+    http::request req;
+    req.update_transfer_encoding_using_header();
+    BOOST_CHECK(! req.is_chunked());
+    req.change_header(http::types::HEADER_TRANSFER_ENCODING, "gzip, Chunked");
+    req.update_transfer_encoding_using_header();
+    BOOST_CHECK(req.is_chunked());
+    req.change_header(http::types::HEADER_TRANSFER_ENCODING, "CHUNKED");
+    req.update_transfer_encoding_using_header();
+    BOOST_CHECK(req.is_chunked());
+    req.change_header(http::types::HEADER_TRANSFER_ENCODING, "chunke");
+    req.update_transfer_encoding_using_header();
+    BOOST_CHECK(! req.is_chunked());
+}
+
 BOOST_AUTO_TEST_CASE(checkGetFirstLineForRequest) {
     http::request http_request;
     
@@ -106,6 +255,54 @@ BOOST_AUTO_TEST_CASE(checkGetFirstLineForResponse) {
     BOOST_CHECK_EQUAL(http_response.get_first_line(), "HTTP/1.1 404 Not Found");
 }
 
+BOOST_AUTO_TEST_CASE(checkFindStatusLine) {
+    const std::string *status_line = http::types::find_status_line(1, 1,
+        http::types::RESPONSE_CODE_OK, http::types::RESPONSE_MESSAGE_OK);
+    BOOST_REQUIRE(status_line != NULL);
+    BOOST_CHECK_EQUAL(*status_line, "HTTP/1.1 200 OK\r\n");
+
+    status_line = http::types::find_status_line(1, 0,
+        http::types::RESPONSE_CODE_NOT_FOUND, http::types::RESPONSE_MESSAGE_NOT_FOUND);
+    BOOST_REQUIRE(status_line != NULL);
+    BOOST_CHECK_EQUAL(*status_line, "HTTP/1.0 404 Not Found\r\n");
+
+    // unusual messages, codes and versions are not pre-encoded
+    BOOST_CHECK(http::types::find_status_line(1, 1, 404, "OK") == NULL);
+    BOOST_CHECK(http::types::find_status_line(1, 1, 299, "OK") == NULL);
+    BOOST_CHECK(http::types::find_status_line(2, 0, 200, "OK") == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(checkPrepareBuffersForSendUsesOneHeaderBuffer) {
+    http::response http_response;
+    http_response.set_content_type(http::types::CONTENT_TYPE_HTML);
+    http_response.add_header("X-Test", "a");
+    http_response.add_header("X-Test", "b");
+
+    http::message::write_buffers_t write_buffers;
+    std::string header_buf;
+    http_response.prepare_buffers_for_send(write_buffers, header_buf, true, false);
+    BOOST_REQUIRE_EQUAL(write_buffers.size(), static_cast<size_t>(1));
+    BOOST_CHECK_EQUAL(boost::asio::buffer_cast<const char*>(write_buffers[0]), header_buf.data());
+    BOOST_CHECK_EQUAL(boost::asio::buffer_size(write_buffers[0]), header_buf.size());
+
+    BOOST_CHECK_EQUAL(header_buf.substr(0, 17), "HTTP/1.1 200 OK\r\n");
+    BOOST_CHECK(header_buf.find("\r\nContent-Type: text/html\r\n") != std::string::npos);
+    BOOST_CHECK(header_buf.find("\r\nContent-Length: 0\r\n") != std::string::npos);
+    BOOST_CHECK(header_buf.find("\r\nConnection: Keep-Alive\r\n") != std::string::npos);
+    BOOST_CHECK(header_buf.find("\r\nX-Test: a\r\n") != std::string::npos);
+    BOOST_CHECK(header_buf.find("\r\nX-Test: b\r\n") != std::string::npos);
+    BOOST_CHECK_EQUAL(header_buf.substr(header_buf.size() - 4), "\r\n\r\n");
+    BOOST_CHECK_EQUAL(header_buf.find("\r\n\r\n"), header_buf.size() - 4);
+
+    // the same headers are written as with one buffer per header
+    http::message::write_buffers_t header_buffers;
+    http_response.prepare_buffers_for_send(header_buffers, true, false);
+    std::string headers;
+    for (http::message::write_buffers_t::const_iterator i = header_buffers.begin(); i != header_buffers.end(); ++i)
+        headers.append(boost::asio::buffer_cast<const char*>(*i), boost::asio::buffer_size(*i));
+    BOOST_CHECK_EQUAL(headers, header_buf);
+}
+
 
 #define FIXTURE_TYPE_LIST(F) boost::mpl::list<F<http::request>, F<http::response> >
 
@@ -7,9 +7,18 @@
 // See http://www.boost.org/LICENSE_1_0.txt
 //
 
+#include <sstream>
+#include <fstream>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/regex.hpp>
+#include <boost/filesystem/operations.hpp>
 #include <boost/test/unit_test.hpp>
 #include <pion/algorithm.hpp>
 #include <pion/http/parser.hpp>
+#include <pion/http/flow_parser.hpp>
+#include <pion/http/multipart_parser.hpp>
+#include <pion/http/url_encoded_parser.hpp>
 #include <pion/http/request.hpp>
 #include <pion/http/response.hpp>
 
@@ -139,6 +148,48 @@ BOOST_AUTO_TEST_CASE(testParseQueryStringWithTabs)
     BOOST_CHECK_EQUAL(i->second, "BOB");
 }
 
+BOOST_AUTO_TEST_CASE(testUrlEncodedParserWithSmallBuffers)
+{
+    const std::string QUERY_STRING("a=b%20c&d=%41+x&&=skipped&e\r\n&f=%4&%+=%");
+    for (std::size_t piece_size = 1; piece_size < 5; ++piece_size) {
+        ihash_multimap params;
+        http::url_encoded_parser query_parser(params);
+        for (std::size_t pos = 0; pos < QUERY_STRING.size(); pos += piece_size)
+            BOOST_REQUIRE(query_parser.parse(QUERY_STRING.c_str() + pos,
+                std::min(piece_size, QUERY_STRING.size() - pos)));
+        BOOST_CHECK_EQUAL(query_parser.get_bytes_parsed(), QUERY_STRING.size());
+        // the last pair is added by finish()
+        BOOST_CHECK_EQUAL(params.size(), 4UL);
+        BOOST_REQUIRE(query_parser.finish());
+        BOOST_CHECK_EQUAL(params.size(), 5UL);
+
+        // same results as decoding the whole string
+        ihash_multimap expected;
+        BOOST_REQUIRE(http::parser::parse_url_encoded(expected, QUERY_STRING));
+        BOOST_CHECK_EQUAL(expected.size(), 5UL);
+        for (ihash_multimap::const_iterator i = expected.begin(); i != expected.end(); ++i) {
+            BOOST_REQUIRE(params.find(i->first) != params.end());
+            BOOST_CHECK_EQUAL(params.find(i->first)->second, i->second);
+        }
+        BOOST_CHECK_EQUAL(params.find("a")->second, "b c");
+        BOOST_CHECK_EQUAL(params.find("d")->second, "A x");
+        BOOST_CHECK_EQUAL(params.find("e")->second, "");
+        BOOST_CHECK_EQUAL(params.find("f")->second, "%4");
+        BOOST_CHECK_EQUAL(params.find("% ")->second, "%");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testUrlEncodedParserWithControlCharacter)
+{
+    ihash_multimap params;
+    http::url_encoded_parser query_parser(params);
+    BOOST_CHECK(query_parser.parse("a=1&b=", 6));
+    BOOST_CHECK(! query_parser.parse("\x01", 1));
+    BOOST_CHECK(query_parser.has_error());
+    BOOST_CHECK(! query_parser.finish());
+    BOOST_CHECK_EQUAL(params.size(), 1UL);
+}
+
 BOOST_AUTO_TEST_CASE(testParseMultipartFormData)
 {
     const std::string FORM_DATA("------WebKitFormBoundarynqrI4c1BfROrEpu7\r\n"
@@ -188,6 +239,151 @@ BOOST_AUTO_TEST_CASE(testParseMultipartFormData)
     BOOST_CHECK_EQUAL(i->second, "funky test!");
 }
 
+/// records the events of an http::multipart_parser
+class MultipartParserTests_F {
+public:
+    MultipartParserTests_F()
+        : m_form_data("preamble is ignored\r\n"
+                      "--AaB03x\r\n"
+                      "Content-Disposition: form-data; name=\"field1\"\r\n"
+                      "\r\n"
+                      "Joe Blow\r\n"
+                      "--AaB03x  \r\n"
+                      "Content-Disposition: form-data; filename=\"file1.bin\"; name=\"pics\"\r\n"
+                      "Content-Type: application/octet-stream\r\n"
+                      "\r\n"
+                      "\r\r\n\r\n-\r\n--AaB03\r\n--AaB03y\r\n--\r\n"
+                      "\r\n"
+                      "--AaB03x\r\n"
+                      "Content-Disposition: form-data; name=\"empty\"\r\n"
+                      "\r\n"
+                      "\r\n"
+                      "--AaB03x--\r\n"
+                      "epilogue is ignored"),
+          m_file_data("\r\r\n\r\n-\r\n--AaB03\r\n--AaB03y\r\n--\r\n"),
+          m_parser("AaB03x")
+    {
+        m_parser.set_part_begin_handler(boost::bind(&MultipartParserTests_F::begin, this, _1));
+        m_parser.set_part_data_handler(boost::bind(&MultipartParserTests_F::data, this, _1, _2, _3));
+        m_parser.set_part_end_handler(boost::bind(&MultipartParserTests_F::end, this, _1));
+    }
+
+    void begin(const http::multipart_parser::part_info& part) {
+        m_events += "begin(" + part.name + "," + part.filename + ")";
+        m_data.clear();
+    }
+    void data(const http::multipart_parser::part_info& part, const char *ptr, std::size_t len) {
+        m_data.append(ptr, len);
+    }
+    void end(const http::multipart_parser::part_info& part) {
+        m_events += "end(" + boost::lexical_cast<std::string>(part.size) + ")";
+        m_values.push_back(m_data);
+        m_files.push_back(part.file_path);
+    }
+
+    const std::string           m_form_data;
+    const std::string           m_file_data;
+    http::multipart_parser      m_parser;
+    std::string                 m_events;
+    std::string                 m_data;
+    std::vector<std::string>    m_values;
+    std::vector<std::string>    m_files;
+};
+
+BOOST_FIXTURE_TEST_SUITE(MultipartParserTests_S, MultipartParserTests_F)
+
+BOOST_AUTO_TEST_CASE(checkMultipartParserEvents) {
+    ihash_multimap fields;
+    m_parser.set_fields(fields);
+    BOOST_CHECK(m_parser.parse(m_form_data.c_str(), m_form_data.size()));
+    BOOST_CHECK(m_parser.is_finished());
+    BOOST_CHECK_EQUAL(m_events, "begin(field1,)end(8)begin(pics,file1.bin)end("
+        + boost::lexical_cast<std::string>(m_file_data.size()) + ")begin(empty,)end(0)");
+    BOOST_REQUIRE_EQUAL(m_values.size(), 3UL);
+    BOOST_CHECK_EQUAL(m_values[0], "Joe Blow");
+    BOOST_CHECK_EQUAL(m_values[1], m_file_data);
+    BOOST_CHECK_EQUAL(m_values[2], "");
+
+    // only text fields are collected
+    BOOST_CHECK_EQUAL(fields.size(), 2UL);
+    BOOST_CHECK_EQUAL(fields.find("field1")->second, "Joe Blow");
+    BOOST_CHECK(fields.find("empty") != fields.end());
+    BOOST_CHECK(fields.find("pics") == fields.end());
+}
+
+BOOST_AUTO_TEST_CASE(checkMultipartParserWithSmallBuffers) {
+    for (std::size_t piece_size = 1; piece_size < 20; ++piece_size) {
+        m_parser.reset();
+        m_events.clear();
+        m_values.clear();
+        boost::tribool rc = boost::indeterminate;
+        for (std::size_t pos = 0; pos < m_form_data.size(); pos += piece_size) {
+            BOOST_REQUIRE(! m_parser.has_error());
+            rc = m_parser.parse(m_form_data.c_str() + pos, std::min(piece_size, m_form_data.size() - pos));
+        }
+        BOOST_CHECK(rc);
+        BOOST_REQUIRE_EQUAL(m_values.size(), 3UL);
+        BOOST_CHECK_EQUAL(m_values[0], "Joe Blow");
+        BOOST_CHECK_EQUAL(m_values[1], m_file_data);
+        BOOST_CHECK_EQUAL(m_values[2], "");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkMultipartParserSpillsFilesToDisk) {
+    m_parser.set_spill_directory(".");
+    BOOST_CHECK(m_parser.parse(m_form_data.c_str(), m_form_data.size()));
+    BOOST_REQUIRE_EQUAL(m_files.size(), 3UL);
+    BOOST_CHECK(m_files[0].empty());
+    BOOST_CHECK(m_files[2].empty());
+    BOOST_REQUIRE(! m_files[1].empty());
+    // file data is not passed to the data handler
+    BOOST_CHECK_EQUAL(m_values[1], "");
+
+    std::ifstream spill_file(m_files[1].c_str(), std::ios::in | std::ios::binary);
+    std::ostringstream spilled_data;
+    spilled_data << spill_file.rdbuf();
+    spill_file.close();
+    BOOST_CHECK_EQUAL(spilled_data.str(), m_file_data);
+    boost::filesystem::remove(m_files[1]);
+}
+
+BOOST_AUTO_TEST_CASE(checkMultipartParserAsPayloadHandler) {
+    std::ostringstream request_str;
+    request_str << "POST /form HTTP/1.1\r\n"
+        "Content-Type: multipart/form-data; boundary=AaB03x\r\nTransfer-Encoding: chunked\r\n\r\n"
+        << std::hex << m_form_data.size() << "\r\n" << m_form_data << "\r\n0\r\n\r\n";
+    const std::string request_data(request_str.str());
+
+    http::parser request_parser(true);
+    http::parser::payload_handler_t payload_handler(boost::ref(m_parser));
+    request_parser.set_payload_handler(payload_handler);
+    request_parser.set_read_buffer(request_data.c_str(), request_data.size());
+    http::request http_request;
+    boost::system::error_code ec;
+    BOOST_CHECK(request_parser.parse(http_request, ec));
+    BOOST_CHECK(m_parser.is_finished());
+    BOOST_REQUIRE_EQUAL(m_values.size(), 3UL);
+    BOOST_CHECK_EQUAL(m_values[1], m_file_data);
+}
+
+BOOST_AUTO_TEST_CASE(checkMultipartParserInvalidContent) {
+    const std::string bad_data("--AaB03x\r\nContent-Disposition: form-data; name=\"a\"\r\n\r\nb\r\n--AaB03xyz");
+    BOOST_CHECK(! m_parser.parse(bad_data.c_str(), bad_data.size()));
+    BOOST_CHECK(m_parser.has_error());
+    BOOST_CHECK_EQUAL(m_events, "begin(a,)end(1)");
+}
+
+BOOST_AUTO_TEST_CASE(checkMultipartParserParseBoundary) {
+    std::string boundary;
+    BOOST_CHECK(http::multipart_parser::parse_boundary("multipart/form-data; boundary=AaB03x", boundary));
+    BOOST_CHECK_EQUAL(boundary, "AaB03x");
+    BOOST_CHECK(http::multipart_parser::parse_boundary("multipart/form-data; boundary=\"a b\"; charset=x", boundary));
+    BOOST_CHECK_EQUAL(boundary, "a b");
+    BOOST_CHECK(! http::multipart_parser::parse_boundary("multipart/form-data", boundary));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
 BOOST_AUTO_TEST_CASE(testParseSingleCookieHeader)
 {
     std::string cookie_header;
@@ -332,6 +528,37 @@ BOOST_AUTO_TEST_CASE(testHTTPParserSimpleResponse)
     BOOST_CHECK(boost::regex_match(http_response.get_content(), content_regex));
 }
 
+BOOST_AUTO_TEST_CASE(testHTTPParserSpecializedForMessageType)
+{
+    http::request_parser request_parser;
+    BOOST_CHECK(request_parser.is_parsing_request());
+    request_parser.set_read_buffer((const char*)request_data_1, sizeof(request_data_1));
+
+    http::request http_request;
+    boost::system::error_code ec;
+    BOOST_CHECK(request_parser.parse(http_request, ec));
+    BOOST_CHECK(!ec);
+    BOOST_CHECK_EQUAL(request_parser.get_total_bytes_read(), sizeof(request_data_1));
+    BOOST_CHECK_EQUAL(http_request.get_method(), "GET");
+
+    http::response_parser response_parser;
+    BOOST_CHECK(response_parser.is_parsing_response());
+    response_parser.set_read_buffer((const char*)response_data_1, sizeof(response_data_1));
+
+    http::response http_response;
+    BOOST_CHECK(response_parser.parse(http_response, ec));
+    BOOST_CHECK(!ec);
+    BOOST_CHECK_EQUAL(http_response.get_status_code(), 200U);
+    BOOST_CHECK_EQUAL(http_response.get_content_length(), 117UL);
+    BOOST_CHECK_EQUAL(response_parser.get_content_bytes_read(), 117UL);
+
+    // a response is not a valid request
+    request_parser.reset();
+    request_parser.set_read_buffer((const char*)response_data_1, sizeof(response_data_1));
+    http::request bad_request;
+    BOOST_CHECK(!request_parser.parse(bad_request, ec));
+}
+
 BOOST_AUTO_TEST_CASE(testHTTPParserBadRequest)
 {
     http::parser request_parser(true);
@@ -416,6 +643,386 @@ BOOST_AUTO_TEST_CASE(testHTTPParser_MultipleResponseFrames)
     BOOST_CHECK(boost::regex_match(http_response.get_content(), content_regex));
 }
 
+BOOST_AUTO_TEST_CASE(testHTTPParserChunkedRequest)
+{
+    // build a chunked request with chunks of various sizes, and the expected content
+    std::string request_str("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n");
+    std::string content;
+    const std::size_t chunk_sizes[] = { 1, 10, 4095, 4096, 4097, 20000, 3 };
+    for (std::size_t n = 0; n < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); ++n) {
+        const std::string chunk(chunk_sizes[n], static_cast<char>('a' + n));
+        std::ostringstream chunk_size;
+        chunk_size << std::hex << chunk_sizes[n];
+        request_str += chunk_size.str() + "\r\n" + chunk + "\r\n";
+        content += chunk;
+    }
+    request_str += "0\r\n\r\n";
+
+    // parse the whole request at once, and in pieces of various sizes
+    const std::size_t piece_sizes[] = { 1, 7, 1000, 4096, request_str.size() };
+    for (std::size_t n = 0; n < sizeof(piece_sizes) / sizeof(piece_sizes[0]); ++n) {
+        http::parser request_parser(true);
+        request_parser.set_max_content_length(content.size());
+        http::request http_request;
+        boost::system::error_code ec;
+        boost::tribool rc = boost::indeterminate;
+        for (std::size_t pos = 0; pos < request_str.size() && boost::indeterminate(rc); pos += piece_sizes[n]) {
+            request_parser.set_read_buffer(request_str.c_str() + pos,
+                std::min(piece_sizes[n], request_str.size() - pos));
+            rc = request_parser.parse(http_request, ec);
+        }
+        BOOST_REQUIRE(rc);
+        BOOST_CHECK(!ec);
+        BOOST_CHECK(http_request.is_chunked());
+        BOOST_CHECK(http_request.get_chunk_cache().empty());
+        BOOST_REQUIRE_EQUAL(http_request.get_content_length(), content.size());
+        BOOST_CHECK(memcmp(http_request.get_content(), content.c_str(), content.size()) == 0);
+        BOOST_CHECK_EQUAL(http_request.get_content()[content.size()], '\0');
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserChunkedRequestWithSmallerMaxSize)
+{
+    const std::string request_str("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "5\r\n01234\r\n5\r\n56789\r\n0\r\n\r\n");
+
+    http::parser request_parser(true);
+    request_parser.set_max_content_length(7);
+    request_parser.set_read_buffer(request_str.c_str(), request_str.size());
+    http::request http_request;
+    boost::system::error_code ec;
+    BOOST_CHECK(request_parser.parse(http_request, ec));
+    BOOST_CHECK(!ec);
+    BOOST_CHECK_EQUAL(http_request.get_content_length(), 7UL);
+    BOOST_CHECK_EQUAL(http_request.get_content(), "0123456");
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserChunkSizeDoesNotAllocateContent)
+{
+    // a large chunk size is announced, but only a few bytes of it arrive
+    const std::string request_str("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "fffff\r\nabc");
+
+    http::parser request_parser(true);
+    request_parser.set_read_buffer(request_str.c_str(), request_str.size());
+    http::request http_request;
+    boost::system::error_code ec;
+    BOOST_CHECK(boost::indeterminate(request_parser.parse(http_request, ec)));
+    BOOST_CHECK(!ec);
+    BOOST_CHECK_EQUAL(http_request.get_chunk_cache().size(), 3UL);
+    BOOST_CHECK(http_request.get_chunk_cache().capacity() <= static_cast<std::size_t>(http::message::chunk_cache_t::MIN_SEGMENT_SIZE));
+
+    // the size alone does not allocate memory either
+    const std::string header_str("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "fffff\r\n");
+    http::parser header_parser(true);
+    header_parser.set_read_buffer(header_str.c_str(), header_str.size());
+    http::request header_request;
+    BOOST_CHECK(boost::indeterminate(header_parser.parse(header_request, ec)));
+    BOOST_CHECK(!ec);
+    BOOST_CHECK_EQUAL(header_request.get_chunk_cache().capacity(), 0UL);
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserResponseWithNoContentLength)
+{
+    const std::string header_str("HTTP/1.1 200 OK\r\n\r\n");
+    std::string content;
+    for (std::size_t n = 0; n < 10000; ++n)
+        content += static_cast<char>('0' + (n % 10));
+
+    http::parser response_parser(false);
+    response_parser.set_read_buffer(header_str.c_str(), header_str.size());
+    http::response http_response;
+    boost::system::error_code ec;
+    BOOST_CHECK(boost::indeterminate(response_parser.parse(http_response, ec)));
+    for (std::size_t pos = 0; pos < content.size(); pos += 3000) {
+        response_parser.set_read_buffer(content.c_str() + pos, std::min<std::size_t>(3000, content.size() - pos));
+        BOOST_CHECK(boost::indeterminate(response_parser.parse(http_response, ec)));
+        BOOST_CHECK(!ec);
+    }
+    BOOST_CHECK(! response_parser.check_premature_eof(http_response));
+    BOOST_REQUIRE_EQUAL(http_response.get_content_length(), content.size());
+    BOOST_CHECK_EQUAL(http_response.get_content(), content);
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserSegmentedContent)
+{
+    const std::string content(2 * http::content_block_pool::BLOCK_SIZE + 10, 'z');
+    const std::string request_str("PUT /resource HTTP/1.1\r\nContent-Length: "
+        + boost::lexical_cast<std::string>(content.size()) + "\r\n\r\n" + content);
+
+    for (std::size_t piece_size = 1000; piece_size <= request_str.size(); piece_size *= 10) {
+        http::parser request_parser(true);
+        request_parser.set_segmented_content();
+        http::request http_request;
+        boost::system::error_code ec;
+        boost::tribool rc = boost::indeterminate;
+        for (std::size_t pos = 0; pos < request_str.size() && boost::indeterminate(rc); pos += piece_size) {
+            request_parser.set_read_buffer(request_str.c_str() + pos,
+                std::min(piece_size, request_str.size() - pos));
+            rc = request_parser.parse(http_request, ec);
+        }
+        BOOST_REQUIRE(rc);
+        BOOST_CHECK(!ec);
+        BOOST_CHECK_EQUAL(http_request.get_content_length(), content.size());
+        BOOST_REQUIRE(http_request.has_content_blocks());
+        BOOST_CHECK_EQUAL(http_request.get_content_blocks().get_num_blocks(), 3UL);
+        BOOST_CHECK_EQUAL(http_request.get_content_buffer_size(), 0UL);
+        BOOST_CHECK_EQUAL(http_request.get_content(), content);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserSegmentedChunkedContent)
+{
+    const std::string request_str("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+        "5\r\n01234\r\n5\r\n56789\r\n0\r\n\r\n");
+
+    http::parser request_parser(true);
+    request_parser.set_segmented_content();
+    request_parser.set_read_buffer(request_str.c_str(), request_str.size());
+    http::request http_request;
+    boost::system::error_code ec;
+    BOOST_CHECK(request_parser.parse(http_request, ec));
+    BOOST_CHECK(!ec);
+    BOOST_CHECK(http_request.get_chunk_cache().empty());
+    BOOST_CHECK(http_request.has_content_blocks());
+    BOOST_CHECK_EQUAL(http_request.get_content_length(), 10UL);
+    BOOST_CHECK_EQUAL(http_request.get_content(), "0123456789");
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserStreamFormData)
+{
+    const std::string content("name=Joe+Blow&comment=1%2B1%3D2&empty=&last=value");
+    const std::string request_str("POST /form HTTP/1.1\r\n"
+        "Content-Type: application/x-www-form-urlencoded; charset=UTF-8\r\n"
+        "Content-Length: " + boost::lexical_cast<std::string>(content.size()) + "\r\n\r\n" + content);
+
+    for (std::size_t piece_size = 1; piece_size <= request_str.size(); piece_size *= 3) {
+        http::parser request_parser(true);
+        request_parser.set_stream_form_data();
+        http::request http_request;
+        boost::system::error_code ec;
+        boost::tribool rc = boost::indeterminate;
+        for (std::size_t pos = 0; pos < request_str.size() && boost::indeterminate(rc); pos += piece_size) {
+            request_parser.set_read_buffer(request_str.c_str() + pos,
+                std::min(piece_size, request_str.size() - pos));
+            rc = request_parser.parse(http_request, ec);
+        }
+        BOOST_REQUIRE(rc);
+        BOOST_CHECK(!ec);
+
+        // the content is decoded but not stored
+        BOOST_CHECK_EQUAL(http_request.get_content_length(), 0UL);
+        BOOST_CHECK_EQUAL(request_parser.get_content_bytes_read(), content.size());
+        BOOST_CHECK_EQUAL(http_request.get_queries().size(), 4UL);
+        BOOST_CHECK_EQUAL(http_request.get_query("name"), "Joe Blow");
+        BOOST_CHECK_EQUAL(http_request.get_query("comment"), "1+1=2");
+        BOOST_CHECK(http_request.has_query("empty"));
+        BOOST_CHECK_EQUAL(http_request.get_query("last"), "value");
+    }
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserStreamChunkedFormData)
+{
+    const std::string request_str("POST /form HTTP/1.1\r\n"
+        "Content-Type: application/x-www-form-urlencoded\r\n"
+        "Transfer-Encoding: chunked\r\n\r\n"
+        "5\r\na=1%2\r\n6\r\n0&b=%7\r\n2\r\nE!\r\n0\r\n\r\n");
+
+    http::parser request_parser(true);
+    request_parser.set_stream_form_data();
+    request_parser.set_read_buffer(request_str.c_str(), request_str.size());
+    http::request http_request;
+    boost::system::error_code ec;
+    BOOST_CHECK(request_parser.parse(http_request, ec));
+    BOOST_CHECK(!ec);
+    BOOST_CHECK_EQUAL(http_request.get_content_length(), 0UL);
+    BOOST_CHECK_EQUAL(http_request.get_query("a"), "1 ");
+    BOOST_CHECK_EQUAL(http_request.get_query("b"), "~!");
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserLongHeaders)
+{
+    // header names and values long enough to cross several vector blocks,
+    // using characters that are not part of the fast character classes
+    const std::string header_name("X-Very-Long_Header!Name#With$Odd%Chars&'*+.^`|~-0123456789abcdefghijklmnopqrstuvwxyz");
+    std::string header_value("first value\twith tab ");
+    for (int n = 0; n < 20; ++n)
+        header_value += "0123456789 ABCDEF \x80\xff;,:=\"/?<>[]{}@\\ ";
+    const std::string request_str("GET /index.html HTTP/1.1\r\nHost: localhost\r\n"
+        + header_name + ": " + header_value + "\r\n"
+        + "Content-Length: 0\r\n\r\n");
+
+    // parse all at once
+    http::parser request_parser(true);
+    request_parser.set_save_raw_headers(true);
+    request_parser.set_read_buffer(request_str.c_str(), request_str.size());
+    http::request http_request;
+    boost::system::error_code ec;
+    BOOST_CHECK(request_parser.parse(http_request, ec));
+    BOOST_CHECK(!ec);
+    BOOST_CHECK_EQUAL(http_request.get_header(header_name), header_value);
+    BOOST_CHECK_EQUAL(http_request.get_header(http::types::HEADER_HOST), "localhost");
+    BOOST_CHECK_EQUAL(request_parser.get_raw_headers(), request_str);
+    BOOST_CHECK_EQUAL(request_parser.get_total_bytes_read(), request_str.size());
+
+    // parse one byte at a time
+    http::parser split_parser(true);
+    split_parser.set_save_raw_headers(true);
+    http::request split_request;
+    boost::tribool rc = boost::indeterminate;
+    for (std::size_t n = 0; n < request_str.size() && boost::indeterminate(rc); ++n) {
+        split_parser.set_read_buffer(request_str.c_str() + n, 1);
+        rc = split_parser.parse(split_request, ec);
+    }
+    BOOST_CHECK(rc);
+    BOOST_CHECK(!ec);
+    BOOST_CHECK_EQUAL(split_request.get_header(header_name), header_value);
+    BOOST_CHECK_EQUAL(split_parser.get_raw_headers(), request_str);
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserBadCharInLongHeaderValue)
+{
+    std::string request_str("GET / HTTP/1.1\r\nX-Value: ");
+    request_str += std::string(70, 'a');
+    request_str += '\x01';
+    request_str += "\r\n\r\n";
+
+    http::parser request_parser(true);
+    request_parser.set_read_buffer(request_str.c_str(), request_str.size());
+    http::request http_request;
+    boost::system::error_code ec;
+    BOOST_CHECK(!request_parser.parse(http_request, ec));
+    BOOST_CHECK_EQUAL(ec.value(), http::parser::ERROR_HEADER_CHAR);
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserBadCharInLongHeaderName)
+{
+    std::string request_str("GET / HTTP/1.1\r\nX-");
+    request_str += std::string(70, 'n');
+    request_str += "(name): value\r\n\r\n";
+
+    http::parser request_parser(true);
+    request_parser.set_read_buffer(request_str.c_str(), request_str.size());
+    http::request http_request;
+    boost::system::error_code ec;
+    BOOST_CHECK(!request_parser.parse(http_request, ec));
+    BOOST_CHECK_EQUAL(ec.value(), http::parser::ERROR_HEADER_CHAR);
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserHeaderNameTooLong)
+{
+    std::string request_str("GET / HTTP/1.1\r\nX-");
+    request_str += std::string(4096, 'n');
+    request_str += ": value\r\n\r\n";
+
+    http::parser request_parser(true);
+    request_parser.set_read_buffer(request_str.c_str(), request_str.size());
+    http::request http_request;
+    boost::system::error_code ec;
+    BOOST_CHECK(!request_parser.parse(http_request, ec));
+    BOOST_CHECK_EQUAL(ec.value(), http::parser::ERROR_HEADER_NAME_SIZE);
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserTokenViews)
+{
+    const std::string request_str("POST /resource/name?a=b&c=d HTTP/1.1\r\n"
+        "Host: localhost\r\nCookie: session=12345\r\nX-Empty:\r\nContent-Length: 4\r\n\r\nbody");
+
+    http::parser request_parser(true);
+    request_parser.set_token_views();
+    request_parser.set_read_buffer(request_str.c_str(), request_str.size());
+    http::request http_request;
+    boost::system::error_code ec;
+    BOOST_CHECK(request_parser.parse(http_request, ec));
+    BOOST_CHECK(!ec);
+
+    // tokens refer to the read buffer
+    const char *buffer_begin = request_str.c_str();
+    const char *buffer_end = buffer_begin + request_str.size();
+    BOOST_CHECK(http_request.get_method_view() == "POST");
+    BOOST_CHECK(http_request.get_method_view().data() == buffer_begin);
+    BOOST_CHECK(http_request.get_resource_view() == "/resource/name");
+    BOOST_CHECK(http_request.get_query_string_view() == "a=b&c=d");
+    BOOST_REQUIRE(http_request.has_header_views());
+    BOOST_CHECK_EQUAL(http_request.get_header_views().size(), 4UL);
+    const http::token_view host_view(http_request.get_header_view("host"));
+    BOOST_CHECK(host_view == "localhost");
+    BOOST_CHECK(host_view.data() > buffer_begin && host_view.data() < buffer_end);
+    BOOST_CHECK(http_request.has_header("X-Empty"));
+    BOOST_CHECK(http_request.get_header_view("X-Empty").empty());
+    BOOST_CHECK(! http_request.has_header("X-Missing"));
+
+    // query parameters, cookies and content are parsed as usual
+    BOOST_CHECK_EQUAL(http_request.get_query("a"), "b");
+    BOOST_CHECK_EQUAL(http_request.get_query("c"), "d");
+    BOOST_CHECK_EQUAL(http_request.get_cookie("session"), "12345");
+    BOOST_CHECK_EQUAL(http_request.get_content_length(), 4UL);
+    BOOST_CHECK_EQUAL(http_request.get_content(), "body");
+    BOOST_CHECK(http_request.has_header_views());
+
+    // const accessors read the views without changing the request
+    const http::request& const_request(http_request);
+    BOOST_CHECK_EQUAL(const_request.get_method(), "POST");
+    BOOST_CHECK_EQUAL(const_request.get_resource(), "/resource/name");
+    BOOST_CHECK_EQUAL(const_request.get_original_resource(), "/resource/name");
+    BOOST_CHECK_EQUAL(const_request.get_query_string(), "a=b&c=d");
+    BOOST_CHECK_EQUAL(const_request.get_header(http::types::HEADER_HOST), "localhost");
+    BOOST_CHECK_EQUAL(const_request.get_first_line(), "POST /resource/name?a=b&c=d HTTP/1.1");
+    http::request request_copy(const_request);
+    BOOST_CHECK_EQUAL(request_copy.get_header(http::types::HEADER_HOST), "localhost");
+    BOOST_CHECK(http_request.has_header_views());
+    BOOST_CHECK(http_request.get_method_view().data() == buffer_begin);
+
+    // string accessors copy the views
+    BOOST_CHECK_EQUAL(http_request.get_method(), "POST");
+    BOOST_CHECK_EQUAL(http_request.get_resource(), "/resource/name");
+    BOOST_CHECK_EQUAL(http_request.get_query_string(), "a=b&c=d");
+    BOOST_CHECK_EQUAL(http_request.get_header(http::types::HEADER_HOST), "localhost");
+    BOOST_CHECK(! http_request.has_header_views());
+    BOOST_CHECK_EQUAL(http_request.get_headers().size(), 4UL);
+    BOOST_CHECK(http_request.has_header("X-Empty"));
+}
+
+BOOST_AUTO_TEST_CASE(testHTTPParserTokenViewsWithReusedReadBuffer)
+{
+    const std::string request_str("GET /a/rather/long/resource/name?query=string HTTP/1.1\r\n"
+        "Host: localhost\r\nUser-Agent: pion unit tests (token views)\r\n"
+        "Cookie: first=1; second=2\r\nContent-Length: 10\r\n\r\n0123456789");
+
+    // feed the request in small pieces through a single read buffer that is
+    // overwritten each time, the same way as tcp::connection's read buffer
+    for (std::size_t piece_size = 1; piece_size <= 16; ++piece_size) {
+        http::parser request_parser(true);
+        request_parser.set_token_views();
+        http::request http_request;
+        boost::system::error_code ec;
+        boost::tribool rc = boost::indeterminate;
+        char read_buffer[16];
+        for (std::size_t n = 0; n < request_str.size() && boost::indeterminate(rc); n += piece_size) {
+            const std::size_t len = std::min(piece_size, request_str.size() - n);
+            memcpy(read_buffer, request_str.c_str() + n, len);
+            request_parser.set_read_buffer(read_buffer, len);
+            rc = request_parser.parse(http_request, ec);
+        }
+        memset(read_buffer, 'X', sizeof(read_buffer));
+        BOOST_REQUIRE(rc);
+        BOOST_CHECK(!ec);
+
+        BOOST_CHECK(http_request.get_method_view() == "GET");
+        BOOST_CHECK(http_request.get_resource_view() == "/a/rather/long/resource/name");
+        BOOST_CHECK(http_request.get_query_string_view() == "query=string");
+        BOOST_CHECK(http_request.get_header_view("User-Agent") == "pion unit tests (token views)");
+        BOOST_CHECK(http_request.get_header_view("Content-Length") == "10");
+        BOOST_CHECK_EQUAL(http_request.get_query("query"), "string");
+        BOOST_CHECK_EQUAL(http_request.get_cookie("second"), "2");
+        BOOST_CHECK_EQUAL(http_request.get_content(), "0123456789");
+        BOOST_CHECK_EQUAL(http_request.get_header(http::types::HEADER_HOST), "localhost");
+        BOOST_CHECK_EQUAL(http_request.get_first_line(),
+            "GET /a/rather/long/resource/name?query=string HTTP/1.1");
+    }
+}
+
 
 /// fixture used for testing http::parser's X-Fowarded-For header parsing
 class HTTPParserForwardedForTests_F
@@ -468,3 +1075,121 @@ BOOST_AUTO_TEST_CASE(checkParseForwardedForHeaderFirstNotPublic) {
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+
+BOOST_AUTO_TEST_CASE(testParseMissingDataUsesDummyContent)
+{
+    const char *request_head = "POST / HTTP/1.1\r\nContent-Length: 10\r\n\r\nabc";
+    http::request_parser request_parser;
+    http::request http_request;
+    boost::system::error_code ec;
+    request_parser.set_read_buffer(request_head, strlen(request_head));
+    BOOST_CHECK(boost::indeterminate(request_parser.parse(http_request, ec)));
+
+    BOOST_CHECK(boost::indeterminate(request_parser.parse_missing_data(http_request, 4, ec)));
+    request_parser.set_read_buffer("hij", 3);
+    BOOST_CHECK(request_parser.parse(http_request, ec) == true);
+    BOOST_CHECK_EQUAL(std::string(http_request.get_content(), http_request.get_content_length()),
+        "abcXXXXhij");
+    BOOST_CHECK(http_request.has_missing_packets());
+}
+
+static void addMissingBytes(std::size_t& total, std::size_t len) { total += len; }
+
+BOOST_AUTO_TEST_CASE(testParseMissingDataWithMissingDataHandler)
+{
+    const char *request_head = "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\na\r\nabc";
+    std::size_t missing_bytes = 0;
+    http::request_parser request_parser;
+    request_parser.set_missing_data_handler(boost::bind(addMissingBytes, boost::ref(missing_bytes), _1));
+    http::request http_request;
+    boost::system::error_code ec;
+    request_parser.set_read_buffer(request_head, strlen(request_head));
+    BOOST_CHECK(boost::indeterminate(request_parser.parse(http_request, ec)));
+
+    BOOST_CHECK(boost::indeterminate(request_parser.parse_missing_data(http_request, 4, ec)));
+    const char *request_tail = "hij\r\n0\r\n\r\n";
+    request_parser.set_read_buffer(request_tail, strlen(request_tail));
+    BOOST_CHECK(request_parser.parse(http_request, ec) == true);
+
+    // no dummy content is stored for the missing data
+    BOOST_CHECK_EQUAL(std::string(http_request.get_content(), http_request.get_content_length()),
+        "abchij");
+    BOOST_CHECK_EQUAL(missing_bytes, 4UL);
+}
+
+
+/// fixture used for testing http::flow_parser
+class HTTPFlowParserTests_F
+{
+public:
+    HTTPFlowParserTests_F(void)
+        : m_flow(boost::bind(&HTTPFlowParserTests_F::transaction, this, _1, _2), 64)
+    {
+        m_flow.client_syn(999);
+        m_flow.server_syn(4999);
+    }
+
+    void transaction(http::request_ptr& request_ptr, http::response_ptr& response_ptr) {
+        m_requests.push_back(request_ptr);
+        m_responses.push_back(response_ptr);
+    }
+
+    void client(boost::uint32_t seq, const char *str) { m_flow.client_segment(seq, str, strlen(str)); }
+
+    void server(boost::uint32_t seq, const char *str) { m_flow.server_segment(seq, str, strlen(str)); }
+
+    http::flow_parser                   m_flow;
+    std::vector<http::request_ptr>      m_requests;
+    std::vector<http::response_ptr>     m_responses;
+};
+
+BOOST_FIXTURE_TEST_SUITE(HTTPFlowParserTests_S, HTTPFlowParserTests_F)
+
+BOOST_AUTO_TEST_CASE(checkPipelinedTransactions) {
+    client(1000, "GET /a HTTP/1.1\r\n\r\nGET /b HTTP/1.1\r\n\r\n");
+    server(5000, "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\nA");
+    server(5039, "HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\nB");
+    BOOST_REQUIRE_EQUAL(m_requests.size(), 2UL);
+    BOOST_CHECK_EQUAL(m_requests[0]->get_resource(), "/a");
+    BOOST_CHECK_EQUAL(m_responses[0]->get_content(), "A");
+    BOOST_CHECK_EQUAL(m_requests[1]->get_resource(), "/b");
+    BOOST_CHECK_EQUAL(m_responses[1]->get_content(), "B");
+}
+
+BOOST_AUTO_TEST_CASE(checkResponseSegmentsOutOfOrderWithGap) {
+    client(1000, "GET / HTTP/1.1\r\n\r\n");
+    server(5040, "cdef");
+    server(5000, "HTTP/1.1 200 OK\r\nContent-Length: 8\r\n\r\nab");
+    BOOST_CHECK_EQUAL(m_requests.size(), 0UL);
+
+    // the last two bytes of content were never captured
+    m_flow.close();
+    BOOST_REQUIRE_EQUAL(m_requests.size(), 1UL);
+    BOOST_REQUIRE(m_responses[0]);
+    BOOST_CHECK_EQUAL(m_responses[0]->get_status_code(), 200U);
+    BOOST_CHECK_EQUAL(m_responses[0]->get_content(), "abcdef");
+    BOOST_CHECK_EQUAL(m_responses[0]->get_status(), http::message::STATUS_TRUNCATED);
+}
+
+BOOST_AUTO_TEST_CASE(checkGapInContentIsNotFilled) {
+    client(1000, "GET / HTTP/1.1\r\n\r\n");
+    server(5000, "HTTP/1.1 200 OK\r\n\r\nab");
+    server(5117, "yz");
+    m_flow.close();
+    BOOST_REQUIRE_EQUAL(m_responses.size(), 1UL);
+    BOOST_REQUIRE(m_responses[0]);
+    BOOST_CHECK_EQUAL(m_responses[0]->get_content(), "abyz");
+    BOOST_CHECK_EQUAL(m_flow.get_missing_content_bytes(), 96UL);
+    BOOST_CHECK_EQUAL(m_flow.get_server_stream().get_gap_bytes(), 96UL);
+}
+
+BOOST_AUTO_TEST_CASE(checkRequestWithoutResponse) {
+    client(1000, "GET / HTTP/1.1\r\n\r\n");
+    m_flow.close();
+    BOOST_REQUIRE_EQUAL(m_requests.size(), 1UL);
+    BOOST_CHECK(m_requests[0]);
+    BOOST_CHECK(! m_responses[0]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
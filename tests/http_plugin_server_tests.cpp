@@ -7,6 +7,7 @@
 // See http://www.boost.org/LICENSE_1_0.txt
 //
 
+#include <iomanip>
 #include <pion/config.hpp>
 #include <boost/asio.hpp>
 #include <boost/shared_ptr.hpp>
@@ -423,6 +424,88 @@ BOOST_AUTO_TEST_CASE(checkSendRequestAndReceiveResponseFromEchoService) {
     BOOST_CHECK(boost::regex_match(http_response.get_content(), post_content));
 }
 
+BOOST_AUTO_TEST_CASE(checkSendFormattedContentToEchoService) {
+    m_server.load_service("/echo", "EchoService");
+    m_server.start();
+
+    // open a connection
+    tcp::connection_ptr tcp_conn(new pion::tcp::connection(get_io_service()));
+    tcp_conn->set_lifecycle(pion::tcp::connection::LIFECYCLE_KEEPALIVE);
+    boost::system::error_code error_code;
+    error_code = tcp_conn->connect(boost::asio::ip::address::from_string("127.0.0.1"), m_server.get_port());
+    BOOST_REQUIRE(!error_code);
+
+    pion::http::request_writer_ptr writer(pion::http::request_writer::create(tcp_conn));
+    writer->get_request().set_method("POST");
+    writer->get_request().set_resource("/echo");
+
+    // mix numbers, text, binary data larger than one arena block, and stream manipulators
+    const std::string big_text(20000, 'x');
+    writer << "a" << 1 << -2 << 3.5 << ' ' << 'c' << (unsigned short)65535 << -1234567890123LL;
+    writer->write(big_text.data(), big_text.size());
+    writer << std::setw(4) << 7 << std::hex << 255 << std::dec << 255;
+    writer->send();
+
+    // receive the response from the server
+    http::response http_response(writer->get_request());
+    http_response.receive(*tcp_conn, error_code);
+    BOOST_CHECK(!error_code);
+    BOOST_CHECK(http_response.get_status_code() == 200);
+
+    const std::string expected_content("a1-23.5 c65535-1234567890123" + big_text + "   7ff255");
+    const std::string response_content(http_response.get_content(), http_response.get_content_length());
+    BOOST_CHECK(response_content.find("Content length: "
+        + boost::lexical_cast<std::string>(expected_content.size())) != std::string::npos);
+    BOOST_CHECK(response_content.find("[POST Content]\r\n\r\n" + expected_content + "\r\n")
+        != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(checkSendRequestsOverConnectionWithRecycledObjects) {
+    m_server.set_recycle_objects();
+    m_server.load_service("/hello", "HelloService");
+    m_server.load_service("/echo", "EchoService");
+    m_server.start();
+
+    // open a connection
+    tcp::connection_ptr tcp_conn(new pion::tcp::connection(get_io_service()));
+    tcp_conn->set_lifecycle(pion::tcp::connection::LIFECYCLE_KEEPALIVE);
+    boost::system::error_code error_code;
+    error_code = tcp_conn->connect(boost::asio::ip::address::from_string("127.0.0.1"), m_server.get_port());
+    BOOST_REQUIRE(!error_code);
+
+    // nothing from one request or response may be left in the next
+    const boost::regex hello_content(".*Hello World.*");
+    for (unsigned int n = 0; n < 4; ++n) {
+        const std::string post_content(n % 2 ? "junk" : "more junk");
+        pion::http::request_writer_ptr writer(pion::http::request_writer::create(tcp_conn));
+        writer->get_request().set_method("POST");
+        writer->get_request().set_resource("/echo");
+        if (n == 0)
+            writer->get_request().add_header("X-First-Request", "yes");
+        writer << post_content;
+        writer->send();
+
+        http::response echo_response(writer->get_request());
+        echo_response.receive(*tcp_conn, error_code);
+        BOOST_REQUIRE(!error_code);
+        BOOST_CHECK_EQUAL(echo_response.get_status_code(), 200U);
+        const std::string echo_content(echo_response.get_content(), echo_response.get_content_length());
+        BOOST_CHECK(echo_content.find("[POST Content]\r\n\r\n" + post_content + "\r\n") != std::string::npos);
+        BOOST_CHECK_EQUAL(echo_content.find("X-First-Request") != std::string::npos, n == 0);
+
+        writer = pion::http::request_writer::create(tcp_conn);
+        writer->get_request().set_resource(n % 2 ? "/hello" : "/doesnotexist");
+        writer->send();
+
+        http::response http_response(writer->get_request());
+        http_response.receive(*tcp_conn, error_code);
+        BOOST_REQUIRE(!error_code);
+        BOOST_CHECK_EQUAL(http_response.get_status_code(), n % 2 ? 200U : 404U);
+        BOOST_CHECK_EQUAL(boost::regex_match(http_response.get_content(), hello_content), n % 2 == 1);
+        BOOST_CHECK(http_response.has_header(http::types::HEADER_DATE));
+    }
+}
+
 BOOST_AUTO_TEST_CASE(checkRedirectHelloServiceToEchoService) {
     m_server.load_service("/hello", "HelloService");
     m_server.load_service("/echo", "EchoService");
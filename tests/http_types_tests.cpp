@@ -68,4 +68,37 @@ BOOST_AUTO_TEST_CASE(testMultipleHeaderValues) {
     BOOST_CHECK(it == h.end());
 }
 
+BOOST_AUTO_TEST_CASE(testGetDateString) {
+    BOOST_CHECK_EQUAL(http::types::get_date_string(0), "Thu, 01 Jan 1970 00:00:00 GMT");
+    BOOST_CHECK_EQUAL(http::types::get_date_string(784111777), "Sun, 06 Nov 1994 08:49:37 GMT");
+    BOOST_CHECK_EQUAL(http::types::get_date_string(951782400), "Tue, 29 Feb 2000 00:00:00 GMT");
+    BOOST_CHECK_EQUAL(http::types::get_date_string(1234567890), "Fri, 13 Feb 2009 23:31:30 GMT");
+    // the same time again (cached)
+    BOOST_CHECK_EQUAL(http::types::get_date_string(1234567890), "Fri, 13 Feb 2009 23:31:30 GMT");
+}
+
+BOOST_AUTO_TEST_CASE(testGetCurrentDateString) {
+    const time_t before = time(NULL);
+    const std::string date_string(http::types::get_current_date_string());
+    const time_t after = time(NULL);
+    const time_t t = http::types::parse_date_string(date_string);
+    BOOST_CHECK(t >= before && t <= after);
+    BOOST_CHECK_EQUAL(http::types::get_date_string(t), date_string);
+}
+
+BOOST_AUTO_TEST_CASE(testParseDateString) {
+    // RFC 1123, RFC 850 and asctime() formats
+    BOOST_CHECK_EQUAL(http::types::parse_date_string("Sun, 06 Nov 1994 08:49:37 GMT"), 784111777);
+    BOOST_CHECK_EQUAL(http::types::parse_date_string("Sunday, 06-Nov-94 08:49:37 GMT"), 784111777);
+    BOOST_CHECK_EQUAL(http::types::parse_date_string("Sun Nov  6 08:49:37 1994"), 784111777);
+    BOOST_CHECK_EQUAL(http::types::parse_date_string("Tue, 29 Feb 2000 00:00:00 GMT"), 951782400);
+    // the same string again (cached)
+    BOOST_CHECK_EQUAL(http::types::parse_date_string("Tue, 29 Feb 2000 00:00:00 GMT"), 951782400);
+
+    BOOST_CHECK_EQUAL(http::types::parse_date_string(""), static_cast<time_t>(-1));
+    BOOST_CHECK_EQUAL(http::types::parse_date_string("yesterday"), static_cast<time_t>(-1));
+    BOOST_CHECK_EQUAL(http::types::parse_date_string("Sun, 06 Foo 1994 08:49:37 GMT"), static_cast<time_t>(-1));
+    BOOST_CHECK_EQUAL(http::types::parse_date_string("Sun, 06 Nov 1994 25:49:37 GMT"), static_cast<time_t>(-1));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
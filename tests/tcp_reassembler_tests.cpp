@@ -0,0 +1,114 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <string>
+#include <cstring>
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <pion/config.hpp>
+#include <pion/tcp/reassembler.hpp>
+#include <boost/test/unit_test.hpp>
+
+using namespace pion;
+
+
+///
+/// ReassemblerTests_F: fixture that records the data and gaps passed on by a reassembler
+///
+class ReassemblerTests_F {
+public:
+    ReassemblerTests_F()
+        : m_stream(16)
+    {
+        m_stream.set_data_handler(boost::bind(&ReassemblerTests_F::data, this, _1, _2));
+        m_stream.set_gap_handler(boost::bind(&ReassemblerTests_F::gap, this, _1));
+    }
+
+    void data(const char *ptr, std::size_t len) { m_output.append(ptr, len); }
+
+    void gap(std::size_t len) { m_output += "<gap " + boost::lexical_cast<std::string>(len) + ">"; }
+
+    void push(boost::uint32_t seq, const char *str) { m_stream.push(seq, str, strlen(str)); }
+
+    tcp::reassembler    m_stream;
+    std::string         m_output;
+};
+
+BOOST_FIXTURE_TEST_SUITE(ReassemblerTests_S, ReassemblerTests_F)
+
+BOOST_AUTO_TEST_CASE(checkSegmentsInOrder) {
+    m_stream.start(999);
+    push(1000, "GET ");
+    push(1004, "/ HTTP/1.1");
+    BOOST_CHECK_EQUAL(m_output, "GET / HTTP/1.1");
+    BOOST_CHECK_EQUAL(m_stream.get_next_seq(), 1014U);
+    BOOST_CHECK_EQUAL(m_stream.get_buffered_bytes(), 0UL);
+}
+
+BOOST_AUTO_TEST_CASE(checkSegmentsOutOfOrder) {
+    m_stream.start(999);
+    push(1008, "ijkl");
+    push(1004, "efgh");
+    BOOST_CHECK_EQUAL(m_output, "");
+    BOOST_CHECK_EQUAL(m_stream.get_buffered_bytes(), 8UL);
+    push(1000, "abcd");
+    BOOST_CHECK_EQUAL(m_output, "abcdefghijkl");
+    BOOST_CHECK_EQUAL(m_stream.get_buffered_bytes(), 0UL);
+    BOOST_CHECK_EQUAL(m_stream.get_gap_bytes(), 0UL);
+}
+
+BOOST_AUTO_TEST_CASE(checkDuplicateAndOverlappingSegments) {
+    m_stream.start(999);
+    push(1000, "abcd");
+    push(1000, "abcd");
+    push(1002, "cdef");
+    push(1008, "ij");
+    push(1008, "ij");
+    push(1005, "fgh");
+    BOOST_CHECK_EQUAL(m_output, "abcdefghij");
+    BOOST_CHECK_EQUAL(m_stream.get_duplicate_bytes(), 9UL);
+}
+
+BOOST_AUTO_TEST_CASE(checkGapIsReportedWhenFlushed) {
+    m_stream.start(999);
+    push(1000, "abcd");
+    push(1010, "klm");
+    m_stream.flush();
+    BOOST_CHECK_EQUAL(m_output, "abcd<gap 6>klm");
+    BOOST_CHECK_EQUAL(m_stream.get_gap_bytes(), 6UL);
+    BOOST_CHECK_EQUAL(m_stream.get_next_seq(), 1013U);
+}
+
+BOOST_AUTO_TEST_CASE(checkGapIsReportedWhenHoldingTooMuch) {
+    m_stream.start(999);
+    push(1010, "0123456789");
+    push(1020, "0123456789");
+    BOOST_CHECK_EQUAL(m_output, "<gap 10>01234567890123456789");
+    BOOST_CHECK_EQUAL(m_stream.get_buffered_bytes(), 0UL);
+
+    // late data for the gap is ignored
+    push(1000, "abcd");
+    BOOST_CHECK_EQUAL(m_output, "<gap 10>01234567890123456789");
+}
+
+BOOST_AUTO_TEST_CASE(checkStreamStartsWithFirstSegmentWithoutSyn) {
+    push(5000, "abc");
+    push(5003, "def");
+    BOOST_CHECK_EQUAL(m_output, "abcdef");
+}
+
+BOOST_AUTO_TEST_CASE(checkSequenceNumbersWrapAround) {
+    m_stream.start(0xFFFFFFFD);
+    push(0x00000002, "efgh");
+    push(0xFFFFFFFE, "abcd");
+    BOOST_CHECK_EQUAL(m_output, "abcdefgh");
+    BOOST_CHECK_EQUAL(m_stream.get_next_seq(), 6U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
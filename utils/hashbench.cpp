@@ -0,0 +1,136 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <locale>
+#include <cstdlib>
+#include <boost/algorithm/string.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <pion/hash_map.hpp>
+#include <pion/flat_hash_map.hpp>
+
+using namespace pion;
+
+
+/// the locale-based equality predicate that ihash_multimap used to use
+struct locale_iequal_to
+    : std::binary_function<std::string, std::string, bool>
+{
+    bool operator()(std::string const& x, std::string const& y) const {
+        return boost::algorithm::iequals(x, y, std::locale());
+    }
+};
+
+/// the locale-based hash function that ihash_multimap used to use
+struct locale_ihash
+    : std::unary_function<std::string, std::size_t>
+{
+    std::size_t operator()(std::string const& x) const {
+        std::size_t seed = 0;
+        std::locale locale;
+        for (std::string::const_iterator it = x.begin(); it != x.end(); ++it)
+            boost::hash_combine(seed, std::toupper(*it, locale));
+        return seed;
+    }
+};
+
+/// ihash_multimap, as it was before it used ASCII case folding
+typedef PION_HASH_MULTIMAP<std::string, std::string, locale_ihash, locale_iequal_to>  locale_ihash_multimap;
+
+
+/// headers of a typical browser request
+static const char *REQUEST_HEADERS[][2] = {
+    { "Host", "www.example.com" },
+    { "Connection", "keep-alive" },
+    { "Cache-Control", "max-age=0" },
+    { "Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8" },
+    { "User-Agent", "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)" },
+    { "Referer", "http://www.example.com/index.html" },
+    { "Accept-Encoding", "gzip,deflate,sdch" },
+    { "Accept-Language", "en-US,en;q=0.8" },
+    { "Accept-Charset", "ISO-8859-1,utf-8;q=0.7,*;q=0.3" },
+    { "Cookie", "session=0123456789abcdef" },
+    { "Cookie", "theme=dark" },
+    { "If-Modified-Since", "Tue, 15 Nov 1994 12:45:26 GMT" }
+};
+
+/// headers that the server looks up for each request (in any case)
+static const char *LOOKUP_HEADERS[] = {
+    "Content-Length", "Transfer-Encoding", "connection", "Content-Type", "COOKIE", "host"
+};
+
+
+/// builds a dictionary of request headers, looks up common headers and clears it
+template <typename DictionaryType>
+double run_benchmark(DictionaryType& dict, const std::vector<std::pair<std::string, std::string> >& headers,
+                     const std::vector<std::string>& lookups, unsigned long iterations,
+                     std::size_t& found)
+{
+    const boost::posix_time::ptime start(boost::posix_time::microsec_clock::universal_time());
+    for (unsigned long n = 0; n < iterations; ++n) {
+        for (std::size_t i = 0; i < headers.size(); ++i)
+            dict.insert(std::make_pair(headers[i].first, headers[i].second));
+        for (std::size_t i = 0; i < lookups.size(); ++i) {
+            if (dict.find(lookups[i]) != dict.end())
+                ++found;
+        }
+        found += dict.count("cookie");
+        dict.clear();
+    }
+    const boost::posix_time::time_duration elapsed(boost::posix_time::microsec_clock::universal_time() - start);
+    return static_cast<double>(elapsed.total_microseconds()) * 1000.0 / iterations;
+}
+
+
+/// main control function
+int main (int argc, char *argv[])
+{
+    static const unsigned long DEFAULT_ITERATIONS = 200000;
+
+    // parse command line: determine number of iterations
+    unsigned long iterations = DEFAULT_ITERATIONS;
+    if (argc == 2) {
+        iterations = strtoul(argv[1], 0, 10);
+        if (iterations == 0) iterations = DEFAULT_ITERATIONS;
+    } else if (argc != 1) {
+        std::cerr << "usage: hashbench [iterations]" << std::endl;
+        return 1;
+    }
+
+    std::vector<std::pair<std::string, std::string> > headers;
+    for (std::size_t i = 0; i < sizeof(REQUEST_HEADERS) / sizeof(REQUEST_HEADERS[0]); ++i)
+        headers.push_back(std::make_pair(std::string(REQUEST_HEADERS[i][0]), std::string(REQUEST_HEADERS[i][1])));
+    std::vector<std::string> lookups(LOOKUP_HEADERS, LOOKUP_HEADERS + sizeof(LOOKUP_HEADERS) / sizeof(LOOKUP_HEADERS[0]));
+
+    // each dictionary is reused, like the dictionaries of a recycled message
+    locale_ihash_multimap locale_dict;
+    ihash_multimap ascii_dict;
+    flat_ihash_multimap flat_dict;
+    std::size_t found[3] = { 0, 0, 0 };
+    const double locale_ns = run_benchmark(locale_dict, headers, lookups, iterations, found[0]);
+    const double ascii_ns = run_benchmark(ascii_dict, headers, lookups, iterations, found[1]);
+    const double flat_ns = run_benchmark(flat_dict, headers, lookups, iterations, found[2]);
+    if (found[0] != found[1] || found[0] != found[2]) {
+        std::cerr << "error: dictionaries found different headers" << std::endl;
+        return 1;
+    }
+
+    std::cout << "ns per request (" << headers.size() << " inserts, "
+        << (lookups.size() + 1) << " lookups, clear; " << iterations << " iterations)" << std::endl
+        << std::fixed << std::setprecision(1)
+        << "  ihash_multimap (locale hash):  " << std::setw(8) << locale_ns << std::endl
+        << "  ihash_multimap (ASCII hash):   " << std::setw(8) << ascii_ns << std::endl
+        << "  flat_ihash_multimap:           " << std::setw(8) << flat_ns << std::endl;
+
+    return 0;
+}
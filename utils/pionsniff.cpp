@@ -0,0 +1,1397 @@
+// ---------------------------------------------------------------------
+// pion:  a Boost C++ framework for building lightweight HTTP interfaces
+// ---------------------------------------------------------------------
+// Copyright (C) 2007-2012 Cloudmeter, Inc.  (http://www.cloudmeter.com)
+//
+// Distributed under the Boost Software License, Version 1.0.
+// See http://www.boost.org/LICENSE_1_0.txt
+//
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/asio/ip/address.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <pion/algorithm.hpp>
+#include <pion/hash_map.hpp>
+#include <pion/logger.hpp>
+#include <pion/tcp/reassembler.hpp>
+#include <pion/http/flow_parser.hpp>
+#include <pion/spdy/parser.hpp>
+#include <pion/spdy/decompressor.hpp>
+
+using namespace pion;
+
+
+/// options that control the analyzer
+struct analyzer_options {
+    analyzer_options(void)
+        : num_threads(1), max_buffered(tcp::reassembler::DEFAULT_MAX_BUFFERED),
+        idle_timeout(120 * 1000000ULL), quiet(false)
+    {}
+
+    /// number of worker threads (flows are sharded across them)
+    unsigned int        num_threads;
+
+    /// maximum number of bytes held for out-of-order segments, per direction
+    std::size_t         max_buffered;
+
+    /// flows without packets for this long (capture time, in microseconds) are closed
+    boost::uint64_t     idle_timeout;
+
+    /// if true, per-transaction records are not written
+    bool                quiet;
+};
+
+
+///
+/// flow_key: identifies a TCP connection.  The endpoints are stored in a
+/// canonical order, so that both directions of a connection have the same key.
+///
+struct flow_key {
+    flow_key(void) { memset(this, 0, sizeof(flow_key)); }
+
+    inline bool operator==(const flow_key& k) const { return memcmp(this, &k, sizeof(flow_key)) == 0; }
+
+    /// IPv4 addresses use the first four bytes
+    boost::uint8_t      addr[2][16];
+    boost::uint16_t     port[2];
+    boost::uint8_t      ipv6;
+    boost::uint8_t      unused[3];
+};
+
+/// hashes a flow key, a word at a time
+inline std::size_t hash_value(const flow_key& k)
+{
+    boost::uint32_t words[sizeof(flow_key) / 4];
+    memcpy(words, &k, sizeof(words));
+    std::size_t seed = 0;
+    for (std::size_t n = 0; n < sizeof(words) / sizeof(words[0]); ++n)
+        boost::hash_combine(seed, words[n]);
+    return seed;
+}
+
+/// returns one of a flow's endpoints as a string (i.e. "10.0.0.1:80")
+std::string format_endpoint(const flow_key& k, int n)
+{
+    std::ostringstream out;
+    if (k.ipv6) {
+        boost::asio::ip::address_v6::bytes_type bytes;
+        memcpy(&bytes[0], k.addr[n], 16);
+        out << '[' << boost::asio::ip::address_v6(bytes).to_string() << "]:" << k.port[n];
+    } else {
+        boost::asio::ip::address_v4::bytes_type bytes;
+        memcpy(&bytes[0], k.addr[n], 4);
+        out << boost::asio::ip::address_v4(bytes).to_string() << ':' << k.port[n];
+    }
+    return out.str();
+}
+
+
+/// TCP header flags
+enum {
+    TCP_FIN = 0x01, TCP_SYN = 0x02, TCP_RST = 0x04, TCP_ACK = 0x10
+};
+
+/// a TCP segment that has been decoded and queued for a worker
+struct segment_t {
+    flow_key            key;
+    boost::uint64_t     timestamp;  // microseconds
+    boost::uint32_t     seq;
+    boost::uint32_t     len;
+    std::size_t         offset;     // of the payload, in the batch's data
+    boost::uint8_t      flags;
+    bool                from_first; // sent by the first endpoint of the key
+};
+
+/// segments that are passed to a worker together (with a copy of their payloads)
+struct batch_t {
+    batch_t(void) : first_timestamp(0) {}
+
+    inline void clear(void) {
+        segments.clear();
+        data.clear();
+        first_timestamp = 0;
+    }
+
+    std::vector<segment_t>  segments;
+    std::vector<char>       data;
+    boost::uint64_t         first_timestamp;
+};
+
+
+///
+/// capture_reader: reads packets from a pcap or pcapng capture
+///
+class capture_reader
+    : private boost::noncopyable
+{
+public:
+
+    /// a packet read from the capture (valid until the next packet is read)
+    struct packet_t {
+        boost::uint32_t     link_type;
+        boost::uint64_t     timestamp;  // microseconds
+        const char *        ptr;
+        std::size_t         len;
+    };
+
+    /// creates a new capture reader for a stream
+    explicit capture_reader(std::istream& in)
+        : m_in(in), m_buf(READ_BUFFER_SIZE), m_pos(0), m_end(0),
+        m_pcapng(false), m_swap(false), m_nanoseconds(false), m_link_type(0)
+    {}
+
+    /**
+     * reads the header of the capture
+     *
+     * @return true if it is a pcap or pcapng capture
+     */
+    bool open(void) {
+        if (! fill(24))
+            return false;
+        const boost::uint32_t magic = get_le32(0);
+        if (magic == 0x0A0D0D0A) {
+            m_pcapng = true;
+            return true;
+        }
+        if (magic == 0xA1B2C3D4 || magic == 0xA1B23C4D) {
+            m_swap = false;
+        } else if (magic == 0xD4C3B2A1 || magic == 0x4D3CB2A1) {
+            m_swap = true;
+        } else {
+            return false;
+        }
+        m_nanoseconds = (magic == 0xA1B23C4D || magic == 0x4D3CB2A1);
+        m_link_type = get32(20);
+        m_pos += 24;
+        return true;
+    }
+
+    /**
+     * reads the next packet
+     *
+     * @return false if there are no more packets
+     */
+    bool next(packet_t& pkt) {
+        return (m_pcapng ? next_pcapng(pkt) : next_pcap(pkt));
+    }
+
+private:
+
+    /// size of the buffer used for reading
+    static const std::size_t    READ_BUFFER_SIZE = 1024 * 1024;
+
+    /// maximum size of a packet record (anything larger is treated as corrupt)
+    static const std::size_t    MAX_RECORD_SIZE = 64 * 1024 * 1024;
+
+    /// reads a classic pcap packet record
+    bool next_pcap(packet_t& pkt) {
+        if (! fill(16))
+            return false;
+        const boost::uint32_t ts_sec = get32(0);
+        const boost::uint32_t ts_frac = get32(4);
+        const boost::uint32_t caplen = get32(8);
+        if (caplen > MAX_RECORD_SIZE || ! fill(16 + caplen))
+            return false;
+        pkt.link_type = m_link_type;
+        pkt.timestamp = ts_sec * 1000000ULL + (m_nanoseconds ? ts_frac / 1000 : ts_frac);
+        pkt.ptr = &m_buf[m_pos + 16];
+        pkt.len = caplen;
+        m_pos += 16 + caplen;
+        return true;
+    }
+
+    /// reads pcapng blocks up to the next packet block
+    bool next_pcapng(packet_t& pkt) {
+        for (;;) {
+            if (! fill(12))
+                return false;
+            const boost::uint32_t block_type = get_le32(0);
+            if (block_type == 0x0A0D0D0A) {
+                // section header block: determines the byte order of the section
+                const boost::uint32_t magic = get_le32(8);
+                if (magic == 0x1A2B3C4D)
+                    m_swap = false;
+                else if (magic == 0x4D3C2B1A)
+                    m_swap = true;
+                else
+                    return false;
+                m_interfaces.clear();
+            }
+            const boost::uint32_t block_len = get32(4);
+            if (block_len < 12 || (block_len % 4) != 0 || block_len > MAX_RECORD_SIZE
+                || ! fill(block_len))
+            {
+                return false;
+            }
+            const std::size_t block_pos = m_pos;
+            m_pos += block_len;
+
+            switch (get32At(block_pos, 0)) {
+            case 1:     // interface description block
+                if (block_len >= 20)
+                    add_interface(block_pos, block_len);
+                break;
+            case 6:     // enhanced packet block
+                if (block_len >= 32) {
+                    const boost::uint32_t if_id = get32At(block_pos, 8);
+                    const boost::uint64_t ticks = (static_cast<boost::uint64_t>(get32At(block_pos, 12)) << 32)
+                        | get32At(block_pos, 16);
+                    const boost::uint32_t caplen = get32At(block_pos, 20);
+                    if (caplen > block_len - 32 || if_id >= m_interfaces.size())
+                        break;
+                    const boost::uint64_t tps = m_interfaces[if_id].second;
+                    pkt.link_type = m_interfaces[if_id].first;
+                    pkt.timestamp = ticks / tps * 1000000ULL + (ticks % tps) * 1000000ULL / tps;
+                    pkt.ptr = &m_buf[block_pos + 28];
+                    pkt.len = caplen;
+                    return true;
+                }
+                break;
+            case 3:     // simple packet block
+                if (block_len >= 16 && ! m_interfaces.empty()) {
+                    pkt.link_type = m_interfaces[0].first;
+                    pkt.timestamp = 0;
+                    pkt.ptr = &m_buf[block_pos + 12];
+                    pkt.len = std::min<std::size_t>(get32At(block_pos, 8), block_len - 16);
+                    return true;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    /// adds an interface (link type and timestamp resolution) from its description block
+    void add_interface(std::size_t block_pos, boost::uint32_t block_len) {
+        boost::uint64_t ticks_per_second = 1000000;
+        // look for the if_tsresol option
+        std::size_t opt = block_pos + 16;
+        const std::size_t opt_end = block_pos + block_len - 4;
+        while (opt + 4 <= opt_end) {
+            const boost::uint16_t code = get16At(opt, 0);
+            const boost::uint16_t len = get16At(opt, 2);
+            if (code == 0 || opt + 4 + len > opt_end)
+                break;
+            if (code == 9 && len == 1) {
+                const boost::uint8_t resolution = static_cast<boost::uint8_t>(m_buf[opt + 4]);
+                const unsigned int exponent = (resolution & 0x7F);
+                if (exponent < 20) {
+                    ticks_per_second = 1;
+                    for (unsigned int n = 0; n < exponent; ++n)
+                        ticks_per_second *= ((resolution & 0x80) ? 2 : 10);
+                }
+            }
+            opt += 4 + ((len + 3) & ~3);
+        }
+        m_interfaces.push_back(std::make_pair(static_cast<boost::uint32_t>(get16At(block_pos, 8)),
+            ticks_per_second));
+    }
+
+    /// makes sure that at least n bytes are available in the buffer (returns false at EOF)
+    bool fill(std::size_t n) {
+        if (m_end - m_pos >= n)
+            return true;
+        // move the bytes that are left to the front of the buffer
+        if (m_pos > 0) {
+            memmove(&m_buf[0], &m_buf[m_pos], m_end - m_pos);
+            m_end -= m_pos;
+            m_pos = 0;
+        }
+        if (n > m_buf.size())
+            m_buf.resize(n);
+        while (m_end < n && m_in) {
+            m_in.read(&m_buf[m_end], m_buf.size() - m_end);
+            m_end += static_cast<std::size_t>(m_in.gcount());
+        }
+        return (m_end >= n);
+    }
+
+    inline boost::uint16_t get16At(std::size_t pos, std::size_t offset) const {
+        const unsigned char *p = reinterpret_cast<const unsigned char*>(&m_buf[pos + offset]);
+        return (m_swap ? algorithm::to_uint16(p[0], p[1]) : algorithm::to_uint16(p[1], p[0]));
+    }
+
+    inline boost::uint32_t get32At(std::size_t pos, std::size_t offset) const {
+        const unsigned char *p = reinterpret_cast<const unsigned char*>(&m_buf[pos + offset]);
+        return (m_swap ? algorithm::to_uint32(p[0], p[1], p[2], p[3])
+            : algorithm::to_uint32(p[3], p[2], p[1], p[0]));
+    }
+
+    inline boost::uint32_t get32(std::size_t offset) const { return get32At(m_pos, offset); }
+
+    inline boost::uint32_t get_le32(std::size_t offset) const {
+        const unsigned char *p = reinterpret_cast<const unsigned char*>(&m_buf[m_pos + offset]);
+        return algorithm::to_uint32(p[3], p[2], p[1], p[0]);
+    }
+
+
+    std::istream&       m_in;
+    std::vector<char>   m_buf;
+    std::size_t         m_pos;
+    std::size_t         m_end;
+    bool                m_pcapng;
+    bool                m_swap;
+    bool                m_nanoseconds;
+    boost::uint32_t     m_link_type;
+
+    /// link type and timestamp ticks per second of each pcapng interface
+    std::vector<std::pair<boost::uint32_t, boost::uint64_t> >   m_interfaces;
+};
+
+
+/**
+ * decodes the link, IP and TCP headers of a packet
+ *
+ * @param pkt the packet to decode
+ * @param seg will be set to the segment's flow key, sequence number and flags
+ * @param payload will point to the segment's payload
+ *
+ * @return true if the packet is a TCP segment
+ */
+bool decode_packet(const capture_reader::packet_t& pkt, segment_t& seg, const char *& payload)
+{
+    const unsigned char *ptr = reinterpret_cast<const unsigned char*>(pkt.ptr);
+    const unsigned char *end = ptr + pkt.len;
+    boost::uint16_t ether_type = 0;
+
+    // link layer
+    switch (pkt.link_type) {
+    case 1:     // Ethernet
+        if (end - ptr < 14) return false;
+        ether_type = algorithm::to_uint16(ptr + 12);
+        ptr += 14;
+        while ((ether_type == 0x8100 || ether_type == 0x88A8) && end - ptr >= 4) {
+            ether_type = algorithm::to_uint16(ptr + 2);
+            ptr += 4;
+        }
+        break;
+    case 113:   // Linux cooked capture
+        if (end - ptr < 16) return false;
+        ether_type = algorithm::to_uint16(ptr + 14);
+        ptr += 16;
+        break;
+    case 276:   // Linux cooked capture v2
+        if (end - ptr < 20) return false;
+        ether_type = algorithm::to_uint16(ptr);
+        ptr += 20;
+        break;
+    case 0:     // BSD loopback
+    case 108:
+        if (end - ptr < 4) return false;
+        ptr += 4;
+        // fall through
+    case 12:    // raw IP
+    case 14:
+    case 101:
+        if (ptr == end) return false;
+        ether_type = ((*ptr >> 4) == 6 ? 0x86DD : 0x0800);
+        break;
+    case 228:   // raw IPv4
+        ether_type = 0x0800;
+        break;
+    case 229:   // raw IPv6
+        ether_type = 0x86DD;
+        break;
+    default:
+        return false;
+    }
+
+    // network layer
+    boost::uint8_t protocol = 0;
+    if (ether_type == 0x0800) {
+        if (end - ptr < 20 || (*ptr >> 4) != 4) return false;
+        const std::size_t header_len = (*ptr & 0x0F) * 4;
+        const std::size_t total_len = algorithm::to_uint16(ptr + 2);
+        if (header_len < 20 || total_len < header_len || static_cast<std::size_t>(end - ptr) < header_len)
+            return false;
+        // ignore fragments (other than the first)
+        if ((algorithm::to_uint16(ptr + 6) & 0x1FFF) != 0)
+            return false;
+        protocol = ptr[9];
+        memcpy(seg.key.addr[0], ptr + 12, 4);
+        memcpy(seg.key.addr[1], ptr + 16, 4);
+        // Ethernet frames may be padded
+        if (static_cast<std::size_t>(end - ptr) > total_len)
+            end = ptr + total_len;
+        ptr += header_len;
+    } else if (ether_type == 0x86DD) {
+        if (end - ptr < 40 || (*ptr >> 4) != 6) return false;
+        const std::size_t payload_len = algorithm::to_uint16(ptr + 4);
+        protocol = ptr[6];
+        seg.key.ipv6 = 1;
+        memcpy(seg.key.addr[0], ptr + 8, 16);
+        memcpy(seg.key.addr[1], ptr + 24, 16);
+        ptr += 40;
+        if (payload_len != 0 && static_cast<std::size_t>(end - ptr) > payload_len)
+            end = ptr + payload_len;
+        // skip extension headers
+        for (;;) {
+            if (protocol == 0 || protocol == 43 || protocol == 60) {
+                if (end - ptr < 8) return false;
+                protocol = ptr[0];
+                ptr += (ptr[1] + 1) * 8;
+            } else if (protocol == 51) {
+                if (end - ptr < 8) return false;
+                protocol = ptr[0];
+                ptr += (ptr[1] + 2) * 4;
+            } else if (protocol == 44) {
+                // ignore fragments (other than a complete "atomic" fragment)
+                if (end - ptr < 8 || (algorithm::to_uint16(ptr + 2) & 0xFFF9) != 0) return false;
+                protocol = ptr[0];
+                ptr += 8;
+            } else {
+                break;
+            }
+            if (ptr > end) return false;
+        }
+    } else {
+        return false;
+    }
+
+    // transport layer
+    if (protocol != 6 || end - ptr < 20)
+        return false;
+    const std::size_t header_len = (ptr[12] >> 4) * 4;
+    if (header_len < 20 || static_cast<std::size_t>(end - ptr) < header_len)
+        return false;
+    seg.key.port[0] = algorithm::to_uint16(ptr);
+    seg.key.port[1] = algorithm::to_uint16(ptr + 2);
+    seg.seq = algorithm::to_uint32(ptr + 4);
+    seg.flags = ptr[13];
+    seg.timestamp = pkt.timestamp;
+    payload = reinterpret_cast<const char*>(ptr + header_len);
+    seg.len = static_cast<boost::uint32_t>(end - (ptr + header_len));
+
+    // put the endpoints in canonical order
+    const std::size_t addr_len = (seg.key.ipv6 ? 16 : 4);
+    const int cmp = memcmp(seg.key.addr[0], seg.key.addr[1], addr_len);
+    seg.from_first = (cmp < 0 || (cmp == 0 && seg.key.port[0] <= seg.key.port[1]));
+    if (! seg.from_first) {
+        boost::uint8_t addr[16];
+        memcpy(addr, seg.key.addr[0], 16);
+        memcpy(seg.key.addr[0], seg.key.addr[1], 16);
+        memcpy(seg.key.addr[1], addr, 16);
+        std::swap(seg.key.port[0], seg.key.port[1]);
+    }
+    return true;
+}
+
+
+/// statistics collected by a worker
+struct worker_stats {
+    worker_stats(void)
+        : segments(0), payload_bytes(0), flows(0), http_transactions(0),
+        spdy_transactions(0), gap_bytes(0), resyncs(0), busy_usec(0)
+    {}
+
+    inline void add(const worker_stats& s) {
+        segments += s.segments;
+        payload_bytes += s.payload_bytes;
+        flows += s.flows;
+        http_transactions += s.http_transactions;
+        spdy_transactions += s.spdy_transactions;
+        gap_bytes += s.gap_bytes;
+        resyncs += s.resyncs;
+        busy_usec += s.busy_usec;
+    }
+
+    inline boost::uint64_t transactions(void) const { return http_transactions + spdy_transactions; }
+
+    boost::uint64_t     segments;
+    boost::uint64_t     payload_bytes;
+    boost::uint64_t     flows;
+    boost::uint64_t     http_transactions;
+    boost::uint64_t     spdy_transactions;
+    boost::uint64_t     gap_bytes;
+    boost::uint64_t     resyncs;
+    boost::uint64_t     busy_usec;
+};
+
+
+class worker;
+
+///
+/// flow: a TCP connection being analyzed.  The protocol (HTTP or SPDY) is
+/// determined by the first payload byte that is seen.
+///
+class flow
+    : private boost::noncopyable
+{
+public:
+
+    /// creates a new flow, starting with its first segment
+    flow(worker& w, const flow_key& key, const segment_t& seg, const analyzer_options& opts);
+
+    /// processes a segment of the flow
+    void process(const segment_t& seg, const char *payload);
+
+    /// reports the transactions that are left and releases the flow's parsers
+    void close(void);
+
+    /// returns true if the connection has been closed by both sides (or reset)
+    inline bool is_finished(void) const { return m_reset || (m_fin[0] && m_fin[1]); }
+
+    /// returns the capture time of the last segment (in microseconds)
+    inline boost::uint64_t get_last_seen(void) const { return m_last_seen; }
+
+private:
+
+    /// the protocol used by the flow
+    enum protocol_t { PROTOCOL_UNKNOWN, PROTOCOL_HTTP, PROTOCOL_SPDY };
+
+    /// a SPDY stream, from its SYN_STREAM until its response is finished
+    struct spdy_stream_t {
+        spdy_stream_t(void) : content_length(0), has_reply(false) {}
+        std::string         method;
+        std::string         resource;
+        std::string         status;
+        boost::uint64_t     content_length;
+        bool                has_reply;
+    };
+
+    /// state of a SPDY session
+    struct spdy_session_t {
+        spdy_session_t(std::size_t max_buffered)
+            : client_stream(max_buffered), server_stream(max_buffered),
+            decompressor(new spdy::decompressor), broken(false)
+        {}
+        tcp::reassembler                                client_stream;
+        tcp::reassembler                                server_stream;
+        spdy::parser                                    parser;
+        spdy::decompressor_ptr                          decompressor;
+        std::string                                     partial_frame[2];   // server, client
+        std::map<boost::uint32_t, spdy_stream_t>        streams;
+        bool                                            broken;
+    };
+
+    /// starts parsing the flow as HTTP or SPDY
+    void start(bool spdy);
+
+    /// called for each HTTP transaction
+    void http_transaction(http::request_ptr& request, http::response_ptr& response);
+
+    /// consumes SPDY data sent by the client or by the server
+    void consume_spdy_data(bool from_client, const char *ptr, std::size_t len);
+
+    /// a SPDY session cannot recover from missing data (compressed headers)
+    void consume_spdy_gap(std::size_t len);
+
+    /// parses a complete SPDY frame
+    void parse_spdy_frame(bool from_client, const char *ptr, std::size_t len);
+
+    /// reports a SPDY stream's transaction
+    void finish_spdy_stream(boost::uint32_t stream_id, const char *flags);
+
+
+    worker&                             m_worker;
+    const flow_key                      m_key;
+    const analyzer_options&             m_options;
+    protocol_t                          m_protocol;
+    bool                                m_client_first;  // client is the key's first endpoint
+    bool                                m_syn_seen[2];   // server, client
+    boost::uint32_t                     m_isn[2];        // server, client
+    bool                                m_fin[2];
+    bool                                m_reset;
+    boost::uint64_t                     m_last_seen;
+    boost::scoped_ptr<http::flow_parser>    m_http;
+    boost::scoped_ptr<spdy_session_t>       m_spdy;
+};
+
+typedef boost::shared_ptr<flow>     flow_ptr;
+
+
+///
+/// worker: analyzes the flows that are hashed to it, in its own thread
+///
+class worker
+    : private boost::noncopyable
+{
+public:
+
+    /// creates a new worker
+    worker(unsigned int id, const analyzer_options& opts, boost::mutex& output_mutex)
+        : m_id(id), m_options(opts), m_output_mutex(output_mutex), m_finished(false),
+        m_now(0), m_last_expired(0)
+    {}
+
+    ~worker() {
+        for (std::size_t n = 0; n < m_free.size(); ++n)
+            delete m_free[n];
+    }
+
+    /// starts the worker's thread
+    inline void start(void) {
+        m_thread.reset(new boost::thread(boost::bind(&worker::run, this)));
+    }
+
+    /// returns an empty batch for the worker
+    batch_t *get_batch(void) {
+        boost::mutex::scoped_lock lock(m_mutex);
+        if (m_free.empty())
+            return new batch_t;
+        batch_t *batch_ptr = m_free.back();
+        m_free.pop_back();
+        return batch_ptr;
+    }
+
+    /// queues a batch for the worker (waits while the worker is too far behind)
+    void push(batch_t *batch_ptr) {
+        boost::mutex::scoped_lock lock(m_mutex);
+        while (m_queue.size() >= MAX_QUEUED_BATCHES)
+            m_cond.wait(lock);
+        m_queue.push_back(batch_ptr);
+        m_cond.notify_all();
+    }
+
+    /// tells the worker that there are no more batches, and waits for it to finish
+    void finish(void) {
+        {
+            boost::mutex::scoped_lock lock(m_mutex);
+            m_finished = true;
+            m_cond.notify_all();
+        }
+        if (m_thread)
+            m_thread->join();
+    }
+
+    /// writes a transaction record
+    void add_transaction(const flow_key& key, bool client_first, const char *protocol,
+        const std::string& method, const std::string& resource, const std::string& status,
+        const std::string& content_length, const char *flags)
+    {
+        if (m_options.quiet)
+            return;
+        m_output << (m_now / 1000000) << '.' << std::setw(6) << std::setfill('0') << (m_now % 1000000)
+            << '\t' << format_endpoint(key, client_first ? 0 : 1)
+            << '\t' << format_endpoint(key, client_first ? 1 : 0)
+            << '\t' << protocol
+            << '\t' << (method.empty() ? "-" : method)
+            << '\t' << (resource.empty() ? "-" : resource)
+            << '\t' << (status.empty() ? "-" : status)
+            << '\t' << (content_length.empty() ? "-" : content_length)
+            << '\t' << flags << '\n';
+    }
+
+    /// returns the worker's statistics (only after it has finished)
+    inline worker_stats& get_stats(void) { return m_stats; }
+
+    /// returns the worker's number
+    inline unsigned int get_id(void) const { return m_id; }
+
+private:
+
+    /// maximum number of batches waiting for the worker
+    static const std::size_t    MAX_QUEUED_BATCHES = 8;
+
+    /// how often idle flows are expired (capture time, in microseconds)
+    static const boost::uint64_t    EXPIRE_INTERVAL = 10 * 1000000ULL;
+
+    /// table of flows that are being analyzed
+    typedef PION_HASH_MAP<flow_key, flow_ptr, boost::hash<flow_key> >  flow_map_t;
+
+    /// the worker's thread function
+    void run(void) {
+        for (;;) {
+            batch_t *batch_ptr = NULL;
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                while (m_queue.empty() && ! m_finished)
+                    m_cond.wait(lock);
+                if (m_queue.empty())
+                    break;
+                batch_ptr = m_queue.front();
+                m_queue.pop_front();
+                m_cond.notify_all();
+            }
+            const boost::posix_time::ptime start(boost::posix_time::microsec_clock::universal_time());
+            process(*batch_ptr);
+            m_stats.busy_usec += (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds();
+            batch_ptr->clear();
+            {
+                boost::mutex::scoped_lock lock(m_mutex);
+                m_free.push_back(batch_ptr);
+            }
+            flush_output();
+        }
+
+        // the capture has ended: close all flows
+        const boost::posix_time::ptime start(boost::posix_time::microsec_clock::universal_time());
+        for (flow_map_t::iterator i = m_flows.begin(); i != m_flows.end(); ++i)
+            i->second->close();
+        m_flows.clear();
+        m_stats.busy_usec += (boost::posix_time::microsec_clock::universal_time() - start).total_microseconds();
+        flush_output();
+    }
+
+    /// processes the segments in a batch
+    void process(const batch_t& batch) {
+        for (std::size_t n = 0; n < batch.segments.size(); ++n) {
+            const segment_t& seg = batch.segments[n];
+            if (seg.timestamp > m_now)
+                m_now = seg.timestamp;
+            ++m_stats.segments;
+            m_stats.payload_bytes += seg.len;
+
+            flow_map_t::iterator i = m_flows.find(seg.key);
+            if (i == m_flows.end()) {
+                // don't start flows with segments that end a connection
+                if (seg.flags & (TCP_FIN | TCP_RST))
+                    continue;
+                i = m_flows.insert(std::make_pair(seg.key,
+                    flow_ptr(new flow(*this, seg.key, seg, m_options)))).first;
+                ++m_stats.flows;
+            }
+            i->second->process(seg, seg.len ? &batch.data[seg.offset] : NULL);
+            if (i->second->is_finished()) {
+                i->second->close();
+                m_flows.erase(i);
+            }
+        }
+        if (m_now - m_last_expired >= EXPIRE_INTERVAL) {
+            expire_flows();
+            m_last_expired = m_now;
+        }
+    }
+
+    /// closes flows that have been idle for too long
+    void expire_flows(void) {
+        flow_map_t::iterator i = m_flows.begin();
+        while (i != m_flows.end()) {
+            if (m_now - i->second->get_last_seen() >= m_options.idle_timeout) {
+                i->second->close();
+                m_flows.erase(i++);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    /// writes the records of the transactions that were found
+    void flush_output(void) {
+        const std::string records(m_output.str());
+        if (! records.empty()) {
+            boost::mutex::scoped_lock lock(m_output_mutex);
+            std::cout << records << std::flush;
+        }
+        m_output.str(std::string());
+    }
+
+
+    friend class flow;
+
+    const unsigned int                  m_id;
+    const analyzer_options&             m_options;
+    boost::mutex&                       m_output_mutex;
+    boost::scoped_ptr<boost::thread>    m_thread;
+    boost::mutex                        m_mutex;
+    boost::condition                    m_cond;
+    std::deque<batch_t*>                m_queue;
+    std::vector<batch_t*>               m_free;
+    bool                                m_finished;
+    flow_map_t                          m_flows;
+    std::ostringstream                  m_output;
+    worker_stats                        m_stats;
+    boost::uint64_t                     m_now;
+    boost::uint64_t                     m_last_expired;
+};
+
+
+// flow member functions
+
+flow::flow(worker& w, const flow_key& key, const segment_t& seg, const analyzer_options& opts)
+    : m_worker(w), m_key(key), m_options(opts), m_protocol(PROTOCOL_UNKNOWN),
+    m_reset(false), m_last_seen(seg.timestamp)
+{
+    // the client sends the SYN; without one, guess that the server has the lower port
+    if (seg.flags & TCP_SYN)
+        m_client_first = ((seg.flags & TCP_ACK) ? ! seg.from_first : seg.from_first);
+    else if (key.port[0] != key.port[1])
+        m_client_first = (key.port[0] > key.port[1]);
+    else
+        m_client_first = seg.from_first;
+    m_syn_seen[0] = m_syn_seen[1] = false;
+    m_fin[0] = m_fin[1] = false;
+    m_isn[0] = m_isn[1] = 0;
+}
+
+void flow::process(const segment_t& seg, const char *payload)
+{
+    const bool from_client = (seg.from_first == m_client_first);
+    m_last_seen = seg.timestamp;
+
+    if (seg.flags & TCP_SYN) {
+        m_syn_seen[from_client] = true;
+        m_isn[from_client] = seg.seq;
+        if (m_protocol == PROTOCOL_HTTP) {
+            if (from_client) m_http->client_syn(seg.seq);
+            else m_http->server_syn(seg.seq);
+        }
+    }
+
+    if (seg.len != 0) {
+        if (m_protocol == PROTOCOL_UNKNOWN) {
+            // SPDY sessions start with a control frame
+            start(static_cast<unsigned char>(payload[0]) == 0x80);
+        }
+        if (m_protocol == PROTOCOL_HTTP) {
+            if (from_client) m_http->client_segment(seg.seq, payload, seg.len);
+            else m_http->server_segment(seg.seq, payload, seg.len);
+        } else if (! m_spdy->broken) {
+            if (from_client) m_spdy->client_stream.push(seg.seq, payload, seg.len);
+            else m_spdy->server_stream.push(seg.seq, payload, seg.len);
+        }
+    }
+
+    if (seg.flags & TCP_FIN)
+        m_fin[from_client] = true;
+    if (seg.flags & TCP_RST)
+        m_reset = true;
+}
+
+void flow::start(bool spdy)
+{
+    if (spdy) {
+        m_protocol = PROTOCOL_SPDY;
+        m_spdy.reset(new spdy_session_t(m_options.max_buffered));
+        m_spdy->client_stream.set_data_handler(boost::bind(&flow::consume_spdy_data, this, true, _1, _2));
+        m_spdy->client_stream.set_gap_handler(boost::bind(&flow::consume_spdy_gap, this, _1));
+        m_spdy->server_stream.set_data_handler(boost::bind(&flow::consume_spdy_data, this, false, _1, _2));
+        m_spdy->server_stream.set_gap_handler(boost::bind(&flow::consume_spdy_gap, this, _1));
+        if (m_syn_seen[1]) m_spdy->client_stream.start(m_isn[1]);
+        if (m_syn_seen[0]) m_spdy->server_stream.start(m_isn[0]);
+    } else {
+        m_protocol = PROTOCOL_HTTP;
+        m_http.reset(new http::flow_parser(boost::bind(&flow::http_transaction, this, _1, _2),
+            m_options.max_buffered));
+        // content is not needed: only count it
+        m_http->set_max_content_length(0);
+        if (m_syn_seen[1]) m_http->client_syn(m_isn[1]);
+        if (m_syn_seen[0]) m_http->server_syn(m_isn[0]);
+    }
+}
+
+void flow::close(void)
+{
+    worker_stats& stats = m_worker.m_stats;
+    if (m_http) {
+        m_http->close();
+        stats.gap_bytes += m_http->get_client_stream().get_gap_bytes()
+            + m_http->get_server_stream().get_gap_bytes();
+        stats.resyncs += m_http->get_resync_count();
+        m_http.reset();
+    } else if (m_spdy) {
+        m_spdy->client_stream.flush();
+        m_spdy->server_stream.flush();
+        while (! m_spdy->streams.empty())
+            finish_spdy_stream(m_spdy->streams.begin()->first, "closed");
+        stats.gap_bytes += m_spdy->client_stream.get_gap_bytes()
+            + m_spdy->server_stream.get_gap_bytes();
+        m_spdy.reset();
+    }
+}
+
+void flow::http_transaction(http::request_ptr& request, http::response_ptr& response)
+{
+    ++m_worker.m_stats.http_transactions;
+    if (m_options.quiet)
+        return;
+
+    const char *flags = "-";
+    if (! request)
+        flags = "no-request";
+    else if (! response)
+        flags = "no-response";
+    else if (request->has_missing_packets() || response->has_missing_packets())
+        flags = "missing";
+    else if (response->get_status() == http::message::STATUS_TRUNCATED)
+        flags = "truncated";
+
+    // content is not stored, so the length is the one declared by the response
+    const std::string no_value;
+    const std::string status(response ? boost::lexical_cast<std::string>(response->get_status_code()) : no_value);
+    m_worker.add_transaction(m_key, m_client_first, "HTTP",
+        request ? request->get_method() : no_value,
+        request ? request->get_resource() : no_value,
+        status, response ? response->get_header(http::types::HEADER_CONTENT_LENGTH) : no_value, flags);
+}
+
+void flow::consume_spdy_data(bool from_client, const char *ptr, std::size_t len)
+{
+    std::string& partial_frame = m_spdy->partial_frame[from_client];
+
+    // complete a frame that was started by an earlier segment
+    if (! partial_frame.empty()) {
+        std::size_t needed = 8;
+        if (partial_frame.size() >= 8)
+            needed += (algorithm::to_uint32(partial_frame.data() + 4) & 0xFFFFFF);
+        if (partial_frame.size() < 8) {
+            const std::size_t n = std::min(len, 8 - partial_frame.size());
+            partial_frame.append(ptr, n);
+            ptr += n;
+            len -= n;
+            if (partial_frame.size() < 8)
+                return;
+            needed += (algorithm::to_uint32(partial_frame.data() + 4) & 0xFFFFFF);
+        }
+        const std::size_t n = std::min(len, needed - partial_frame.size());
+        partial_frame.append(ptr, n);
+        ptr += n;
+        len -= n;
+        if (partial_frame.size() < needed)
+            return;
+        parse_spdy_frame(from_client, partial_frame.data(), partial_frame.size());
+        partial_frame.clear();
+    }
+
+    // parse complete frames without copying them
+    while (len >= 8 && ! m_spdy->broken) {
+        const std::size_t frame_len = 8 + (algorithm::to_uint32(ptr + 4) & 0xFFFFFF);
+        if (len < frame_len)
+            break;
+        parse_spdy_frame(from_client, ptr, frame_len);
+        ptr += frame_len;
+        len -= frame_len;
+    }
+    if (! m_spdy->broken)
+        partial_frame.assign(ptr, len);
+}
+
+void flow::consume_spdy_gap(std::size_t len)
+{
+    m_spdy->broken = true;
+    m_spdy->partial_frame[0].clear();
+    m_spdy->partial_frame[1].clear();
+    ++m_worker.m_stats.resyncs;
+}
+
+void flow::parse_spdy_frame(bool from_client, const char *ptr, std::size_t len)
+{
+    spdy::http_protocol_info info;
+    boost::system::error_code ec;
+    boost::uint32_t length_packet = static_cast<boost::uint32_t>(len);
+
+    if (spdy::parser::get_spdy_frame_type(ptr) == spdy::spdy_control_frame) {
+        // only frames with headers are parsed (they share the decompressor's state)
+        const boost::uint16_t type = algorithm::to_uint16(ptr + 2);
+        if (type != SPDY_SYN_STREAM && type != SPDY_SYN_REPLY && type != SPDY_HEADERS)
+            return;
+    } else if ((algorithm::to_uint32(ptr) & 0x7FFFFFFF) == 0) {
+        return;
+    }
+
+    if (m_spdy->parser.parse(info, ec, m_spdy->decompressor, ptr, length_packet,
+        static_cast<boost::uint32_t>(m_spdy->streams.size())) == false)
+    {
+        // the decompressor cannot recover from an error
+        m_spdy->broken = true;
+        ++m_worker.m_stats.resyncs;
+        return;
+    }
+
+    const bool fin = ((static_cast<unsigned char>(ptr[4]) & SPDY_FLAG_FIN) != 0);
+    std::map<std::string, std::string>::const_iterator i;
+    switch (info.http_type) {
+    case HTTP_REQUEST: {
+        spdy_stream_t& stream = m_spdy->streams[info.stream_id];
+        // SPDY/2 and SPDY/3 header names
+        if ((i = info.http_headers.find("method")) != info.http_headers.end()
+            || (i = info.http_headers.find(":method")) != info.http_headers.end())
+            stream.method = i->second;
+        if ((i = info.http_headers.find("url")) != info.http_headers.end()
+            || (i = info.http_headers.find(":path")) != info.http_headers.end())
+            stream.resource = i->second;
+        break;
+    }
+    case HTTP_RESPONSE: {
+        spdy_stream_t& stream = m_spdy->streams[info.stream_id];
+        stream.has_reply = true;
+        if ((i = info.http_headers.find("status")) != info.http_headers.end()
+            || (i = info.http_headers.find(":status")) != info.http_headers.end())
+            stream.status = i->second.substr(0, i->second.find(' '));
+        if (fin)
+            finish_spdy_stream(info.stream_id, "-");
+        break;
+    }
+    case HTTP_DATA:
+        if (! from_client) {
+            std::map<boost::uint32_t, spdy_stream_t>::iterator s = m_spdy->streams.find(info.stream_id);
+            if (s != m_spdy->streams.end()) {
+                s->second.content_length += info.data_size;
+                if (info.last_chunk)
+                    finish_spdy_stream(info.stream_id, "-");
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+void flow::finish_spdy_stream(boost::uint32_t stream_id, const char *flags)
+{
+    std::map<boost::uint32_t, spdy_stream_t>::iterator i = m_spdy->streams.find(stream_id);
+    if (i == m_spdy->streams.end())
+        return;
+    ++m_worker.m_stats.spdy_transactions;
+    m_worker.add_transaction(m_key, m_client_first, "SPDY", i->second.method, i->second.resource,
+        i->second.status, boost::lexical_cast<std::string>(i->second.content_length),
+        i->second.has_reply ? flags : "no-response");
+    m_spdy->streams.erase(i);
+}
+
+
+///
+/// analyzer: reads a capture and distributes its TCP segments to the
+/// workers, by hashing the segments' flows
+///
+class analyzer
+    : private boost::noncopyable
+{
+public:
+
+    /// creates a new analyzer and starts its workers
+    explicit analyzer(const analyzer_options& opts)
+        : m_options(opts), m_packets(0)
+    {
+        for (unsigned int n = 0; n < opts.num_threads; ++n) {
+            m_workers.push_back(boost::shared_ptr<worker>(new worker(n, opts, m_output_mutex)));
+            m_batches.push_back(m_workers.back()->get_batch());
+            m_workers.back()->start();
+        }
+    }
+
+    /**
+     * analyzes a capture, and waits for the workers to finish
+     *
+     * @return false if the capture is not a pcap or pcapng capture
+     */
+    bool run(std::istream& in) {
+        capture_reader reader(in);
+        if (! reader.open()) {
+            finish();
+            return false;
+        }
+        capture_reader::packet_t pkt;
+        segment_t seg;
+        const char *payload;
+        while (reader.next(pkt)) {
+            ++m_packets;
+            seg.key = flow_key();
+            if (! decode_packet(pkt, seg, payload))
+                continue;
+            const std::size_t n = hash_value(seg.key) % m_workers.size();
+            batch_t& batch = *m_batches[n];
+            if (batch.segments.empty())
+                batch.first_timestamp = seg.timestamp;
+            seg.offset = batch.data.size();
+            batch.data.insert(batch.data.end(), payload, payload + seg.len);
+            batch.segments.push_back(seg);
+            // pass on full batches, and batches that have waited long (live captures)
+            if (batch.segments.size() >= MAX_BATCH_SEGMENTS || batch.data.size() >= MAX_BATCH_BYTES
+                || seg.timestamp - batch.first_timestamp >= MAX_BATCH_USEC)
+            {
+                m_workers[n]->push(m_batches[n]);
+                m_batches[n] = m_workers[n]->get_batch();
+            }
+        }
+        finish();
+        return true;
+    }
+
+    /// returns the number of packets that were read
+    inline boost::uint64_t get_packets(void) const { return m_packets; }
+
+    /// returns the statistics of each worker
+    inline worker_stats& get_stats(unsigned int n) { return m_workers[n]->get_stats(); }
+
+private:
+
+    /// maximum number of segments in a batch
+    static const std::size_t        MAX_BATCH_SEGMENTS = 512;
+
+    /// maximum number of payload bytes in a batch
+    static const std::size_t        MAX_BATCH_BYTES = 512 * 1024;
+
+    /// maximum capture time covered by a batch (in microseconds)
+    static const boost::uint64_t    MAX_BATCH_USEC = 1000000;
+
+    /// passes on the remaining batches and waits for the workers to finish
+    void finish(void) {
+        for (std::size_t n = 0; n < m_workers.size(); ++n) {
+            if (m_batches[n]) {
+                m_workers[n]->push(m_batches[n]);
+                m_batches[n] = NULL;
+            }
+            m_workers[n]->finish();
+        }
+    }
+
+    const analyzer_options&                     m_options;
+    boost::mutex                                m_output_mutex;
+    std::vector<boost::shared_ptr<worker> >     m_workers;
+    std::vector<batch_t*>                       m_batches;
+    boost::uint64_t                             m_packets;
+};
+
+
+///
+/// capture_generator: writes a synthetic pcap capture of HTTP/1.1 keep-alive
+/// connections, with their transactions interleaved (used for benchmarks)
+///
+class capture_generator
+{
+public:
+
+    /// creates a new generator
+    capture_generator(unsigned long num_flows, unsigned long transactions_per_flow)
+        : m_num_flows(num_flows), m_transactions(transactions_per_flow), m_timestamp(0)
+    {}
+
+    /// writes the capture
+    void write(std::string& out) {
+        static const char *RESPONSE_HEAD = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\n"
+            "Content-Length: 1024\r\n\r\n";
+        const std::string response_body(1024, 'x');
+
+        out.clear();
+        // global header (little endian, Ethernet)
+        put_le32(out, 0xA1B2C3D4); put_le16(out, 2); put_le16(out, 4);
+        put_le32(out, 0); put_le32(out, 0); put_le32(out, 65535); put_le32(out, 1);
+
+        std::vector<boost::uint32_t> client_seq(m_num_flows, 1000), server_seq(m_num_flows, 5000);
+        for (unsigned long f = 0; f < m_num_flows; ++f) {
+            packet(out, f, true, client_seq[f]++, TCP_SYN, NULL, 0);
+            packet(out, f, false, server_seq[f]++, TCP_SYN | TCP_ACK, NULL, 0);
+        }
+        for (unsigned long t = 0; t < m_transactions; ++t) {
+            for (unsigned long f = 0; f < m_num_flows; ++f) {
+                std::ostringstream request;
+                request << "GET /items/" << f << '/' << t << " HTTP/1.1\r\n"
+                    "Host: www.example.com\r\nUser-Agent: pionsniff\r\nAccept: */*\r\n"
+                    "Accept-Encoding: gzip,deflate\r\nCookie: session=0123456789abcdef\r\n\r\n";
+                const std::string request_str(request.str());
+                packet(out, f, true, client_seq[f], TCP_ACK, request_str.data(), request_str.size());
+                client_seq[f] += request_str.size();
+
+                // the response is sent in two segments, out of order every fourth time
+                const std::string response_str(RESPONSE_HEAD + response_body);
+                const std::size_t split = response_str.size() / 2;
+                if (t % 4 == 3) {
+                    packet(out, f, false, server_seq[f] + split, TCP_ACK,
+                        response_str.data() + split, response_str.size() - split);
+                    packet(out, f, false, server_seq[f], TCP_ACK, response_str.data(), split);
+                } else {
+                    packet(out, f, false, server_seq[f], TCP_ACK, response_str.data(), split);
+                    packet(out, f, false, server_seq[f] + split, TCP_ACK,
+                        response_str.data() + split, response_str.size() - split);
+                }
+                server_seq[f] += response_str.size();
+            }
+        }
+        for (unsigned long f = 0; f < m_num_flows; ++f) {
+            packet(out, f, true, client_seq[f], TCP_FIN | TCP_ACK, NULL, 0);
+            packet(out, f, false, server_seq[f], TCP_FIN | TCP_ACK, NULL, 0);
+        }
+    }
+
+private:
+
+    /// writes a packet (Ethernet, IPv4 and TCP headers and payload)
+    void packet(std::string& out, unsigned long f, bool from_client, boost::uint32_t seq,
+        boost::uint8_t flags, const char *payload, std::size_t len)
+    {
+        m_timestamp += 10;
+        const std::size_t frame_len = 14 + 20 + 20 + len;
+        put_le32(out, static_cast<boost::uint32_t>(m_timestamp / 1000000));
+        put_le32(out, static_cast<boost::uint32_t>(m_timestamp % 1000000));
+        put_le32(out, static_cast<boost::uint32_t>(frame_len));
+        put_le32(out, static_cast<boost::uint32_t>(frame_len));
+
+        char header[54];
+        memset(header, 0, sizeof(header));
+        // Ethernet
+        algorithm::from_uint16(header + 12, 0x0800);
+        // IPv4
+        char *ip = header + 14;
+        ip[0] = 0x45;
+        algorithm::from_uint16(ip + 2, static_cast<boost::uint16_t>(40 + len));
+        ip[8] = 64;
+        ip[9] = 6;
+        const boost::uint32_t client_addr = 0x0A000000 + static_cast<boost::uint32_t>(f / 50000);
+        const boost::uint32_t server_addr = 0xC0A80001;
+        algorithm::from_uint32(ip + 12, from_client ? client_addr : server_addr);
+        algorithm::from_uint32(ip + 16, from_client ? server_addr : client_addr);
+        // TCP
+        char *tcp = header + 34;
+        const boost::uint16_t client_port = static_cast<boost::uint16_t>(10000 + f % 50000);
+        algorithm::from_uint16(tcp, from_client ? client_port : 80);
+        algorithm::from_uint16(tcp + 2, from_client ? 80 : client_port);
+        algorithm::from_uint32(tcp + 4, seq);
+        tcp[12] = 0x50;
+        tcp[13] = static_cast<char>(flags);
+        algorithm::from_uint16(tcp + 14, 65535);
+
+        out.append(header, sizeof(header));
+        if (len)
+            out.append(payload, len);
+    }
+
+    static inline void put_le16(std::string& out, boost::uint16_t n) {
+        out.push_back(static_cast<char>(n & 0xFF));
+        out.push_back(static_cast<char>(n >> 8));
+    }
+
+    static inline void put_le32(std::string& out, boost::uint32_t n) {
+        put_le16(out, static_cast<boost::uint16_t>(n & 0xFFFF));
+        put_le16(out, static_cast<boost::uint16_t>(n >> 16));
+    }
+
+    const unsigned long     m_num_flows;
+    const unsigned long     m_transactions;
+    boost::uint64_t         m_timestamp;
+};
+
+
+/// displays an error message if the arguments are invalid
+void argument_error(void)
+{
+    std::cerr << "usage:   pionsniff [OPTIONS] CAPTURE_FILE" << std::endl
+              << "         pionsniff [OPTIONS] -            (reads a capture from stdin, i.e. tcpdump -w -)" << std::endl
+              << "         pionsniff [OPTIONS] -b FLOWS [-n TRANSACTIONS_PER_FLOW]" << std::endl
+              << "options: [-t THREADS] [-m MAX_BUFFERED_BYTES] [-i IDLE_SECONDS] [-q] [-v]" << std::endl;
+}
+
+
+/// main control function
+int main (int argc, char *argv[])
+{
+    static const unsigned long DEFAULT_TRANSACTIONS_PER_FLOW = 10;
+
+    analyzer_options options;
+    options.num_threads = boost::thread::hardware_concurrency();
+    if (options.num_threads == 0)
+        options.num_threads = 1;
+    std::string capture_file;
+    unsigned long benchmark_flows = 0;
+    unsigned long transactions_per_flow = DEFAULT_TRANSACTIONS_PER_FLOW;
+    bool verbose_flag = false;
+
+    // parse command line
+    for (int argnum=1; argnum < argc; ++argnum) {
+        if (argv[argnum][0] == '-' && argv[argnum][1] != '\0' && argv[argnum][2] == '\0') {
+            const char option = argv[argnum][1];
+            if (option == 'q') {
+                options.quiet = true;
+            } else if (option == 'v') {
+                verbose_flag = true;
+            } else if (argnum+1 < argc) {
+                const unsigned long value = strtoul(argv[++argnum], 0, 10);
+                switch (option) {
+                case 't': options.num_threads = (value ? static_cast<unsigned int>(value) : 1); break;
+                case 'm': options.max_buffered = value; break;
+                case 'i': options.idle_timeout = value * 1000000ULL; break;
+                case 'b': benchmark_flows = value; break;
+                case 'n': transactions_per_flow = value; break;
+                default:
+                    argument_error();
+                    return 1;
+                }
+            } else {
+                argument_error();
+                return 1;
+            }
+        } else if (argnum+1 == argc && capture_file.empty()) {
+            capture_file = argv[argnum];
+        } else {
+            argument_error();
+            return 1;
+        }
+    }
+    if (capture_file.empty() == (benchmark_flows == 0)) {
+        argument_error();
+        return 1;
+    }
+
+    // initialize log system (use simple configuration)
+    logger pion_log(PION_GET_LOGGER("pion"));
+    if (verbose_flag) {
+        PION_LOG_SETLEVEL_WARN(pion_log);
+    } else {
+        PION_LOG_SETLEVEL_FATAL(pion_log);
+    }
+    PION_LOG_CONFIG_BASIC;
+
+    // open the capture (or generate one for a benchmark)
+    boost::scoped_ptr<std::istream> in_ptr;
+    if (benchmark_flows) {
+        options.quiet = true;
+        std::string capture;
+        capture_generator(benchmark_flows, transactions_per_flow).write(capture);
+        std::cerr << "generated " << benchmark_flows << " flows, " << transactions_per_flow
+            << " transactions per flow (" << capture.size() / (1024 * 1024) << " MB)" << std::endl;
+        in_ptr.reset(new std::istringstream(capture));
+    } else if (capture_file == "-") {
+        std::ios_base::sync_with_stdio(false);
+    } else {
+        in_ptr.reset(new std::ifstream(capture_file.c_str(), std::ios::in | std::ios::binary));
+        if (! *in_ptr) {
+            std::cerr << "pionsniff: unable to open " << capture_file << std::endl;
+            return 1;
+        }
+    }
+
+    const boost::posix_time::ptime start(boost::posix_time::microsec_clock::universal_time());
+    analyzer capture_analyzer(options);
+    if (! capture_analyzer.run(in_ptr ? *in_ptr : std::cin)) {
+        std::cerr << "pionsniff: not a pcap or pcapng capture" << std::endl;
+        return 1;
+    }
+    const double elapsed = static_cast<double>((boost::posix_time::microsec_clock::universal_time()
+        - start).total_microseconds()) / 1000000.0;
+
+    // report statistics
+    worker_stats total;
+    std::cerr << std::fixed << std::setprecision(0);
+    for (unsigned int n = 0; n < options.num_threads; ++n) {
+        const worker_stats& stats = capture_analyzer.get_stats(n);
+        total.add(stats);
+        const double busy = static_cast<double>(stats.busy_usec) / 1000000.0;
+        std::cerr << "thread " << n << ": " << stats.flows << " flows, "
+            << stats.transactions() << " transactions, "
+            << (busy > 0 ? stats.transactions() / busy : 0.0) << " transactions/s busy" << std::endl;
+    }
+    std::cerr << "packets: " << capture_analyzer.get_packets()
+        << ", TCP segments: " << total.segments
+        << ", payload bytes: " << total.payload_bytes
+        << ", flows: " << total.flows << std::endl
+        << "transactions: " << total.transactions() << " (HTTP " << total.http_transactions
+        << ", SPDY " << total.spdy_transactions << ")"
+        << ", missing bytes: " << total.gap_bytes
+        << ", parse errors: " << total.resyncs << std::endl
+        << std::setprecision(3) << "elapsed: " << elapsed << " s, " << std::setprecision(0)
+        << (elapsed > 0 ? total.transactions() / elapsed : 0.0) << " transactions/s, "
+        << (elapsed > 0 ? total.transactions() / elapsed / options.num_threads : 0.0)
+        << " transactions/s per core (" << options.num_threads << " threads)" << std::endl;
+
+    return 0;
+}